@@ -0,0 +1,406 @@
+#include <JuceHeader.h>
+#include "BenchmarkSuite.h"
+#include "../Source/Audio/StreamBuffer.h"
+#include "../Source/Audio/PcmConversion.h"
+#include "../Source/Audio/ALACEncoderWrapper.h"
+#include "../Source/Audio/ALAC/ALACDecoder.h"
+#include "../Source/Audio/ALAC/ALACBitUtilities.h"
+#include "../Source/AirPlay/RaopSessionGroup.h"
+#include "../Tests/LoopbackReceiver.h"
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    constexpr int packetFrames = RaopTransport::framesPerPacket;
+    constexpr int hostBlockFrames = 512;
+
+    // Packets cycled through, so the encoders don't see the same frame
+    // every call
+    constexpr int numSignalPackets = 32;
+
+    // Stands in for music: a few harmonics under a slow swell, plus a little
+    // noise, so ALAC has something realistic to predict
+    juce::AudioBuffer<float> makeSignal(int numChannels, int numFrames)
+    {
+        juce::AudioBuffer<float> signal(numChannels, numFrames);
+        juce::Random random(17);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            const double fundamental = 2.0 * juce::MathConstants<double>::pi * (110.0 + 55.0 * ch) / 44100.0;
+
+            for (int i = 0; i < numFrames; ++i)
+            {
+                const double swell = 0.6 + 0.4 * std::sin(2.0 * juce::MathConstants<double>::pi * i / 88200.0);
+                double sample = 0.0;
+
+                for (int harmonic = 1; harmonic <= 5; ++harmonic)
+                    sample += std::sin(fundamental * harmonic * i) / harmonic;
+
+                signal.setSample(ch, i, (float)(0.2 * swell * sample) + (random.nextFloat() - 0.5f) * 0.002f);
+            }
+        }
+
+        return signal;
+    }
+
+    std::vector<juce::AudioBuffer<float>> makePackets(int numChannels)
+    {
+        auto signal = makeSignal(numChannels, packetFrames * numSignalPackets);
+        std::vector<juce::AudioBuffer<float>> packets;
+
+        for (int p = 0; p < numSignalPackets; ++p)
+        {
+            juce::AudioBuffer<float> packet(numChannels, packetFrames);
+            for (int ch = 0; ch < numChannels; ++ch)
+                packet.copyFrom(ch, 0, signal, ch, p * packetFrames, packetFrames);
+            packets.push_back(std::move(packet));
+        }
+
+        return packets;
+    }
+
+    void benchmarkStreamBuffer(BenchmarkSuite& suite)
+    {
+        const std::pair<const char*, StreamBuffer::Storage> storages[] = {
+            { "float", StreamBuffer::Storage::Float },
+            { "int16", StreamBuffer::Storage::Int16 },
+            { "int24", StreamBuffer::Storage::Int24 },
+        };
+
+        auto block = makeSignal(2, hostBlockFrames);
+        juce::AudioBuffer<float> out(2, hostBlockFrames);
+        juce::HeapBlock<char> pcm((size_t)(hostBlockFrames * 2 * 3));
+
+        for (auto& storage : storages)
+        {
+            StreamBuffer buffer;
+            buffer.prepare(44100.0, 1000.0, storage.second);
+
+            // A host block in, the same amount out, as the stream takes it
+            suite.run(juce::String("streambuffer_") + storage.first + "_write_read", "frames/s", hostBlockFrames, [&]
+            {
+                buffer.write(block, hostBlockFrames);
+
+                if (storage.second == StreamBuffer::Storage::Float)
+                    buffer.read(out, hostBlockFrames);
+                else
+                    buffer.readInterleaved(pcm, hostBlockFrames);
+            });
+        }
+    }
+
+    void benchmarkPcmConversion(BenchmarkSuite& suite)
+    {
+        auto packet = makeSignal(2, packetFrames);
+        juce::AudioBuffer<float> out(2, packetFrames);
+        std::vector<juce::int16> pcm16((size_t)(packetFrames * 2));
+        std::vector<juce::uint8> pcm24((size_t)(packetFrames * 2 * 3));
+
+        suite.run("pcm16_from_float", "frames/s", packetFrames, [&]
+        {
+            PcmConversion::floatToInt16(packet, 0, packetFrames, 2, pcm16.data());
+        });
+
+        suite.run("pcm16_to_float", "frames/s", packetFrames, [&]
+        {
+            PcmConversion::int16ToFloat(pcm16.data(), packetFrames, 2, out, 0);
+        });
+
+        suite.run("pcm24_from_float", "frames/s", packetFrames, [&]
+        {
+            PcmConversion::floatToInt24(packet, 0, packetFrames, 2, pcm24.data());
+        });
+
+        suite.run("pcm24_to_float", "frames/s", packetFrames, [&]
+        {
+            PcmConversion::int24ToFloat(pcm24.data(), packetFrames, 2, out, 0);
+        });
+    }
+
+    void benchmarkAlac(BenchmarkSuite& suite)
+    {
+        struct Setup
+        {
+            const char* name;
+            juce::AudioChannelSet layout;
+            bool fastMode;
+            int elementThreads;
+        };
+
+        // Fast mode only changes stereo streams, element threads only
+        // multichannel ones
+        const Setup setups[] = {
+            { "stereo_default", juce::AudioChannelSet::stereo(), false, 0 },
+            { "stereo_fast", juce::AudioChannelSet::stereo(), true, 0 },
+            { "7.1_default", juce::AudioChannelSet::create7point1(), false, 0 },
+            { "7.1_elements", juce::AudioChannelSet::create7point1(), false, -1 },
+        };
+
+        for (auto& setup : setups)
+        {
+            const int numChannels = setup.layout.size();
+            const juce::String encodeName = juce::String("alac_encode_") + setup.name;
+            const juce::String decodeName = juce::String("alac_decode_") + setup.name;
+            const juce::String ratioName = juce::String("alac_ratio_") + setup.name;
+
+            if (!suite.shouldRun(encodeName) && !suite.shouldRun(decodeName) && !suite.shouldRun(ratioName))
+                continue;
+
+            auto packets = makePackets(numChannels);
+
+            ALACEncoderWrapper encoder;
+            encoder.setFastMode(setup.fastMode);
+            encoder.setElementThreads(setup.elementThreads);
+
+            if (!encoder.initialize(44100.0, setup.layout, packetFrames))
+            {
+                std::cerr << "Could not set up the ALAC encoder for " << setup.name << std::endl;
+                continue;
+            }
+
+            int next = 0;
+            suite.run(encodeName, "frames/s", packetFrames, [&]
+            {
+                encoder.encode(packets[(size_t)next], packetFrames);
+                next = (next + 1) % numSignalPackets;
+            });
+
+            // The encoder adapts its predictors from packet to packet, so
+            // the packets measured for size and decoded come from a fresh one
+            ALACEncoderWrapper reference;
+            reference.setFastMode(setup.fastMode);
+            reference.initialize(44100.0, setup.layout, packetFrames);
+
+            std::vector<juce::MemoryBlock> encoded;
+            size_t encodedBytes = 0;
+
+            for (auto& packet : packets)
+            {
+                encoded.push_back(reference.encode(packet, packetFrames));
+                encodedBytes += encoded.back().getSize();
+            }
+
+            suite.addResult(ratioName, "of 16-bit PCM",
+                            (double)encodedBytes / (double)(numSignalPackets * packetFrames * numChannels * 2), false);
+
+            auto cookie = reference.getMagicCookie();
+            ALACDecoder decoder;
+
+            if (decoder.Init(cookie.getData(), (uint32_t)cookie.getSize()) != 0)
+            {
+                std::cerr << "Could not set up the ALAC decoder for " << setup.name << std::endl;
+                continue;
+            }
+
+            std::vector<juce::int16> decoded((size_t)(packetFrames * numChannels));
+            next = 0;
+
+            suite.run(decodeName, "frames/s", packetFrames, [&]
+            {
+                auto& packet = encoded[(size_t)next];
+                BitBuffer bits;
+                BitBufferInit(&bits, static_cast<uint8_t*>(packet.getData()), (uint32_t)packet.getSize());
+
+                uint32_t numDecoded = 0;
+                decoder.Decode(&bits, reinterpret_cast<uint8_t*>(decoded.data()), (uint32_t)packetFrames,
+                               (uint32_t)numChannels, &numDecoded);
+                next = (next + 1) % numSignalPackets;
+            });
+        }
+    }
+
+    void benchmarkPipeline(BenchmarkSuite& suite)
+    {
+        struct Setup
+        {
+            const char* name;
+            juce::AudioChannelSet layout;
+            bool encrypted;
+        };
+
+        const Setup setups[] = {
+            { "stereo", juce::AudioChannelSet::stereo(), false },
+            { "stereo_aes", juce::AudioChannelSet::stereo(), true },
+            { "7.1", juce::AudioChannelSet::create7point1(), false },
+        };
+
+        for (auto& setup : setups)
+        {
+            const juce::String name = juce::String("pipeline_loopback_") + setup.name;
+
+            if (!suite.shouldRun(name))
+                continue;
+
+            const int numChannels = setup.layout.size();
+
+            // Host blocks through the stream buffer, encoded and sent to a
+            // receiver on localhost as fast as they go
+            StreamBuffer buffer;
+            buffer.setNumChannels(numChannels);
+            buffer.prepare(44100.0, 1000.0);
+
+            RaopSessionGroup group;
+
+            if (!group.prepare(44100.0, setup.layout))
+            {
+                std::cerr << group.getLastError() << std::endl;
+                continue;
+            }
+
+            LoopbackReceiver receiver;
+            receiver.setKeepAudioPackets(false);
+
+            if (!group.addReceiver(AirPlayDevice("Bench", "127.0.0.1", 7000), receiver.getEndpoint()))
+            {
+                std::cerr << "Could not reach the loopback receiver: " << group.getLastError() << std::endl;
+                continue;
+            }
+
+            if (setup.encrypted)
+            {
+                juce::uint8 key[16], iv[16];
+                juce::Random random(5);
+                random.fillBitsRandomly(key, sizeof(key));
+                random.fillBitsRandomly(iv, sizeof(iv));
+                group.setEncryptionKey(key, iv);
+            }
+
+            auto block = makeSignal(numChannels, hostBlockFrames);
+            juce::AudioBuffer<float> out(numChannels, hostBlockFrames);
+
+            suite.run(name, "packets/s", (double)hostBlockFrames / packetFrames, [&]
+            {
+                buffer.write(block, hostBlockFrames);
+                int numRead = buffer.read(out, hostBlockFrames);
+                group.streamAudio(out, numRead);
+            });
+
+            juce::Thread::sleep(50);
+            auto stats = group.getStats();
+            std::cout << "    " << (juce::int64)receiver.getNumAudioPacketsReceived() << " of "
+                      << (juce::int64)stats.packetsSent << " packets received" << std::endl;
+        }
+    }
+
+    void printUsage()
+    {
+        std::cout << "Usage:\n"
+                     "  FreeCasterBench [--output results.json] [--filter name] [--quick]\n"
+                     "  FreeCasterBench --compare baseline.json current.json [--threshold percent]\n"
+                     "\n"
+                     "Benchmarks StreamBuffer, PCM conversion, ALAC encode and decode and the\n"
+                     "whole stream against a loopback receiver. --compare exits with 1 when a\n"
+                     "benchmark got worse by more than the threshold (default 10%)."
+                  << std::endl;
+    }
+
+    bool loadResults(const juce::String& path, juce::Array<BenchmarkSuite::Result>& results)
+    {
+        auto file = juce::File::getCurrentWorkingDirectory().getChildFile(path);
+        juce::String error;
+
+        if (!file.existsAsFile())
+            error = "not found";
+        else if (BenchmarkSuite::parseJson(file.loadFileAsString(), results, error))
+            return true;
+
+        std::cerr << path << ": " << error << std::endl;
+        return false;
+    }
+
+    int runComparison(const juce::String& baselinePath, const juce::String& currentPath, double thresholdPercent)
+    {
+        juce::Array<BenchmarkSuite::Result> baseline, current;
+
+        if (!loadResults(baselinePath, baseline) || !loadResults(currentPath, current))
+            return 2;
+
+        auto comparisons = BenchmarkSuite::compare(baseline, current, thresholdPercent);
+        int numRegressed = 0;
+
+        for (auto& comparison : comparisons)
+        {
+            std::cout << comparison.name.paddedRight(' ', 36)
+                      << juce::String(comparison.baseline, 1).paddedLeft(' ', 14)
+                      << juce::String(comparison.current, 1).paddedLeft(' ', 14)
+                      << (juce::String(comparison.changePercent >= 0.0 ? "+" : "")
+                          + juce::String(comparison.changePercent, 1) + "%").paddedLeft(' ', 10)
+                      << (comparison.regressed ? "  REGRESSED" : "") << std::endl;
+
+            if (comparison.regressed)
+                numRegressed++;
+        }
+
+        std::cout << "\n" << numRegressed << " of " << comparisons.size() << " benchmarks regressed by more than "
+                  << juce::String(thresholdPercent, 1) << "%" << std::endl;
+
+        return numRegressed > 0 ? 1 : 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::StringArray args;
+    for (int i = 1; i < argc; ++i)
+        args.add(argv[i]);
+
+    auto valueAfter = [&args](const juce::String& option)
+    {
+        int index = args.indexOf(option);
+        return index >= 0 && index + 1 < args.size() ? args[index + 1] : juce::String();
+    };
+
+    if (args.contains("--help") || args.contains("-h"))
+    {
+        printUsage();
+        return 0;
+    }
+
+    if (args.contains("--compare"))
+    {
+        int index = args.indexOf("--compare");
+
+        if (index + 2 >= args.size())
+        {
+            printUsage();
+            return 2;
+        }
+
+        auto threshold = valueAfter("--threshold");
+        return runComparison(args[index + 1], args[index + 2], threshold.isEmpty() ? 10.0 : threshold.getDoubleValue());
+    }
+
+    BenchmarkSuite::Options options;
+    options.filter = valueAfter("--filter");
+
+    if (args.contains("--quick"))
+    {
+        options.roundSeconds = 0.1;
+        options.numRounds = 3;
+    }
+
+    BenchmarkSuite suite(options);
+    benchmarkStreamBuffer(suite);
+    benchmarkPcmConversion(suite);
+    benchmarkAlac(suite);
+    benchmarkPipeline(suite);
+
+    auto output = valueAfter("--output");
+
+    if (output.isNotEmpty())
+    {
+        auto file = juce::File::getCurrentWorkingDirectory().getChildFile(output);
+
+        if (!file.replaceWithText(suite.toJson()))
+        {
+            std::cerr << "Could not write " << output << std::endl;
+            return 2;
+        }
+
+        std::cout << "\nResults written to " << file.getFullPathName() << std::endl;
+    }
+
+    return 0;
+}
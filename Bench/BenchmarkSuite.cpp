@@ -0,0 +1,189 @@
+#include "BenchmarkSuite.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+BenchmarkSuite::BenchmarkSuite(const Options& optionsToUse) : options(optionsToUse)
+{
+}
+
+bool BenchmarkSuite::shouldRun(const juce::String& name) const
+{
+    return options.filter.isEmpty() || name.contains(options.filter);
+}
+
+void BenchmarkSuite::run(const juce::String& name, const juce::String& unit, double unitsPerCall,
+                         const std::function<void()>& work)
+{
+    if (!shouldRun(name))
+        return;
+
+    auto runFor = [&work](double seconds)
+    {
+        const auto endTicks = juce::Time::getHighResolutionTicks() + juce::Time::secondsToHighResolutionTicks(seconds);
+        juce::int64 calls = 0;
+        juce::int64 now = 0;
+
+        do
+        {
+            work();
+            calls++;
+            now = juce::Time::getHighResolutionTicks();
+        }
+        while (now < endTicks);
+
+        return std::make_pair(calls, now);
+    };
+
+    // Warm caches, branch predictors and any lazily started threads
+    runFor(options.roundSeconds * 0.2);
+
+    std::vector<double> rates;
+
+    for (int round = 0; round < options.numRounds; ++round)
+    {
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        const auto [calls, endTicks] = runFor(options.roundSeconds);
+        const double seconds = juce::Time::highResolutionTicksToSeconds(endTicks - startTicks);
+
+        rates.push_back((double)calls * unitsPerCall / seconds);
+    }
+
+    std::sort(rates.begin(), rates.end());
+
+    Result result;
+    result.name = name;
+    result.unit = unit;
+    result.value = rates[rates.size() / 2];
+    result.min = rates.front();
+    result.max = rates.back();
+    result.rounds = (int)rates.size();
+    results.add(result);
+
+    std::cout << name.paddedRight(' ', 36) << juce::String(result.value, 1) << " " << unit
+              << "  (" << juce::String(result.min, 1) << " - " << juce::String(result.max, 1) << ")" << std::endl;
+}
+
+void BenchmarkSuite::addResult(const juce::String& name, const juce::String& unit, double value, bool higherIsBetter)
+{
+    if (!shouldRun(name))
+        return;
+
+    Result result;
+    result.name = name;
+    result.unit = unit;
+    result.value = value;
+    result.min = value;
+    result.max = value;
+    result.rounds = 1;
+    result.higherIsBetter = higherIsBetter;
+    results.add(result);
+
+    std::cout << name.paddedRight(' ', 36) << juce::String(value, 3) << " " << unit << std::endl;
+}
+
+juce::String BenchmarkSuite::toJson() const
+{
+    auto* system = new juce::DynamicObject();
+    system->setProperty("os", juce::SystemStats::getOperatingSystemName());
+    system->setProperty("cpu", juce::SystemStats::getCpuModel());
+    system->setProperty("numCpus", juce::SystemStats::getNumCpus());
+
+    juce::Array<juce::var> entries;
+
+    for (auto& result : results)
+    {
+        auto* entry = new juce::DynamicObject();
+        entry->setProperty("name", result.name);
+        entry->setProperty("unit", result.unit);
+        entry->setProperty("value", result.value);
+        entry->setProperty("min", result.min);
+        entry->setProperty("max", result.max);
+        entry->setProperty("rounds", result.rounds);
+        entry->setProperty("higherIsBetter", result.higherIsBetter);
+        entries.add(juce::var(entry));
+    }
+
+    auto* root = new juce::DynamicObject();
+    root->setProperty("version", 1);
+    root->setProperty("timeMs", juce::Time::currentTimeMillis());
+    root->setProperty("system", juce::var(system));
+    root->setProperty("results", entries);
+
+    return juce::JSON::toString(juce::var(root));
+}
+
+bool BenchmarkSuite::parseJson(const juce::String& json, juce::Array<Result>& parsedResults, juce::String& error)
+{
+    juce::var root;
+    auto parsed = juce::JSON::parse(json, root);
+
+    if (parsed.failed())
+    {
+        error = parsed.getErrorMessage();
+        return false;
+    }
+
+    auto* entries = root["results"].getArray();
+
+    if (entries == nullptr)
+    {
+        error = "No results array";
+        return false;
+    }
+
+    parsedResults.clear();
+
+    for (auto& entry : *entries)
+    {
+        Result result;
+        result.name = entry["name"].toString();
+        result.unit = entry["unit"].toString();
+        result.value = (double)entry["value"];
+        result.min = (double)entry["min"];
+        result.max = (double)entry["max"];
+        result.rounds = (int)entry["rounds"];
+        result.higherIsBetter = entry.getProperty("higherIsBetter", true);
+
+        if (result.name.isEmpty())
+        {
+            error = "A result without a name";
+            return false;
+        }
+
+        parsedResults.add(result);
+    }
+
+    return true;
+}
+
+juce::Array<BenchmarkSuite::Comparison> BenchmarkSuite::compare(const juce::Array<Result>& baseline,
+                                                                const juce::Array<Result>& current,
+                                                                double thresholdPercent)
+{
+    juce::Array<Comparison> comparisons;
+
+    for (auto& before : baseline)
+    {
+        for (auto& after : current)
+        {
+            if (after.name != before.name || before.value <= 0.0)
+                continue;
+
+            Comparison comparison;
+            comparison.name = before.name;
+            comparison.unit = before.unit;
+            comparison.baseline = before.value;
+            comparison.current = after.value;
+
+            const double difference = before.higherIsBetter ? after.value - before.value
+                                                            : before.value - after.value;
+            comparison.changePercent = 100.0 * difference / before.value;
+            comparison.regressed = comparison.changePercent < -thresholdPercent;
+            comparisons.add(comparison);
+            break;
+        }
+    }
+
+    return comparisons;
+}
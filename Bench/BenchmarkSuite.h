@@ -0,0 +1,75 @@
+#pragma once
+#include <JuceHeader.h>
+#include <functional>
+
+// Runs FreeCasterBench's benchmarks and keeps their results. A benchmark is
+// one unit of work (a block, a packet) called repeatedly for a fixed time
+// per round; the result is the median rate over the rounds, so one round
+// that was descheduled doesn't move it.
+//
+// Results are written as JSON, and two result files can be compared: a
+// benchmark counts as regressed when it got worse by more than a threshold.
+class BenchmarkSuite
+{
+public:
+    struct Result
+    {
+        juce::String name;
+        juce::String unit;
+        double value = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        int rounds = 0;
+        bool higherIsBetter = true;
+    };
+
+    struct Comparison
+    {
+        juce::String name;
+        juce::String unit;
+        double baseline = 0.0;
+        double current = 0.0;
+
+        // Positive when current is better, whichever way better is
+        double changePercent = 0.0;
+        bool regressed = false;
+    };
+
+    struct Options
+    {
+        double roundSeconds = 0.5;
+        int numRounds = 5;
+
+        // Only benchmarks whose name contains this run; empty runs them all
+        juce::String filter;
+    };
+
+    explicit BenchmarkSuite(const Options& options);
+
+    bool shouldRun(const juce::String& name) const;
+
+    // Calls work() for a round at a time; each call does unitsPerCall units.
+    // Skipped when the name doesn't match the filter.
+    void run(const juce::String& name, const juce::String& unit, double unitsPerCall,
+             const std::function<void()>& work);
+
+    // A figure measured some other way, such as a compression ratio
+    void addResult(const juce::String& name, const juce::String& unit, double value, bool higherIsBetter);
+
+    const juce::Array<Result>& getResults() const { return results; }
+
+    // The results with the machine they ran on
+    juce::String toJson() const;
+
+    static bool parseJson(const juce::String& json, juce::Array<Result>& results, juce::String& error);
+
+    // One comparison per benchmark present in both runs, in baseline order
+    static juce::Array<Comparison> compare(const juce::Array<Result>& baseline, const juce::Array<Result>& current,
+                                           double thresholdPercent);
+
+private:
+    Options options;
+    juce::Array<Result> results;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BenchmarkSuite)
+};
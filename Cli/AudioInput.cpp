@@ -0,0 +1,137 @@
+#include "AudioInput.h"
+#include "../Source/Audio/PcmConversion.h"
+
+#if JUCE_WINDOWS
+ #include <fcntl.h>
+ #include <io.h>
+#endif
+
+namespace
+{
+    class FileInput : public AudioInput
+    {
+    public:
+        explicit FileInput(std::unique_ptr<juce::AudioFormatReader> readerToUse, const juce::File& file)
+            : reader(std::move(readerToUse))
+        {
+            sampleRate = reader->sampleRate;
+            numChannels = (int)reader->numChannels;
+            lengthInFrames = reader->lengthInSamples;
+            description = file.getFileName() + ", " + reader->getFormatName() + " "
+                        + juce::String((int)reader->bitsPerSample) + "-bit";
+        }
+
+        int read(juce::AudioBuffer<float>& buffer, int numFrames) override
+        {
+            const int numToRead = (int)juce::jmin((juce::int64)numFrames, lengthInFrames - position);
+
+            if (numToRead <= 0 || !reader->read(&buffer, 0, numToRead, position, true, true))
+                return 0;
+
+            position += numToRead;
+            return numToRead;
+        }
+
+        bool rewind() override
+        {
+            position = 0;
+            return true;
+        }
+
+    private:
+        std::unique_ptr<juce::AudioFormatReader> reader;
+        juce::int64 position = 0;
+    };
+
+    class RawPcmInput : public AudioInput
+    {
+    public:
+        RawPcmInput(std::FILE* sourceToUse, double rate, int channels, int bits)
+            : source(sourceToUse), bitsPerSample(bits)
+        {
+            sampleRate = rate;
+            numChannels = channels;
+            description = "raw " + juce::String(bits) + (bits == 32 ? "-bit float" : "-bit") + " PCM";
+        }
+
+        int read(juce::AudioBuffer<float>& buffer, int numFrames) override
+        {
+            const size_t bytesPerFrame = (size_t)(numChannels * bitsPerSample / 8);
+            frames.allocate(bytesPerFrame * (size_t)numFrames, false);
+
+            // A pipe can deliver less than asked for without having ended,
+            // so read until the block is full or the pipe closes
+            size_t numBytes = 0;
+            while (numBytes < bytesPerFrame * (size_t)numFrames)
+            {
+                auto numRead = std::fread(frames.get() + numBytes, 1, bytesPerFrame * (size_t)numFrames - numBytes, source);
+                if (numRead == 0)
+                    break;
+
+                numBytes += numRead;
+            }
+
+            const int numWhole = (int)(numBytes / bytesPerFrame);
+
+            if (bitsPerSample == 16)
+                PcmConversion::int16ToFloat(reinterpret_cast<const juce::int16*>(frames.get()), numWhole, numChannels, buffer, 0);
+            else if (bitsPerSample == 24)
+                PcmConversion::int24ToFloat(frames.get(), numWhole, numChannels, buffer, 0);
+            else
+                for (int ch = 0; ch < numChannels; ++ch)
+                    for (int i = 0; i < numWhole; ++i)
+                        buffer.setSample(ch, i, reinterpret_cast<const float*>(frames.get())[i * numChannels + ch]);
+
+            return numWhole;
+        }
+
+    private:
+        std::FILE* source;
+        int bitsPerSample;
+        juce::HeapBlock<juce::uint8> frames;
+    };
+}
+
+std::unique_ptr<AudioInput> AudioInput::openFile(const juce::File& file, juce::String& error)
+{
+    if (!file.existsAsFile())
+    {
+        error = file.getFullPathName() + " not found";
+        return nullptr;
+    }
+
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+
+    if (reader == nullptr)
+    {
+        error = file.getFileName() + " isn't a WAV or AIFF file";
+        return nullptr;
+    }
+
+    return std::make_unique<FileInput>(std::move(reader), file);
+}
+
+std::unique_ptr<AudioInput> AudioInput::openRawPcm(std::FILE* source, double sampleRate, int numChannels,
+                                                   int bitsPerSample, juce::String& error)
+{
+    if (bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32)
+    {
+        error = "Raw PCM is 16, 24 or 32-bit (float)";
+        return nullptr;
+    }
+
+    if (sampleRate <= 0.0 || numChannels < 1)
+    {
+        error = "Raw PCM needs a sample rate and channel count";
+        return nullptr;
+    }
+
+   #if JUCE_WINDOWS
+    _setmode(_fileno(source), _O_BINARY);
+   #endif
+
+    return std::make_unique<RawPcmInput>(source, sampleRate, numChannels, bitsPerSample);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <JuceHeader.h>
+#include <cstdio>
+
+// Where freecaster-cli's audio comes from: a WAV or AIFF file, or raw
+// interleaved PCM from a pipe such as stdin
+class AudioInput
+{
+public:
+    virtual ~AudioInput() = default;
+
+    static std::unique_ptr<AudioInput> openFile(const juce::File& file, juce::String& error);
+
+    // 16 and 24-bit integer or 32-bit float samples, in native byte order
+    static std::unique_ptr<AudioInput> openRawPcm(std::FILE* source, double sampleRate, int numChannels,
+                                                  int bitsPerSample, juce::String& error);
+
+    // Fills the start of the buffer with up to numFrames; fewer only at the
+    // end of the input, and 0 once it's over
+    virtual int read(juce::AudioBuffer<float>& buffer, int numFrames) = 0;
+
+    // Goes back to the start, where the input allows it
+    virtual bool rewind() { return false; }
+
+    double getSampleRate() const { return sampleRate; }
+    int getNumChannels() const { return numChannels; }
+
+    // -1 for a pipe, whose length isn't known until it ends
+    juce::int64 getLengthInFrames() const { return lengthInFrames; }
+
+    juce::String getDescription() const { return description; }
+
+protected:
+    double sampleRate = 44100.0;
+    int numChannels = 2;
+    juce::int64 lengthInFrames = -1;
+    juce::String description;
+};
@@ -0,0 +1,348 @@
+#include <JuceHeader.h>
+#include "AudioInput.h"
+#include "../Source/AirPlay/AirPlayManager.h"
+#include "../Source/Audio/AlacFileWriter.h"
+#include "../Source/Audio/OfflineEncoder.h"
+#include <ctime>
+#include <iostream>
+
+namespace
+{
+    // ALAC's usual packet size in files; streams use RAOP's 352 frames
+    constexpr int filePacketFrames = 4096;
+
+    void printUsage()
+    {
+        std::cout << "Usage:\n"
+                     "  freecaster-cli <input> [--receiver host:port]... [--alac out.caf] [options]\n"
+                     "\n"
+                     "Input:\n"
+                     "  <file>                 a WAV or AIFF file\n"
+                     "  -                      raw interleaved PCM on stdin, in native byte order\n"
+                     "  --rate <hz>            raw sample rate (default 44100)\n"
+                     "  --channels <n>         raw channel count (default 2)\n"
+                     "  --bits <16|24|32>      raw sample size; 32 is float (default 16)\n"
+                     "\n"
+                     "Output, one or both:\n"
+                     "  --receiver <host:port> stream in real time to a RAOP receiver's audio port, its\n"
+                     "                         control and timing ports the next two (or give all three\n"
+                     "                         as host:audio:control:timing); repeat for more receivers\n"
+                     "  --alac <file>          write ALAC to a CAF file, or MPEG-4 if it ends .m4a; alone,\n"
+                     "                         encoded offline on every core, as fast as they go;\n"
+                     "                         with receivers, the stream recorded as it's sent\n"
+                     "\n"
+                     "Streaming:\n"
+                     "  --format <alac|pcm16|pcm24>  what receivers are sent (default alac)\n"
+                     "  --block <frames>       host block size (default 512)\n"
+                     "  --loops <n>            play a file n times (default 1)\n"
+                     "  --stats-log <file>     append a line of JSON pipeline stats every second\n"
+                     "\n"
+                     "Offline encoding:\n"
+                     "  --jobs <n>             encoding threads (default one per core)\n"
+                     "\n"
+                     "Reports the real-time factor (CPU time over audio time), CPU time and\n"
+                     "packet statistics; offline, how many times faster than real time it ran."
+                  << std::endl;
+    }
+
+    bool parseEndpoint(const juce::String& text, RaopTransport::Endpoint& endpoint)
+    {
+        auto parts = juce::StringArray::fromTokens(text, ":", "");
+
+        if ((parts.size() != 2 && parts.size() != 4) || parts[0].isEmpty() || parts[1].getIntValue() <= 0)
+            return false;
+
+        endpoint.host = parts[0];
+        endpoint.audioPort = parts[1].getIntValue();
+        endpoint.controlPort = parts.size() == 4 ? parts[2].getIntValue() : endpoint.audioPort + 1;
+        endpoint.timingPort = parts.size() == 4 ? parts[3].getIntValue() : endpoint.audioPort + 2;
+        return endpoint.controlPort > 0 && endpoint.timingPort > 0;
+    }
+
+    double getCpuSeconds()
+    {
+        return (double)std::clock() / CLOCKS_PER_SEC;
+    }
+
+    void printFileSummary(const juce::String& path, AlacFileWriter::Container container, juce::int64 numFrames,
+                          juce::int64 numPackets, juce::int64 numAudioBytes, int numChannels)
+    {
+        const double pcmBytes = (double)numFrames * numChannels * 2.0;
+        std::cout << "ALAC file: " << path << (container == AlacFileWriter::Container::MPEG4 ? " (MPEG-4), " : " (CAF), ")
+                  << numPackets << " packets, " << numAudioBytes << " bytes, ratio "
+                  << juce::String(pcmBytes > 0.0 ? (double)numAudioBytes / pcmBytes : 0.0, 3) << " of PCM" << std::endl;
+    }
+
+    // With no receivers to keep pace with, the file is encoded on every core
+    int encodeOffline(AudioInput& input, const juce::AudioChannelSet& layout, const juce::String& path,
+                      int numLoops, int numThreads)
+    {
+        const auto file = juce::File::getCurrentWorkingDirectory().getChildFile(path);
+        int loop = 0;
+        juce::AudioBuffer<float> rest;
+
+        // Plays the input numLoops times over, as streaming does
+        auto read = [&input, &loop, &rest, numLoops](juce::AudioBuffer<float>& buffer, int numFrames)
+        {
+            int numRead = input.read(buffer, numFrames);
+
+            // Across the end of a loop, the rest comes from the start again
+            while (numRead < numFrames && ++loop < numLoops && input.rewind())
+            {
+                rest.setSize(buffer.getNumChannels(), numFrames - numRead, false, false, true);
+                const int numMore = input.read(rest, numFrames - numRead);
+
+                for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                    buffer.copyFrom(ch, numRead, rest, ch, 0, numMore);
+
+                numRead += numMore;
+            }
+
+            return numRead;
+        };
+
+        OfflineEncoder::Options options;
+        options.numThreads = numThreads;
+        options.framesPerPacket = filePacketFrames;
+
+        std::cout << "Input:     " << input.getDescription() << ", " << juce::String(input.getSampleRate(), 0)
+                  << " Hz, " << layout.getDescription() << std::endl;
+
+        const auto startCpu = getCpuSeconds();
+        OfflineEncoder encoder;
+
+        if (!encoder.encode(read, input.getSampleRate(), layout, file, options))
+        {
+            std::cerr << encoder.getLastError() << std::endl;
+            return 1;
+        }
+
+        const auto stats = encoder.getStats();
+        std::cout << "Audio:     " << juce::String(stats.audioSeconds, 2) << " s in "
+                  << juce::String(stats.wallSeconds, 2) << " s" << std::endl;
+        std::cout << "CPU:       " << juce::String(getCpuSeconds() - startCpu, 3) << " s" << std::endl;
+        std::cout << "Speed:     " << juce::String(stats.getRealtimeFactor(), 1) << "x real time on "
+                  << stats.numThreads << (stats.numThreads == 1 ? " thread" : " threads") << std::endl;
+
+        printFileSummary(path, AlacFileWriter::getContainerFor(file), stats.numFrames, stats.numPackets,
+                         stats.numAudioBytes, layout.size());
+        return 0;
+    }
+
+    juce::String formatSummary(const LockFreeHistogram::Summary& summary, const char* unit)
+    {
+        return "p50 " + juce::String(summary.p50, 1) + unit + ", p99 " + juce::String(summary.p99, 1) + unit
+             + ", max " + juce::String(summary.max, 1) + unit;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::StringArray args;
+    for (int i = 1; i < argc; ++i)
+        args.add(argv[i]);
+
+    auto valueAfter = [&args](const juce::String& option, const juce::String& defaultValue = {})
+    {
+        int index = args.indexOf(option);
+        return index >= 0 && index + 1 < args.size() ? args[index + 1] : defaultValue;
+    };
+
+    if (args.size() == 0 || args.contains("--help") || args.contains("-h"))
+    {
+        printUsage();
+        return args.size() == 0 ? 2 : 0;
+    }
+
+    // Input
+    const juce::String inputName = args[0];
+    juce::String error;
+    std::unique_ptr<AudioInput> input;
+
+    if (inputName == "-")
+        input = AudioInput::openRawPcm(stdin, valueAfter("--rate", "44100").getDoubleValue(),
+                                       valueAfter("--channels", "2").getIntValue(),
+                                       valueAfter("--bits", "16").getIntValue(), error);
+    else
+        input = AudioInput::openFile(juce::File::getCurrentWorkingDirectory().getChildFile(inputName), error);
+
+    if (input == nullptr)
+    {
+        std::cerr << error << std::endl;
+        return 2;
+    }
+
+    const double sampleRate = input->getSampleRate();
+
+    // Inputs carry a channel count only; assume ALAC's layout for it
+    const auto layout = AudioEncoder::getLayoutForChannelCount(input->getNumChannels());
+
+    if (!AudioEncoder::isLayoutSupported(layout))
+    {
+        std::cerr << input->getNumChannels() << " channels can't be carried in ALAC" << std::endl;
+        return 2;
+    }
+
+    // Outputs
+    juce::Array<RaopTransport::Endpoint> endpoints;
+
+    for (int i = 0; i < args.size(); ++i)
+    {
+        if (args[i] != "--receiver")
+            continue;
+
+        RaopTransport::Endpoint endpoint;
+
+        if (i + 1 >= args.size() || !parseEndpoint(args[i + 1], endpoint))
+        {
+            std::cerr << "A receiver is host:port or host:audio:control:timing" << std::endl;
+            return 2;
+        }
+
+        endpoints.add(endpoint);
+    }
+
+    const auto alacPath = valueAfter("--alac");
+
+    if (endpoints.isEmpty() && alacPath.isEmpty())
+    {
+        std::cerr << "Nothing to do: give a --receiver, an --alac file or both" << std::endl;
+        return 2;
+    }
+
+    const auto formatName = valueAfter("--format", "alac");
+    const auto format = formatName == "pcm16" ? AudioEncoder::Format::PCM_16
+                      : formatName == "pcm24" ? AudioEncoder::Format::PCM_24
+                                              : AudioEncoder::Format::ALAC;
+    const int blockSize = juce::jlimit(16, 8192, valueAfter("--block", "512").getIntValue());
+    const int numLoops = juce::jmax(1, valueAfter("--loops", "1").getIntValue());
+
+    if (endpoints.isEmpty())
+        return encodeOffline(*input, layout, alacPath, numLoops, juce::jmax(0, valueAfter("--jobs", "0").getIntValue()));
+
+    AirPlayManager manager;
+    manager.prepare(sampleRate, blockSize, layout);
+    manager.getSessionGroup().setFormat(format);
+
+    // The only stream in the process, so surround elements encode on spare cores
+    manager.getSessionGroup().setElementThreads(-1);
+
+    for (auto& endpoint : endpoints)
+    {
+        const auto name = endpoint.host + ":" + juce::String(endpoint.audioPort);
+
+        if (!manager.addReceiver(AirPlayDevice(name, endpoint.host, endpoint.audioPort), endpoint))
+        {
+            std::cerr << "Could not stream to " << name << ": " << manager.getLastError() << std::endl;
+            return 1;
+        }
+    }
+
+    // Alongside receivers, the file is the stream itself: its packets as
+    // sent, written from the recorder's thread
+    auto& group = manager.getSessionGroup();
+
+    if (alacPath.isNotEmpty() && (format != AudioEncoder::Format::ALAC
+                                  || !group.startRecording(juce::File::getCurrentWorkingDirectory().getChildFile(alacPath))))
+    {
+        std::cerr << (format != AudioEncoder::Format::ALAC ? juce::String("--alac records the stream, so needs --format alac")
+                                                           : group.getLastError()) << std::endl;
+        return 2;
+    }
+
+    const auto statsLog = valueAfter("--stats-log");
+
+    if (statsLog.isNotEmpty() && !manager.startStatsLog(juce::File::getCurrentWorkingDirectory().getChildFile(statsLog)))
+    {
+        std::cerr << "Could not write " << statsLog << std::endl;
+        return 2;
+    }
+
+    std::cout << "Input:     " << input->getDescription() << ", " << juce::String(sampleRate, 0) << " Hz, "
+              << layout.getDescription() << std::endl;
+
+    // Blocks are handed over as a host would: paced to the sample clock
+    juce::AudioBuffer<float> block(layout.size(), blockSize);
+    juce::int64 numFrames = 0;
+
+    const auto startCpu = getCpuSeconds();
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+
+    for (int loop = 0; loop < numLoops; ++loop)
+    {
+        if (loop > 0 && !input->rewind())
+            break;
+
+        for (;;)
+        {
+            const int numRead = input->read(block, blockSize);
+
+            if (numRead == 0)
+                break;
+
+            manager.pushAudioData(block, numRead);
+            numFrames += numRead;
+
+            const double due = (double)numFrames / sampleRate;
+            const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+            if (due > elapsed + 0.001)
+                juce::Thread::sleep((int)((due - elapsed) * 1000.0));
+        }
+    }
+
+    // Let what's buffered reach the receivers
+    juce::Thread::sleep((int)manager.getLatencyMs() + 100);
+
+    const bool recorded = alacPath.isEmpty() || group.stopRecording();
+
+    const double wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    const double cpuSeconds = getCpuSeconds() - startCpu;
+    const double audioSeconds = (double)numFrames / sampleRate;
+
+    manager.stopStatsLog();
+    auto pipeline = manager.getStats();
+    auto groupStats = group.getStats();
+
+    std::cout << "Audio:     " << juce::String(audioSeconds, 2) << " s in " << juce::String(wallSeconds, 2) << " s"
+              << std::endl;
+    std::cout << "CPU:       " << juce::String(cpuSeconds, 3) << " s" << std::endl;
+    std::cout << "Real-time factor: " << juce::String(audioSeconds > 0.0 ? cpuSeconds / audioSeconds : 0.0, 4)
+              << std::endl;
+
+    std::cout << "Packets:   " << (juce::int64)groupStats.packetsEncoded << " encoded, "
+              << (juce::int64)groupStats.packetsSent << " sent, " << (juce::int64)groupStats.packetsEncrypted << " encrypted"
+              << std::endl;
+    std::cout << "Size:      " << formatSummary(pipeline.packetBytes, " B") << ", ratio "
+              << juce::String(pipeline.compressionRatio.p50, 3) << " of PCM" << std::endl;
+    std::cout << "Encode:    " << formatSummary(pipeline.getStage(PipelineStats::Stage::Encode), " us") << std::endl;
+    std::cout << "Send:      " << formatSummary(pipeline.getStage(PipelineStats::Stage::Send), " us") << std::endl;
+
+    for (auto& endpoint : endpoints)
+    {
+        const auto name = endpoint.host + ":" + juce::String(endpoint.audioPort);
+        auto stats = group.getReceiverStats(AirPlayDevice(name, endpoint.host, endpoint.audioPort));
+
+        std::cout << "Receiver " << name << ": " << (juce::int64)stats.packetsSent << " packets, "
+                  << (juce::int64)stats.bytesSent << " bytes, " << (juce::int64)stats.packetsRetransmitted
+                  << " retransmitted, " << (juce::int64)stats.retransmitMisses << " retransmit misses" << std::endl;
+    }
+
+    manager.disconnectFromDevice();
+
+    if (alacPath.isNotEmpty())
+    {
+        auto stats = group.getRecordingStats();
+
+        printFileSummary(alacPath, AlacFileWriter::getContainerFor(alacPath), stats.framesWritten, stats.packetsWritten,
+                         stats.bytesWritten, layout.size());
+
+        if (!recorded)
+        {
+            std::cerr << group.getLastError() << " (" << stats.packetsDropped << " packets dropped)" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
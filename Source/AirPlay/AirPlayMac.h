@@ -3,7 +3,7 @@
 #include <JuceHeader.h>
 #include "../Discovery/AirPlayDevice.h"
 
-#if JUCE_MAC || JUCE_IOS
+#if JUCE_MAC
 
 class AirPlayMac
 {
@@ -15,6 +15,7 @@ public:
     void disconnect();
     bool isConnected() const;
     bool streamAudio(const juce::AudioBuffer<float>& buffer, int numSamples);
+    bool streamInterleaved(const void* frames, int numSamples, int numChannels, int bitsPerSample);
     juce::String getLastError() const;
 
 private:
@@ -25,4 +26,19 @@ private:
     juce::String lastError;
 };
 
+#else
+
+// Elsewhere there's no direct connection: connecting fails, and
+// AirPlayManager streams to the receivers added to its session group
+class AirPlayMac
+{
+public:
+    bool connect(const AirPlayDevice&) { return false; }
+    void disconnect() {}
+    bool isConnected() const { return false; }
+    bool streamAudio(const juce::AudioBuffer<float>&, int) { return false; }
+    bool streamInterleaved(const void*, int, int, int) { return false; }
+    juce::String getLastError() const { return "Direct connections need macOS; add the device as a receiver instead"; }
+};
+
 #endif
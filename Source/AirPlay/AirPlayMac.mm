@@ -10,6 +10,15 @@ struct AirPlayMac::Impl
     std::unique_ptr<AudioEncoder> encoder;
     bool isConnected = false;
     juce::String lastError;
+
+    // Where both streaming entry points hand over their encoded packets
+    bool send(const juce::MemoryBlock& encodedData)
+    {
+        // TODO: Implement native macOS AirPlay streaming
+        // For now, just simulate successful streaming (stub implementation)
+        juce::ignoreUnused(encodedData);
+        return true;
+    }
 };
 
 AirPlayMac::AirPlayMac()
@@ -67,12 +76,15 @@ bool AirPlayMac::streamAudio(const juce::AudioBuffer<float>& buffer, int numSamp
     //     DBG("AirPlayMac::streamAudio called - samples: " << numSamples << ", channels: " << buffer.getNumChannels());
     // }
 
-    // TODO: Implement native macOS AirPlay streaming
-    // For now, just encode the audio (stub implementation)
-    auto encodedData = pimpl->encoder->encode(buffer, numSamples);
+    return pimpl->send(pimpl->encoder->encode(buffer, numSamples));
+}
 
-    // Simulate successful streaming
-    return true;
+bool AirPlayMac::streamInterleaved(const void* frames, int numSamples, int numChannels, int bitsPerSample)
+{
+    if (!connected || !pimpl->encoder)
+        return false;
+
+    return pimpl->send(pimpl->encoder->encodeInterleaved(frames, numSamples, numChannels, bitsPerSample));
 }
 
 juce::String AirPlayMac::getLastError() const
@@ -1,26 +1,101 @@
 #include "AirPlayManager.h"
 #include "AirPlayMac.h"
 
-AirPlayManager::AirPlayManager() : Thread("AirPlayStream")
+// Writes the manager's statistics to a file at a fixed interval, off the
+// streaming threads. A last line is written when the log stops.
+class AirPlayManager::StatsLog : public juce::Thread
+{
+public:
+    StatsLog(const AirPlayManager& ownerToUse, const juce::File& fileToUse, int intervalMsToUse)
+        : Thread("AirPlayStatsLog"), owner(ownerToUse), file(fileToUse), intervalMs(intervalMsToUse)
+    {
+        startThread(Priority::background);
+    }
+
+    ~StatsLog() override
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread(2000);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wait(intervalMs);
+            writeLine();
+        }
+    }
+
+    bool writeLine() const
+    {
+        return file.appendText(owner.getStatsLogLine() + "\n", false, false, "\n");
+    }
+
+private:
+    const AirPlayManager& owner;
+    const juce::File file;
+    const int intervalMs;
+};
+
+AirPlayManager::AirPlayManager(bool useSharedScheduler)
+    : Thread("AirPlayStream"),
+      sharedScheduler(useSharedScheduler ? std::make_unique<juce::SharedResourcePointer<StreamScheduler>>() : nullptr)
 {
     encoder = std::make_unique<AudioEncoder>();
-    buffer = std::make_unique<StreamBuffer>(2, 8192);
-    airplayImpl = std::make_unique<AirPlayMac>();
+    buffer = std::make_unique<StreamBuffer>();
+    buffer->setOverflowPolicy(StreamBuffer::OverflowPolicy::Resync);
+    sessionGroup.setPipelineStats(&pipelineStats);
 }
 
 AirPlayManager::~AirPlayManager()
 {
     // Clear callbacks first to prevent UI access during destruction
     clearCallbacks();
+    stopStatsLog();
     disconnectFromDevice();
+
+    if (sharedScheduler)
+        (*sharedScheduler)->removeSession(this);
+
     stopThread(2000);
 }
 
-void AirPlayManager::prepare(double sampleRate, int samplesPerBlock)
+void AirPlayManager::prepare(double sampleRate, int samplesPerBlock, const juce::AudioChannelSet& layout)
 {
+    const juce::ScopedLock sl(streamLock);
+    const int numChannels = layout.size();
     currentSampleRate = sampleRate;
     currentSamplesPerBlock = samplesPerBlock;
-    encoder->prepare(sampleRate, samplesPerBlock);
+    currentNumChannels = numChannels;
+
+    // Receivers expect 44.1 kHz; convert when the host runs at 48/88.2/96 kHz
+    converter.prepare(numChannels, samplesPerBlock, sampleRate);
+    streamSampleRate = converter.getOutputSampleRate();
+    hostAudio.setSize(numChannels, samplesPerBlock);
+    buffer->setNumChannels(numChannels);
+    buffer->prepare(sampleRate, maxBufferLatencyMs, getDirectStorage());
+    streamAudio.setSize(numChannels, toStreamFrames(samplesPerBlock));
+    streamPcm.calloc((size_t)(samplesPerBlock * numChannels * sizeof(juce::int16)));
+
+    encoder->prepare(streamSampleRate, samplesPerBlock, layout);
+
+    if (!sessionGroup.prepare(streamSampleRate, layout))
+    {
+        lastError = sessionGroup.getLastError();
+        notifyError(lastError);
+    }
+
+    // The buffer sizes its own target from the measured cadence; the
+    // resampler follows it, starting from a host block plus one packet
+    resampler.prepare(numChannels, 2 * RaopTransport::framesPerPacket, streamSampleRate);
+    resampler.setTargetFill(toStreamFrames(samplesPerBlock) + RaopTransport::framesPerPacket);
+    rebuffering = false;
+    resamplerInput.setSize(numChannels, 2 * RaopTransport::framesPerPacket + DriftResampler::numTaps);
+    packetAudio.setSize(numChannels, RaopTransport::framesPerPacket);
+    packetClock.reset();
+    framesPaced = 0;
 }
 
 void AirPlayManager::connectToDevice(const AirPlayDevice& device)
@@ -31,17 +106,19 @@ void AirPlayManager::connectToDevice(const AirPlayDevice& device)
     hasError = false;
     isReconnecting = false;
 
-    if (airplayImpl && airplayImpl->connect(device))
+    // A fresh connection each time: a pass still sending to the previous
+    // one keeps it open until the pass ends
+    auto direct = std::make_shared<AirPlayMac>();
+
+    if (direct->connect(device))
     {
-        connectedDevice = device;
+        publishOutputSession(direct, device, true);
         notifyStatusChange("Connected to: " + device.getDeviceName());
-
-        if (!isThreadRunning())
-            startThread();
+        startStreaming();
     }
     else
     {
-        lastError = airplayImpl ? airplayImpl->getLastError() : "Failed to create AirPlay implementation";
+        lastError = direct->getLastError();
         notifyError(lastError);
         hasError = true;
     }
@@ -52,10 +129,8 @@ void AirPlayManager::disconnectFromDevice()
     juce::Logger::writeToLog("AirPlayManager: Disconnecting");
     const juce::ScopedLock sl(connectionLock);
 
-    if (airplayImpl)
-    {
-        airplayImpl->disconnect();
-    }
+    sessionGroup.removeAllReceivers();
+    publishOutputSession(nullptr, {}, false);
 
     // Only notify if we have a valid callback (UI still exists)
     if (onStatusChange)
@@ -64,24 +139,89 @@ void AirPlayManager::disconnectFromDevice()
     }
 }
 
-bool AirPlayManager::isConnected() const
+bool AirPlayManager::addReceiver(const AirPlayDevice& device, const RaopTransport::Endpoint& endpoint,
+                                 juce::uint32 outputLatencyFrames)
 {
+    juce::Logger::writeToLog("AirPlayManager: Adding receiver: " + device.getDeviceName());
     const juce::ScopedLock sl(connectionLock);
-    return airplayImpl && airplayImpl->isConnected();
+
+    if (!sessionGroup.addReceiver(device, endpoint, outputLatencyFrames))
+    {
+        lastError = sessionGroup.getLastError();
+        notifyError(lastError);
+        return false;
+    }
+
+    auto current = getOutputSession();
+    publishOutputSession(current != nullptr ? current->direct : nullptr,
+                         current != nullptr ? current->device : AirPlayDevice(), false);
+    notifyStatusChange("Streaming to " + juce::String(sessionGroup.getNumReceivers()) + " receiver(s)");
+    startStreaming();
+    return true;
 }
 
-juce::String AirPlayManager::getConnectedDeviceName() const
+void AirPlayManager::removeReceiver(const AirPlayDevice& device)
 {
     const juce::ScopedLock sl(connectionLock);
-    return isConnected() ? connectedDevice.getDeviceName() : "";
+    sessionGroup.removeReceiver(device);
+
+    auto current = getOutputSession();
+    publishOutputSession(current != nullptr ? current->direct : nullptr,
+                         current != nullptr ? current->device : AirPlayDevice(), false);
+}
+
+int AirPlayManager::getNumReceivers() const
+{
+    auto session = getOutputSession();
+    return session != nullptr ? session->numReceivers : 0;
+}
+
+AirPlayManager::OutputSessionPtr AirPlayManager::getOutputSession() const
+{
+    return std::atomic_load(&outputSession);
+}
+
+void AirPlayManager::publishOutputSession(std::shared_ptr<AirPlayMac> direct, const AirPlayDevice& device, bool newStream)
+{
+    // Called with connectionLock held, whenever the outputs may have changed
+    if (direct != nullptr && !direct->isConnected())
+        direct.reset();
+
+    const int numReceivers = sessionGroup.getNumReceivers();
+    OutputSessionPtr session;
+
+    if (direct != nullptr || numReceivers > 0)
+    {
+        auto current = getOutputSession();
+        auto next = std::make_shared<OutputSession>();
+        next->direct = std::move(direct);
+        next->device = next->direct != nullptr ? device : AirPlayDevice();
+        next->numReceivers = numReceivers;
+        next->streamId = (current != nullptr && !newStream) ? current->streamId : ++nextStreamId;
+        session = std::move(next);
+    }
+
+    std::atomic_store(&outputSession, session);
+    connected = session != nullptr;
+}
+
+juce::String AirPlayManager::getConnectedDeviceName() const
+{
+    auto session = getOutputSession();
+    return session != nullptr ? session->device.getDeviceName() : "";
 }
 
 juce::String AirPlayManager::getConnectionStatus() const
 {
-    if (!isConnected())
+    auto session = getOutputSession();
+
+    if (session == nullptr)
         return "Disconnected";
 
-    return "Connected to: " + getConnectedDeviceName();
+    if (!(session->direct != nullptr && session->direct->isConnected()))
+        return "Streaming to " + juce::String(session->numReceivers) + " receiver(s)";
+
+    return "Connected to: " + session->device.getDeviceName();
 }
 
 void AirPlayManager::pushAudioData(const juce::AudioBuffer<float>& audioBuffer, int numSamples)
@@ -89,7 +229,41 @@ void AirPlayManager::pushAudioData(const juce::AudioBuffer<float>& audioBuffer,
     if (!isConnected())
         return;
 
+    auto startTicks = juce::Time::getHighResolutionTicks();
+
     buffer->write(audioBuffer, numSamples);
+
+    if (sharedScheduler)
+        (*sharedScheduler)->schedule(this);
+
+    pipelineStats.recordStage(PipelineStats::Stage::Enqueue, juce::Time::getHighResolutionTicks() - startTicks);
+}
+
+bool AirPlayManager::startStatsLog(const juce::File& file, int intervalMs)
+{
+    stopStatsLog();
+
+    auto log = std::make_unique<StatsLog>(*this, file, juce::jmax(1, intervalMs));
+
+    if (!log->writeLine())
+        return false;
+
+    statsLog = std::move(log);
+    return true;
+}
+
+void AirPlayManager::stopStatsLog()
+{
+    statsLog.reset();
+}
+
+juce::String AirPlayManager::getStatsLogLine() const
+{
+    return "{\"timeMs\":" + juce::String(juce::Time::currentTimeMillis())
+         + ",\"receivers\":" + juce::String(getNumReceivers())
+         + ",\"bufferLatencyMs\":" + juce::String(getLatencyMs(), 3)
+         + ",\"driftCorrectionPpm\":" + juce::String(getDriftCorrectionPpm(), 3)
+         + ",\"pipeline\":" + getStats().toJson() + "}";
 }
 
 juce::String AirPlayManager::getLastError() const
@@ -107,33 +281,323 @@ bool AirPlayManager::isAutoReconnectEnabled() const
     return true; // Always enabled on macOS
 }
 
+void AirPlayManager::startStreaming()
+{
+    if (sharedScheduler)
+        (*sharedScheduler)->addSession(this);
+    else if (!isThreadRunning())
+        startThread();
+}
+
+void AirPlayManager::setDriftCompensation(bool enable)
+{
+    const juce::ScopedLock sl(streamLock);
+
+    driftCompensation = enable;
+    rebuffering = false;
+
+    // The buffer keeps its storage until the next prepare(): the audio thread
+    // writes to it without streamLock, so it can't be reallocated here. Both
+    // reading paths handle either storage meanwhile.
+    resampler.reset();
+    converter.reset();
+    packetClock.reset();
+    framesPaced = 0;
+}
+
+void AirPlayManager::setLatencyTargetMs(double ms)
+{
+    buffer->setLatencyTargetMs(ms);
+}
+
+double AirPlayManager::getLatencyTargetMs() const
+{
+    return buffer->getLatencyTargetMs();
+}
+
+double AirPlayManager::getLatencyMs() const
+{
+    return buffer->getLatencyMs();
+}
+
+double AirPlayManager::getTargetLatencyMs() const
+{
+    return buffer->getTargetLatencyMs();
+}
+
 void AirPlayManager::run()
 {
     while (!threadShouldExit())
     {
         processAudioStream();
         monitorConnection();
-        juce::Thread::sleep(10);
+        juce::Thread::sleep(getMillisecondsUntilNextPass());
     }
 }
 
-void AirPlayManager::processAudioStream()
+int AirPlayManager::getMillisecondsUntilNextPass() const
 {
-    const juce::ScopedLock sl(connectionLock);
+    // Wake for the next packet when paced, but never sleep past 10 ms
+    int waitMs = packetClock.isRunning() ? packetClock.getMillisecondsUntilDue(framesPaced) : 10;
+    return juce::jlimit(1, 10, waitMs);
+}
 
-    if (!isConnected() || !airplayImpl)
-        return;
+void AirPlayManager::serviceStream()
+{
+    // Scheduled once per pushed block, but passes can be coalesced, so drain
+    // whatever has accumulated
+    while (processAudioStream() > 0)
+    {
+    }
 
-    juce::AudioBuffer<float> audioBuffer(2, currentSamplesPerBlock);
-    int samplesRead = buffer->read(audioBuffer, currentSamplesPerBlock);
+    monitorConnection();
+
+    // Pushes alone would send paced packets in a burst per host block, and
+    // nothing at all once the host stops calling; wake again when the next
+    // packet is due, as the streaming thread does, while there's an output
+    if (getOutputSession() != nullptr)
+        (*sharedScheduler)->scheduleAfter(this, getMillisecondsUntilNextPass());
+}
+
+int AirPlayManager::processAudioStream()
+{
+    const juce::ScopedLock sl(streamLock);
+
+    // The session this pass streams to; connect and disconnect can swap in
+    // another meanwhile without waiting for the pass
+    auto session = getOutputSession();
+
+    if (!beginStreamPass(session))
+        return 0;
+
+    if (driftCompensation)
+        return processPacedAudio(*session);
+
+    // Hold the buffer's target latency; it also absorbs host jitter here
+    if (buffer->getAvailableData() < buffer->getTargetFill())
+        return 0;
+
+    pipelineStats.recordQueueDepth(buffer->getAvailableData());
+
+    // Integer storage: the buffer already holds packets in the encoder's layout
+    if (buffer->getStorage() != StreamBuffer::Storage::Float)
+    {
+        auto startTicks = juce::Time::getHighResolutionTicks();
+        int samplesRead = buffer->readInterleaved(streamPcm, currentSamplesPerBlock);
+        pipelineStats.recordStage(PipelineStats::Stage::Dequeue, juce::Time::getHighResolutionTicks() - startTicks);
+
+        if (samplesRead > 0)
+            streamInterleavedToOutputs(*session, streamPcm, samplesRead);
+
+        return samplesRead;
+    }
+
+    convertTicks = 0;
+    int samplesRead = readStreamAudio(streamAudio, streamAudio.getNumSamples());
+
+    if (converter.isActive())
+        pipelineStats.recordStage(PipelineStats::Stage::Convert, convertTicks);
 
     if (samplesRead > 0)
+        streamToOutputs(*session, streamAudio, samplesRead);
+
+    return samplesRead;
+}
+
+bool AirPlayManager::beginStreamPass(const OutputSessionPtr& session)
+{
+    // Called with streamLock held
+    if (session == nullptr)
+        return false;
+
+    // A new stream starts its own packet timeline
+    if (session->streamId != passStreamId)
+    {
+        passStreamId = session->streamId;
+        packetClock.reset();
+    }
+
+    // A direct connection that dropped by itself, with nothing else to
+    // stream to: withdraw the session, unless a connect is under way, in
+    // which case the next pass looks again
+    if (session->numReceivers == 0 && !session->direct->isConnected())
     {
-        if (!airplayImpl->streamAudio(audioBuffer, samplesRead))
+        const juce::ScopedTryLock tl(connectionLock);
+
+        if (tl.isLocked() && getOutputSession() == session)
+            publishOutputSession(nullptr, {}, false);
+
+        return false;
+    }
+
+    return true;
+}
+
+int AirPlayManager::processPacedAudio(const OutputSession& session)
+{
+    const int packetFrames = RaopTransport::framesPerPacket;
+
+    // Start the clock once the buffer holds its target, so the controller
+    // begins from a centred fill rather than chasing an empty buffer
+    if (!packetClock.isRunning())
+    {
+        if (buffer->getAvailableData() < buffer->getTargetFill())
+            return 0;
+
+        resampler.reset();
+        converter.reset();
+        packetClock.start(streamSampleRate);
+        framesPaced = 0;
+    }
+
+    // After a stall (system sleep, debugger) restart rather than burst
+    if (packetClock.getMillisecondsUntilDue(framesPaced) < -1000)
+    {
+        packetClock.reset();
+        return 0;
+    }
+
+    int packetsSent = 0;
+
+    while (packetClock.getMillisecondsUntilDue(framesPaced) <= 0)
+    {
+        resampler.setTargetFill(toStreamFrames(buffer->getTargetFill()));
+
+        // After an underflow the buffer has raised its target; keep
+        // concealing until it refills rather than trickling audio out as it
+        // arrives
+        bool holding = rebuffering && buffer->getAvailableData() < buffer->getTargetFill();
+
+        pipelineStats.recordQueueDepth(buffer->getAvailableData());
+        convertTicks = 0;
+
+        int needed = juce::jmin(resampler.getInputFramesNeeded(packetFrames), resamplerInput.getNumSamples());
+        if (needed > 0)
+            readStreamAudio(resamplerInput, needed, holding);
+
+        auto resampleStartTicks = juce::Time::getHighResolutionTicks();
+        resampler.pushInput(resamplerInput, 0, needed);
+
+        // An underflow still produces a full packet so the receiver's
+        // timeline keeps moving; the buffer conceals the missing audio
+        int produced = resampler.pullOutput(packetAudio, 0, packetFrames);
+        if (produced < packetFrames)
+            packetAudio.clear(produced, packetFrames - produced);
+
+        convertTicks += juce::Time::getHighResolutionTicks() - resampleStartTicks;
+        pipelineStats.recordStage(PipelineStats::Stage::Convert, convertTicks);
+
+        rebuffering = buffer->isConcealing();
+
+        if (!holding)
         {
-            notifyError("Failed to stream audio");
-            hasError = true;
+            resampler.updateController(toStreamFrames(buffer->getAvailableData()), packetFrames);
+            driftCorrectionPpm = resampler.getCorrectionPpm();
         }
+
+        streamToOutputs(session, packetAudio, packetFrames);
+        framesPaced += (juce::uint64)packetFrames;
+        packetsSent++;
+    }
+
+    return packetsSent * packetFrames;
+}
+
+int AirPlayManager::readStreamAudio(juce::AudioBuffer<float>& dest, int numFrames, bool concealOnly)
+{
+    auto startTicks = juce::Time::getHighResolutionTicks();
+
+    if (!converter.isActive())
+    {
+        int read = concealOnly ? buffer->conceal(dest, numFrames) : buffer->read(dest, numFrames);
+        pipelineStats.recordStage(PipelineStats::Stage::Dequeue, juce::Time::getHighResolutionTicks() - startTicks);
+        return read;
+    }
+
+    // Read exactly the host frames the converter needs, a block at a time.
+    // The buffer conceals what it cannot supply, so the converter always
+    // gets the full amount.
+    int produced = 0;
+    juce::int64 readTicks = 0;
+
+    while (produced < numFrames)
+    {
+        int needed = juce::jmin(converter.getInputFramesNeeded(numFrames - produced), hostAudio.getNumSamples());
+        if (needed > 0)
+        {
+            auto readStartTicks = juce::Time::getHighResolutionTicks();
+
+            if (concealOnly)
+                buffer->conceal(hostAudio, needed);
+            else
+                buffer->read(hostAudio, needed);
+
+            readTicks += juce::Time::getHighResolutionTicks() - readStartTicks;
+        }
+        converter.pushInput(hostAudio, 0, needed);
+
+        int pulled = converter.pullOutput(dest, produced, numFrames - produced);
+        produced += pulled;
+
+        if (pulled == 0 && needed == 0)
+            break;
+    }
+
+    // The rest of the time went to the converter, which the caller records
+    // with anything else it converts
+    pipelineStats.recordStage(PipelineStats::Stage::Dequeue, readTicks);
+    convertTicks += juce::Time::getHighResolutionTicks() - startTicks - readTicks;
+    return produced;
+}
+
+StreamBuffer::Storage AirPlayManager::getDirectStorage() const
+{
+    // Without rate conversion or drift compensation nothing touches the audio
+    // between the buffer and the encoder, so it can be stored as 16-bit PCM
+    if (driftCompensation || converter.isActive())
+        return StreamBuffer::Storage::Float;
+
+    return StreamBuffer::Storage::Int16;
+}
+
+int AirPlayManager::toStreamFrames(int hostFrames) const
+{
+    return (int)((double)hostFrames * streamSampleRate / currentSampleRate);
+}
+
+void AirPlayManager::streamToOutputs(const OutputSession& session, const juce::AudioBuffer<float>& audio, int numSamples)
+{
+    auto* direct = session.direct.get();
+
+    if (direct != nullptr && direct->isConnected() && !direct->streamAudio(audio, numSamples))
+    {
+        notifyError("Failed to stream audio");
+        hasError = true;
+    }
+
+    // One encode per packet, fanned out to every group receiver. The group
+    // may have been emptied since the session was taken, which is no error.
+    if (session.numReceivers > 0 && !sessionGroup.streamAudio(audio, numSamples) && sessionGroup.getNumReceivers() > 0)
+    {
+        notifyError(sessionGroup.getLastError());
+        hasError = true;
+    }
+}
+
+void AirPlayManager::streamInterleavedToOutputs(const OutputSession& session, const void* frames, int numSamples)
+{
+    auto* direct = session.direct.get();
+
+    if (direct != nullptr && direct->isConnected() && !direct->streamInterleaved(frames, numSamples, currentNumChannels, 16))
+    {
+        notifyError("Failed to stream audio");
+        hasError = true;
+    }
+
+    if (session.numReceivers > 0 && !sessionGroup.streamInterleaved(frames, numSamples, 16) && sessionGroup.getNumReceivers() > 0)
+    {
+        notifyError(sessionGroup.getLastError());
+        hasError = true;
     }
 }
 
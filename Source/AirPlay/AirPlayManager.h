@@ -3,19 +3,46 @@
 #include "../Discovery/AirPlayDevice.h"
 #include "../Audio/AudioEncoder.h"
 #include "../Audio/StreamBuffer.h"
+#include "../Audio/DriftResampler.h"
+#include "../Audio/SampleRateConverter.h"
 #include "AirPlayMac.h"
+#include "RaopSessionGroup.h"
+#include "PipelineStats.h"
+#include "StreamScheduler.h"
 
-class AirPlayManager : public juce::Thread
+class AirPlayManager : public juce::Thread,
+                       private StreamScheduler::Session
 {
 public:
-    AirPlayManager();
+    // With useSharedScheduler, streaming work runs on the process-wide
+    // StreamScheduler pool shared by all instances instead of this manager's
+    // own thread. The choice is fixed for the manager's lifetime: the audio
+    // thread reads it on every push without a lock.
+    explicit AirPlayManager(bool useSharedScheduler = false);
     ~AirPlayManager() override;
 
-    void prepare(double sampleRate, int samplesPerBlock);
+    // The layout is the host's channel order; anything AudioEncoder supports
+    // (mono up to 7.1) is streamed with all its channels
+    void prepare(double sampleRate, int samplesPerBlock,
+                 const juce::AudioChannelSet& layout = juce::AudioChannelSet::stereo());
     void connectToDevice(const AirPlayDevice& device);
     void disconnectFromDevice();
 
-    bool isConnected() const;
+    // Multi-room: additional receivers fed from the same encode. The endpoint
+    // carries the UDP ports negotiated for the receiver's RAOP session and
+    // outputLatencyFrames the audio latency the receiver reported, used to
+    // keep all receivers in phase.
+    bool addReceiver(const AirPlayDevice& device, const RaopTransport::Endpoint& endpoint,
+                     juce::uint32 outputLatencyFrames = 0);
+    void removeReceiver(const AirPlayDevice& device);
+    int getNumReceivers() const;
+    RaopSessionGroup& getSessionGroup() { return sessionGroup; }
+
+    // Lock-free, so the audio thread can ask every block
+    bool isConnected() const { return connected.load(); }
+
+    // Read from the published session, so they never wait for a streaming
+    // pass
     juce::String getConnectedDeviceName() const;
     juce::String getConnectionStatus() const;
 
@@ -23,6 +50,40 @@ public:
 
     juce::String getLastError() const;
 
+    bool isUsingSharedScheduler() const { return sharedScheduler != nullptr; }
+
+    // When enabled (the default), audio leaves the stream buffer in whole
+    // packets paced by the receiver-facing clock, through a resampler that
+    // absorbs the drift between that clock and the host's audio clock. The
+    // stream buffer's storage follows at the next prepare().
+    void setDriftCompensation(bool enable);
+    bool isDriftCompensationEnabled() const { return driftCompensation; }
+    double getDriftCorrectionPpm() const { return driftCorrectionPpm.load(); }
+
+    // Rate sent to receivers: 44.1 kHz when the host rate is one the
+    // converter handles (48, 88.2, 96 kHz), otherwise the host rate
+    double getStreamSampleRate() const { return streamSampleRate; }
+
+    // Buffering between the audio thread and the stream. The buffer adapts
+    // its size to the host and network cadence, growing after underflows and
+    // settling back towards the latency target (20 ms by default) when stable.
+    void setLatencyTargetMs(double ms);
+    double getLatencyTargetMs() const;
+    double getTargetLatencyMs() const;
+    double getLatencyMs() const;
+
+    // Where time goes between pushAudioData() and the wire: per-stage times,
+    // packet sizes, compression and buffer depth since the last reset.
+    // Lock-free to record and to read.
+    PipelineStats::Snapshot getStats() const { return pipelineStats.getSnapshot(); }
+    void resetStats() { pipelineStats.reset(); }
+
+    // Appends a line of JSON to the file every intervalMs: getStats() plus
+    // the receiver count, buffer latency and drift correction. Figures are
+    // cumulative since the last resetStats(). Replaces any log running.
+    bool startStatsLog(const juce::File& file, int intervalMs = 1000);
+    void stopStatsLog();
+
     // Auto-reconnect settings
     void setAutoReconnect(bool enable);
     bool isAutoReconnectEnabled() const;
@@ -35,25 +96,89 @@ public:
     void clearCallbacks();
 
 private:
+    static constexpr double maxBufferLatencyMs = 1000.0;
+
+    // What audio is streamed to. A session is never modified once published:
+    // connect, disconnect and receiver changes build a new one and swap it in,
+    // and a streaming pass keeps the one it started with, so it encodes and
+    // sends without the connection lock. The direct connection closes when
+    // the last session using it is released.
+    struct OutputSession
+    {
+        std::shared_ptr<AirPlayMac> direct;
+        AirPlayDevice device;
+        int numReceivers = 0;
+
+        // Changes when a stream starts afresh, not when receivers come and go
+        juce::uint64 streamId = 0;
+    };
+
+    using OutputSessionPtr = std::shared_ptr<const OutputSession>;
+
+    class StatsLog;
+
     void run() override;
-    void processAudioStream();
+    void serviceStream() override;
+    void startStreaming();
+    int processAudioStream();
+    int getMillisecondsUntilNextPass() const;
+    int processPacedAudio(const OutputSession& session);
+    bool beginStreamPass(const OutputSessionPtr& session);
+    int readStreamAudio(juce::AudioBuffer<float>& dest, int numFrames, bool concealOnly = false);
+    int toStreamFrames(int hostFrames) const;
+    StreamBuffer::Storage getDirectStorage() const;
+    void streamToOutputs(const OutputSession& session, const juce::AudioBuffer<float>& audio, int numSamples);
+    void streamInterleavedToOutputs(const OutputSession& session, const void* frames, int numSamples);
     void monitorConnection();
+    OutputSessionPtr getOutputSession() const;
+    void publishOutputSession(std::shared_ptr<AirPlayMac> direct, const AirPlayDevice& device, bool newStream);
+    juce::String getStatsLogLine() const;
     void notifyError(const juce::String& error);
     void notifyStatusChange(const juce::String& status);
 
-    std::unique_ptr<AirPlayMac> airplayImpl;
     std::unique_ptr<AudioEncoder> encoder;
     std::unique_ptr<StreamBuffer> buffer;
+    PipelineStats pipelineStats;
+    RaopSessionGroup sessionGroup;
+    const std::unique_ptr<juce::SharedResourcePointer<StreamScheduler>> sharedScheduler;
+
+    SampleRateConverter converter;
+    juce::AudioBuffer<float> hostAudio;
+    juce::AudioBuffer<float> streamAudio;
+    juce::HeapBlock<char> streamPcm;
+    DriftResampler resampler;
+    RaopPacketPacer packetClock;
+    juce::uint64 framesPaced = 0;
+    juce::AudioBuffer<float> resamplerInput;
+    juce::AudioBuffer<float> packetAudio;
+    // Conversion time of the block or packet being assembled
+    juce::int64 convertTicks = 0;
+    bool driftCompensation = true;
+    bool rebuffering = false;
+    std::atomic<double> driftCorrectionPpm{0.0};
 
-    AirPlayDevice connectedDevice;
     double currentSampleRate = 44100.0;
+    double streamSampleRate = 44100.0;
     int currentSamplesPerBlock = 512;
+    int currentNumChannels = 2;
 
+    // connectionLock orders connect, disconnect and receiver changes;
+    // streamLock is held by each streaming pass and by reconfiguration.
+    // Neither is taken on the audio thread, and no query takes either.
     juce::CriticalSection connectionLock;
+    juce::CriticalSection streamLock;
+
+    // Only accessed through std::atomic_load/atomic_store; null when
+    // disconnected
+    OutputSessionPtr outputSession;
+    juce::uint64 nextStreamId = 0;
+    juce::uint64 passStreamId = 0;
+    std::atomic<bool> connected{false};
     juce::String lastError;
     juce::int64 lastMonitorTime = 0;
     std::atomic<bool> hasError{false};
     std::atomic<bool> isReconnecting{false};
+    std::unique_ptr<StatsLog> statsLog;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AirPlayManager)
 };
@@ -0,0 +1,253 @@
+#include "PipelineStats.h"
+
+namespace
+{
+    int findHighestBit(juce::uint64 value) noexcept
+    {
+        const auto high = (juce::uint32)(value >> 32);
+        return high != 0 ? 32 + juce::findHighestSetBit(high) : juce::findHighestSetBit((juce::uint32)value);
+    }
+
+    void storeMinimum(std::atomic<juce::uint64>& minimum, juce::uint64 value) noexcept
+    {
+        auto current = minimum.load(std::memory_order_relaxed);
+        while (value < current && !minimum.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void storeMaximum(std::atomic<juce::uint64>& maximum, juce::uint64 value) noexcept
+    {
+        auto current = maximum.load(std::memory_order_relaxed);
+        while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    juce::String toJsonNumber(double value)
+    {
+        return juce::String(value, 3);
+    }
+}
+
+//==============================================================================
+LockFreeHistogram::LockFreeHistogram()
+{
+    reset();
+}
+
+int LockFreeHistogram::getBucketIndex(juce::uint64 value) noexcept
+{
+    constexpr juce::uint64 subBuckets = 1 << subBucketBits;
+
+    // Small values get a bucket each; above that, each power of two is split
+    // into subBuckets equal parts
+    if (value < subBuckets)
+        return (int)value;
+
+    const int shift = findHighestBit(value) - subBucketBits;
+    return ((shift + 1) << subBucketBits) + (int)((value >> shift) & (subBuckets - 1));
+}
+
+juce::uint64 LockFreeHistogram::getBucketLowerBound(int index) noexcept
+{
+    constexpr int subBuckets = 1 << subBucketBits;
+
+    if (index < subBuckets)
+        return (juce::uint64)index;
+
+    const int shift = (index >> subBucketBits) - 1;
+    return (juce::uint64)(subBuckets + (index & (subBuckets - 1))) << shift;
+}
+
+juce::uint64 LockFreeHistogram::getBucketUpperBound(int index) noexcept
+{
+    if (index < (1 << subBucketBits))
+        return (juce::uint64)index;
+
+    const int shift = (index >> subBucketBits) - 1;
+    return getBucketLowerBound(index) + (((juce::uint64)1 << shift) - 1);
+}
+
+void LockFreeHistogram::record(juce::uint64 value) noexcept
+{
+    buckets[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(value, std::memory_order_relaxed);
+    storeMinimum(minimum, value);
+    storeMaximum(maximum, value);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LockFreeHistogram::reset() noexcept
+{
+    for (auto& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+
+    count = 0;
+    total = 0;
+    minimum = std::numeric_limits<juce::uint64>::max();
+    maximum = 0;
+}
+
+LockFreeHistogram::Summary LockFreeHistogram::getSummary(double scale) const
+{
+    Summary summary;
+
+    // Buckets are read one at a time while records may land, so percentiles
+    // come from the bucket counts actually seen
+    juce::uint64 counts[numBuckets];
+    juce::uint64 numSeen = 0;
+
+    for (int i = 0; i < numBuckets; ++i)
+    {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        numSeen += counts[i];
+    }
+
+    summary.count = count.load(std::memory_order_relaxed);
+
+    if (summary.count == 0 || numSeen == 0)
+        return summary;
+
+    const auto lowest = minimum.load(std::memory_order_relaxed);
+    const auto highest = maximum.load(std::memory_order_relaxed);
+
+    summary.total = (double)total.load(std::memory_order_relaxed) * scale;
+    summary.mean = summary.total / (double)summary.count;
+    summary.min = (double)lowest * scale;
+    summary.max = (double)highest * scale;
+
+    auto percentile = [&](double fraction)
+    {
+        const auto rank = juce::jmax((juce::uint64)1, (juce::uint64)std::ceil(fraction * (double)numSeen));
+        juce::uint64 seen = 0;
+
+        for (int i = 0; i < numBuckets; ++i)
+        {
+            seen += counts[i];
+
+            if (seen >= rank)
+            {
+                // The middle of the bucket, kept within what was recorded
+                const double lower = (double)getBucketLowerBound(i);
+                const double upper = (double)getBucketUpperBound(i);
+                return juce::jlimit((double)lowest, (double)highest, (lower + upper) * 0.5) * scale;
+            }
+        }
+
+        return (double)highest * scale;
+    };
+
+    summary.p50 = percentile(0.5);
+    summary.p90 = percentile(0.9);
+    summary.p99 = percentile(0.99);
+    return summary;
+}
+
+juce::String LockFreeHistogram::Summary::toJson() const
+{
+    return "{\"count\":" + juce::String((juce::int64)count)
+         + ",\"mean\":" + toJsonNumber(mean)
+         + ",\"min\":" + toJsonNumber(min)
+         + ",\"p50\":" + toJsonNumber(p50)
+         + ",\"p90\":" + toJsonNumber(p90)
+         + ",\"p99\":" + toJsonNumber(p99)
+         + ",\"max\":" + toJsonNumber(max) + "}";
+}
+
+//==============================================================================
+PipelineStats::PipelineStats()
+{
+    reset();
+}
+
+const char* PipelineStats::getStageName(Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::Enqueue: return "enqueue";
+        case Stage::Dequeue: return "dequeue";
+        case Stage::Convert: return "convert";
+        case Stage::Encode:  return "encode";
+        case Stage::Encrypt: return "encrypt";
+        case Stage::Send:    return "send";
+    }
+
+    return "";
+}
+
+void PipelineStats::recordStage(Stage stage, juce::int64 ticks) noexcept
+{
+    stages[(int)stage].record((juce::uint64)juce::jmax((juce::int64)0, ticks));
+}
+
+void PipelineStats::recordPacket(int pcmBytes, int encodedBytes) noexcept
+{
+    packetBytes.record((juce::uint64)juce::jmax(0, encodedBytes));
+
+    if (pcmBytes > 0)
+        compressionRatio.record((juce::uint64)juce::jmax(0, encodedBytes) * (juce::uint64)ratioScale
+                                / (juce::uint64)pcmBytes);
+}
+
+void PipelineStats::recordQueueDepth(int frames) noexcept
+{
+    queueDepth.record((juce::uint64)juce::jmax(0, frames));
+}
+
+void PipelineStats::reset() noexcept
+{
+    for (auto& stage : stages)
+        stage.reset();
+
+    packetBytes.reset();
+    compressionRatio.reset();
+    queueDepth.reset();
+    periodStartTicks = juce::Time::getHighResolutionTicks();
+}
+
+PipelineStats::Snapshot PipelineStats::getSnapshot() const
+{
+    Snapshot snapshot;
+    snapshot.elapsedSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks()
+                                                                        - periodStartTicks.load());
+
+    const double microsPerTick = 1.0e6 / (double)juce::Time::getHighResolutionTicksPerSecond();
+
+    for (int i = 0; i < numStages; ++i)
+        snapshot.stageMicros[i] = stages[i].getSummary(microsPerTick);
+
+    snapshot.packetBytes = packetBytes.getSummary();
+    snapshot.compressionRatio = compressionRatio.getSummary(1.0 / ratioScale);
+    snapshot.queueDepthFrames = queueDepth.getSummary();
+
+    if (snapshot.elapsedSeconds > 0.0)
+    {
+        snapshot.packetsPerSecond = (double)snapshot.packetBytes.count / snapshot.elapsedSeconds;
+        snapshot.encodedBytesPerSecond = snapshot.packetBytes.total / snapshot.elapsedSeconds;
+    }
+
+    return snapshot;
+}
+
+juce::String PipelineStats::Snapshot::toJson() const
+{
+    juce::String json = "{\"elapsedSeconds\":" + toJsonNumber(elapsedSeconds)
+                      + ",\"packetsPerSecond\":" + toJsonNumber(packetsPerSecond)
+                      + ",\"encodedBytesPerSecond\":" + toJsonNumber(encodedBytesPerSecond)
+                      + ",\"stageMicros\":{";
+
+    for (int i = 0; i < numStages; ++i)
+    {
+        if (i > 0)
+            json << ",";
+
+        json << "\"" << getStageName((Stage)i) << "\":" << stageMicros[i].toJson();
+    }
+
+    json << "},\"packetBytes\":" << packetBytes.toJson()
+         << ",\"compressionRatio\":" << compressionRatio.toJson()
+         << ",\"queueDepthFrames\":" << queueDepthFrames.toJson() << "}";
+
+    return json;
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Histogram of non-negative integer samples that any number of threads can
+// record into without waiting, the audio thread included: a record is a few
+// relaxed atomic adds. Buckets are log-linear, eight to each power of two,
+// so percentiles are within about 6% at any magnitude, and the whole range
+// of a 64-bit value fits in a fixed 496 buckets.
+class LockFreeHistogram
+{
+public:
+    static constexpr int subBucketBits = 3;
+    static constexpr int numBuckets = (64 - subBucketBits + 1) << subBucketBits;
+
+    LockFreeHistogram();
+
+    void record(juce::uint64 value) noexcept;
+
+    // Not atomic with respect to concurrent records; one landing during a
+    // reset may be counted in either period
+    void reset() noexcept;
+
+    // All values are multiplied by scale, to report in other units
+    struct Summary
+    {
+        juce::uint64 count = 0;
+        double total = 0.0;
+        double mean = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        double p50 = 0.0;
+        double p90 = 0.0;
+        double p99 = 0.0;
+
+        juce::String toJson() const;
+    };
+
+    Summary getSummary(double scale = 1.0) const;
+
+    static int getBucketIndex(juce::uint64 value) noexcept;
+    static juce::uint64 getBucketLowerBound(int index) noexcept;
+    static juce::uint64 getBucketUpperBound(int index) noexcept;
+
+private:
+    std::atomic<juce::uint64> buckets[numBuckets];
+    std::atomic<juce::uint64> count{0};
+    std::atomic<juce::uint64> total{0};
+    std::atomic<juce::uint64> minimum;
+    std::atomic<juce::uint64> maximum{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LockFreeHistogram)
+};
+
+// Where the time goes between pushAudioData() and the wire. Each stage a
+// block passes through records its duration, and every encoded packet its
+// size, into lock-free histograms, so recording never disturbs the threads
+// being measured. The direct AirPlayMac connection encodes and sends inside
+// the system framework, so only the group path records encode, encrypt and
+// send.
+class PipelineStats
+{
+public:
+    enum class Stage
+    {
+        Enqueue,    // audio thread writing a block into the stream buffer
+        Dequeue,    // stream reading it back out
+        Convert,    // rate conversion and drift resampling
+        Encode,     // per packet
+        Encrypt,    // per packet, when the group is encrypting
+        Send        // per packet, fanned out to every receiver
+    };
+
+    static constexpr int numStages = 6;
+    static const char* getStageName(Stage stage);
+
+    PipelineStats();
+
+    // Durations in Time::getHighResolutionTicks() units
+    void recordStage(Stage stage, juce::int64 ticks) noexcept;
+
+    // One encoded packet, with the size of the PCM it was encoded from
+    void recordPacket(int pcmBytes, int encodedBytes) noexcept;
+
+    // Frames waiting in the stream buffer when the stream takes audio
+    void recordQueueDepth(int frames) noexcept;
+
+    // Starts a new measurement period
+    void reset() noexcept;
+
+    struct Snapshot
+    {
+        double elapsedSeconds = 0.0;
+
+        // Microseconds per stage
+        LockFreeHistogram::Summary stageMicros[numStages];
+        LockFreeHistogram::Summary packetBytes;
+
+        // Encoded size over PCM size, per packet
+        LockFreeHistogram::Summary compressionRatio;
+        LockFreeHistogram::Summary queueDepthFrames;
+
+        double packetsPerSecond = 0.0;
+        double encodedBytesPerSecond = 0.0;
+
+        const LockFreeHistogram::Summary& getStage(Stage stage) const { return stageMicros[(int)stage]; }
+
+        // The whole snapshot as one line of JSON, without a line break
+        juce::String toJson() const;
+    };
+
+    Snapshot getSnapshot() const;
+
+private:
+    // Ratios are kept in thousandths so they fit the integer histogram
+    static constexpr double ratioScale = 1000.0;
+
+    LockFreeHistogram stages[numStages];
+    LockFreeHistogram packetBytes;
+    LockFreeHistogram compressionRatio;
+    LockFreeHistogram queueDepth;
+    std::atomic<juce::int64> periodStartTicks{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PipelineStats)
+};
@@ -0,0 +1,67 @@
+#include "RaopCrypto.h"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+RaopCrypto::RaopCrypto()
+{
+}
+
+RaopCrypto::~RaopCrypto()
+{
+    clear();
+}
+
+bool RaopCrypto::setKey(const juce::uint8* key, const juce::uint8* iv)
+{
+    clear();
+
+    context = EVP_CIPHER_CTX_new();
+    if (context == nullptr)
+        return false;
+
+    if (EVP_EncryptInit_ex(context, EVP_aes_128_cbc(), nullptr, key, iv) != 1)
+    {
+        clear();
+        return false;
+    }
+
+    EVP_CIPHER_CTX_set_padding(context, 0);
+    std::memcpy(sessionIv, iv, blockSize);
+    return true;
+}
+
+void RaopCrypto::clear()
+{
+    if (context != nullptr)
+    {
+        EVP_CIPHER_CTX_free(context);
+        context = nullptr;
+    }
+}
+
+bool RaopCrypto::encryptInPlace(juce::uint8* data, int size)
+{
+    if (context == nullptr)
+        return false;
+
+    int encryptedSize = size & ~(blockSize - 1);
+    if (encryptedSize == 0)
+        return true;
+
+    // Passing only the IV keeps the expanded key and restarts the CBC chain
+    if (EVP_EncryptInit_ex(context, nullptr, nullptr, nullptr, sessionIv) != 1)
+        return false;
+
+    int outputSize = 0;
+    if (EVP_EncryptUpdate(context, data, &outputSize, data, encryptedSize) != 1)
+        return false;
+
+    packetsEncrypted++;
+    return outputSize == encryptedSize;
+}
+
+bool RaopCrypto::generateKey(juce::uint8* key, juce::uint8* iv)
+{
+    return RAND_bytes(key, keySize) == 1 && RAND_bytes(iv, blockSize) == 1;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <JuceHeader.h>
+
+struct evp_cipher_ctx_st;
+
+// AES-128-CBC payload encryption as used by RAOP. Every packet is encrypted
+// from the same session IV, only whole 16-byte blocks are encrypted and the
+// trailing partial block is sent in the clear (no padding).
+//
+// The key schedule is set up once in setKey(); each packet only resets the
+// IV on the existing context and encrypts in place, so the per-packet cost
+// is the cipher itself. OpenSSL selects AES-NI / ARMv8 AES when available.
+class RaopCrypto
+{
+public:
+    static constexpr int keySize = 16;
+    static constexpr int blockSize = 16;
+
+    RaopCrypto();
+    ~RaopCrypto();
+
+    bool setKey(const juce::uint8* key, const juce::uint8* iv);
+    void clear();
+    bool isEnabled() const { return context != nullptr; }
+
+    // Encrypts the whole blocks of data in place
+    bool encryptInPlace(juce::uint8* data, int size);
+
+    // Fills a fresh random session key and IV, to be wrapped with the
+    // receiver's public key during session setup
+    static bool generateKey(juce::uint8* key, juce::uint8* iv);
+
+    juce::uint64 getPacketsEncrypted() const { return packetsEncrypted.load(); }
+
+private:
+    evp_cipher_ctx_st* context = nullptr;
+    juce::uint8 sessionIv[blockSize] = {};
+    std::atomic<juce::uint64> packetsEncrypted{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RaopCrypto)
+};
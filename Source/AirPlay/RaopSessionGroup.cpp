@@ -0,0 +1,498 @@
+#include "RaopSessionGroup.h"
+
+RaopSessionGroup::RaopSessionGroup()
+{
+    prepare(currentSampleRate, currentNumChannels);
+    encoder.setFormat(AudioEncoder::Format::ALAC);
+}
+
+RaopSessionGroup::~RaopSessionGroup()
+{
+    stopRecording();
+    removeAllReceivers();
+}
+
+bool RaopSessionGroup::prepare(double sampleRate, int numChannels)
+{
+    return prepare(sampleRate, AudioEncoder::getLayoutForChannelCount(numChannels));
+}
+
+bool RaopSessionGroup::prepare(double sampleRate, const juce::AudioChannelSet& layout)
+{
+    // A file holds one format. Finishing it waits for the disk, so it's done
+    // before taking the locks, as stopRecording() leaves them for that.
+    stopRecording();
+
+    const juce::ScopedLock el(encodeLock);
+    const juce::ScopedLock sl(receiverLock);
+
+    const int numChannels = layout.size();
+    currentSampleRate = sampleRate;
+    currentNumChannels = numChannels;
+
+    // The encoder always works on whole RAOP packets, whatever the host block size
+    encoder.prepare(sampleRate, RaopTransport::framesPerPacket, layout);
+    packetBuffer.setSize(numChannels, RaopTransport::framesPerPacket);
+    packetBuffer.clear();
+    packetPcm.calloc((size_t)(RaopTransport::framesPerPacket * numChannels * 3));
+    packetFill = 0;
+    discardPartialPacket = false;
+    resetClock();
+
+    return checkEncodedFormat();
+}
+
+bool RaopSessionGroup::setFormat(AudioEncoder::Format format)
+{
+    const juce::ScopedLock el(encodeLock);
+    const juce::ScopedLock sl(receiverLock);
+    encoder.setFormat(format);
+
+    return checkEncodedFormat();
+}
+
+bool RaopSessionGroup::checkEncodedFormat()
+{
+    // Called with both locks held. Receivers are told ALAC; PCM in its place
+    // would play as noise, so the encoder's fallback is never taken silently.
+    if (encoder.getEncodedFormat() == encoder.getFormat())
+        return true;
+
+    lastError = "ALAC can't carry " + juce::String(currentNumChannels) + " channels in this layout";
+    return false;
+}
+
+void RaopSessionGroup::setElementThreads(int numThreads)
+{
+    const juce::ScopedLock el(encodeLock);
+    encoder.setElementThreads(numThreads);
+}
+
+bool RaopSessionGroup::startRecording(const juce::File& file)
+{
+    stopRecording();
+
+    const juce::ScopedLock el(encodeLock);
+    juce::String error;
+
+    if (encoder.getEncodedFormat() != AudioEncoder::Format::ALAC)
+        error = "Recording needs the ALAC format";
+    else if (!recorder.start(file, currentSampleRate, currentNumChannels, RaopTransport::framesPerPacket,
+                             encoder.getMagicCookie()))
+        error = recorder.getLastError();
+
+    if (error.isNotEmpty())
+    {
+        const juce::ScopedLock sl(receiverLock);
+        lastError = error;
+        return false;
+    }
+
+    recordingPackets = true;
+    return true;
+}
+
+bool RaopSessionGroup::stopRecording()
+{
+    {
+        const juce::ScopedLock el(encodeLock);
+
+        if (!recordingPackets)
+            return false;
+
+        recordingPackets = false;
+    }
+
+    // Outside the lock, so streaming carries on while the file is finished
+    if (recorder.stop())
+        return true;
+
+    const juce::ScopedLock sl(receiverLock);
+    lastError = recorder.getLastError();
+    return false;
+}
+
+bool RaopSessionGroup::addReceiver(const AirPlayDevice& device, const RaopTransport::Endpoint& endpoint,
+                                   juce::uint32 outputLatencyFrames)
+{
+    double sampleRate;
+    {
+        const juce::ScopedLock sl(receiverLock);
+        sampleRate = currentSampleRate;
+    }
+
+    auto transport = std::make_unique<RaopTransport>();
+
+    if (!transport->open(endpoint, sampleRate, &eventLoops->getLoopForNewSession()))
+    {
+        const juce::ScopedLock sl(receiverLock);
+        lastError = device.getDeviceName() + ": " + transport->getLastError();
+        return false;
+    }
+
+    const juce::ScopedLock sl(receiverLock);
+
+    // A receiver joining a running stream picks up the group timeline at the
+    // next packet instead of starting its own
+    if (clock.isRunning())
+        transport->followClock(clock, clockFramePosition);
+
+    int existing = indexOfReceiver(device);
+    if (existing >= 0)
+        receivers.erase(receivers.begin() + existing);
+
+    auto receiver = std::make_shared<Receiver>();
+    receiver->device = device;
+    receiver->transport = std::move(transport);
+    receiver->outputLatencyFrames = outputLatencyFrames;
+    receivers.push_back(std::move(receiver));
+
+    alignReceiverLatencies();
+    return true;
+}
+
+void RaopSessionGroup::removeReceiver(const AirPlayDevice& device)
+{
+    const juce::ScopedLock sl(receiverLock);
+
+    int index = indexOfReceiver(device);
+    if (index >= 0)
+    {
+        receivers.erase(receivers.begin() + index);
+        alignReceiverLatencies();
+    }
+
+    if (receivers.empty())
+        resetClock();
+}
+
+void RaopSessionGroup::removeAllReceivers()
+{
+    const juce::ScopedLock sl(receiverLock);
+    receivers.clear();
+    resetClock();
+
+    // A pass may be encoding; it drops the partial packet before its next one
+    discardPartialPacket = true;
+}
+
+int RaopSessionGroup::getNumReceivers() const
+{
+    const juce::ScopedLock sl(receiverLock);
+    return (int)receivers.size();
+}
+
+bool RaopSessionGroup::hasReceiver(const AirPlayDevice& device) const
+{
+    const juce::ScopedLock sl(receiverLock);
+    return indexOfReceiver(device) >= 0;
+}
+
+juce::StringArray RaopSessionGroup::getReceiverNames() const
+{
+    const juce::ScopedLock sl(receiverLock);
+
+    juce::StringArray names;
+    for (auto& receiver : receivers)
+        names.add(receiver->device.getDeviceName());
+
+    return names;
+}
+
+int RaopSessionGroup::indexOfReceiver(const AirPlayDevice& device) const
+{
+    for (size_t i = 0; i < receivers.size(); ++i)
+        if (receivers[i]->device == device)
+            return (int)i;
+
+    return -1;
+}
+
+void RaopSessionGroup::setLatencyFrames(juce::uint32 frames)
+{
+    const juce::ScopedLock sl(receiverLock);
+
+    latencyFrames = frames;
+    alignReceiverLatencies();
+}
+
+void RaopSessionGroup::setReceiverOutputLatency(const AirPlayDevice& device, juce::uint32 outputLatencyFrames)
+{
+    const juce::ScopedLock sl(receiverLock);
+
+    int index = indexOfReceiver(device);
+    if (index < 0)
+        return;
+
+    receivers[(size_t)index]->outputLatencyFrames = outputLatencyFrames;
+    alignReceiverLatencies();
+}
+
+bool RaopSessionGroup::setEncryptionKey(const juce::uint8* key, const juce::uint8* iv)
+{
+    const juce::ScopedLock el(encodeLock);
+
+    if (!crypto.setKey(key, iv))
+    {
+        const juce::ScopedLock sl(receiverLock);
+        lastError = "Failed to set up AES context";
+        return false;
+    }
+
+    return true;
+}
+
+void RaopSessionGroup::clearEncryption()
+{
+    const juce::ScopedLock el(encodeLock);
+    crypto.clear();
+}
+
+juce::uint32 RaopSessionGroup::getGroupLatencyFrames() const
+{
+    const juce::ScopedLock sl(receiverLock);
+    return groupLatencyFrames;
+}
+
+double RaopSessionGroup::getGroupLatencyMs() const
+{
+    const juce::ScopedLock sl(receiverLock);
+    return groupLatencyFrames * 1000.0 / currentSampleRate;
+}
+
+void RaopSessionGroup::alignReceiverLatencies()
+{
+    // The slowest output sets the pace; faster receivers are asked to buffer
+    // the difference. Their latency never drops below the group target.
+    juce::uint32 slowestOutput = 0;
+    for (auto& receiver : receivers)
+        slowestOutput = juce::jmax(slowestOutput, receiver->outputLatencyFrames);
+
+    groupLatencyFrames = juce::jmax(latencyFrames, RaopTransport::minimumLatencyFrames) + slowestOutput;
+
+    for (auto& receiver : receivers)
+        receiver->transport->setLatencyFrames(groupLatencyFrames - receiver->outputLatencyFrames);
+}
+
+void RaopSessionGroup::resetClock()
+{
+    clock.reset();
+    clockFramePosition = 0;
+}
+
+bool RaopSessionGroup::streamAudio(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    const juce::ScopedLock el(encodeLock);
+
+    if (!beginStreaming())
+        return false;
+
+    bool allSent = true;
+    int numChannels = juce::jmin(buffer.getNumChannels(), packetBuffer.getNumChannels());
+    int position = 0;
+
+    while (position < numSamples)
+    {
+        int toCopy = juce::jmin(numSamples - position, RaopTransport::framesPerPacket - packetFill);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            packetBuffer.copyFrom(ch, packetFill, buffer, ch, position, toCopy);
+
+        packetFill += toCopy;
+        position += toCopy;
+
+        if (packetFill == RaopTransport::framesPerPacket)
+        {
+            allSent = encodeAndSendPacket() && allSent;
+            packetFill = 0;
+        }
+    }
+
+    return allSent;
+}
+
+bool RaopSessionGroup::streamInterleaved(const void* frames, int numSamples, int bitsPerSample)
+{
+    const juce::ScopedLock el(encodeLock);
+
+    if (!beginStreaming())
+        return false;
+
+    bool allSent = true;
+    const int bytesPerFrame = currentNumChannels * bitsPerSample / 8;
+    auto* source = static_cast<const char*>(frames);
+    int position = 0;
+
+    while (position < numSamples)
+    {
+        int toCopy = juce::jmin(numSamples - position, RaopTransport::framesPerPacket - packetFill);
+
+        // Whole packets go to the encoder straight from the caller's frames
+        if (packetFill == 0 && toCopy == RaopTransport::framesPerPacket)
+        {
+            auto startTicks = juce::Time::getHighResolutionTicks();
+            auto encoded = encoder.encodeInterleaved(source + position * bytesPerFrame, toCopy,
+                                                     currentNumChannels, bitsPerSample);
+            allSent = sendEncodedPacket(encoded, startTicks) && allSent;
+            position += toCopy;
+            continue;
+        }
+
+        std::memcpy(packetPcm + packetFill * bytesPerFrame, source + position * bytesPerFrame,
+                    (size_t)(toCopy * bytesPerFrame));
+        packetFill += toCopy;
+        position += toCopy;
+
+        if (packetFill == RaopTransport::framesPerPacket)
+        {
+            auto startTicks = juce::Time::getHighResolutionTicks();
+            auto encoded = encoder.encodeInterleaved(packetPcm, RaopTransport::framesPerPacket,
+                                                     currentNumChannels, bitsPerSample);
+            allSent = sendEncodedPacket(encoded, startTicks) && allSent;
+            packetFill = 0;
+        }
+    }
+
+    return allSent;
+}
+
+bool RaopSessionGroup::beginStreaming()
+{
+    // Called with encodeLock held
+    if (discardPartialPacket.exchange(false))
+        packetFill = 0;
+
+    const juce::ScopedLock sl(receiverLock);
+    return !receivers.empty();
+}
+
+bool RaopSessionGroup::encodeAndSendPacket()
+{
+    auto startTicks = juce::Time::getHighResolutionTicks();
+    auto encoded = encoder.encode(packetBuffer, RaopTransport::framesPerPacket);
+    return sendEncodedPacket(encoded, startTicks);
+}
+
+bool RaopSessionGroup::sendEncodedPacket(juce::MemoryBlock& encoded, juce::int64 startTicks)
+{
+    auto encodedTicks = juce::Time::getHighResolutionTicks();
+
+    // The recording takes the packet before it's encrypted in place. Only
+    // ALAC goes in, as the encoder produced it: a format change, or an ALAC
+    // setup that failed, mid-recording leaves a gap.
+    if (recordingPackets && encoder.getEncodedFormat() == AudioEncoder::Format::ALAC)
+        recorder.addPacket(encoded.getData(), (int)encoded.getSize(), RaopTransport::framesPerPacket);
+
+    // The cipher is only changed under encodeLock, which is held here
+    juce::int64 encryptTicks = 0;
+
+    if (crypto.isEnabled())
+    {
+        auto encryptStartTicks = juce::Time::getHighResolutionTicks();
+        crypto.encryptInPlace(static_cast<juce::uint8*>(encoded.getData()), (int)encoded.getSize());
+        encryptTicks = juce::Time::getHighResolutionTicks() - encryptStartTicks;
+    }
+
+    auto sendStartTicks = juce::Time::getHighResolutionTicks();
+
+    packetsEncoded++;
+    encodeTicks += encodedTicks - startTicks + encryptTicks;
+
+    // receiverLock is only held to take the packet's place on the clock and
+    // the receivers it goes to; the sends run outside it. A receiver removed
+    // meanwhile gets this last packet and is released after it.
+    {
+        const juce::ScopedLock sl(receiverLock);
+
+        if (!clock.isRunning())
+        {
+            clock.start(currentSampleRate);
+            for (auto& receiver : receivers)
+                receiver->transport->followClock(clock, clockFramePosition);
+        }
+
+        sendList.assign(receivers.begin(), receivers.end());
+        clockFramePosition += RaopTransport::framesPerPacket;
+    }
+
+    bool allSent = true;
+    juce::String sendError;
+
+    for (auto& receiver : sendList)
+    {
+        if (receiver->transport->sendAudioPacket(encoded.getData(), (int)encoded.getSize(),
+                                                 RaopTransport::framesPerPacket))
+        {
+            packetsSent++;
+        }
+        else
+        {
+            sendError = receiver->device.getDeviceName() + ": " + receiver->transport->getLastError();
+            allSent = false;
+        }
+    }
+
+    sendList.clear();
+
+    auto sendTicks = juce::Time::getHighResolutionTicks() - sendStartTicks;
+    fanOutTicks += sendTicks;
+
+    if (!allSent)
+    {
+        const juce::ScopedLock sl(receiverLock);
+        lastError = sendError;
+    }
+
+    if (pipelineStats != nullptr)
+    {
+        const int bytesPerSample = encoder.getFormat() == AudioEncoder::Format::PCM_24 ? 3 : 2;
+
+        pipelineStats->recordStage(PipelineStats::Stage::Encode, encodedTicks - startTicks);
+        if (crypto.isEnabled())
+            pipelineStats->recordStage(PipelineStats::Stage::Encrypt, encryptTicks);
+        pipelineStats->recordStage(PipelineStats::Stage::Send, sendTicks);
+        pipelineStats->recordPacket(RaopTransport::framesPerPacket * currentNumChannels * bytesPerSample,
+                                    (int)encoded.getSize());
+    }
+
+    return allSent;
+}
+
+RaopSessionGroup::Stats RaopSessionGroup::getStats() const
+{
+    Stats stats;
+    stats.packetsEncoded = packetsEncoded.load();
+    stats.packetsSent = packetsSent.load();
+    stats.packetsEncrypted = crypto.getPacketsEncrypted();
+
+    if (stats.packetsEncoded > 0)
+    {
+        auto ticksPerMicro = (double)juce::Time::getHighResolutionTicksPerSecond() / 1.0e6;
+        stats.meanEncodeMicros = (double)encodeTicks.load() / ticksPerMicro / (double)stats.packetsEncoded;
+        stats.meanFanOutMicros = (double)fanOutTicks.load() / ticksPerMicro / (double)stats.packetsEncoded;
+    }
+
+    return stats;
+}
+
+RaopTransport::Stats RaopSessionGroup::getReceiverStats(const AirPlayDevice& device) const
+{
+    const juce::ScopedLock sl(receiverLock);
+
+    int index = indexOfReceiver(device);
+    return index >= 0 ? receivers[(size_t)index]->transport->getStats() : RaopTransport::Stats();
+}
+
+int RaopSessionGroup::getReceiverTimingPort(const AirPlayDevice& device) const
+{
+    const juce::ScopedLock sl(receiverLock);
+
+    int index = indexOfReceiver(device);
+    return index >= 0 ? receivers[(size_t)index]->transport->getLocalTimingPort() : 0;
+}
+
+juce::String RaopSessionGroup::getLastError() const
+{
+    const juce::ScopedLock sl(receiverLock);
+    return lastError;
+}
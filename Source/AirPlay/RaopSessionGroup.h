@@ -0,0 +1,162 @@
+#pragma once
+#include <JuceHeader.h>
+#include "RaopTransport.h"
+#include "PipelineStats.h"
+#include "../Audio/AudioEncoder.h"
+#include "../Audio/AlacRecorder.h"
+#include "../Discovery/AirPlayDevice.h"
+
+// Streams one encode to several receivers (multi-room). Audio is gathered
+// into RAOP-sized packets, each packet is encoded exactly once and the same
+// payload is handed to every receiver's transport. Transports keep their own
+// sequence numbers, timestamps and retransmit rings, so adding a receiver
+// only adds the cost of a header write and a send.
+//
+// All transports follow one group clock. Each receiver's own output latency
+// (as reported during session setup) is subtracted from the group latency
+// before it goes into that receiver's sync packets, so every output plays a
+// given sample at the same moment.
+//
+// Control and timing sockets of every receiver are serviced by the shared
+// TransportEventLoopPool rather than by threads of their own.
+class RaopSessionGroup
+{
+public:
+    RaopSessionGroup();
+    ~RaopSessionGroup();
+
+    // The layout is the order of the channels streamed in; the encoder maps
+    // it to ALAC's. Given a channel count, AudioEncoder's layout for it is
+    // assumed. False, with an error, when ALAC can't carry the layout.
+    bool prepare(double sampleRate, const juce::AudioChannelSet& layout);
+    bool prepare(double sampleRate, int numChannels);
+    bool setFormat(AudioEncoder::Format format);
+
+    // Serial by default, as every plugin instance has a group; a group
+    // streaming alone can give surround elements threads of their own
+    void setElementThreads(int numThreads);
+
+    bool addReceiver(const AirPlayDevice& device, const RaopTransport::Endpoint& endpoint,
+                     juce::uint32 outputLatencyFrames = 0);
+    void removeReceiver(const AirPlayDevice& device);
+    void removeAllReceivers();
+
+    int getNumReceivers() const;
+    bool hasReceiver(const AirPlayDevice& device) const;
+    juce::StringArray getReceiverNames() const;
+
+    // Appends audio; every completed packet is encoded and sent to all receivers
+    bool streamAudio(const juce::AudioBuffer<float>& buffer, int numSamples);
+
+    // The same for interleaved 16/24-bit PCM (StreamBuffer's integer
+    // storage), handed to the encoder without converting back to float.
+    // A stream should stick to one of the two; prepare() starts afresh.
+    bool streamInterleaved(const void* frames, int numSamples, int bitsPerSample);
+
+    // Latency target before per-receiver alignment
+    void setLatencyFrames(juce::uint32 frames);
+
+    // The sender picks the AES key and wraps it for each receiver during
+    // setup, so one key serves the whole group: each packet is encrypted
+    // once and the ciphertext is fanned out.
+    bool setEncryptionKey(const juce::uint8* key, const juce::uint8* iv);
+    void clearEncryption();
+
+    // Updates a receiver's reported output latency and realigns the group
+    void setReceiverOutputLatency(const AirPlayDevice& device, juce::uint32 outputLatencyFrames);
+
+    // Target plus the largest receiver output latency: the delay from the
+    // group clock to audible output at every receiver
+    juce::uint32 getGroupLatencyFrames() const;
+    double getGroupLatencyMs() const;
+
+    struct Stats
+    {
+        juce::uint64 packetsEncoded = 0;
+        juce::uint64 packetsSent = 0;
+        juce::uint64 packetsEncrypted = 0;
+        double meanEncodeMicros = 0.0;
+        double meanFanOutMicros = 0.0;
+    };
+
+    Stats getStats() const;
+    RaopTransport::Stats getReceiverStats(const AirPlayDevice& device) const;
+
+    // Records the packets sent, as encoded and before encryption, to an
+    // ALAC file: CAF, or MPEG-4 if it ends .m4a. Disk writes happen on the
+    // recorder's thread, never the streaming one. Needs the encoder to be
+    // producing ALAC; prepare() ends the recording.
+    bool startRecording(const juce::File& file);
+    bool stopRecording();
+    bool isRecording() const { return recorder.isRecording(); }
+    AlacRecorder::Stats getRecordingStats() const { return recorder.getStats(); }
+
+    // Encode, encrypt and send times and packet sizes are also recorded
+    // here when set. Not owned; set before streaming starts.
+    void setPipelineStats(PipelineStats* stats) { pipelineStats = stats; }
+
+    // Local timing port to announce to the receiver during session setup
+    int getReceiverTimingPort(const AirPlayDevice& device) const;
+
+    juce::String getLastError() const;
+
+private:
+    struct Receiver
+    {
+        AirPlayDevice device;
+        std::unique_ptr<RaopTransport> transport;
+        juce::uint32 outputLatencyFrames = 0;
+    };
+
+    bool beginStreaming();
+    bool encodeAndSendPacket();
+    bool sendEncodedPacket(juce::MemoryBlock& encoded, juce::int64 startTicks);
+    int indexOfReceiver(const AirPlayDevice& device) const;
+    void alignReceiverLatencies();
+    bool checkEncodedFormat();
+    void resetClock();
+
+    juce::SharedResourcePointer<TransportEventLoopPool> eventLoops;
+
+    // encodeLock covers the packet being assembled, the encoder and the
+    // cipher, and is held for a whole streamAudio() call; receiverLock covers
+    // the receivers and the clock, and is only held briefly: packets are
+    // encrypted and sent outside it, to a copy of the list taken per packet,
+    // so queries and receiver changes never wait for an encode or a send.
+    // Taken in that order.
+    juce::CriticalSection encodeLock;
+    juce::CriticalSection receiverLock;
+    std::vector<std::shared_ptr<Receiver>> receivers;
+
+    // The receivers a packet goes to, under encodeLock
+    std::vector<std::shared_ptr<Receiver>> sendList;
+    std::atomic<bool> discardPartialPacket{false};
+
+    AudioEncoder encoder;
+    RaopCrypto crypto;
+
+    // Packets go to the recorder while this is set, under encodeLock
+    AlacRecorder recorder;
+    bool recordingPackets = false;
+    juce::AudioBuffer<float> packetBuffer;
+    juce::HeapBlock<char> packetPcm;
+    int packetFill = 0;
+
+    // Written by prepare() under both locks, so either is enough to read them
+    double currentSampleRate = 44100.0;
+    int currentNumChannels = 2;
+    juce::uint32 latencyFrames = RaopTransport::defaultLatencyFrames;
+    juce::uint32 groupLatencyFrames = RaopTransport::defaultLatencyFrames;
+
+    RaopPacketPacer clock;
+    juce::uint64 clockFramePosition = 0;
+
+    std::atomic<juce::uint64> packetsEncoded{0};
+    std::atomic<juce::uint64> packetsSent{0};
+    std::atomic<juce::int64> encodeTicks{0};
+    std::atomic<juce::int64> fanOutTicks{0};
+    PipelineStats* pipelineStats = nullptr;
+    juce::String lastError;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RaopSessionGroup)
+};
@@ -0,0 +1,251 @@
+#include "RaopTiming.h"
+#include "RtpPacket.h"
+#include <chrono>
+
+namespace
+{
+    // Seconds between the NTP epoch (1900) and the Unix epoch (1970)
+    constexpr juce::uint64 ntpEpochOffset = 2208988800ull;
+
+    double ticksToMicros(juce::int64 ticks)
+    {
+        return (double)ticks * 1.0e6 / (double)juce::Time::getHighResolutionTicksPerSecond();
+    }
+
+    void updateMaximum(std::atomic<juce::int64>& maximum, juce::int64 value)
+    {
+        auto current = maximum.load();
+        while (value > current && !maximum.compare_exchange_weak(current, value)) {}
+    }
+}
+
+//==============================================================================
+NtpTime NtpTime::now()
+{
+    auto sinceUnixEpoch = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    return fromMicroseconds((juce::uint64)sinceUnixEpoch + ntpEpochOffset * 1000000ull);
+}
+
+NtpTime NtpTime::fromMicroseconds(juce::uint64 microsecondsSince1900)
+{
+    NtpTime t;
+    t.seconds = (juce::uint32)(microsecondsSince1900 / 1000000ull);
+    t.fraction = (juce::uint32)(((microsecondsSince1900 % 1000000ull) << 32) / 1000000ull);
+    return t;
+}
+
+juce::uint64 NtpTime::toMicroseconds() const
+{
+    return (juce::uint64)seconds * 1000000ull + (((juce::uint64)fraction * 1000000ull) >> 32);
+}
+
+NtpTime NtpTime::plusSeconds(double offsetSeconds) const
+{
+    auto micros = (juce::int64)toMicroseconds() + (juce::int64)std::llround(offsetSeconds * 1.0e6);
+    return fromMicroseconds((juce::uint64)juce::jmax((juce::int64)0, micros));
+}
+
+void NtpTime::write(juce::uint8* dest) const
+{
+    RtpPacket::writeUInt32(dest, seconds);
+    RtpPacket::writeUInt32(dest + 4, fraction);
+}
+
+NtpTime NtpTime::read(const juce::uint8* src)
+{
+    NtpTime t;
+    t.seconds = RtpPacket::readUInt32(src);
+    t.fraction = RtpPacket::readUInt32(src + 4);
+    return t;
+}
+
+//==============================================================================
+RaopTimingResponder::RaopTimingResponder() : Thread("RaopTiming")
+{
+}
+
+RaopTimingResponder::~RaopTimingResponder()
+{
+    stop();
+}
+
+bool RaopTimingResponder::start(int localPort, TransportEventLoop* loop)
+{
+    stop();
+
+    socket = std::make_unique<juce::DatagramSocket>();
+    if (!RtpPacket::bindExclusive(*socket, localPort))
+    {
+        socket.reset();
+        return false;
+    }
+
+    boundPort = socket->getBoundPort();
+
+    if (loop != nullptr)
+    {
+        if (!loop->addSocket(socket->getRawSocketHandle(), [this] { answerPendingRequests(); }))
+        {
+            socket.reset();
+            boundPort = 0;
+            return false;
+        }
+
+        eventLoop = loop;
+        return true;
+    }
+
+    startThread(juce::Thread::Priority::high);
+    return true;
+}
+
+void RaopTimingResponder::stop()
+{
+    if (eventLoop != nullptr && socket != nullptr)
+        eventLoop->removeSocket(socket->getRawSocketHandle());
+
+    eventLoop = nullptr;
+    stopThread(1000);
+    socket.reset();
+    boundPort = 0;
+}
+
+int RaopTimingResponder::getLocalPort() const
+{
+    return boundPort;
+}
+
+int RaopTimingResponder::buildResponse(const juce::uint8* request, int requestSize,
+                                       NtpTime receivedAt, juce::uint8* response)
+{
+    if (requestSize < RtpPacket::timingPacketSize
+        || RtpPacket::getPayloadType(request) != RtpPacket::timingRequest)
+        return 0;
+
+    std::memset(response, 0, RtpPacket::timingPacketSize);
+    response[0] = 0x80;
+    response[1] = RtpPacket::timingResponse | RtpPacket::markerBit;
+    RtpPacket::writeUInt16(response + 2, 7);
+
+    // Reference time = the requester's send time, echoed back unchanged
+    std::memcpy(response + 8, request + 24, 8);
+    receivedAt.write(response + 16);
+    NtpTime::now().write(response + 24);
+
+    return RtpPacket::timingPacketSize;
+}
+
+void RaopTimingResponder::recordResponse(juce::int64 responseTicks)
+{
+    requestsAnswered++;
+    totalResponseTicks += responseTicks;
+    updateMaximum(maxResponseTicks, responseTicks);
+}
+
+RaopTimingResponder::Stats RaopTimingResponder::getStats() const
+{
+    Stats stats;
+    stats.requestsAnswered = requestsAnswered.load();
+
+    if (stats.requestsAnswered > 0)
+        stats.meanResponseMicros = ticksToMicros(totalResponseTicks.load()) / stats.requestsAnswered;
+
+    stats.maxResponseMicros = ticksToMicros(maxResponseTicks.load());
+    return stats;
+}
+
+void RaopTimingResponder::resetStats()
+{
+    requestsAnswered = 0;
+    totalResponseTicks = 0;
+    maxResponseTicks = 0;
+}
+
+void RaopTimingResponder::run()
+{
+    while (!threadShouldExit())
+    {
+        if (socket->waitUntilReady(true, 100) > 0)
+            answerPendingRequests();
+    }
+}
+
+void RaopTimingResponder::answerPendingRequests()
+{
+    juce::uint8 request[128];
+    juce::uint8 response[RtpPacket::timingPacketSize];
+
+    while (socket->waitUntilReady(true, 0) > 0)
+    {
+        juce::String senderAddress;
+        int senderPort = 0;
+        int size = socket->read(request, (int)sizeof(request), false, senderAddress, senderPort);
+
+        // Stamp the arrival as early as possible; the reply carries it
+        auto receivedTicks = juce::Time::getHighResolutionTicks();
+        auto receivedAt = NtpTime::now();
+
+        if (size <= 0)
+            break;
+
+        int responseSize = buildResponse(request, size, receivedAt, response);
+        if (responseSize == 0)
+            continue;
+
+        if (socket->write(senderAddress, senderPort, response, responseSize) == responseSize)
+            recordResponse(juce::Time::getHighResolutionTicks() - receivedTicks);
+    }
+}
+
+//==============================================================================
+void RaopSyncScheduler::reset(juce::uint32 intervalFrames)
+{
+    interval = juce::jmax((juce::uint32)1, intervalFrames);
+    nextDueTimestamp = 0;
+    firstPacket = true;
+}
+
+bool RaopSyncScheduler::isDue(juce::uint32 rtpTimestamp) const
+{
+    // Signed difference so the schedule survives 32-bit timestamp wrap-around
+    return firstPacket || (juce::int32)(rtpTimestamp - nextDueTimestamp) >= 0;
+}
+
+int RaopSyncScheduler::buildPacket(juce::uint8* dest, juce::uint32 rtpTimestamp,
+                                   juce::uint32 latencyFrames, NtpTime playbackTime)
+{
+    // The first sync of a stream carries the extension bit so the receiver
+    // resets its clock recovery
+    dest[0] = firstPacket ? 0x90 : 0x80;
+    dest[1] = RtpPacket::sync | RtpPacket::markerBit;
+    RtpPacket::writeUInt16(dest + 2, 7);
+    RtpPacket::writeUInt32(dest + 4, rtpTimestamp - latencyFrames);
+    playbackTime.write(dest + 8);
+    RtpPacket::writeUInt32(dest + 16, rtpTimestamp);
+
+    firstPacket = false;
+    nextDueTimestamp = rtpTimestamp + interval;
+    return RtpPacket::syncPacketSize;
+}
+
+void RaopSyncScheduler::recordLateness(juce::int64 latenessTicks)
+{
+    latenessTicks = juce::jmax((juce::int64)0, latenessTicks);
+    packetsSent++;
+    totalLatenessTicks += latenessTicks;
+    updateMaximum(maxLatenessTicks, latenessTicks);
+}
+
+RaopSyncScheduler::Stats RaopSyncScheduler::getStats() const
+{
+    Stats stats;
+    stats.packetsSent = packetsSent.load();
+
+    if (stats.packetsSent > 0)
+        stats.meanLatenessMicros = ticksToMicros(totalLatenessTicks.load()) / stats.packetsSent;
+
+    stats.maxLatenessMicros = ticksToMicros(maxLatenessTicks.load());
+    return stats;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <JuceHeader.h>
+#include "TransportEventLoop.h"
+
+// 64-bit NTP timestamp (seconds since 1900 plus a 32-bit binary fraction),
+// the clock format used by RAOP timing and sync packets.
+struct NtpTime
+{
+    juce::uint32 seconds = 0;
+    juce::uint32 fraction = 0;
+
+    static NtpTime now();
+    static NtpTime fromMicroseconds(juce::uint64 microsecondsSince1900);
+    juce::uint64 toMicroseconds() const;
+
+    NtpTime plusSeconds(double offsetSeconds) const;
+
+    void write(juce::uint8* dest) const;
+    static NtpTime read(const juce::uint8* src);
+};
+
+// Answers timing requests from a receiver on the timing channel.
+// Receivers poll this every few seconds to estimate clock offset and network
+// delay, so the turnaround between receiving a request and sending the reply
+// is measured and exposed: the lower and steadier it is, the smaller the
+// latency target a receiver can be asked to hold.
+class RaopTimingResponder : public juce::Thread
+{
+public:
+    RaopTimingResponder();
+    ~RaopTimingResponder() override;
+
+    // Binds the timing socket (0 = any free port) and starts answering
+    // requests, on the given event loop if there is one, otherwise on this
+    // object's own thread
+    bool start(int localPort = 0, TransportEventLoop* eventLoop = nullptr);
+    void stop();
+
+    int getLocalPort() const;
+
+    struct Stats
+    {
+        int requestsAnswered = 0;
+        double meanResponseMicros = 0.0;
+        double maxResponseMicros = 0.0;
+    };
+
+    Stats getStats() const;
+    void resetStats();
+
+    // Fills a 32-byte timing response for the given request. Returns the
+    // response size, or 0 if the request is malformed.
+    static int buildResponse(const juce::uint8* request, int requestSize,
+                             NtpTime receivedAt, juce::uint8* response);
+
+    // Records one answered request; shared with socket handlers that answer
+    // timing requests without this thread
+    void recordResponse(juce::int64 responseTicks);
+
+private:
+    void run() override;
+    void answerPendingRequests();
+
+    std::unique_ptr<juce::DatagramSocket> socket;
+    TransportEventLoop* eventLoop = nullptr;
+    int boundPort = 0;
+
+    std::atomic<int> requestsAnswered{0};
+    std::atomic<juce::int64> totalResponseTicks{0};
+    std::atomic<juce::int64> maxResponseTicks{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RaopTimingResponder)
+};
+
+// Decides when to send sync packets on the control channel and builds them.
+// A sync packet maps the RTP timestamp that should be playing "now" (the next
+// timestamp minus the latency target) to an NTP time. The NTP time is taken
+// from the packet pacer's schedule rather than the wall clock at send time,
+// so scheduling jitter in the streaming thread does not leak into the
+// receiver's clock recovery.
+class RaopSyncScheduler
+{
+public:
+    void reset(juce::uint32 intervalFrames);
+
+    // True for the first packet of a stream and then once per interval
+    bool isDue(juce::uint32 rtpTimestamp) const;
+
+    // Builds a 20-byte sync packet and advances the schedule past rtpTimestamp
+    int buildPacket(juce::uint8* dest, juce::uint32 rtpTimestamp, juce::uint32 latencyFrames,
+                    NtpTime playbackTime);
+
+    // How late the packet was sent relative to the pacer's schedule
+    void recordLateness(juce::int64 latenessTicks);
+
+    struct Stats
+    {
+        int packetsSent = 0;
+        double meanLatenessMicros = 0.0;
+        double maxLatenessMicros = 0.0;
+    };
+
+    Stats getStats() const;
+
+private:
+    juce::uint32 interval = 44100;
+    juce::uint32 nextDueTimestamp = 0;
+    bool firstPacket = true;
+
+    std::atomic<int> packetsSent{0};
+    std::atomic<juce::int64> totalLatenessTicks{0};
+    std::atomic<juce::int64> maxLatenessTicks{0};
+};
@@ -0,0 +1,322 @@
+#include "RaopTransport.h"
+#include "RtpPacket.h"
+
+//==============================================================================
+void RaopPacketPacer::start(double sampleRate)
+{
+    rate = sampleRate;
+    startTicks = juce::Time::getHighResolutionTicks();
+    startTime = NtpTime::now();
+    running = true;
+}
+
+void RaopPacketPacer::reset()
+{
+    running = false;
+}
+
+juce::int64 RaopPacketPacer::getDueTicks(juce::uint64 framePosition) const
+{
+    auto ticksPerSecond = (double)juce::Time::getHighResolutionTicksPerSecond();
+    return startTicks + (juce::int64)((double)framePosition * ticksPerSecond / rate);
+}
+
+NtpTime RaopPacketPacer::getDueTime(juce::uint64 framePosition) const
+{
+    return startTime.plusSeconds((double)framePosition / rate);
+}
+
+int RaopPacketPacer::getMillisecondsUntilDue(juce::uint64 framePosition) const
+{
+    if (!running)
+        return 0;
+
+    auto remaining = getDueTicks(framePosition) - juce::Time::getHighResolutionTicks();
+    return (int)(remaining * 1000 / juce::Time::getHighResolutionTicksPerSecond());
+}
+
+//==============================================================================
+RaopTransport::RaopTransport()
+{
+}
+
+RaopTransport::~RaopTransport()
+{
+    close();
+}
+
+bool RaopTransport::open(const Endpoint& newEndpoint, double newSampleRate, TransportEventLoop* loop)
+{
+    close();
+
+    endpoint = newEndpoint;
+    sampleRate = newSampleRate;
+
+    audioSocket = std::make_unique<juce::DatagramSocket>();
+    controlSocket = std::make_unique<juce::DatagramSocket>();
+
+    if (!RtpPacket::bindExclusive(*audioSocket, 0) || !RtpPacket::bindExclusive(*controlSocket, 0))
+    {
+        lastError = "Failed to bind RTP sockets";
+        close();
+        return false;
+    }
+
+    if (!timingResponder.start(0, loop))
+    {
+        lastError = "Failed to bind timing socket";
+        close();
+        return false;
+    }
+
+    auto& random = juce::Random::getSystemRandom();
+    sequenceNumber = (juce::uint16)random.nextInt(65536);
+    rtpTimestamp = (juce::uint32)random.nextInt();
+    ssrc = (juce::uint32)random.nextInt();
+    framesSent = 0;
+    firstPacket = true;
+
+    syncScheduler.reset((juce::uint32)sampleRate);
+    pacer.reset();
+
+    retransmitData.calloc((size_t)(retransmitRingSize * retransmitSlotBytes));
+    retransmitSlots.assign(retransmitRingSize, RetransmitSlot());
+
+    if (loop != nullptr)
+    {
+        if (!loop->addSocket(controlSocket->getRawSocketHandle(), [this] { serviceControlChannel(); }))
+        {
+            lastError = "Failed to register control socket";
+            close();
+            return false;
+        }
+
+        eventLoop = loop;
+    }
+
+    lastError = "";
+    return true;
+}
+
+void RaopTransport::close()
+{
+    if (eventLoop != nullptr && controlSocket != nullptr)
+        eventLoop->removeSocket(controlSocket->getRawSocketHandle());
+
+    eventLoop = nullptr;
+    timingResponder.stop();
+    audioSocket.reset();
+    controlSocket.reset();
+    pacer.reset();
+}
+
+bool RaopTransport::isOpen() const
+{
+    return audioSocket != nullptr;
+}
+
+void RaopTransport::setLatencyFrames(juce::uint32 frames)
+{
+    latencyFrames = juce::jmax(minimumLatencyFrames, frames);
+}
+
+juce::uint32 RaopTransport::getLatencyFrames() const
+{
+    return latencyFrames.load();
+}
+
+double RaopTransport::getLatencyMs() const
+{
+    return latencyFrames.load() * 1000.0 / sampleRate;
+}
+
+bool RaopTransport::sendAudioPacket(const void* payload, int payloadSize, int numFrames)
+{
+    if (!isOpen() || payloadSize <= 0)
+        return false;
+
+    if (eventLoop == nullptr)
+        serviceControlChannel();
+
+    if (!pacer.isRunning())
+        pacer.start(sampleRate);
+
+    if (syncScheduler.isDue(rtpTimestamp))
+        sendSyncPacket();
+
+    // Build the packet straight into its retransmit slot so the ring costs
+    // no extra copy; packets too big for a slot are sent but not kept
+    int packetSize = RtpPacket::headerSize + payloadSize;
+    auto& slot = retransmitSlots[(size_t)(sequenceNumber % retransmitRingSize)];
+    juce::uint8* packet = nullptr;
+
+    {
+        const juce::SpinLock::ScopedLockType ringLock(retransmitLock);
+        slot.sequence = sequenceNumber;
+
+        if (packetSize <= retransmitSlotBytes)
+        {
+            packet = getSlotData(sequenceNumber);
+            slot.size = packetSize;
+        }
+        else
+        {
+            oversizePacket.resize((size_t)packetSize);
+            packet = oversizePacket.data();
+            slot.size = 0;
+        }
+
+        RtpPacket::writeAudioHeader(packet, sequenceNumber, rtpTimestamp, ssrc, firstPacket);
+        std::memcpy(packet + RtpPacket::headerSize, payload, (size_t)payloadSize);
+
+        if (crypto.isEnabled())
+            crypto.encryptInPlace(packet + RtpPacket::headerSize, payloadSize);
+    }
+
+    int written = audioSocket->write(endpoint.host, endpoint.audioPort, packet, packetSize);
+
+    sequenceNumber++;
+    rtpTimestamp += (juce::uint32)numFrames;
+    framesSent += (juce::uint64)numFrames;
+    firstPacket = false;
+
+    if (written != packetSize)
+    {
+        lastError = "Failed to send audio packet";
+        return false;
+    }
+
+    packetsSent++;
+    bytesSent += (juce::uint64)packetSize;
+    return true;
+}
+
+bool RaopTransport::setEncryptionKey(const juce::uint8* key, const juce::uint8* iv)
+{
+    if (!crypto.setKey(key, iv))
+    {
+        lastError = "Failed to set up AES context";
+        return false;
+    }
+
+    return true;
+}
+
+void RaopTransport::clearEncryption()
+{
+    crypto.clear();
+}
+
+void RaopTransport::serviceControlChannel()
+{
+    if (!controlSocket)
+        return;
+
+    juce::uint8 request[64];
+
+    while (controlSocket->waitUntilReady(true, 0) > 0)
+    {
+        int size = controlSocket->read(request, (int)sizeof(request), false);
+        if (size <= 0)
+            break;
+
+        if (size >= 8 && RtpPacket::getPayloadType(request) == RtpPacket::retransmitRequest)
+            handleRetransmitRequest(request, size);
+    }
+}
+
+void RaopTransport::handleRetransmitRequest(const juce::uint8* request, int /*size*/)
+{
+    auto firstSequence = RtpPacket::readUInt16(request + 4);
+    int count = juce::jmin((int)RtpPacket::readUInt16(request + 6), retransmitRingSize);
+
+    // Retransmits go out on the control channel: a 4-byte header followed by
+    // the original RTP packet
+    juce::uint8 response[4 + retransmitSlotBytes];
+
+    for (int i = 0; i < count; ++i)
+    {
+        auto sequence = (juce::uint16)(firstSequence + i);
+        int packetSize = 0;
+
+        {
+            const juce::SpinLock::ScopedLockType ringLock(retransmitLock);
+            const auto& slot = retransmitSlots[(size_t)(sequence % retransmitRingSize)];
+
+            if (slot.size > 0 && slot.sequence == sequence)
+            {
+                packetSize = slot.size;
+                std::memcpy(response + 4, getSlotData(sequence), (size_t)packetSize);
+            }
+        }
+
+        if (packetSize == 0)
+        {
+            retransmitMisses++;
+            continue;
+        }
+
+        response[0] = 0x80;
+        response[1] = RtpPacket::retransmitResponse | RtpPacket::markerBit;
+        RtpPacket::writeUInt16(response + 2, sequence);
+
+        if (controlSocket->write(endpoint.host, endpoint.controlPort, response, 4 + packetSize) == 4 + packetSize)
+            packetsRetransmitted++;
+    }
+}
+
+juce::uint8* RaopTransport::getSlotData(juce::uint16 sequence)
+{
+    return retransmitData.get() + (size_t)(sequence % retransmitRingSize) * retransmitSlotBytes;
+}
+
+bool RaopTransport::sendSyncPacket()
+{
+    juce::uint8 packet[RtpPacket::syncPacketSize];
+    int size = syncScheduler.buildPacket(packet, rtpTimestamp, latencyFrames.load(),
+                                         pacer.getDueTime(framesSent));
+
+    if (controlSocket->write(endpoint.host, endpoint.controlPort, packet, size) != size)
+        return false;
+
+    syncScheduler.recordLateness(juce::Time::getHighResolutionTicks() - pacer.getDueTicks(framesSent));
+    return true;
+}
+
+int RaopTransport::getMillisecondsUntilNextPacket() const
+{
+    return pacer.getMillisecondsUntilDue(framesSent);
+}
+
+void RaopTransport::followClock(const RaopPacketPacer& clock, juce::uint64 framePosition)
+{
+    pacer = clock;
+    framesSent = framePosition;
+}
+
+int RaopTransport::getLocalControlPort() const
+{
+    return controlSocket ? controlSocket->getBoundPort() : 0;
+}
+
+int RaopTransport::getLocalTimingPort() const
+{
+    return timingResponder.getLocalPort();
+}
+
+RaopTransport::Stats RaopTransport::getStats() const
+{
+    Stats stats;
+    stats.packetsSent = packetsSent.load();
+    stats.bytesSent = bytesSent.load();
+    stats.packetsRetransmitted = packetsRetransmitted.load();
+    stats.retransmitMisses = retransmitMisses.load();
+    stats.timing = timingResponder.getStats();
+    stats.sync = syncScheduler.getStats();
+    return stats;
+}
+
+juce::String RaopTransport::getLastError() const
+{
+    return lastError;
+}
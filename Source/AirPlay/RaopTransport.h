@@ -0,0 +1,151 @@
+#pragma once
+#include <JuceHeader.h>
+#include "RaopTiming.h"
+#include "RaopCrypto.h"
+
+// Schedules packets against the stream's sample clock. Packet N is due at
+// start + framePosition / sampleRate; the same schedule provides the NTP time
+// stamped into sync packets.
+class RaopPacketPacer
+{
+public:
+    void start(double sampleRate);
+    void reset();
+    bool isRunning() const { return running; }
+
+    juce::int64 getDueTicks(juce::uint64 framePosition) const;
+    NtpTime getDueTime(juce::uint64 framePosition) const;
+    int getMillisecondsUntilDue(juce::uint64 framePosition) const;
+
+private:
+    double rate = 44100.0;
+    juce::int64 startTicks = 0;
+    NtpTime startTime;
+    bool running = false;
+};
+
+// UDP side of a RAOP session: RTP audio packets to the receiver's audio port,
+// sync packets on the control channel and a timing responder for the
+// receiver's clock-offset requests. The RTSP handshake that negotiates the
+// ports is not part of this class; open() takes the negotiated endpoint.
+class RaopTransport
+{
+public:
+    struct Endpoint
+    {
+        juce::String host;
+        int audioPort = 0;
+        int controlPort = 0;
+        int timingPort = 0;
+    };
+
+    static constexpr int framesPerPacket = 352;
+    static constexpr juce::uint32 defaultLatencyFrames = 88200;  // ~2 s, the usual RAOP default
+    static constexpr juce::uint32 minimumLatencyFrames = 4410;   // 100 ms
+    static constexpr int retransmitRingSize = 256;                // ~2 s of packets
+    static constexpr int retransmitSlotBytes = 2048;
+
+    RaopTransport();
+    ~RaopTransport();
+
+    // With an event loop, the control and timing sockets are serviced by the
+    // loop; without one the timing responder runs its own thread and
+    // retransmit requests are answered before each audio packet.
+    bool open(const Endpoint& endpoint, double sampleRate = 44100.0, TransportEventLoop* eventLoop = nullptr);
+    void close();
+    bool isOpen() const;
+
+    // Latency target the receiver is asked to hold, carried in every sync packet
+    void setLatencyFrames(juce::uint32 frames);
+    juce::uint32 getLatencyFrames() const;
+    double getLatencyMs() const;
+
+    // AES key and IV negotiated for this session. Payloads are then
+    // encrypted in place in the packet buffer before sending. Transports fed
+    // by a RaopSessionGroup get already encrypted payloads instead.
+    bool setEncryptionKey(const juce::uint8* key, const juce::uint8* iv);
+    void clearEncryption();
+    bool isEncrypting() const { return crypto.isEnabled(); }
+
+    // Sends one encoded packet of numFrames frames. A sync packet is sent
+    // first whenever the packet's timestamp crosses the sync interval.
+    // Pending retransmit requests on the control channel are answered first.
+    bool sendAudioPacket(const void* payload, int payloadSize, int numFrames);
+
+    // Answers any retransmit requests waiting on the control socket. Safe to
+    // call from the event loop while packets are being sent.
+    void serviceControlChannel();
+
+    // Time until the next packet is due according to the pacer (<= 0: send now)
+    int getMillisecondsUntilNextPacket() const;
+
+    // Puts this transport on a shared timeline: the next packet is treated as
+    // frame framePosition of clock, so sync packets from every transport that
+    // follows the same clock map the same audio to the same NTP time, even
+    // for receivers that join mid-stream.
+    void followClock(const RaopPacketPacer& clock, juce::uint64 framePosition);
+
+    int getLocalControlPort() const;
+    int getLocalTimingPort() const;
+    juce::uint32 getNextTimestamp() const { return rtpTimestamp; }
+    juce::uint16 getNextSequenceNumber() const { return sequenceNumber; }
+
+    struct Stats
+    {
+        juce::uint64 packetsSent = 0;
+        juce::uint64 bytesSent = 0;
+        juce::uint64 packetsRetransmitted = 0;
+        juce::uint64 retransmitMisses = 0;
+        RaopTimingResponder::Stats timing;
+        RaopSyncScheduler::Stats sync;
+    };
+
+    Stats getStats() const;
+    juce::String getLastError() const;
+
+private:
+    bool sendSyncPacket();
+    void handleRetransmitRequest(const juce::uint8* request, int size);
+
+    // Sent packets are kept, header included, so retransmits resend the
+    // original bytes. Slots are indexed by sequence number.
+    struct RetransmitSlot
+    {
+        juce::uint16 sequence = 0;
+        int size = 0;
+    };
+
+    juce::uint8* getSlotData(juce::uint16 sequence);
+
+    Endpoint endpoint;
+    double sampleRate = 44100.0;
+
+    std::unique_ptr<juce::DatagramSocket> audioSocket;
+    std::unique_ptr<juce::DatagramSocket> controlSocket;
+    TransportEventLoop* eventLoop = nullptr;
+    RaopTimingResponder timingResponder;
+    RaopSyncScheduler syncScheduler;
+    RaopPacketPacer pacer;
+    RaopCrypto crypto;
+
+    juce::uint16 sequenceNumber = 0;
+    juce::uint32 rtpTimestamp = 0;
+    juce::uint32 ssrc = 0;
+    juce::uint64 framesSent = 0;
+    bool firstPacket = true;
+    std::atomic<juce::uint32> latencyFrames{defaultLatencyFrames};
+
+    // Guards the ring when retransmits are answered on the event loop
+    juce::SpinLock retransmitLock;
+    juce::HeapBlock<juce::uint8> retransmitData;
+    std::vector<RetransmitSlot> retransmitSlots;
+    std::vector<juce::uint8> oversizePacket;
+
+    std::atomic<juce::uint64> packetsSent{0};
+    std::atomic<juce::uint64> bytesSent{0};
+    std::atomic<juce::uint64> packetsRetransmitted{0};
+    std::atomic<juce::uint64> retransmitMisses{0};
+    juce::String lastError;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RaopTransport)
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <JuceHeader.h>
+
+#if JUCE_WINDOWS
+ #include <winsock2.h>
+#else
+ #include <sys/socket.h>
+#endif
+
+// Byte-level helpers for the RTP/RAOP packets exchanged on the audio, control
+// and timing channels. All multi-byte fields are big-endian on the wire.
+namespace RtpPacket
+{
+    // RTP payload types used by RAOP (marker bit cleared)
+    enum PayloadType : juce::uint8
+    {
+        timingRequest = 0x52,
+        timingResponse = 0x53,
+        sync = 0x54,
+        retransmitRequest = 0x55,
+        retransmitResponse = 0x56,
+        audioData = 0x60
+    };
+
+    constexpr int headerSize = 12;
+    constexpr int timingPacketSize = 32;
+    constexpr int syncPacketSize = 20;
+    constexpr juce::uint8 markerBit = 0x80;
+
+    inline void writeUInt16(juce::uint8* dest, juce::uint16 value)
+    {
+        dest[0] = (juce::uint8)(value >> 8);
+        dest[1] = (juce::uint8)(value & 0xff);
+    }
+
+    inline void writeUInt32(juce::uint8* dest, juce::uint32 value)
+    {
+        dest[0] = (juce::uint8)(value >> 24);
+        dest[1] = (juce::uint8)((value >> 16) & 0xff);
+        dest[2] = (juce::uint8)((value >> 8) & 0xff);
+        dest[3] = (juce::uint8)(value & 0xff);
+    }
+
+    inline juce::uint16 readUInt16(const juce::uint8* src)
+    {
+        return (juce::uint16)((src[0] << 8) | src[1]);
+    }
+
+    inline juce::uint32 readUInt32(const juce::uint8* src)
+    {
+        return ((juce::uint32)src[0] << 24) | ((juce::uint32)src[1] << 16)
+             | ((juce::uint32)src[2] << 8) | (juce::uint32)src[3];
+    }
+
+    inline juce::uint8 getPayloadType(const juce::uint8* packet)
+    {
+        return packet[1] & 0x7f;
+    }
+
+    // Writes the 12-byte RTP header used for audio data packets
+    inline void writeAudioHeader(juce::uint8* dest, juce::uint16 sequence, juce::uint32 timestamp,
+                                 juce::uint32 ssrc, bool marker)
+    {
+        dest[0] = 0x80;
+        dest[1] = (juce::uint8)(audioData | (marker ? markerBit : 0));
+        writeUInt16(dest + 2, sequence);
+        writeUInt32(dest + 4, timestamp);
+        writeUInt32(dest + 8, ssrc);
+    }
+
+    // JUCE makes datagram sockets reusable, which lets Linux hand the same
+    // ephemeral port to two sockets; RTP channels bind exclusively instead
+    inline bool bindExclusive(juce::DatagramSocket& socket, int port, const juce::String& address = {})
+    {
+        const int off = 0;
+        const auto* value = reinterpret_cast<const char*>(&off);
+
+        setsockopt(socket.getRawSocketHandle(), SOL_SOCKET, SO_REUSEADDR, value, sizeof(off));
+       #ifdef SO_REUSEPORT
+        setsockopt(socket.getRawSocketHandle(), SOL_SOCKET, SO_REUSEPORT, value, sizeof(off));
+       #endif
+
+        return socket.bindToPort(port, address);
+    }
+}
@@ -0,0 +1,367 @@
+#include "StreamScheduler.h"
+
+#if JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#else
+ #include <semaphore.h>
+ #include <cerrno>
+#endif
+
+// Counts wakeups for the workers. Posting never blocks or allocates, so the
+// audio thread can wake a worker without touching queueMutex.
+class StreamScheduler::Semaphore
+{
+public:
+   #if JUCE_MAC || JUCE_IOS
+    Semaphore() : semaphore(dispatch_semaphore_create(0)) {}
+    ~Semaphore() { dispatch_release(semaphore); }
+
+    void post() { dispatch_semaphore_signal(semaphore); }
+    void wait() { dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER); }
+
+private:
+    dispatch_semaphore_t semaphore;
+   #else
+    Semaphore() { sem_init(&semaphore, 0, 0); }
+    ~Semaphore() { sem_destroy(&semaphore); }
+
+    void post() { sem_post(&semaphore); }
+
+    void wait()
+    {
+        while (sem_wait(&semaphore) != 0 && errno == EINTR)
+        {
+        }
+    }
+
+private:
+    sem_t semaphore;
+   #endif
+};
+
+//==============================================================================
+class StreamScheduler::Worker : public juce::Thread
+{
+public:
+    Worker(StreamScheduler& ownerToUse, int index)
+        : Thread("StreamWorker " + juce::String(index)), owner(ownerToUse)
+    {
+    }
+
+    void run() override
+    {
+        owner.runWorker(*this);
+    }
+
+private:
+    StreamScheduler& owner;
+};
+
+//==============================================================================
+class StreamScheduler::TimerThread : public juce::Thread
+{
+public:
+    explicit TimerThread(StreamScheduler& ownerToUse)
+        : Thread("StreamTimer"), owner(ownerToUse)
+    {
+    }
+
+    void run() override
+    {
+        owner.runTimer(*this);
+    }
+
+private:
+    StreamScheduler& owner;
+};
+
+//==============================================================================
+StreamScheduler::StreamScheduler() : StreamScheduler(getDefaultNumWorkers())
+{
+}
+
+StreamScheduler::StreamScheduler(int numWorkers) : wakeups(std::make_unique<Semaphore>())
+{
+    for (int i = 0; i < juce::jmax(1, numWorkers); ++i)
+    {
+        auto* worker = workers.add(new Worker(*this, i + 1));
+        worker->startThread(juce::Thread::Priority::high);
+    }
+
+    timerThread = std::make_unique<TimerThread>(*this);
+    timerThread->startThread(juce::Thread::Priority::high);
+}
+
+StreamScheduler::~StreamScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        shuttingDown = true;
+    }
+
+    for (int i = 0; i < workers.size(); ++i)
+        wakeups->post();
+
+    timersChanged.notify_all();
+    timerThread->stopThread(2000);
+
+    for (auto* worker : workers)
+        worker->stopThread(2000);
+}
+
+int StreamScheduler::getDefaultNumWorkers()
+{
+    // Encoding a stereo stream takes a small fraction of a core, so a couple
+    // of workers keep up with many instances
+    return juce::jlimit(1, 4, juce::SystemStats::getNumCpus() / 2);
+}
+
+void StreamScheduler::addSession(Session* session)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    takeScheduledLocked();
+
+    if (session->registered)
+        return;
+
+    session->registered = true;
+    sessions.add(session);
+
+    if (session->pending)
+    {
+        enqueueLocked(session);
+
+        if (claimSleepingWorker())
+            wakeups->post();
+    }
+}
+
+void StreamScheduler::removeSession(Session* session)
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+
+    // Nothing may keep pointing at the session once it is gone
+    takeScheduledLocked();
+
+    if (!session->registered)
+        return;
+
+    session->registered = false;
+    sessions.removeFirstMatchingValue(session);
+    cancelTimerLocked(session);
+
+    if (session->queued)
+    {
+        runQueue.erase(std::find(runQueue.begin(), runQueue.end(), session));
+        session->queued = false;
+    }
+
+    passFinished.wait(lock, [session] { return !session->running; });
+    session->pending = false;
+}
+
+void StreamScheduler::schedule(Session* session)
+{
+    if (session->pending.exchange(true))
+    {
+        schedulesCollapsed++;
+        return;
+    }
+
+    // Still listed from an earlier call that a worker hasn't taken yet; that
+    // call's wakeup covers this one
+    if (session->inScheduledList.exchange(true))
+        return;
+
+    auto* head = scheduledList.load();
+    do
+    {
+        session->nextScheduled = head;
+    }
+    while (!scheduledList.compare_exchange_weak(head, session));
+
+    // A worker that is awake takes the list before it sleeps
+    if (claimSleepingWorker())
+        wakeups->post();
+}
+
+void StreamScheduler::scheduleAfter(Session* session, int delayMs)
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+
+        // removeSession() may be waiting for the pass that calls this
+        if (!session->registered)
+            return;
+
+        if (!session->timerSet)
+            timedSessions.push_back(session);
+
+        session->timerSet = true;
+        session->timerDue = std::chrono::steady_clock::now() + std::chrono::milliseconds(juce::jmax(0, delayMs));
+    }
+
+    timersChanged.notify_one();
+}
+
+void StreamScheduler::cancelTimerLocked(Session* session)
+{
+    if (!session->timerSet)
+        return;
+
+    session->timerSet = false;
+    timedSessions.erase(std::find(timedSessions.begin(), timedSessions.end(), session));
+}
+
+void StreamScheduler::runTimer(TimerThread& thread)
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+
+    while (!thread.threadShouldExit() && !shuttingDown)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        auto nextDue = std::chrono::steady_clock::time_point::max();
+
+        // Few sessions have timers, so a scan beats keeping them sorted.
+        // Scheduled under the lock, so removeSession() can't slip in between.
+        for (size_t i = 0; i < timedSessions.size();)
+        {
+            auto* session = timedSessions[i];
+
+            if (session->timerDue <= now)
+            {
+                session->timerSet = false;
+                timedSessions[i] = timedSessions.back();
+                timedSessions.pop_back();
+                schedule(session);
+                timersFired++;
+                continue;
+            }
+
+            nextDue = juce::jmin(nextDue, session->timerDue);
+            ++i;
+        }
+
+        if (nextDue == std::chrono::steady_clock::time_point::max())
+            timersChanged.wait(lock);
+        else
+            timersChanged.wait_until(lock, nextDue);
+    }
+}
+
+bool StreamScheduler::claimSleepingWorker()
+{
+    // One post per sleeping worker, however many sessions are scheduled
+    // before it runs
+    int sleeping = sleepingWorkers.load();
+    while (sleeping > 0)
+        if (sleepingWorkers.compare_exchange_weak(sleeping, sleeping - 1))
+            return true;
+
+    return false;
+}
+
+void StreamScheduler::takeScheduledLocked()
+{
+    // The list is newest first; reverse it so sessions run in the order
+    // they were scheduled
+    Session* reversed = nullptr;
+    for (auto* session = scheduledList.exchange(nullptr); session != nullptr;)
+    {
+        auto* next = session->nextScheduled;
+        session->nextScheduled = reversed;
+        reversed = session;
+        session = next;
+    }
+
+    // Unregistered sessions stay pending, for addSession() to queue
+    while (reversed != nullptr)
+    {
+        auto* session = reversed;
+        reversed = session->nextScheduled;
+        session->nextScheduled = nullptr;
+        session->inScheduledList = false;
+
+        if (session->registered)
+            enqueueLocked(session);
+    }
+}
+
+void StreamScheduler::enqueueLocked(Session* session)
+{
+    // A running session is requeued by its worker when the pass ends
+    if (session->queued || session->running)
+        return;
+
+    session->queued = true;
+    runQueue.push_back(session);
+}
+
+void StreamScheduler::runWorker(Worker& worker)
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+
+    while (!worker.threadShouldExit() && !shuttingDown)
+    {
+        takeScheduledLocked();
+
+        if (runQueue.empty())
+        {
+            lock.unlock();
+
+            // Announced before the last look at the list: a session pushed
+            // after that look claims this worker and posts
+            sleepingWorkers++;
+
+            if (scheduledList.load() == nullptr)
+            {
+                wakeups->wait();
+                workerWakeups++;
+            }
+            else if (!claimSleepingWorker())
+            {
+                // Already claimed; take the post that is on its way
+                wakeups->wait();
+            }
+
+            lock.lock();
+            continue;
+        }
+
+        auto* session = runQueue.front();
+        runQueue.pop_front();
+        session->queued = false;
+        session->running = true;
+
+        // Cleared before the pass so audio pushed during it schedules another
+        session->pending = false;
+
+        lock.unlock();
+        session->serviceStream();
+        passesRun++;
+        lock.lock();
+
+        session->running = false;
+
+        if (session->registered && session->pending)
+            enqueueLocked(session);
+
+        passFinished.notify_all();
+    }
+}
+
+int StreamScheduler::getNumSessions() const
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return sessions.size();
+}
+
+StreamScheduler::Stats StreamScheduler::getStats() const
+{
+    Stats stats;
+    stats.passesRun = passesRun.load();
+    stats.schedulesCollapsed = schedulesCollapsed.load();
+    stats.workerWakeups = workerWakeups.load();
+    stats.timersFired = timersFired.load();
+    return stats;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <JuceHeader.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Process-wide pool that services the encode/transport work of every
+// streaming session (one per plugin instance). Instead of each instance
+// running its own thread that wakes every 10 ms, sessions are queued when
+// they have audio waiting and a small fixed set of workers drains the queue.
+// Idle sessions cost nothing. Sessions that pace their own output between
+// pushes ask for a pass at a given time, which a timer thread schedules.
+//
+// Share one pool between instances with juce::SharedResourcePointer.
+class StreamScheduler
+{
+public:
+    // A unit of streaming work. serviceStream() runs on a pool worker and is
+    // never run on two workers at once; work scheduled while it is running
+    // is picked up by another pass as soon as it returns.
+    class Session
+    {
+    public:
+        virtual ~Session() = default;
+        virtual void serviceStream() = 0;
+
+    private:
+        friend class StreamScheduler;
+        std::atomic<bool> pending{false};
+        std::atomic<bool> inScheduledList{false};
+        Session* nextScheduled = nullptr;
+        std::chrono::steady_clock::time_point timerDue;
+        bool timerSet = false;
+        bool queued = false;
+        bool running = false;
+        bool registered = false;
+    };
+
+    StreamScheduler();
+    explicit StreamScheduler(int numWorkers);
+    ~StreamScheduler();
+
+    void addSession(Session* session);
+
+    // Unregisters the session, waiting for a pass in progress to finish.
+    // After this returns serviceStream() will not be called again.
+    void removeSession(Session* session);
+
+    // Requests a pass of serviceStream(). Cheap when the session is already
+    // waiting: repeated calls before it runs collapse into one pass.
+    // Real-time safe: it never locks, allocates or blocks, so the audio
+    // thread can call it every block. Not to be called for a session once
+    // removeSession() has begun.
+    void schedule(Session* session);
+
+    // Requests a pass once delayMs have passed, replacing a request that
+    // hasn't come due; ignored for sessions not registered. Takes a lock, so
+    // for serviceStream() and other non-real-time threads.
+    void scheduleAfter(Session* session, int delayMs);
+
+    int getNumWorkers() const { return workers.size(); }
+    int getNumSessions() const;
+
+    struct Stats
+    {
+        juce::uint64 passesRun = 0;
+        juce::uint64 schedulesCollapsed = 0;
+        juce::uint64 workerWakeups = 0;
+        juce::uint64 timersFired = 0;
+    };
+
+    Stats getStats() const;
+
+    static int getDefaultNumWorkers();
+
+private:
+    class Worker;
+    class TimerThread;
+    class Semaphore;
+
+    void runWorker(Worker& worker);
+    void runTimer(TimerThread& thread);
+    void cancelTimerLocked(Session* session);
+    void enqueueLocked(Session* session);
+    void takeScheduledLocked();
+    bool claimSleepingWorker();
+
+    juce::OwnedArray<Worker> workers;
+    std::unique_ptr<TimerThread> timerThread;
+
+    // schedule() pushes onto this lock-free list and posts the semaphore;
+    // workers move the list onto the run queue under queueMutex
+    std::atomic<Session*> scheduledList{nullptr};
+    std::unique_ptr<Semaphore> wakeups;
+    std::atomic<int> sleepingWorkers{0};
+
+    mutable std::mutex queueMutex;
+    std::condition_variable passFinished;
+    std::condition_variable timersChanged;
+    std::deque<Session*> runQueue;
+    std::vector<Session*> timedSessions;
+    juce::Array<Session*> sessions;
+    bool shuttingDown = false;
+
+    std::atomic<juce::uint64> passesRun{0};
+    std::atomic<juce::uint64> schedulesCollapsed{0};
+    std::atomic<juce::uint64> workerWakeups{0};
+    std::atomic<juce::uint64> timersFired{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamScheduler)
+};
@@ -0,0 +1,481 @@
+#include "TransportEventLoop.h"
+
+#include <ctime>
+
+#if JUCE_LINUX
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <unistd.h>
+ #if FREECASTER_IO_URING
+  #include <liburing.h>
+  #include <poll.h>
+ #endif
+#else
+ #include <fcntl.h>
+ #include <poll.h>
+ #include <unistd.h>
+#endif
+
+// Token reserved for the backend's own wake-up descriptor
+static constexpr juce::uint64 wakeToken = 0;
+
+// Backends report readable sockets as the tokens they were registered with.
+// They are level-triggered from the loop's point of view: a socket that is
+// not drained by its handler is reported again.
+struct TransportEventLoop::Backend
+{
+    virtual ~Backend() = default;
+
+    virtual bool add(int socketHandle, juce::uint64 token) = 0;
+    virtual void remove(int socketHandle, juce::uint64 token) = 0;
+
+    // Blocks until at least one socket is readable or wake() is called
+    virtual int wait(juce::uint64* readyTokens, int maxTokens) = 0;
+    virtual void wake() = 0;
+
+    // Called after a handler has run, for backends whose polls are one-shot
+    virtual void rearm(int /*socketHandle*/, juce::uint64 /*token*/) {}
+
+    virtual const char* getName() const = 0;
+};
+
+#if JUCE_LINUX && FREECASTER_IO_URING
+//==============================================================================
+// io_uring: one-shot IORING_OP_POLL_ADD per socket, re-armed after each
+// dispatch. Submissions can come from any thread, so they are serialised.
+// Requires liburing 2.2 or later; where the kernel refuses a ring (too old,
+// or io_uring disabled) the loop uses epoll instead.
+struct IoUringBackend : public TransportEventLoop::Backend
+{
+    IoUringBackend()
+    {
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ringOpen = wakeFd >= 0 && io_uring_queue_init(256, &ring, 0) == 0;
+        ready = ringOpen && submitPoll(wakeFd, wakeToken);
+    }
+
+    ~IoUringBackend() override
+    {
+        if (ringOpen)
+            io_uring_queue_exit(&ring);
+
+        if (wakeFd >= 0)
+            ::close(wakeFd);
+    }
+
+    bool isReady() const { return ready; }
+
+    bool add(int socketHandle, juce::uint64 token) override
+    {
+        return ready && submitPoll(socketHandle, token);
+    }
+
+    void remove(int /*socketHandle*/, juce::uint64 token) override
+    {
+        const juce::ScopedLock sl(submitLock);
+
+        if (auto* sqe = io_uring_get_sqe(&ring))
+        {
+            io_uring_prep_poll_remove(sqe, token);
+            io_uring_sqe_set_data64(sqe, cancelToken);
+            io_uring_submit(&ring);
+        }
+    }
+
+    int wait(juce::uint64* readyTokens, int maxTokens) override
+    {
+        io_uring_cqe* cqe = nullptr;
+        if (io_uring_wait_cqe(&ring, &cqe) != 0)
+            return 0;
+
+        int count = 0;
+        unsigned head, numSeen = 0;
+
+        io_uring_for_each_cqe(&ring, head, cqe)
+        {
+            // The rest stay queued for the next wait(): their polls are
+            // one-shot, and a dropped completion would never be re-armed
+            if (count == maxTokens)
+                break;
+
+            auto token = io_uring_cqe_get_data64(cqe);
+
+            if (token == wakeToken)
+            {
+                eventfd_t value;
+                eventfd_read(wakeFd, &value);
+                submitPoll(wakeFd, wakeToken);
+            }
+            else if (token != cancelToken && cqe->res > 0)
+            {
+                readyTokens[count++] = token;
+            }
+
+            numSeen++;
+        }
+
+        io_uring_cq_advance(&ring, numSeen);
+        return count;
+    }
+
+    void wake() override
+    {
+        eventfd_write(wakeFd, 1);
+    }
+
+    void rearm(int socketHandle, juce::uint64 token) override
+    {
+        submitPoll(socketHandle, token);
+    }
+
+    const char* getName() const override { return "io_uring"; }
+
+private:
+    bool submitPoll(int fd, juce::uint64 token)
+    {
+        const juce::ScopedLock sl(submitLock);
+
+        auto* sqe = io_uring_get_sqe(&ring);
+        if (sqe == nullptr)
+            return false;
+
+        io_uring_prep_poll_add(sqe, fd, POLLIN);
+        io_uring_sqe_set_data64(sqe, token);
+        return io_uring_submit(&ring) >= 0;
+    }
+
+    static constexpr juce::uint64 cancelToken = ~(juce::uint64)0;
+
+    io_uring ring;
+    bool ringOpen = false;
+    bool ready = false;
+    int wakeFd = -1;
+    juce::CriticalSection submitLock;
+};
+#endif
+
+#if JUCE_LINUX
+//==============================================================================
+struct EpollBackend : public TransportEventLoop::Backend
+{
+    EpollBackend()
+    {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        add(wakeFd, wakeToken);
+    }
+
+    ~EpollBackend() override
+    {
+        ::close(wakeFd);
+        ::close(epollFd);
+    }
+
+    bool add(int socketHandle, juce::uint64 token) override
+    {
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.u64 = token;
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, socketHandle, &event) == 0;
+    }
+
+    void remove(int socketHandle, juce::uint64 /*token*/) override
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, socketHandle, nullptr);
+    }
+
+    int wait(juce::uint64* readyTokens, int maxTokens) override
+    {
+        epoll_event events[64];
+        int numEvents = epoll_wait(epollFd, events, juce::jmin(64, maxTokens), -1);
+        int count = 0;
+
+        for (int i = 0; i < numEvents; ++i)
+        {
+            if (events[i].data.u64 == wakeToken)
+            {
+                eventfd_t value;
+                eventfd_read(wakeFd, &value);
+                continue;
+            }
+
+            readyTokens[count++] = events[i].data.u64;
+        }
+
+        return count;
+    }
+
+    void wake() override
+    {
+        eventfd_write(wakeFd, 1);
+    }
+
+    const char* getName() const override { return "epoll"; }
+
+private:
+    int epollFd = -1;
+    int wakeFd = -1;
+};
+
+#else
+//==============================================================================
+// Portable fallback: poll() over the registered sockets plus a self-pipe used
+// to interrupt the wait when the socket set changes.
+struct PollBackend : public TransportEventLoop::Backend
+{
+    PollBackend()
+    {
+        if (pipe(wakePipe) == 0)
+        {
+            fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+            fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+        }
+    }
+
+    ~PollBackend() override
+    {
+        ::close(wakePipe[0]);
+        ::close(wakePipe[1]);
+    }
+
+    bool add(int socketHandle, juce::uint64 token) override
+    {
+        {
+            const juce::ScopedLock sl(lock);
+            sockets.push_back({ socketHandle, token });
+        }
+
+        wake();
+        return true;
+    }
+
+    void remove(int socketHandle, juce::uint64 /*token*/) override
+    {
+        {
+            const juce::ScopedLock sl(lock);
+            sockets.erase(std::remove_if(sockets.begin(), sockets.end(),
+                                         [socketHandle](const Entry& e) { return e.socketHandle == socketHandle; }),
+                          sockets.end());
+        }
+
+        wake();
+    }
+
+    int wait(juce::uint64* readyTokens, int maxTokens) override
+    {
+        std::vector<Entry> snapshot;
+        {
+            const juce::ScopedLock sl(lock);
+            snapshot = sockets;
+        }
+
+        pollFds.resize(snapshot.size() + 1);
+        pollFds[0] = { wakePipe[0], POLLIN, 0 };
+        for (size_t i = 0; i < snapshot.size(); ++i)
+            pollFds[i + 1] = { snapshot[i].socketHandle, POLLIN, 0 };
+
+        if (poll(pollFds.data(), (nfds_t)pollFds.size(), -1) <= 0)
+            return 0;
+
+        if (pollFds[0].revents != 0)
+        {
+            char drain[64];
+            while (read(wakePipe[0], drain, sizeof(drain)) > 0) {}
+        }
+
+        int count = 0;
+        for (size_t i = 1; i < pollFds.size() && count < maxTokens; ++i)
+            if ((pollFds[i].revents & POLLIN) != 0)
+                readyTokens[count++] = snapshot[i - 1].token;
+
+        return count;
+    }
+
+    void wake() override
+    {
+        char byte = 0;
+        (void)write(wakePipe[1], &byte, 1);
+    }
+
+    const char* getName() const override { return "poll"; }
+
+private:
+    struct Entry
+    {
+        int socketHandle;
+        juce::uint64 token;
+    };
+
+    juce::CriticalSection lock;
+    std::vector<Entry> sockets;
+    std::vector<pollfd> pollFds;
+    int wakePipe[2] = { -1, -1 };
+};
+#endif
+
+//==============================================================================
+TransportEventLoop::TransportEventLoop(int index)
+    : Thread("TransportLoop " + juce::String(index))
+{
+   #if JUCE_LINUX && FREECASTER_IO_URING
+    auto uring = std::make_unique<IoUringBackend>();
+
+    if (uring->isReady())
+        backend = std::move(uring);
+   #endif
+
+    if (backend == nullptr)
+    {
+       #if JUCE_LINUX
+        backend = std::make_unique<EpollBackend>();
+       #else
+        backend = std::make_unique<PollBackend>();
+       #endif
+    }
+
+    startThread(juce::Thread::Priority::high);
+}
+
+TransportEventLoop::~TransportEventLoop()
+{
+    signalThreadShouldExit();
+    backend->wake();
+    stopThread(2000);
+}
+
+const char* TransportEventLoop::getBackendName() const
+{
+    return backend->getName();
+}
+
+double TransportEventLoop::getThreadCpuMicros()
+{
+   #if JUCE_WINDOWS
+    return 0.0;
+   #else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec * 1.0e6 + (double)ts.tv_nsec / 1.0e3;
+   #endif
+}
+
+bool TransportEventLoop::addSocket(int socketHandle, ReadHandler handler)
+{
+    if (socketHandle < 0)
+        return false;
+
+    const juce::ScopedLock sl(handlerLock);
+
+    auto token = nextToken++;
+    registrations[token] = { socketHandle, std::move(handler) };
+
+    if (!backend->add(socketHandle, token))
+    {
+        registrations.erase(token);
+        return false;
+    }
+
+    return true;
+}
+
+void TransportEventLoop::removeSocket(int socketHandle)
+{
+    const juce::ScopedLock sl(handlerLock);
+
+    for (auto it = registrations.begin(); it != registrations.end(); ++it)
+    {
+        if (it->second.socketHandle == socketHandle)
+        {
+            backend->remove(socketHandle, it->first);
+            registrations.erase(it);
+            return;
+        }
+    }
+}
+
+int TransportEventLoop::getNumSockets() const
+{
+    const juce::ScopedLock sl(handlerLock);
+    return (int)registrations.size();
+}
+
+void TransportEventLoop::run()
+{
+    juce::uint64 readyTokens[64];
+    auto cpuAtStart = getThreadCpuMicros();
+
+    while (!threadShouldExit())
+    {
+        int numReady = backend->wait(readyTokens, 64);
+        wakeups++;
+
+        for (int i = 0; i < numReady; ++i)
+        {
+            // Handlers run under the lock so removeSocket() from another
+            // thread cannot return while the handler is still running
+            const juce::ScopedLock sl(handlerLock);
+
+            auto it = registrations.find(readyTokens[i]);
+            if (it == registrations.end())
+                continue;
+
+            auto socketHandle = it->second.socketHandle;
+            it->second.handler();
+            eventsHandled++;
+
+            // The handler may have removed its own socket
+            if (registrations.count(readyTokens[i]) > 0)
+                backend->rearm(socketHandle, readyTokens[i]);
+        }
+
+        cpuMicros = getThreadCpuMicros() - cpuAtStart;
+    }
+}
+
+TransportEventLoop::Stats TransportEventLoop::getStats() const
+{
+    Stats stats;
+    stats.wakeups = wakeups.load();
+    stats.eventsHandled = eventsHandled.load();
+    stats.cpuMicros = cpuMicros.load();
+    return stats;
+}
+
+//==============================================================================
+TransportEventLoopPool::TransportEventLoopPool()
+    : TransportEventLoopPool(juce::jlimit(1, 16, juce::SystemStats::getNumCpus()))
+{
+}
+
+TransportEventLoopPool::TransportEventLoopPool(int numLoops)
+{
+    for (int i = 0; i < juce::jmax(1, numLoops); ++i)
+        loops.add(new TransportEventLoop(i + 1));
+}
+
+TransportEventLoop& TransportEventLoopPool::getLoopForNewSession()
+{
+    const juce::ScopedLock sl(lock);
+
+    auto* best = loops.getUnchecked(0);
+    for (auto* loop : loops)
+        if (loop->getNumSockets() < best->getNumSockets())
+            best = loop;
+
+    return *best;
+}
+
+TransportEventLoop::Stats TransportEventLoopPool::getStats() const
+{
+    TransportEventLoop::Stats total;
+
+    for (auto* loop : loops)
+    {
+        auto stats = loop->getStats();
+        total.wakeups += stats.wakeups;
+        total.eventsHandled += stats.eventsHandled;
+        total.cpuMicros += stats.cpuMicros;
+    }
+
+    return total;
+}
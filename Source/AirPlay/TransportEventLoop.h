@@ -0,0 +1,88 @@
+#pragma once
+#include <JuceHeader.h>
+#include <functional>
+#include <map>
+
+// Waits for incoming datagrams on many sockets from a single thread and
+// calls each socket's handler when it becomes readable. RAOP sessions
+// register their control and timing sockets here instead of running a
+// thread per socket, so the thread count stays flat as sessions are added.
+//
+// Linux uses epoll, or io_uring when built with FREECASTER_USE_IO_URING;
+// other platforms fall back to poll().
+class TransportEventLoop : private juce::Thread
+{
+public:
+    using ReadHandler = std::function<void()>;
+
+    explicit TransportEventLoop(int index = 0);
+    ~TransportEventLoop() override;
+
+    // Handlers run on the loop thread and should read until the socket is
+    // drained. removeSocket() waits for a running handler to return and may
+    // be called from inside a handler.
+    bool addSocket(int socketHandle, ReadHandler handler);
+    void removeSocket(int socketHandle);
+
+    int getNumSockets() const;
+
+    struct Stats
+    {
+        juce::uint64 wakeups = 0;
+        juce::uint64 eventsHandled = 0;
+        double cpuMicros = 0.0;
+    };
+
+    Stats getStats() const;
+
+    // The backend in use, which is epoll when an io_uring build can't open a ring
+    const char* getBackendName() const;
+
+    // CPU time used by the calling thread, in microseconds
+    static double getThreadCpuMicros();
+
+    // Platform polling mechanism, defined in the .cpp
+    struct Backend;
+
+private:
+    struct Registration
+    {
+        int socketHandle = -1;
+        ReadHandler handler;
+    };
+
+    void run() override;
+
+    std::unique_ptr<Backend> backend;
+
+    juce::CriticalSection handlerLock;
+    std::map<juce::uint64, Registration> registrations;
+    juce::uint64 nextToken = 1;
+
+    std::atomic<juce::uint64> wakeups{0};
+    std::atomic<juce::uint64> eventsHandled{0};
+    std::atomic<double> cpuMicros{0.0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TransportEventLoop)
+};
+
+// One TransportEventLoop per core, shared process-wide through
+// juce::SharedResourcePointer. New sessions go to the loop with the fewest
+// sockets.
+class TransportEventLoopPool
+{
+public:
+    TransportEventLoopPool();
+    explicit TransportEventLoopPool(int numLoops);
+
+    TransportEventLoop& getLoopForNewSession();
+
+    int getNumLoops() const { return loops.size(); }
+    TransportEventLoop::Stats getStats() const;
+
+private:
+    juce::CriticalSection lock;
+    juce::OwnedArray<TransportEventLoop> loops;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TransportEventLoopPool)
+};
@@ -40,10 +40,6 @@
 #include "ALACAudioTypes.h"
 #include "EndianPortable.h"
 
-// Note: in C you can't typecast to a 2-dimensional array pointer but that's what we need when
-// picking which coefs to use so we declare this typedef b/c we *can* typecast to this type
-typedef int16_t (*SearchCoefs)[kALACMaxCoefs];
-
 // defines/constants
 const uint32_t kALACEncoderMagic	= 'dpge';
 const uint32_t kMaxSampleSize		= 32;			// max allowed bit width is 32
@@ -53,6 +49,13 @@ const uint32_t kMaxRes			= 4;
 const uint32_t kDefaultNumUV		= 8;
 const uint32_t kMinUV				= 4;
 const uint32_t kMaxUV				= 8;
+const uint32_t kArenaAlignment	= 64;			// cache line
+const uint32_t kElementOverhead	= 64;			// element header and predictor coefs, rounded up
+
+// Note: in C you can't typecast to a 2-dimensional array pointer but that's what we need when
+// picking which coefs to use so we declare this typedef b/c we *can* typecast to this type
+// - the searches only use numU = 4 and 8, so each channel keeps kMaxUV rows of kMaxUV coefs
+typedef int16_t (*SearchCoefs)[kMaxUV];
 
 // static functions
 #if VERBOSE_DEBUG
@@ -102,13 +105,14 @@ static const uint32_t sSupportediPodSampleRates[] =
 ALACEncoder::ALACEncoder() :
 	mBitDepth( 0 ),
     mFastMode( 0 ),
-	mMixBufferU( nil ),
-	mMixBufferV( nil ),
-	mPredictorU( nil ),
-	mPredictorV( nil ),
-	mShiftBufferUV( nil ),
-	mWorkBuffer( nil ),
-
+	mElementBuffers( nil ),
+	mNumElements( 0 ),
+	mElementBytes( 0 ),
+	mConcurrentElements( false ),
+	mCoefsU( nil ),
+	mCoefsV( nil ),
+	mArena( nil ),
+	mArenaSize( 0 ),
 
 	mTotalBytesGenerated( 0 ),
 	mAvgBitRate( 0 ),
@@ -123,43 +127,8 @@ ALACEncoder::ALACEncoder() :
 */
 ALACEncoder::~ALACEncoder()
 {
-	// delete the matrix mixing buffers
-	if ( mMixBufferU )
-    {
-		free(mMixBufferU);
-        mMixBufferU = NULL;
-    }
-	if ( mMixBufferV )
-    {
-		free(mMixBufferV);
-        mMixBufferV = NULL;
-    }
-	
-	// delete the dynamic predictor's "corrector" buffers
-	if ( mPredictorU )
-    {
-		free(mPredictorU);
-        mPredictorU = NULL;
-    }
-	if ( mPredictorV )
-    {
-		free(mPredictorV);
-        mPredictorV = NULL;
-    }
-
-	// delete the unused byte shift buffer
-	if ( mShiftBufferUV )
-    {
-		free(mShiftBufferUV);
-        mShiftBufferUV = NULL;
-    }
-
-	// delete the work buffer
-	if ( mWorkBuffer )
-    {
-		free(mWorkBuffer);
-        mWorkBuffer = NULL;
-    }	
+	// every buffer lives in the arena
+	free( mArena );
 }
 
 #if PRAGMA_MARK
@@ -263,7 +232,7 @@ ALACEncoder::~ALACEncoder()
 	EncodeStereo()
 	- encode a channel pair
 */
-int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, uint32_t stride, uint32_t channelIndex, uint32_t numSamples )
+int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, uint32_t stride, uint32_t channelIndex, uint32_t numSamples, ElementBuffers & buffers )
 {
 	BitBuffer		workBits;
 	BitBuffer		startBits = *bitstream;			// squirrel away copy of current state in case we need to go back and do an escape packet
@@ -294,8 +263,8 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
 	//	 actually results in better overall compression
 	// - strangely, re-using the same coefs for the different passes of the "mixRes" search loop instead of using
 	//	 different coefs for the different passes of "mixRes" results in even better compression
-	coefsU = (SearchCoefs) mCoefsU[channelIndex];
-	coefsV = (SearchCoefs) mCoefsV[channelIndex];
+	coefsU = (SearchCoefs) (mCoefsU + channelIndex * kMaxUV * kMaxUV);
+	coefsV = (SearchCoefs) (mCoefsV + channelIndex * kMaxUV * kMaxUV);
 
 	// matrix encoding adds an extra bit but 32-bit inputs cannot be matrixed b/c 33 is too many
 	// so enable 16-bit "shift off" and encode in 17-bit mode
@@ -332,36 +301,36 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
         switch ( mBitDepth )
         {
             case 16:
-                mix16( (int16_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples/dilate, mixBits, mixRes );
+                mix16( (int16_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples/dilate, mixBits, mixRes );
                 break;
             case 20:
-                mix20( (uint8_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples/dilate, mixBits, mixRes );
+                mix20( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples/dilate, mixBits, mixRes );
                 break;
             case 24:
                 // includes extraction of shifted-off bytes
-                mix24( (uint8_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples/dilate,
-                        mixBits, mixRes, mShiftBufferUV, bytesShifted );
+                mix24( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples/dilate,
+                        mixBits, mixRes, buffers.mShiftBufferUV, bytesShifted );
                 break;
             case 32:
                 // includes extraction of shifted-off bytes
-                mix32( (int32_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples/dilate,
-                        mixBits, mixRes, mShiftBufferUV, bytesShifted );
+                mix32( (int32_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples/dilate,
+                        mixBits, mixRes, buffers.mShiftBufferUV, bytesShifted );
                 break;
         }
 
-        BitBufferInit( &workBits, mWorkBuffer, mMaxOutputBytes );
+        BitBufferInit( &workBits, buffers.mWorkBuffer, mElementBytes );
         
         // run the dynamic predictors
-        pc_block( mMixBufferU, mPredictorU, numSamples/dilate, coefsU[numU - 1], numU, chanBits, DENSHIFT_DEFAULT );
-        pc_block( mMixBufferV, mPredictorV, numSamples/dilate, coefsV[numV - 1], numV, chanBits, DENSHIFT_DEFAULT );
+        pc_block( buffers.mMixBufferU, buffers.mPredictorU, numSamples/dilate, coefsU[numU - 1], numU, chanBits, DENSHIFT_DEFAULT );
+        pc_block( buffers.mMixBufferV, buffers.mPredictorV, numSamples/dilate, coefsV[numV - 1], numV, chanBits, DENSHIFT_DEFAULT );
 
         // run the lossless compressor on each channel
         set_ag_params( &agParams, MB0, (pbFactor * PB0) / 4, KB0, numSamples/dilate, numSamples/dilate, MAX_RUN_DEFAULT );
-        status = dyn_comp( &agParams, mPredictorU, &workBits, numSamples/dilate, chanBits, &bits1 );
+        status = dyn_comp( &agParams, buffers.mPredictorU, &workBits, numSamples/dilate, chanBits, &bits1 );
         RequireNoErr( status, goto Exit; );
 
         set_ag_params( &agParams, MB0, (pbFactor * PB0) / 4, KB0, numSamples/dilate, numSamples/dilate, MAX_RUN_DEFAULT );
-        status = dyn_comp( &agParams, mPredictorV, &workBits, numSamples/dilate, chanBits, &bits2 );
+        status = dyn_comp( &agParams, buffers.mPredictorV, &workBits, numSamples/dilate, chanBits, &bits2 );
         RequireNoErr( status, goto Exit; );
 
         // look for best match
@@ -379,20 +348,20 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
 	switch ( mBitDepth )
 	{
 		case 16:
-			mix16( (int16_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples, mixBits, mixRes );
+			mix16( (int16_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples, mixBits, mixRes );
 			break;
 		case 20:
-			mix20( (uint8_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples, mixBits, mixRes );
+			mix20( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples, mixBits, mixRes );
 			break;
 		case 24:
 			// also extracts the shifted off bytes into the shift buffers
-			mix24( (uint8_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples,
-					mixBits, mixRes, mShiftBufferUV, bytesShifted );
+			mix24( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples,
+					mixBits, mixRes, buffers.mShiftBufferUV, bytesShifted );
 			break;
 		case 32:
 			// also extracts the shifted off bytes into the shift buffers
-			mix32( (int32_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples,
-					mixBits, mixRes, mShiftBufferUV, bytesShifted );
+			mix32( (int32_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples,
+					mixBits, mixRes, buffers.mShiftBufferUV, bytesShifted );
 			break;
 	}
 
@@ -402,21 +371,21 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
 
 	for ( uint32_t numUV = kMinUV; numUV <= kMaxUV; numUV += 4 )
 	{
-		BitBufferInit( &workBits, mWorkBuffer, mMaxOutputBytes );		
+		BitBufferInit( &workBits, buffers.mWorkBuffer, mElementBytes );		
 
 		dilate = 32;
 
 		// run the predictor over the same data multiple times to help it converge
 		for ( uint32_t converge = 0; converge < 8; converge++ )
 		{
-		    pc_block( mMixBufferU, mPredictorU, numSamples/dilate, coefsU[numUV-1], numUV, chanBits, DENSHIFT_DEFAULT );
-		    pc_block( mMixBufferV, mPredictorV, numSamples/dilate, coefsV[numUV-1], numUV, chanBits, DENSHIFT_DEFAULT );
+		    pc_block( buffers.mMixBufferU, buffers.mPredictorU, numSamples/dilate, coefsU[numUV-1], numUV, chanBits, DENSHIFT_DEFAULT );
+		    pc_block( buffers.mMixBufferV, buffers.mPredictorV, numSamples/dilate, coefsV[numUV-1], numUV, chanBits, DENSHIFT_DEFAULT );
 		}
 
 		dilate = 8;
 
 		set_ag_params( &agParams, MB0, (pbFactor * PB0)/4, KB0, numSamples/dilate, numSamples/dilate, MAX_RUN_DEFAULT );
-		status = dyn_comp( &agParams, mPredictorU, &workBits, numSamples/dilate, chanBits, &bits1 );
+		status = dyn_comp( &agParams, buffers.mPredictorU, &workBits, numSamples/dilate, chanBits, &bits1 );
 
 		if ( (bits1 * dilate + 16 * numUV) < minBits1 )
 		{
@@ -425,7 +394,7 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
 		}
 
 		set_ag_params( &agParams, MB0, (pbFactor * PB0)/4, KB0, numSamples/dilate, numSamples/dilate, MAX_RUN_DEFAULT );
-		status = dyn_comp( &agParams, mPredictorV, &workBits, numSamples/dilate, chanBits, &bits2 );
+		status = dyn_comp( &agParams, buffers.mPredictorV, &workBits, numSamples/dilate, chanBits, &bits2 );
 
 		if ( (bits2 * dilate + 16 * numUV) < minBits2 )
 		{
@@ -478,7 +447,7 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
 			{
 				uint32_t			shiftedVal;
 				
-				shiftedVal = ((uint32_t)mShiftBufferUV[index + 0] << bitShift) | (uint32_t)mShiftBufferUV[index + 1];
+				shiftedVal = ((uint32_t)buffers.mShiftBufferUV[index + 0] << bitShift) | (uint32_t)buffers.mShiftBufferUV[index + 1];
 				BitBufferWrite( bitstream, shiftedVal, bitShift * 2 );
 			}
 		}
@@ -488,31 +457,31 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
 		//		   of only using "U" buffers for the U-channel and "V" buffers for the V-channel
 		if ( mode == 0 )
 		{
-			pc_block( mMixBufferU, mPredictorU, numSamples, coefsU[numU - 1], numU, chanBits, DENSHIFT_DEFAULT );
+			pc_block( buffers.mMixBufferU, buffers.mPredictorU, numSamples, coefsU[numU - 1], numU, chanBits, DENSHIFT_DEFAULT );
 		}
 		else
 		{
-			pc_block( mMixBufferU, mPredictorV, numSamples, coefsU[numU - 1], numU, chanBits, DENSHIFT_DEFAULT );
-			pc_block( mPredictorV, mPredictorU, numSamples, nil, 31, chanBits, 0 );
+			pc_block( buffers.mMixBufferU, buffers.mPredictorV, numSamples, coefsU[numU - 1], numU, chanBits, DENSHIFT_DEFAULT );
+			pc_block( buffers.mPredictorV, buffers.mPredictorU, numSamples, nil, 31, chanBits, 0 );
 		}
 
 		set_ag_params( &agParams, MB0, (pbFactor * PB0) / 4, KB0, numSamples, numSamples, MAX_RUN_DEFAULT );
-		status = dyn_comp( &agParams, mPredictorU, bitstream, numSamples, chanBits, &bits1 );
+		status = dyn_comp( &agParams, buffers.mPredictorU, bitstream, numSamples, chanBits, &bits1 );
 		RequireNoErr( status, goto Exit; );
 
 		// run the dynamic predictor and lossless compression for the "right" channel
 		if ( mode == 0 )
 		{
-			pc_block( mMixBufferV, mPredictorV, numSamples, coefsV[numV - 1], numV, chanBits, DENSHIFT_DEFAULT );
+			pc_block( buffers.mMixBufferV, buffers.mPredictorV, numSamples, coefsV[numV - 1], numV, chanBits, DENSHIFT_DEFAULT );
 		}
 		else
 		{
-			pc_block( mMixBufferV, mPredictorU, numSamples, coefsV[numV - 1], numV, chanBits, DENSHIFT_DEFAULT );
-			pc_block( mPredictorU, mPredictorV, numSamples, nil, 31, chanBits, 0 );
+			pc_block( buffers.mMixBufferV, buffers.mPredictorU, numSamples, coefsV[numV - 1], numV, chanBits, DENSHIFT_DEFAULT );
+			pc_block( buffers.mPredictorU, buffers.mPredictorV, numSamples, nil, 31, chanBits, 0 );
 		}
 
 		set_ag_params( &agParams, MB0, (pbFactor * PB0) / 4, KB0, numSamples, numSamples, MAX_RUN_DEFAULT );
-		status = dyn_comp( &agParams, mPredictorV, bitstream, numSamples, chanBits, &bits2 );
+		status = dyn_comp( &agParams, buffers.mPredictorV, bitstream, numSamples, chanBits, &bits2 );
 		RequireNoErr( status, goto Exit; );
 
 		/*	if we happened to create a compressed packet that was actually bigger than an escape packet would be,
@@ -530,7 +499,7 @@ int32_t ALACEncoder::EncodeStereo( BitBuffer * bitstream, void * inputBuffer, ui
 	if ( doEscape == true )
 	{
 		/* escape */
-		status = this->EncodeStereoEscape( bitstream, inputBuffer, stride, numSamples );
+		status = this->EncodeStereoEscape( bitstream, inputBuffer, stride, numSamples, buffers );
 
 #if VERBOSE_DEBUG		
 		DebugMsg( "escape!: %lu vs %lu", minBits, escapeBits );
@@ -545,7 +514,7 @@ Exit:
 	EncodeStereoFast()
 	- encode a channel pair without the search loop for maximum possible speed
 */
-int32_t ALACEncoder::EncodeStereoFast( BitBuffer * bitstream, void * inputBuffer, uint32_t stride, uint32_t channelIndex, uint32_t numSamples )
+int32_t ALACEncoder::EncodeStereoFast( BitBuffer * bitstream, void * inputBuffer, uint32_t stride, uint32_t channelIndex, uint32_t numSamples, ElementBuffers & buffers )
 {
 	BitBuffer		startBits = *bitstream;			// squirrel away current bit position in case we decide to use escape hatch
 	AGParamRec		agParams;
@@ -574,8 +543,8 @@ int32_t ALACEncoder::EncodeStereoFast( BitBuffer * bitstream, void * inputBuffer
 	//	 actually results in better overall compression
 	// - strangely, re-using the same coefs for the different passes of the "mixRes" search loop instead of using
 	//	 different coefs for the different passes of "mixRes" results in even better compression
-	coefsU = (SearchCoefs) mCoefsU[channelIndex];
-	coefsV = (SearchCoefs) mCoefsV[channelIndex];
+	coefsU = (SearchCoefs) (mCoefsU + channelIndex * kMaxUV * kMaxUV);
+	coefsV = (SearchCoefs) (mCoefsV + channelIndex * kMaxUV * kMaxUV);
 
 	// matrix encoding adds an extra bit but 32-bit inputs cannot be matrixed b/c 33 is too many
 	// so enable 16-bit "shift off" and encode in 17-bit mode
@@ -606,20 +575,20 @@ int32_t ALACEncoder::EncodeStereoFast( BitBuffer * bitstream, void * inputBuffer
 	switch ( mBitDepth )
 	{
 		case 16:
-			mix16( (int16_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples, mixBits, mixRes );
+			mix16( (int16_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples, mixBits, mixRes );
 			break;
 		case 20:
-			mix20( (uint8_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples, mixBits, mixRes );
+			mix20( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples, mixBits, mixRes );
 			break;
 		case 24:
 			// also extracts the shifted off bytes into the shift buffers
-			mix24( (uint8_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples,
-					mixBits, mixRes, mShiftBufferUV, bytesShifted );
+			mix24( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples,
+					mixBits, mixRes, buffers.mShiftBufferUV, bytesShifted );
 			break;
 		case 32:
 			// also extracts the shifted off bytes into the shift buffers
-			mix32( (int32_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples,
-					mixBits, mixRes, mShiftBufferUV, bytesShifted );
+			mix32( (int32_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples,
+					mixBits, mixRes, buffers.mShiftBufferUV, bytesShifted );
 			break;
 	}
 
@@ -658,24 +627,24 @@ int32_t ALACEncoder::EncodeStereoFast( BitBuffer * bitstream, void * inputBuffer
 		{
 			uint32_t			shiftedVal;
 			
-			shiftedVal = ((uint32_t)mShiftBufferUV[index + 0] << bitShift) | (uint32_t)mShiftBufferUV[index + 1];
+			shiftedVal = ((uint32_t)buffers.mShiftBufferUV[index + 0] << bitShift) | (uint32_t)buffers.mShiftBufferUV[index + 1];
 			BitBufferWrite( bitstream, shiftedVal, bitShift * 2 );
 		}
 	}
 
 	// run the dynamic predictor and lossless compression for the "left" channel
 	// - note: we always use mode 0 in the "fast" path so we don't need the code for mode != 0
-	pc_block( mMixBufferU, mPredictorU, numSamples, coefsU[numU - 1], numU, chanBits, DENSHIFT_DEFAULT );
+	pc_block( buffers.mMixBufferU, buffers.mPredictorU, numSamples, coefsU[numU - 1], numU, chanBits, DENSHIFT_DEFAULT );
 
 	set_ag_params( &agParams, MB0, (pbFactor * PB0) / 4, KB0, numSamples, numSamples, MAX_RUN_DEFAULT );
-	status = dyn_comp( &agParams, mPredictorU, bitstream, numSamples, chanBits, &bits1 );
+	status = dyn_comp( &agParams, buffers.mPredictorU, bitstream, numSamples, chanBits, &bits1 );
 	RequireNoErr( status, goto Exit; );
 
 	// run the dynamic predictor and lossless compression for the "right" channel
-	pc_block( mMixBufferV, mPredictorV, numSamples, coefsV[numV - 1], numV, chanBits, DENSHIFT_DEFAULT );
+	pc_block( buffers.mMixBufferV, buffers.mPredictorV, numSamples, coefsV[numV - 1], numV, chanBits, DENSHIFT_DEFAULT );
 
 	set_ag_params( &agParams, MB0, (pbFactor * PB0) / 4, KB0, numSamples, numSamples, MAX_RUN_DEFAULT );
-	status = dyn_comp( &agParams, mPredictorV, bitstream, numSamples, chanBits, &bits2 );
+	status = dyn_comp( &agParams, buffers.mPredictorV, bitstream, numSamples, chanBits, &bits2 );
 	RequireNoErr( status, goto Exit; );
 
 	// do bit requirement calculations
@@ -713,7 +682,7 @@ int32_t ALACEncoder::EncodeStereoFast( BitBuffer * bitstream, void * inputBuffer
 		*bitstream = startBits;
 
 		// write escape frame
-		status = this->EncodeStereoEscape( bitstream, inputBuffer, stride, numSamples );
+		status = this->EncodeStereoEscape( bitstream, inputBuffer, stride, numSamples, buffers );
 
 #if VERBOSE_DEBUG		
 		DebugMsg( "escape!: %u vs %u", minBits, (numSamples * mBitDepth * 2) );
@@ -728,7 +697,7 @@ Exit:
 	EncodeStereoEscape()
 	- encode stereo escape frame
 */
-int32_t ALACEncoder::EncodeStereoEscape( BitBuffer * bitstream, void * inputBuffer, uint32_t stride, uint32_t numSamples )
+int32_t ALACEncoder::EncodeStereoEscape( BitBuffer * bitstream, void * inputBuffer, uint32_t stride, uint32_t numSamples, ElementBuffers & buffers )
 {
 	int16_t *		input16;
 	int32_t *		input32;
@@ -758,20 +727,20 @@ int32_t ALACEncoder::EncodeStereoEscape( BitBuffer * bitstream, void * inputBuff
 			break;
 		case 20:
 			// mix20() with mixres param = 0 means de-interleave so use it to simplify things
-			mix20( (uint8_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples, 0, 0 );
+			mix20( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples, 0, 0 );
 			for ( index = 0; index < numSamples; index++ )
 			{
-				BitBufferWrite( bitstream, mMixBufferU[index], 20 );
-				BitBufferWrite( bitstream, mMixBufferV[index], 20 );
+				BitBufferWrite( bitstream, buffers.mMixBufferU[index], 20 );
+				BitBufferWrite( bitstream, buffers.mMixBufferV[index], 20 );
 			}				
 			break;
 		case 24:
 			// mix24() with mixres param = 0 means de-interleave so use it to simplify things
-			mix24( (uint8_t *) inputBuffer, stride, mMixBufferU, mMixBufferV, numSamples, 0, 0, mShiftBufferUV, 0 );
+			mix24( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, buffers.mMixBufferV, numSamples, 0, 0, buffers.mShiftBufferUV, 0 );
 			for ( index = 0; index < numSamples; index++ )
 			{
-				BitBufferWrite( bitstream, mMixBufferU[index], 24 );
-				BitBufferWrite( bitstream, mMixBufferV[index], 24 );
+				BitBufferWrite( bitstream, buffers.mMixBufferU[index], 24 );
+				BitBufferWrite( bitstream, buffers.mMixBufferV[index], 24 );
 			}				
 			break;
 		case 32:
@@ -792,7 +761,7 @@ int32_t ALACEncoder::EncodeStereoEscape( BitBuffer * bitstream, void * inputBuff
 	EncodeMono()
 	- encode a mono input buffer
 */
-int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint32_t stride, uint32_t channelIndex, uint32_t numSamples )
+int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint32_t stride, uint32_t channelIndex, uint32_t numSamples, ElementBuffers & buffers )
 {
 	BitBuffer		startBits = *bitstream;			// squirrel away copy of current state in case we need to go back and do an escape packet
 	AGParamRec		agParams;
@@ -821,7 +790,7 @@ int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint
 	status = ALAC_noErr;
 	
 	// reload coefs array from previous frame
-	coefsU = (SearchCoefs) mCoefsU[channelIndex];
+	coefsU = (SearchCoefs) (mCoefsU + channelIndex * kMaxUV * kMaxUV);
 
 	// pick bit depth for actual encoding
 	// - we lop off the lower byte(s) for 24-/32-bit encodings
@@ -847,20 +816,20 @@ int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint
 			// convert 16-bit data to 32-bit for predictor
 			input16 = (int16_t *) inputBuffer;
 			for ( index = 0, index2 = 0; index < numSamples; index++, index2 += stride )
-				mMixBufferU[index] = (int32_t) input16[index2];
+				buffers.mMixBufferU[index] = (int32_t) input16[index2];
 			break;
 		}
 		case 20:
 			// convert 20-bit data to 32-bit for predictor
-			copy20ToPredictor( (uint8_t *) inputBuffer, stride, mMixBufferU, numSamples );
+			copy20ToPredictor( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, numSamples );
 			break;
 		case 24:
 			// convert 24-bit data to 32-bit for the predictor and extract the shifted off byte(s)
-			copy24ToPredictor( (uint8_t *) inputBuffer, stride, mMixBufferU, numSamples );
+			copy24ToPredictor( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, numSamples );
 			for ( index = 0; index < numSamples; index++ )
 			{
-				mShiftBufferUV[index] = (uint16_t)(mMixBufferU[index] & mask);
-				mMixBufferU[index] >>= shift;
+				buffers.mShiftBufferUV[index] = (uint16_t)(buffers.mMixBufferU[index] & mask);
+				buffers.mMixBufferU[index] >>= shift;
 			}
 			break;
 		case 32:
@@ -872,8 +841,8 @@ int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint
 			{
 				int32_t			val = input32[index2];
 				
-				mShiftBufferUV[index] = (uint16_t)(val & mask);
-				mMixBufferU[index] = val >> shift;
+				buffers.mShiftBufferUV[index] = (uint16_t)(val & mask);
+				buffers.mMixBufferU[index] = val >> shift;
 			}
 			break;
 		}
@@ -894,17 +863,17 @@ int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint
 		BitBuffer		workBits;
 		uint32_t			numBits;
 
-		BitBufferInit( &workBits, mWorkBuffer, mMaxOutputBytes );
+		BitBufferInit( &workBits, buffers.mWorkBuffer, mElementBytes );
 	
 		dilate = 32;
 		for ( uint32_t converge = 0; converge < 7; converge++ )	
-			pc_block( mMixBufferU, mPredictorU, numSamples/dilate, coefsU[numU-1], numU, chanBits, DENSHIFT_DEFAULT );
+			pc_block( buffers.mMixBufferU, buffers.mPredictorU, numSamples/dilate, coefsU[numU-1], numU, chanBits, DENSHIFT_DEFAULT );
 
 		dilate = 8;
-		pc_block( mMixBufferU, mPredictorU, numSamples/dilate, coefsU[numU-1], numU, chanBits, DENSHIFT_DEFAULT );
+		pc_block( buffers.mMixBufferU, buffers.mPredictorU, numSamples/dilate, coefsU[numU-1], numU, chanBits, DENSHIFT_DEFAULT );
 
 		set_ag_params( &agParams, MB0, (pbFactor * PB0) / 4, KB0, numSamples/dilate, numSamples/dilate, MAX_RUN_DEFAULT );
-		status = dyn_comp( &agParams, mPredictorU, &workBits, numSamples/dilate, chanBits, &bits1 );
+		status = dyn_comp( &agParams, buffers.mPredictorU, &workBits, numSamples/dilate, chanBits, &bits1 );
 		RequireNoErr( status, goto Exit; );
 
 		numBits = (dilate * bits1) + (16 * numU);
@@ -945,15 +914,15 @@ int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint
 		if ( bytesShifted != 0 )
 		{
 			for ( index = 0; index < numSamples; index++ )
-				BitBufferWrite( bitstream, mShiftBufferUV[index], shift );
+				BitBufferWrite( bitstream, buffers.mShiftBufferUV[index], shift );
 		}
 
 		// run the dynamic predictor with the best result
-		pc_block( mMixBufferU, mPredictorU, numSamples, coefsU[numU-1], numU, chanBits, DENSHIFT_DEFAULT );
+		pc_block( buffers.mMixBufferU, buffers.mPredictorU, numSamples, coefsU[numU-1], numU, chanBits, DENSHIFT_DEFAULT );
 
 		// do lossless compression
 		set_standard_ag_params( &agParams, numSamples, numSamples );
-		status = dyn_comp( &agParams, mPredictorU, bitstream, numSamples, chanBits, &bits1 );
+		status = dyn_comp( &agParams, buffers.mPredictorU, bitstream, numSamples, chanBits, &bits1 );
 		//AssertNoErr( status );
 
 
@@ -987,15 +956,15 @@ int32_t ALACEncoder::EncodeMono( BitBuffer * bitstream, void * inputBuffer, uint
 				break;
 			case 20:
 				// convert 20-bit data to 32-bit for simplicity
-				copy20ToPredictor( (uint8_t *) inputBuffer, stride, mMixBufferU, numSamples );
+				copy20ToPredictor( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, numSamples );
 				for ( index = 0; index < numSamples; index++ )
-					BitBufferWrite( bitstream, mMixBufferU[index], 20 );
+					BitBufferWrite( bitstream, buffers.mMixBufferU[index], 20 );
 				break;
 			case 24:
 				// convert 24-bit data to 32-bit for simplicity
-				copy24ToPredictor( (uint8_t *) inputBuffer, stride, mMixBufferU, numSamples );
+				copy24ToPredictor( (uint8_t *) inputBuffer, stride, buffers.mMixBufferU, numSamples );
 				for ( index = 0; index < numSamples; index++ )
-					BitBufferWrite( bitstream, mMixBufferU[index], 24 );
+					BitBufferWrite( bitstream, buffers.mMixBufferU[index], 24 );
 				break;
 			case 32:
 				input32 = (int32_t *) inputBuffer;
@@ -1041,9 +1010,9 @@ int32_t ALACEncoder::Encode(AudioFormatDescription theInputFormat, AudioFormatDe
 
 		// encode stereo input buffer
 		if ( mFastMode == false )
-			status = this->EncodeStereo( &bitstream, theReadBuffer, 2, 0, numFrames );
+			status = this->EncodeStereo( &bitstream, theReadBuffer, 2, 0, numFrames, mElementBuffers[0] );
 		else
-			status = this->EncodeStereoFast( &bitstream, theReadBuffer, 2, 0, numFrames );
+			status = this->EncodeStereoFast( &bitstream, theReadBuffer, 2, 0, numFrames, mElementBuffers[0] );
 		RequireNoErr( status, goto Exit; );
 	}
 	else if ( theInputFormat.mChannelsPerFrame == 1 )
@@ -1053,7 +1022,7 @@ int32_t ALACEncoder::Encode(AudioFormatDescription theInputFormat, AudioFormatDe
 		BitBufferWrite( &bitstream, 0, 4 );
 
 		// encode mono input buffer
-		status = this->EncodeMono( &bitstream, theReadBuffer, 1, 0, numFrames );
+		status = this->EncodeMono( &bitstream, theReadBuffer, 1, 0, numFrames, mElementBuffers[0] );
 		RequireNoErr( status, goto Exit; );
 	}
 	else
@@ -1084,7 +1053,7 @@ int32_t ALACEncoder::Encode(AudioFormatDescription theInputFormat, AudioFormatDe
 					// mono
 					BitBufferWrite( &bitstream, monoElementTag, 4 );
 
-					status = this->EncodeMono( &bitstream, inputBuffer, theInputFormat.mChannelsPerFrame, channelIndex, numFrames );
+					status = this->EncodeMono( &bitstream, inputBuffer, theInputFormat.mChannelsPerFrame, channelIndex, numFrames, mElementBuffers[0] );
 					
 					inputBuffer += inputIncrement;
 					channelIndex++;
@@ -1095,7 +1064,7 @@ int32_t ALACEncoder::Encode(AudioFormatDescription theInputFormat, AudioFormatDe
 					// stereo
 					BitBufferWrite( &bitstream, stereoElementTag, 4 );
 
-					status = this->EncodeStereo( &bitstream, inputBuffer, theInputFormat.mChannelsPerFrame, channelIndex, numFrames );
+					status = this->EncodeStereo( &bitstream, inputBuffer, theInputFormat.mChannelsPerFrame, channelIndex, numFrames, mElementBuffers[0] );
 
 					inputBuffer += (inputIncrement * 2);
 					channelIndex += 2;
@@ -1106,7 +1075,7 @@ int32_t ALACEncoder::Encode(AudioFormatDescription theInputFormat, AudioFormatDe
 					// LFE channel (subwoofer)
 					BitBufferWrite( &bitstream, lfeElementTag, 4 );
 
-					status = this->EncodeMono( &bitstream, inputBuffer, theInputFormat.mChannelsPerFrame, channelIndex, numFrames );
+					status = this->EncodeMono( &bitstream, inputBuffer, theInputFormat.mChannelsPerFrame, channelIndex, numFrames, mElementBuffers[0] );
 
 					inputBuffer += inputIncrement;
 					channelIndex++;
@@ -1161,6 +1130,131 @@ Exit:
 	return status;
 }
 
+/*
+	AppendBits()
+	- copy numBits bits from the start of source to the current position of bits
+*/
+static void AppendBits( BitBuffer * bits, const uint8_t * source, uint32_t numBits )
+{
+	uint32_t		numBytes = numBits >> 3;
+	uint32_t		shift = bits->bitIndex;
+
+	if ( shift == 0 )
+	{
+		memcpy( bits->cur, source, numBytes );
+	}
+	else
+	{
+		// each source byte straddles two output bytes
+		uint8_t *		cur = bits->cur;
+		uint8_t			carry = (uint8_t)(cur[0] & (0xffu << (8 - shift)));
+
+		for ( uint32_t index = 0; index < numBytes; index++ )
+		{
+			cur[index] = (uint8_t)(carry | (source[index] >> shift));
+			carry = (uint8_t)(source[index] << (8 - shift));
+		}
+		cur[numBytes] = carry;
+	}
+	bits->cur += numBytes;
+
+	if ( (numBits & 7) != 0 )
+		BitBufferWrite( bits, (uint32_t)(source[numBytes] >> (8 - (numBits & 7))), numBits & 7 );
+}
+
+/*
+	EncodeElement()
+	- encode one element of a frame into the element's own bitstream
+*/
+int32_t ALACEncoder::EncodeElement( uint32_t element, AudioFormatDescription theInputFormat,
+									unsigned char * theReadBuffer, uint32_t numFrames )
+{
+	BitBuffer			bitstream;
+	uint32_t			numChannels = theInputFormat.mChannelsPerFrame;
+	uint32_t			channelIndex = 0;
+	uint32_t			tag = ID_SCE;
+	uint8_t				elementTags[8] = { 0 };
+	uint8_t				elementTag = 0;
+	int32_t				status;
+
+	RequireAction( mConcurrentElements && (element < mNumElements) && (numChannels == mNumChannels), return kALAC_ParamError; );
+	ElementBuffers &	buffers = mElementBuffers[element];
+
+	// walk the channel map to this element's channels and instance tag
+	for ( uint32_t index = 0; index <= element; index++ )
+	{
+		if ( index > 0 )
+			channelIndex += (tag == ID_CPE) ? 2 : 1;
+
+		tag = (sChannelMaps[numChannels - 1] & (0x7ul << (channelIndex * 3))) >> (channelIndex * 3);
+		elementTag = elementTags[tag]++;
+	}
+
+	BitBufferInit( &bitstream, buffers.mElementBits, mElementBytes );
+	BitBufferWrite( &bitstream, tag, 3 );
+	BitBufferWrite( &bitstream, elementTag, 4 );
+
+	unsigned char *		inputBuffer = theReadBuffer + channelIndex * ((mBitDepth + 7) / 8);
+
+	switch ( tag )
+	{
+		case ID_SCE:
+		case ID_LFE:
+			status = this->EncodeMono( &bitstream, inputBuffer, numChannels, channelIndex, numFrames, buffers );
+			break;
+
+		case ID_CPE:
+			// as in Encode(), only a plain stereo frame uses the fast mode
+			if ( (mFastMode == false) || (numChannels != 2) )
+				status = this->EncodeStereo( &bitstream, inputBuffer, numChannels, channelIndex, numFrames, buffers );
+			else
+				status = this->EncodeStereoFast( &bitstream, inputBuffer, numChannels, channelIndex, numFrames, buffers );
+			break;
+
+		default:
+			status = kALAC_ParamError;
+			break;
+	}
+
+	buffers.mNumBits = BitBufferGetPosition( &bitstream );
+	buffers.mStatus = status;
+
+	return status;
+}
+
+/*
+	FinishElements()
+	- join the elements encoded by EncodeElement() into one frame
+*/
+int32_t ALACEncoder::FinishElements( unsigned char * theWriteBuffer, int32_t * ioNumBytes )
+{
+	BitBuffer			bitstream;
+	uint32_t			outputSize;
+
+	BitBufferInit( &bitstream, theWriteBuffer, mMaxOutputBytes );
+
+	for ( uint32_t element = 0; element < mNumElements; element++ )
+	{
+		RequireNoErr( mElementBuffers[element].mStatus, return mElementBuffers[element].mStatus; );
+		AppendBits( &bitstream, mElementBuffers[element].mElementBits, mElementBuffers[element].mNumBits );
+	}
+
+	// add 3-bit frame end tag: ID_END
+	BitBufferWrite( &bitstream, ID_END, 3 );
+
+	// byte-align the output data
+	BitBufferByteAlign( &bitstream, true );
+
+	outputSize = BitBufferGetPosition( &bitstream ) / 8;
+	*ioNumBytes = outputSize;
+
+	// gather encoding stats
+	mTotalBytesGenerated += outputSize;
+	mMaxFrameBytes = MAX( mMaxFrameBytes, outputSize );
+
+	return ALAC_noErr;
+}
+
 /*
 	Finish()
 	- drain out any leftover samples
@@ -1254,6 +1348,7 @@ int32_t ALACEncoder::InitializeEncoder(AudioFormatDescription theOutputFormat)
     
     mOutputSampleRate = theOutputFormat.mSampleRate;
     mNumChannels = theOutputFormat.mChannelsPerFrame;
+	RequireAction( (mNumChannels >= 1) && (mNumChannels <= kALACMaxChannels), return kALAC_ParamError; );
     switch(theOutputFormat.mFormatFlags)
     {
         case 1:
@@ -1279,38 +1374,36 @@ int32_t ALACEncoder::InitializeEncoder(AudioFormatDescription theOutputFormat)
 
 	// the maximum output frame size can be no bigger than (samplesPerBlock * numChannels * ((10 + sampleSize)/8) + 1)
 	// but note that this can be bigger than the input size!
-	// - since we don't yet know what our input format will be, use our max allowed sample size in the calculation
-	mMaxOutputBytes = mFrameSize * mNumChannels * ((10 + kMaxSampleSize) / 8)  + 1;
+	// - round the bits per sample up so a worst-case compressed sample (a 9-bit escape plus the full sample) fits,
+	//	 and leave room for each element's header and coefs
+	mMaxOutputBytes = mFrameSize * mNumChannels * ((10 + mBitDepth + 7) / 8) + 1;
 
-	// allocate mix buffers
-	mMixBufferU = (int32_t *) calloc( mFrameSize * sizeof(int32_t), 1 );
-	mMixBufferV = (int32_t *) calloc( mFrameSize * sizeof(int32_t), 1 );
+	// one element holds at most a channel pair, so that bounds each element's bitstream
+	mElementBytes = mFrameSize * 2 * ((10 + mBitDepth + 7) / 8) + kElementOverhead + 1;
 
-	// allocate dynamic predictor buffers
-	mPredictorU = (int32_t *) calloc( mFrameSize * sizeof(int32_t), 1 );
-	mPredictorV = (int32_t *) calloc( mFrameSize * sizeof(int32_t), 1 );
-	
-	// allocate combined shift buffer
-	mShiftBufferUV = (uint16_t *) calloc( mFrameSize * 2 * sizeof(uint16_t),1 );
-	
-	// allocate work buffer for search loop
-	mWorkBuffer = (uint8_t *) calloc( mMaxOutputBytes, 1 );
+	mNumElements = GetNumElements( mNumChannels );
+	mMaxOutputBytes += mNumElements * kElementOverhead;
 
-	RequireAction( (mMixBufferU != nil) && (mMixBufferV != nil) &&
-					(mPredictorU != nil) && (mPredictorV != nil) &&
-					(mShiftBufferUV != nil) && (mWorkBuffer != nil ),
-					status = kALAC_MemFullError; goto Exit; );
+	// allocate all buffers and coefs in one block, releasing any from a previous configuration
+	free( mArena );
+	mArenaSize = LayoutArena( nil );
+	mArena = calloc( mArenaSize + kArenaAlignment, 1 );
+	RequireAction( mArena != nil, mArenaSize = 0; status = kALAC_MemFullError; goto Exit; );
 
-	status = ALAC_noErr;
+	LayoutArena( (uint8_t *) mArena );
 
+	status = ALAC_noErr;
 
 	// initialize coefs arrays once b/c retaining state across blocks actually improves the encode ratio
-	for ( int32_t channel = 0; channel < (int32_t)mNumChannels; channel++ )
+	for ( uint32_t channel = 0; channel < mNumChannels; channel++ )
 	{
-		for ( int32_t search = 0; search < kALACMaxSearches; search++ )
+		SearchCoefs		coefsU = (SearchCoefs) (mCoefsU + channel * kMaxUV * kMaxUV);
+		SearchCoefs		coefsV = (SearchCoefs) (mCoefsV + channel * kMaxUV * kMaxUV);
+
+		for ( uint32_t search = 0; search < kMaxUV; search++ )
 		{
-			init_coefs( mCoefsU[channel][search], DENSHIFT_DEFAULT, kALACMaxCoefs );
-			init_coefs( mCoefsV[channel][search], DENSHIFT_DEFAULT, kALACMaxCoefs );
+			init_coefs( coefsU[search], DENSHIFT_DEFAULT, kMaxUV );
+			init_coefs( coefsV[search], DENSHIFT_DEFAULT, kMaxUV );
 		}
 	}
 
@@ -1318,6 +1411,96 @@ Exit:
 	return status;
 }
 
+/*
+	ArenaBlock()
+	- hand out the next cache-aligned block of the arena, or nil while only measuring it
+*/
+static uint8_t * ArenaBlock( uint8_t * base, uintptr_t & offset, uintptr_t numBytes )
+{
+	uint8_t *		block = (base != nil) ? base + offset : nil;
+
+	offset += (numBytes + kArenaAlignment - 1) & ~(uintptr_t)(kArenaAlignment - 1);
+	return block;
+}
+
+/*
+	LayoutArena()
+	- place the coefs and element buffers for the current config in the arena, each on its own cache line
+	- with a nil arena, only return the bytes needed
+*/
+uint32_t ALACEncoder::LayoutArena( uint8_t * arena )
+{
+	uint8_t *		base = nil;
+	uintptr_t		offset = 0;
+	uint32_t		numSets = mConcurrentElements ? mNumElements : 1;
+	uint32_t		channelIndex = 0;
+
+	if ( arena != nil )
+		base = (uint8_t *)(((uintptr_t) arena + kArenaAlignment - 1) & ~(uintptr_t)(kArenaAlignment - 1));
+
+	mElementBuffers	= (ElementBuffers *) ArenaBlock( base, offset, numSets * sizeof(ElementBuffers) );
+	mCoefsU			= (int16_t *) ArenaBlock( base, offset, mNumChannels * kMaxUV * kMaxUV * sizeof(int16_t) );
+	mCoefsV			= (int16_t *) ArenaBlock( base, offset, mNumChannels * kMaxUV * kMaxUV * sizeof(int16_t) );
+
+	for ( uint32_t element = 0; element < numSets; element++ )
+	{
+		ElementBuffers	buffers;
+		uint32_t		tag = (sChannelMaps[mNumChannels - 1] & (0x7ul << (channelIndex * 3))) >> (channelIndex * 3);
+
+		// Encode() runs every element through the first set, so it must hold a pair if the layout has one;
+		// the other sets only serve their own element, and mono elements never touch the V side
+		bool			pair = (element == 0) ? (mNumChannels > 1) : (tag == ID_CPE);
+
+		memset( &buffers, 0, sizeof(buffers) );
+
+		// mix buffers and dynamic predictor buffers
+		buffers.mMixBufferU = (int32_t *) ArenaBlock( base, offset, mFrameSize * sizeof(int32_t) );
+		buffers.mPredictorU = (int32_t *) ArenaBlock( base, offset, mFrameSize * sizeof(int32_t) );
+		if ( pair )
+		{
+			buffers.mMixBufferV = (int32_t *) ArenaBlock( base, offset, mFrameSize * sizeof(int32_t) );
+			buffers.mPredictorV = (int32_t *) ArenaBlock( base, offset, mFrameSize * sizeof(int32_t) );
+		}
+
+		// combined shift buffer: only 24- and 32-bit samples have bytes shifted off
+		if ( mBitDepth >= 24 )
+			buffers.mShiftBufferUV = (uint16_t *) ArenaBlock( base, offset, mFrameSize * 2 * sizeof(uint16_t) );
+
+		// work buffer for the search loop and, when encoding elements concurrently, the element's own bitstream
+		// - the extra bytes let the adaptive Golomb coder read a whole word at the end of the buffer
+		buffers.mWorkBuffer = (uint8_t *) ArenaBlock( base, offset, mElementBytes + 4 );
+		if ( mConcurrentElements )
+			buffers.mElementBits = (uint8_t *) ArenaBlock( base, offset, mElementBytes + 4 );
+
+		if ( base != nil )
+			mElementBuffers[element] = buffers;
+
+		channelIndex += (tag == ID_CPE) ? 2 : 1;
+	}
+
+	return (uint32_t) offset;
+}
+
+/*
+	GetNumElements()
+	- count the elements (SCE, CPE or LFE) of the channel layout for numChannels
+*/
+uint32_t ALACEncoder::GetNumElements( uint32_t numChannels )
+{
+	uint32_t		numElements = 0;
+
+	if ( (numChannels < 1) || (numChannels > kALACMaxChannels) )
+		return 0;
+
+	for ( uint32_t channelIndex = 0; channelIndex < numChannels; numElements++ )
+	{
+		uint32_t	tag = (sChannelMaps[numChannels - 1] & (0x7ul << (channelIndex * 3))) >> (channelIndex * 3);
+		channelIndex += (tag == ID_CPE) ? 2 : 1;
+	}
+
+	return numElements;
+}
+
 /*
 	GetSourceFormat()
 	- given the input format, return one of our supported formats
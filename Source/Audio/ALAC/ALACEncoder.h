@@ -43,8 +43,9 @@ class ALACEncoder
 
 		void				SetFastMode( bool fast ) { mFastMode = fast; };
 
-		// this must be called *before* InitializeEncoder()
+		// these must be called *before* InitializeEncoder()
 		void				SetFrameSize( uint32_t frameSize ) { mFrameSize = frameSize; };
+		void				SetConcurrentElements( bool concurrent ) { mConcurrentElements = concurrent; };
 
 		void				GetConfig( ALACSpecificConfig & config );
         uint32_t            GetMagicCookieSize(uint32_t inNumChannels);
@@ -52,14 +53,47 @@ class ALACEncoder
 
         virtual int32_t	InitializeEncoder(AudioFormatDescription theOutputFormat);
 
+		// worst-case size of one encoded frame, for sizing the buffer passed to Encode()
+		uint32_t			GetMaxOutputBytes( ) const { return mMaxOutputBytes; };
+
+		// bytes of encoder state and buffers allocated by InitializeEncoder()
+		uint32_t			GetArenaSize( ) const { return mArenaSize; };
+
+		// a frame is a sequence of independent elements (SCE, CPE or LFE), each with its own
+		// buffers and per-channel state, so the elements of one frame can be encoded concurrently:
+		// - call EncodeElement() once for every element index, in any order and from any thread
+		//	 (but each element from one thread), then FinishElements() to join them
+		// - the joined frame is byte-identical to what Encode() produces
+		// - each element needs buffers of its own, so this requires SetConcurrentElements( true )
+		uint32_t			GetNumElements( ) const { return mNumElements; };
+		static uint32_t		GetNumElements( uint32_t numChannels );
+		int32_t				EncodeElement( uint32_t element, AudioFormatDescription theInputFormat,
+										   unsigned char * theReadBuffer, uint32_t numFrames );
+		int32_t				FinishElements( unsigned char * theWriteBuffer, int32_t * ioNumBytes );
+
     protected:
+		// scratch buffers for encoding one element, plus the element's own bitstream
+		struct ElementBuffers
+		{
+			int32_t *				mMixBufferU;
+			int32_t *				mMixBufferV;
+			int32_t *				mPredictorU;
+			int32_t *				mPredictorV;
+			uint16_t *				mShiftBufferUV;
+			uint8_t *				mWorkBuffer;
+			uint8_t *				mElementBits;
+			uint32_t				mNumBits;
+			int32_t					mStatus;
+		};
+
 		virtual void		GetSourceFormat( const AudioFormatDescription * source, AudioFormatDescription * output );
 		
-		int32_t			EncodeStereo( struct BitBuffer * bitstream, void * input, uint32_t stride, uint32_t channelIndex, uint32_t numSamples );
-		int32_t			EncodeStereoFast( struct BitBuffer * bitstream, void * input, uint32_t stride, uint32_t channelIndex, uint32_t numSamples );
-		int32_t			EncodeStereoEscape( struct BitBuffer * bitstream, void * input, uint32_t stride, uint32_t numSamples );
-		int32_t			EncodeMono( struct BitBuffer * bitstream, void * input, uint32_t stride, uint32_t channelIndex, uint32_t numSamples );
+		int32_t			EncodeStereo( struct BitBuffer * bitstream, void * input, uint32_t stride, uint32_t channelIndex, uint32_t numSamples, ElementBuffers & buffers );
+		int32_t			EncodeStereoFast( struct BitBuffer * bitstream, void * input, uint32_t stride, uint32_t channelIndex, uint32_t numSamples, ElementBuffers & buffers );
+		int32_t			EncodeStereoEscape( struct BitBuffer * bitstream, void * input, uint32_t stride, uint32_t numSamples, ElementBuffers & buffers );
+		int32_t			EncodeMono( struct BitBuffer * bitstream, void * input, uint32_t stride, uint32_t channelIndex, uint32_t numSamples, ElementBuffers & buffers );
 
+		uint32_t		LayoutArena( uint8_t * arena );
 
 		// ALAC encoder parameters
 		int16_t					mBitDepth;
@@ -68,18 +102,20 @@ class ALACEncoder
 		// encoding state
 		int16_t					mLastMixRes[kALACMaxChannels];
 
-		// encoding buffers
-		int32_t *				mMixBufferU;
-		int32_t *				mMixBufferV;
-		int32_t *				mPredictorU;
-		int32_t *				mPredictorV;
-		uint16_t *				mShiftBufferUV;
-		
-		uint8_t *					mWorkBuffer;
+		// encoding buffers: one set, or one per element of the channel layout when encoding
+		// elements concurrently
+		ElementBuffers *		mElementBuffers;
+		uint32_t				mNumElements;
+		uint32_t				mElementBytes;
+		bool					mConcurrentElements;
+
+		// per-channel coefficients buffers: [mNumChannels][kMaxUV][kMaxUV]
+		int16_t *				mCoefsU;
+		int16_t *				mCoefsV;
 
-		// per-channel coefficients buffers
-		int16_t					mCoefsU[kALACMaxChannels][kALACMaxSearches][kALACMaxCoefs];
-		int16_t					mCoefsV[kALACMaxChannels][kALACMaxSearches][kALACMaxCoefs];
+		// one cache-aligned block holding all of the above, sized for the configured channels and frame size
+		void *					mArena;
+		uint32_t				mArenaSize;
 
 		// encoding statistics
 		uint32_t					mTotalBytesGenerated;
@@ -1,6 +1,44 @@
 #include "ALACEncoderWrapper.h"
+#include "PcmConversion.h"
 #include <cstring>
 
+namespace
+{
+    // The speaker in each position of ALAC's layout for a given channel count
+    // (ALACChannelLayoutTags), with the name the same speaker goes by in
+    // other JUCE layouts. ALAC's only eight-channel layout has front centre
+    // pairs; 7.1 surround sends its side pair as Ls/Rs and its rear pair in
+    // the Lc/Rc positions.
+    struct AlacPosition
+    {
+        juce::AudioChannelSet::ChannelType type;
+        juce::AudioChannelSet::ChannelType alternative;
+    };
+
+    using Set = juce::AudioChannelSet;
+
+    const AlacPosition alacPositions[kALACMaxChannels][kALACMaxChannels] =
+    {
+        { { Set::centre, Set::centre } },
+        { { Set::left, Set::left }, { Set::right, Set::right } },
+        { { Set::centre, Set::centre }, { Set::left, Set::left }, { Set::right, Set::right } },
+        { { Set::centre, Set::centre }, { Set::left, Set::left }, { Set::right, Set::right },
+          { Set::centreSurround, Set::centreSurround } },
+        { { Set::centre, Set::centre }, { Set::left, Set::left }, { Set::right, Set::right },
+          { Set::leftSurround, Set::leftSurroundSide }, { Set::rightSurround, Set::rightSurroundSide } },
+        { { Set::centre, Set::centre }, { Set::left, Set::left }, { Set::right, Set::right },
+          { Set::leftSurround, Set::leftSurroundSide }, { Set::rightSurround, Set::rightSurroundSide },
+          { Set::LFE, Set::LFE } },
+        { { Set::centre, Set::centre }, { Set::left, Set::left }, { Set::right, Set::right },
+          { Set::leftSurround, Set::leftSurroundSide }, { Set::rightSurround, Set::rightSurroundSide },
+          { Set::centreSurround, Set::centreSurround }, { Set::LFE, Set::LFE } },
+        { { Set::centre, Set::centre }, { Set::leftCentre, Set::leftSurroundRear }, { Set::rightCentre, Set::rightSurroundRear },
+          { Set::left, Set::left }, { Set::right, Set::right },
+          { Set::leftSurround, Set::leftSurroundSide }, { Set::rightSurround, Set::rightSurroundSide },
+          { Set::LFE, Set::LFE } }
+    };
+}
+
 ALACEncoderWrapper::ALACEncoderWrapper()
 {
 }
@@ -15,6 +53,10 @@ bool ALACEncoderWrapper::initialize(double sampleRate, int numChannels, int samp
     currentNumChannels = numChannels;
     currentFrameSize = samplesPerBlock;
     currentBitDepth = 16; // Using 16-bit for compatibility
+    reorderChannels = false;
+    
+    for (int i = 0; i < kALACMaxChannels; ++i)
+        channelOrder[i] = i;
     
     // Set up the output format for ALAC
     AudioFormatDescription outputFormat;
@@ -26,8 +68,15 @@ bool ALACEncoderWrapper::initialize(double sampleRate, int numChannels, int samp
     outputFormat.mChannelsPerFrame = numChannels;
     outputFormat.mFramesPerPacket = currentFrameSize;
     
+    // Multichannel frames have several elements to encode side by side,
+    // each of which then needs buffers of its own in the encoder
+    const int numElements = (int)ALACEncoder::GetNumElements((uint32_t)numChannels);
+    const int numWorkers = elementThreads < 0 ? ElementEncoderPool::getDefaultNumWorkers(numElements)
+                                              : juce::jmin(elementThreads, numElements - 1);
+    
     // Set the frame size before initialization
     encoder.SetFrameSize(currentFrameSize);
+    encoder.SetConcurrentElements(numWorkers > 0);
     
     // Initialize the encoder
     int32_t status = encoder.InitializeEncoder(outputFormat);
@@ -39,30 +88,142 @@ bool ALACEncoderWrapper::initialize(double sampleRate, int numChannels, int samp
     
     isInitialized = true;
     
+    if (numWorkers <= 0)
+        elementPool.reset();
+    else if (elementPool == nullptr || elementPool->getNumWorkers() != numWorkers)
+        elementPool = std::make_unique<ElementEncoderPool>(numWorkers);
+    
     // Pre-allocate buffers
     tempBuffer.resize(currentFrameSize * numChannels);
-    outputBuffer.resize(currentFrameSize * numChannels * 4); // Conservative estimate
+    outputBuffer.resize(encoder.GetMaxOutputBytes());
+    
+    return true;
+}
+
+bool ALACEncoderWrapper::initialize(double sampleRate, const juce::AudioChannelSet& layout, int samplesPerBlock)
+{
+    int order[kALACMaxChannels];
+    
+    if (!getChannelOrder(layout, order))
+    {
+        isInitialized = false;
+        return false;
+    }
+    
+    if (!initialize(sampleRate, layout.size(), samplesPerBlock))
+        return false;
+    
+    for (int i = 0; i < currentNumChannels; ++i)
+    {
+        channelOrder[i] = order[i];
+        reorderChannels = reorderChannels || order[i] != i;
+    }
+    
+    return true;
+}
+
+bool ALACEncoderWrapper::getChannelOrder(const juce::AudioChannelSet& layout, int* order)
+{
+    const int numChannels = layout.size();
+    
+    if (numChannels < 1 || numChannels > kALACMaxChannels)
+        return false;
+    
+    for (int i = 0; i < numChannels; ++i)
+    {
+        const auto& position = alacPositions[numChannels - 1][i];
+        int index = layout.getChannelIndexForType(position.type);
+        
+        if (index < 0)
+            index = layout.getChannelIndexForType(position.alternative);
+        
+        if (index < 0)
+            return false;
+        
+        order[i] = index;
+    }
     
     return true;
 }
 
+juce::MemoryBlock ALACEncoderWrapper::getMagicCookie()
+{
+    if (!isInitialized)
+        return {};
+    
+    uint32_t size = encoder.GetMagicCookieSize(currentNumChannels);
+    juce::MemoryBlock cookie(size, true);
+    encoder.GetMagicCookie(cookie.getData(), &size);
+    cookie.setSize(size);
+    
+    return cookie;
+}
+
+void ALACEncoderWrapper::setElementThreads(int numThreads)
+{
+    elementThreads = numThreads;
+}
+
+int ALACEncoderWrapper::getElementThreads() const
+{
+    return elementPool != nullptr ? elementPool->getNumWorkers() : 0;
+}
+
+void ALACEncoderWrapper::setFastMode(bool shouldUseFastMode)
+{
+    fastMode = shouldUseFastMode;
+    encoder.SetFastMode(shouldUseFastMode);
+}
+
 void ALACEncoderWrapper::convertFloatToInt16(const juce::AudioBuffer<float>& buffer, int numSamples)
 {
-    int numChannels = buffer.getNumChannels();
+    if (reorderChannels && buffer.getNumChannels() >= currentNumChannels)
+    {
+        // Interleave through a view that lists the channels in ALAC's order
+        float* channels[kALACMaxChannels];
+        for (int i = 0; i < currentNumChannels; ++i)
+            channels[i] = const_cast<float*>(buffer.getReadPointer(channelOrder[i]));
+        
+        juce::AudioBuffer<float> alacOrder(channels, currentNumChannels, numSamples);
+        PcmConversion::floatToInt16(alacOrder, 0, numSamples, currentNumChannels, tempBuffer.data());
+        return;
+    }
     
     // Interleave the audio data and convert to int16
-    for (int i = 0; i < numSamples; ++i)
+    PcmConversion::floatToInt16(buffer, 0, numSamples, currentNumChannels, tempBuffer.data());
+}
+
+juce::MemoryBlock ALACEncoderWrapper::encode(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    if (!isInitialized)
     {
-        for (int ch = 0; ch < numChannels; ++ch)
-        {
-            float sample = buffer.getSample(ch, i);
-            sample = juce::jlimit(-1.0f, 1.0f, sample);
-            tempBuffer[i * numChannels + ch] = static_cast<int16_t>(sample * 32767.0f);
-        }
+        return {};
     }
+    
+    // Convert float audio to int16
+    convertFloatToInt16(buffer, numSamples);
+    
+    return encodeAlacOrder(tempBuffer.data(), numSamples);
 }
 
-juce::MemoryBlock ALACEncoderWrapper::encode(const juce::AudioBuffer<float>& buffer, int numSamples)
+juce::MemoryBlock ALACEncoderWrapper::encodeInterleaved(const int16_t* frames, int numSamples)
+{
+    if (!isInitialized || !reorderChannels)
+        return encodeAlacOrder(frames, numSamples);
+    
+    jassert(numSamples <= currentFrameSize);
+    numSamples = juce::jmin(numSamples, currentFrameSize);
+    
+    // Frames arrive in the host's order; shuffle them into ALAC's
+    const int numChannels = currentNumChannels;
+    for (int i = 0; i < numSamples; ++i)
+        for (int ch = 0; ch < numChannels; ++ch)
+            tempBuffer[(size_t)(i * numChannels + ch)] = frames[i * numChannels + channelOrder[ch]];
+    
+    return encodeAlacOrder(tempBuffer.data(), numSamples);
+}
+
+juce::MemoryBlock ALACEncoderWrapper::encodeAlacOrder(const int16_t* frames, int numSamples)
 {
     juce::MemoryBlock result;
     
@@ -71,9 +232,6 @@ juce::MemoryBlock ALACEncoderWrapper::encode(const juce::AudioBuffer<float>& buf
         return result;
     }
     
-    // Convert float audio to int16
-    convertFloatToInt16(buffer, numSamples);
-    
     // Set up input format
     AudioFormatDescription inputFormat;
     std::memset(&inputFormat, 0, sizeof(AudioFormatDescription));
@@ -100,13 +258,21 @@ juce::MemoryBlock ALACEncoderWrapper::encode(const juce::AudioBuffer<float>& buf
     // Encode the data
     int32_t ioNumBytes = numSamples * inputFormat.mBytesPerPacket;
     
-    int32_t status = encoder.Encode(
-        inputFormat,
-        outputFormat,
-        reinterpret_cast<unsigned char*>(tempBuffer.data()),
-        outputBuffer.data(),
-        &ioNumBytes
-    );
+    // Encode only reads the input
+    auto* input = reinterpret_cast<unsigned char*>(const_cast<int16_t*>(frames));
+    int32_t status;
+    
+    if (elementPool != nullptr)
+    {
+        status = elementPool->encodeElements(encoder, inputFormat, input, (uint32_t)numSamples);
+        
+        if (status == 0)
+            status = encoder.FinishElements(outputBuffer.data(), &ioNumBytes);
+    }
+    else
+    {
+        status = encoder.Encode(inputFormat, outputFormat, input, outputBuffer.data(), &ioNumBytes);
+    }
     
     if (status == 0 && ioNumBytes > 0)
     {
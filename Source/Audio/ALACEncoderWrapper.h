@@ -1,6 +1,7 @@
 #pragma once
 #include "ALAC/ALACEncoder.h"
 #include "ALAC/ALACAudioTypes.h"
+#include "ElementEncoderPool.h"
 #include <JuceHeader.h>
 
 class ALACEncoderWrapper
@@ -9,9 +10,42 @@ public:
     ALACEncoderWrapper();
     ~ALACEncoderWrapper();
     
+    // Channels are taken to be in ALAC's order already
     bool initialize(double sampleRate, int numChannels, int samplesPerBlock);
+    
+    // Takes the host's channels in the layout's order and reorders them into
+    // ALAC's (C L R Ls Rs LFE for 5.1, C Lc Rc L R Ls Rs LFE for 7.1) as
+    // they are interleaved. Fails for layouts getChannelOrder() rejects.
+    bool initialize(double sampleRate, const juce::AudioChannelSet& layout, int samplesPerBlock);
+    
+    // Fills order[i] with the layout channel that goes in ALAC position i.
+    // False when ALAC has no layout with the same speakers.
+    static bool getChannelOrder(const juce::AudioChannelSet& layout, int* order);
+    
     juce::MemoryBlock encode(const juce::AudioBuffer<float>& buffer, int numSamples);
     
+    // Encodes interleaved native-endian 16-bit frames without copying them
+    juce::MemoryBlock encodeInterleaved(const int16_t* frames, int numSamples);
+    
+    // ALACSpecificConfig plus channel layout, as a decoder or a file needs it
+    juce::MemoryBlock getMagicCookie();
+    
+    // Worker threads that encode the elements of multichannel frames
+    // alongside the caller; 0 (the default) encodes serially, -1 starts one
+    // per additional element up to the spare cores. Only worth it for an
+    // encoder that has the machine to itself: every encoder starts its own
+    // threads. Output is the same either way. Takes effect at the next
+    // initialize().
+    void setElementThreads(int numThreads);
+    int getElementThreads() const;
+    
+    // The encoder's two effort levels. Fast mode encodes a stereo stream
+    // with fixed mixing and predictor settings instead of searching for the
+    // best ones: quicker and still lossless, though packets are no longer the
+    // smallest the encoder can find. Mono and multichannel streams always search.
+    void setFastMode(bool shouldUseFastMode);
+    bool isFastMode() const { return fastMode; }
+    
 private:
     ALACEncoder encoder;
     bool isInitialized = false;
@@ -20,9 +54,15 @@ private:
     int currentNumChannels = 2;
     int currentFrameSize = 4096;
     int currentBitDepth = 16;
+    int channelOrder[kALACMaxChannels] = {};
+    bool reorderChannels = false;
+    int elementThreads = 0;
+    bool fastMode = false;
+    std::unique_ptr<ElementEncoderPool> elementPool;
     
     std::vector<int16_t> tempBuffer;
     std::vector<uint8_t> outputBuffer;
     
     void convertFloatToInt16(const juce::AudioBuffer<float>& buffer, int numSamples);
+    juce::MemoryBlock encodeAlacOrder(const int16_t* frames, int numSamples);
 };
@@ -0,0 +1,479 @@
+#include "AlacFileWriter.h"
+
+namespace
+{
+    // ALACSpecificConfig, the start of every cookie, and the fields in it
+    // that describe the packets: only known once they're all written
+    constexpr int alacConfigSize = 24;
+    constexpr int maxFrameBytesOffset = 12;
+    constexpr int avgBitRateOffset = 16;
+    constexpr int editCountSize = 4;
+
+    // Disk writes are gathered into blocks this large
+    constexpr size_t writeBufferBytes = 1 << 20;
+    constexpr size_t packetTableBufferBytes = 64 * 1024;
+
+    bool writeChunkHeader(juce::OutputStream& out, const char* type, juce::int64 size)
+    {
+        return out.write(type, 4) && out.writeInt64BigEndian(size);
+    }
+
+    void setBigEndianInt(juce::uint8* dest, juce::uint32 value)
+    {
+        value = juce::ByteOrder::swapIfLittleEndian(value);
+        std::memcpy(dest, &value, sizeof(value));
+    }
+
+    // The packet table's sizes: seven bits to a byte, most significant
+    // first, the top bit set on all but the last
+    void writeVariableLengthInt(juce::OutputStream& out, juce::uint32 value)
+    {
+        juce::uint8 bytes[5];
+        int numBytes = 0;
+
+        do
+        {
+            bytes[numBytes++] = (juce::uint8)(value & 0x7f);
+            value >>= 7;
+        }
+        while (value != 0);
+
+        while (--numBytes >= 0)
+            out.writeByte((char)(bytes[numBytes] | (numBytes > 0 ? 0x80 : 0)));
+    }
+
+    // An MPEG-4 box: its size, header included, its type, then its contents
+    constexpr juce::int64 boxHeaderSize = 8;
+
+    bool writeBoxHeader(juce::OutputStream& out, const char* type, juce::int64 contentsSize)
+    {
+        return out.writeIntBigEndian((int)(boxHeaderSize + contentsSize))
+            && out.write(type, 4);
+    }
+
+    bool writeBox(juce::OutputStream& out, const char* type, const juce::MemoryOutputStream& contents)
+    {
+        return writeBoxHeader(out, type, (juce::int64)contents.getDataSize())
+            && out.write(contents.getData(), contents.getDataSize());
+    }
+
+    juce::int64 boxSize(const juce::MemoryOutputStream& contents)
+    {
+        return boxHeaderSize + (juce::int64)contents.getDataSize();
+    }
+
+    // The fields MPEG-4 calls version and flags
+    void writeVersionAndFlags(juce::OutputStream& out, int version, int flags)
+    {
+        out.writeIntBigEndian((version << 24) | flags);
+    }
+
+    // Times and durations are 64-bit in version 1 boxes, 32-bit in version 0
+    void writeTime(juce::OutputStream& out, juce::int64 value, bool wide)
+    {
+        if (wide)
+            out.writeInt64BigEndian(value);
+        else
+            out.writeIntBigEndian((int)value);
+    }
+
+    void writeUnityMatrix(juce::OutputStream& out)
+    {
+        for (int value : { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 })
+            out.writeIntBigEndian(value);
+    }
+}
+
+AlacFileWriter::AlacFileWriter()
+{
+}
+
+AlacFileWriter::~AlacFileWriter()
+{
+    finish();
+}
+
+AlacFileWriter::Container AlacFileWriter::getContainerFor(const juce::File& file)
+{
+    return file.hasFileExtension(".m4a;.mp4") ? Container::MPEG4 : Container::CAF;
+}
+
+bool AlacFileWriter::open(const juce::File& file, double sampleRate, int numChannels, int framesPerPacketToUse,
+                          const juce::MemoryBlock& magicCookie)
+{
+    finish();
+
+    lastError = {};
+    packetTableBytes = 0;
+    cookie = magicCookie;
+    container = getContainerFor(file);
+    numPackets = 0;
+    numFrames = 0;
+    numAudioBytes = 0;
+    maxPacketBytes = 0;
+    framesPerPacket = framesPerPacketToUse;
+    lastPacketFrames = 0;
+    currentSampleRate = sampleRate;
+    hadShortPacket = false;
+
+    if (magicCookie.getSize() < (size_t)alacConfigSize)
+        return fail("Not an ALAC magic cookie");
+
+    if (numChannels < 1 || framesPerPacket < 1 || sampleRate <= 0.0)
+        return fail("Invalid format");
+
+    stream = std::make_unique<juce::FileOutputStream>(file, writeBufferBytes);
+
+    if (stream->failedToOpen())
+    {
+        stream.reset();
+        return fail("Could not open " + file.getFullPathName());
+    }
+
+    packetTableFile = std::make_unique<juce::TemporaryFile>(file, juce::TemporaryFile::useHiddenFile);
+    packetTable = std::make_unique<juce::FileOutputStream>(packetTableFile->getFile(), packetTableBufferBytes);
+
+    if (packetTable->failedToOpen())
+    {
+        stream.reset();
+        closePacketTable();
+        return fail("Could not open " + file.getFullPathName() + "'s packet table");
+    }
+
+    stream->setPosition(0);
+    stream->truncate();
+
+    const int bitDepth = static_cast<const juce::uint8*>(magicCookie.getData())[5];
+    const bool ok = container == Container::MPEG4 ? writeMpeg4Header() : writeCafHeader(numChannels, bitDepth);
+
+    if (!ok)
+    {
+        stream.reset();
+        closePacketTable();
+        return fail("Could not write to " + file.getFullPathName());
+    }
+
+    return true;
+}
+
+bool AlacFileWriter::writeCafHeader(int numChannels, int bitDepth)
+{
+    // 16, 20, 24 and 32-bit source data are ALAC format flags 1 to 4
+    const int formatFlags = juce::jlimit(1, 4, (bitDepth - 12) / 4);
+
+    bool ok = stream->write("caff", 4)
+           && stream->writeShortBigEndian(1)     // file version
+           && stream->writeShortBigEndian(0);    // flags
+
+    ok = ok && writeChunkHeader(*stream, "desc", 32)
+            && stream->writeDoubleBigEndian(currentSampleRate)
+            && stream->write("alac", 4)
+            && stream->writeIntBigEndian(formatFlags)
+            && stream->writeIntBigEndian(0)      // bytes per packet: they vary
+            && stream->writeIntBigEndian(framesPerPacket)
+            && stream->writeIntBigEndian(numChannels)
+            && stream->writeIntBigEndian(0);     // bits per channel: none, compressed
+
+    ok = ok && writeChunkHeader(*stream, "kuki", (juce::int64)cookie.getSize());
+    cookiePosition = stream->getPosition();
+    ok = ok && stream->write(cookie.getData(), cookie.getSize());
+
+    // The audio size is filled in by finish(); until then the chunk is
+    // marked as running to the end of the file
+    ok = ok && stream->write("data", 4);
+    dataSizePosition = stream->getPosition();
+    return ok && stream->writeInt64BigEndian(-1)
+              && stream->writeIntBigEndian(0);   // edit count
+}
+
+bool AlacFileWriter::writeMpeg4Header()
+{
+    juce::MemoryOutputStream ftyp;
+    ftyp.write("M4A ", 4);
+    ftyp.writeIntBigEndian(0);                   // minor version
+    ftyp.write("M4A mp42isom", 12);              // compatible brands
+
+    // The audio box comes first so packets can be written as they arrive,
+    // with a 64-bit size for files past 4 GB. The description of the audio
+    // (moov) follows it once the packets are all known.
+    bool ok = writeBox(*stream, "ftyp", ftyp)
+           && stream->writeIntBigEndian(1)       // size: see the 64-bit size
+           && stream->write("mdat", 4);
+
+    dataSizePosition = stream->getPosition();
+    ok = ok && stream->writeInt64BigEndian(0);
+    dataStart = stream->getPosition();
+    return ok;
+}
+
+bool AlacFileWriter::writePacket(const void* data, size_t size, int numPacketFrames)
+{
+    if (stream == nullptr)
+        return fail("Not open");
+
+    if (hadShortPacket || numPacketFrames < 1 || numPacketFrames > framesPerPacket)
+        return fail("Only the last packet may hold fewer than " + juce::String(framesPerPacket) + " frames");
+
+    if (!stream->write(data, size))
+        return fail("Could not write to " + stream->getFile().getFullPathName());
+
+    const auto tableStart = packetTable->getPosition();
+
+    if (container == Container::MPEG4)
+        packetTable->writeIntBigEndian((int)size);
+    else
+        writeVariableLengthInt(*packetTable, (juce::uint32)size);
+
+    packetTableBytes += packetTable->getPosition() - tableStart;
+
+    hadShortPacket = numPacketFrames < framesPerPacket;
+    lastPacketFrames = numPacketFrames;
+    numPackets++;
+    numFrames += numPacketFrames;
+    numAudioBytes += (juce::int64)size;
+    maxPacketBytes = juce::jmax(maxPacketBytes, (juce::uint32)size);
+    return true;
+}
+
+bool AlacFileWriter::finish()
+{
+    if (stream == nullptr)
+        return false;
+
+    // The encoder's cookie was taken before any packets, so the largest
+    // packet and bit rate are filled in here
+    const double seconds = (double)numFrames / currentSampleRate;
+    const auto avgBitRate = seconds > 0.0 ? (juce::uint32)((double)numAudioBytes * 8.0 / seconds) : 0;
+    auto* config = static_cast<juce::uint8*>(cookie.getData());
+    setBigEndianInt(config + maxFrameBytesOffset, maxPacketBytes);
+    setBigEndianInt(config + avgBitRateOffset, avgBitRate);
+
+    bool ok = container == Container::MPEG4 ? finishMpeg4() : finishCaf();
+
+    stream->flush();
+    ok = ok && !stream->getStatus().failed();
+
+    const auto file = stream->getFile();
+    stream.reset();
+    closePacketTable();
+
+    if (!ok)
+        return fail("Could not finish " + file.getFullPathName());
+
+    return true;
+}
+
+bool AlacFileWriter::finishCaf()
+{
+    const juce::int64 remainderFrames = numPackets * framesPerPacket - numFrames;
+
+    bool ok = writeChunkHeader(*stream, "pakt", 24 + packetTableBytes)
+           && stream->writeInt64BigEndian(numPackets)
+           && stream->writeInt64BigEndian(numFrames)
+           && stream->writeIntBigEndian(0)       // priming frames
+           && stream->writeIntBigEndian((int)remainderFrames)
+           && copyPacketTable();
+
+    const auto end = stream->getPosition();
+
+    return ok && stream->setPosition(cookiePosition)
+              && stream->write(cookie.getData(), cookie.getSize())
+              && stream->setPosition(dataSizePosition)
+              && stream->writeInt64BigEndian(editCountSize + numAudioBytes)
+              && stream->setPosition(end);
+}
+
+bool AlacFileWriter::finishMpeg4()
+{
+    // Both timescales are the sample rate, so durations are in frames; past
+    // 32 bits of them the version 1 boxes are needed
+    const auto timescale = juce::roundToInt(currentSampleRate);
+    const bool wide = numFrames > 0xffffffffLL;
+    const int version = wide ? 1 : 0;
+    const auto* config = static_cast<const juce::uint8*>(cookie.getData());
+    const int numChannels = config[9];
+    const int bitDepth = config[5];
+
+    juce::MemoryOutputStream mvhd;
+    writeVersionAndFlags(mvhd, version, 0);
+    writeTime(mvhd, 0, wide);                    // created
+    writeTime(mvhd, 0, wide);                    // modified
+    mvhd.writeIntBigEndian(timescale);
+    writeTime(mvhd, numFrames, wide);
+    mvhd.writeIntBigEndian(0x00010000);          // rate 1.0
+    mvhd.writeShortBigEndian(0x0100);            // volume 1.0
+    mvhd.writeRepeatedByte(0, 10);
+    writeUnityMatrix(mvhd);
+    mvhd.writeRepeatedByte(0, 24);
+    mvhd.writeIntBigEndian(2);                   // next track ID
+
+    juce::MemoryOutputStream tkhd;
+    writeVersionAndFlags(tkhd, version, 7);      // enabled, in movie and preview
+    writeTime(tkhd, 0, wide);
+    writeTime(tkhd, 0, wide);
+    tkhd.writeIntBigEndian(1);                   // track ID
+    tkhd.writeIntBigEndian(0);
+    writeTime(tkhd, numFrames, wide);
+    tkhd.writeRepeatedByte(0, 8);
+    tkhd.writeShortBigEndian(0);                 // layer
+    tkhd.writeShortBigEndian(0);                 // alternate group
+    tkhd.writeShortBigEndian(0x0100);            // volume 1.0
+    tkhd.writeShortBigEndian(0);
+    writeUnityMatrix(tkhd);
+    tkhd.writeIntBigEndian(0);                   // width
+    tkhd.writeIntBigEndian(0);                   // height
+
+    juce::MemoryOutputStream mdhd;
+    writeVersionAndFlags(mdhd, version, 0);
+    writeTime(mdhd, 0, wide);
+    writeTime(mdhd, 0, wide);
+    mdhd.writeIntBigEndian(timescale);
+    writeTime(mdhd, numFrames, wide);
+    mdhd.writeShortBigEndian(0x55c4);            // language: und
+    mdhd.writeShortBigEndian(0);
+
+    juce::MemoryOutputStream hdlr;
+    writeVersionAndFlags(hdlr, 0, 0);
+    hdlr.writeIntBigEndian(0);
+    hdlr.write("soun", 4);
+    hdlr.writeRepeatedByte(0, 12);
+    hdlr.write("SoundHandler", 13);
+
+    juce::MemoryOutputStream smhd;
+    writeVersionAndFlags(smhd, 0, 0);
+    smhd.writeIntBigEndian(0);                   // balance
+
+    juce::MemoryOutputStream url, dref, dinf;
+    writeVersionAndFlags(url, 0, 1);             // the audio is in this file
+    writeVersionAndFlags(dref, 0, 0);
+    dref.writeIntBigEndian(1);
+    writeBox(dref, "url ", url);
+    writeBox(dinf, "dref", dref);
+
+    // The sample entry carries the cookie: ALAC's config in an 'alac' box,
+    // then for more than two channels the 'chan' box the encoder appends
+    juce::MemoryOutputStream alacConfig, sampleEntry, stsd;
+    writeVersionAndFlags(alacConfig, 0, 0);
+    alacConfig.write(config, alacConfigSize);
+
+    sampleEntry.writeRepeatedByte(0, 6);
+    sampleEntry.writeShortBigEndian(1);          // data reference index
+    sampleEntry.writeRepeatedByte(0, 8);
+    sampleEntry.writeShortBigEndian((short)numChannels);
+    sampleEntry.writeShortBigEndian((short)bitDepth);
+    sampleEntry.writeIntBigEndian(0);
+    sampleEntry.writeIntBigEndian(timescale <= 0xffff ? timescale << 16 : 0);  // 16.16; the config has the rate
+    writeBox(sampleEntry, "alac", alacConfig);
+    sampleEntry.write(config + alacConfigSize, cookie.getSize() - (size_t)alacConfigSize);
+
+    writeVersionAndFlags(stsd, 0, 0);
+    stsd.writeIntBigEndian(1);
+    writeBox(stsd, "alac", sampleEntry);
+
+    // Frames per packet: all the same but perhaps the last
+    juce::MemoryOutputStream stts;
+    const bool shortLast = lastPacketFrames < framesPerPacket && numPackets > 0;
+    writeVersionAndFlags(stts, 0, 0);
+    stts.writeIntBigEndian(shortLast ? 2 : 1);
+    stts.writeIntBigEndian((int)(shortLast ? numPackets - 1 : numPackets));
+    stts.writeIntBigEndian(framesPerPacket);
+
+    if (shortLast)
+    {
+        stts.writeIntBigEndian(1);
+        stts.writeIntBigEndian(lastPacketFrames);
+    }
+
+    // All the packets are one chunk, at the start of the audio box
+    juce::MemoryOutputStream stsc, stco;
+    writeVersionAndFlags(stsc, 0, 0);
+    stsc.writeIntBigEndian(1);
+    stsc.writeIntBigEndian(1);                   // first chunk
+    stsc.writeIntBigEndian((int)numPackets);
+    stsc.writeIntBigEndian(1);                   // sample description
+
+    writeVersionAndFlags(stco, 0, 0);
+    stco.writeIntBigEndian(1);
+    stco.writeIntBigEndian((int)dataStart);
+
+    // The sample sizes are copied from the packet table file as they're
+    // written, so every enclosing box's size is worked out first
+    const juce::int64 stszSize = boxHeaderSize + 12 + packetTableBytes;
+    const juce::int64 stblSize = boxHeaderSize + boxSize(stsd) + boxSize(stts) + boxSize(stsc) + stszSize + boxSize(stco);
+    const juce::int64 minfSize = boxHeaderSize + boxSize(smhd) + boxSize(dinf) + stblSize;
+    const juce::int64 mdiaSize = boxHeaderSize + boxSize(mdhd) + boxSize(hdlr) + minfSize;
+    const juce::int64 trakSize = boxHeaderSize + boxSize(tkhd) + mdiaSize;
+    const juce::int64 moovSize = boxHeaderSize + boxSize(mvhd) + trakSize;
+
+    bool ok = writeBoxHeader(*stream, "moov", moovSize - boxHeaderSize)
+           && writeBox(*stream, "mvhd", mvhd)
+           && writeBoxHeader(*stream, "trak", trakSize - boxHeaderSize)
+           && writeBox(*stream, "tkhd", tkhd)
+           && writeBoxHeader(*stream, "mdia", mdiaSize - boxHeaderSize)
+           && writeBox(*stream, "mdhd", mdhd)
+           && writeBox(*stream, "hdlr", hdlr)
+           && writeBoxHeader(*stream, "minf", minfSize - boxHeaderSize)
+           && writeBox(*stream, "smhd", smhd)
+           && writeBox(*stream, "dinf", dinf)
+           && writeBoxHeader(*stream, "stbl", stblSize - boxHeaderSize)
+           && writeBox(*stream, "stsd", stsd)
+           && writeBox(*stream, "stts", stts)
+           && writeBox(*stream, "stsc", stsc);
+
+    ok = ok && writeBoxHeader(*stream, "stsz", stszSize - boxHeaderSize);
+    writeVersionAndFlags(*stream, 0, 0);
+    ok = ok && stream->writeIntBigEndian(0)      // sizes vary
+            && stream->writeIntBigEndian((int)numPackets)
+            && copyPacketTable()
+            && writeBox(*stream, "stco", stco);
+
+    const auto end = stream->getPosition();
+
+    return ok && stream->setPosition(dataSizePosition)
+              && stream->writeInt64BigEndian(16 + numAudioBytes)
+              && stream->setPosition(end);
+}
+
+bool AlacFileWriter::copyPacketTable()
+{
+    if (packetTable == nullptr)
+        return false;
+
+    packetTable->flush();
+
+    if (packetTable->getStatus().failed())
+        return false;
+
+    packetTable.reset();
+
+    juce::FileInputStream in(packetTableFile->getFile());
+    juce::HeapBlock<char> block(packetTableBufferBytes);
+    juce::int64 numCopied = 0;
+
+    if (!in.openedOk())
+        return false;
+
+    while (numCopied < packetTableBytes)
+    {
+        const int numRead = in.read(block, (int)juce::jmin((juce::int64)packetTableBufferBytes, packetTableBytes - numCopied));
+
+        if (numRead <= 0 || !stream->write(block, (size_t)numRead))
+            return false;
+
+        numCopied += numRead;
+    }
+
+    return true;
+}
+
+void AlacFileWriter::closePacketTable()
+{
+    packetTable.reset();
+    packetTableFile.reset();
+}
+
+bool AlacFileWriter::fail(const juce::String& error)
+{
+    lastError = error;
+    return false;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Writes ALAC packets to a Core Audio Format (.caf) or MPEG-4 (.m4a) file,
+// which Apple's players and afconvert read ALAC from. Audio is written as
+// packets arrive, through a large write buffer. The packet table (each
+// packet's size) goes to a temporary file beside it and is copied in after
+// the audio when the file is finished, so a recording of any length takes
+// the same memory.
+class AlacFileWriter
+{
+public:
+    AlacFileWriter();
+    ~AlacFileWriter();
+
+    enum class Container
+    {
+        CAF,
+        MPEG4
+    };
+
+    // MPEG-4 for .m4a and .mp4 files, CAF for anything else
+    static Container getContainerFor(const juce::File& file);
+
+    // The cookie is the encoder's (AudioEncoder::getMagicCookie()); the bit
+    // depth is read from it, and its largest packet and bit rate are filled
+    // in on finishing. Replaces the file if it exists; the container is
+    // chosen by its extension.
+    bool open(const juce::File& file, double sampleRate, int numChannels, int framesPerPacket,
+              const juce::MemoryBlock& magicCookie);
+
+    // Every packet holds framesPerPacket frames but the last, which may hold fewer
+    bool writePacket(const void* data, size_t size, int numFrames);
+
+    // Writes the packet table and the audio size. Called by the destructor
+    // if it hasn't been; a file that isn't finished can't be played.
+    bool finish();
+
+    bool isOpen() const { return stream != nullptr; }
+    Container getContainer() const { return container; }
+    juce::int64 getNumPackets() const { return numPackets; }
+    juce::int64 getNumFrames() const { return numFrames; }
+    juce::int64 getNumAudioBytes() const { return numAudioBytes; }
+    juce::String getLastError() const { return lastError; }
+
+private:
+    bool writeCafHeader(int numChannels, int bitDepth);
+    bool writeMpeg4Header();
+    bool finishCaf();
+    bool finishMpeg4();
+    bool copyPacketTable();
+    void closePacketTable();
+    bool fail(const juce::String& error);
+
+    std::unique_ptr<juce::FileOutputStream> stream;
+    Container container = Container::CAF;
+
+    // CAF's variable-length sizes, or MPEG-4's 32-bit ones
+    std::unique_ptr<juce::TemporaryFile> packetTableFile;
+    std::unique_ptr<juce::FileOutputStream> packetTable;
+    juce::int64 packetTableBytes = 0;
+    juce::MemoryBlock cookie;
+    juce::int64 cookiePosition = 0;
+    juce::int64 dataSizePosition = 0;
+    juce::int64 dataStart = 0;
+    juce::int64 numPackets = 0;
+    juce::int64 numFrames = 0;
+    juce::int64 numAudioBytes = 0;
+    juce::uint32 maxPacketBytes = 0;
+    double currentSampleRate = 44100.0;
+    int framesPerPacket = 0;
+    int lastPacketFrames = 0;
+    bool hadShortPacket = false;
+    juce::String lastError;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AlacFileWriter)
+};
@@ -0,0 +1,171 @@
+#include "AlacRecorder.h"
+
+namespace
+{
+    // How often the writer thread looks for packets. addPacket() doesn't
+    // wake it, as that would take a lock on the streaming thread.
+    constexpr int drainIntervalMs = 20;
+}
+
+AlacRecorder::AlacRecorder() : Thread("AlacRecorder")
+{
+}
+
+AlacRecorder::~AlacRecorder()
+{
+    stop();
+}
+
+bool AlacRecorder::start(const juce::File& file, double sampleRate, int numChannels, int framesPerPacket,
+                         const juce::MemoryBlock& magicCookie, int bufferBytes)
+{
+    stop();
+    setError({});
+
+    if (!writer.open(file, sampleRate, numChannels, framesPerPacket, magicCookie))
+    {
+        setError(writer.getLastError());
+        return false;
+    }
+
+    ring.allocate((size_t)bufferBytes, false);
+    fifo.setTotalSize(bufferBytes);
+    writeFailed = false;
+    packetsWritten = 0;
+    packetsDropped = 0;
+    framesWritten = 0;
+    bytesWritten = 0;
+
+    recording = true;
+    startThread();
+    return true;
+}
+
+bool AlacRecorder::addPacket(const void* data, int size, int numFrames)
+{
+    if (!recording.load())
+        return false;
+
+    const PacketHeader header { size, numFrames };
+    const int numBytes = (int)sizeof(header) + size;
+
+    if (fifo.getFreeSpace() < numBytes)
+    {
+        packetsDropped++;
+        return false;
+    }
+
+    // Free space never shrinks under the writer, so the whole record fits
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(numBytes, start1, size1, start2, size2);
+    copyToRing(start1, &header, (int)sizeof(header));
+    copyToRing((start1 + (int)sizeof(header)) % fifo.getTotalSize(), data, size);
+    fifo.finishedWrite(numBytes);
+    return true;
+}
+
+bool AlacRecorder::stop()
+{
+    if (!recording.exchange(false))
+        return false;
+
+    // The thread writes out what's left before it exits, however long that
+    // takes: the file isn't playable until it's finished
+    signalThreadShouldExit();
+    notify();
+    stopThread(-1);
+
+    const bool finished = writer.finish();
+
+    if (!finished && !writeFailed)
+        setError(writer.getLastError());
+
+    ring.free();
+    packet.free();
+    packetCapacity = 0;
+    return finished && !writeFailed && packetsDropped.load() == 0;
+}
+
+AlacRecorder::Stats AlacRecorder::getStats() const
+{
+    Stats stats;
+    stats.packetsWritten = packetsWritten.load();
+    stats.packetsDropped = packetsDropped.load();
+    stats.framesWritten = framesWritten.load();
+    stats.bytesWritten = bytesWritten.load();
+    return stats;
+}
+
+juce::String AlacRecorder::getLastError() const
+{
+    const juce::ScopedLock sl(errorLock);
+    return lastError;
+}
+
+void AlacRecorder::run()
+{
+    while (!threadShouldExit())
+    {
+        wait(drainIntervalMs);
+        writeBufferedPackets();
+    }
+
+    writeBufferedPackets();
+}
+
+void AlacRecorder::writeBufferedPackets()
+{
+    while (fifo.getNumReady() >= (int)sizeof(PacketHeader))
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead((int)sizeof(PacketHeader), start1, size1, start2, size2);
+
+        PacketHeader header;
+        copyFromRing(start1, &header, (int)sizeof(header));
+
+        // A packet is added whole, so its bytes are there with its header
+        if (header.size > packetCapacity)
+        {
+            packetCapacity = header.size;
+            packet.allocate((size_t)packetCapacity, false);
+        }
+
+        copyFromRing((start1 + (int)sizeof(header)) % fifo.getTotalSize(), packet, header.size);
+        fifo.finishedRead((int)sizeof(header) + header.size);
+
+        // After a failed write the rest are only counted, to keep the ring moving
+        if (writeFailed || !writer.writePacket(packet, (size_t)header.size, header.numFrames))
+        {
+            if (!writeFailed)
+                setError(writer.getLastError());
+
+            writeFailed = true;
+            packetsDropped++;
+            continue;
+        }
+
+        packetsWritten++;
+        framesWritten += header.numFrames;
+        bytesWritten += header.size;
+    }
+}
+
+void AlacRecorder::copyToRing(int position, const void* source, int numBytes)
+{
+    const int first = juce::jmin(numBytes, fifo.getTotalSize() - position);
+    std::memcpy(ring + position, source, (size_t)first);
+    std::memcpy(ring, static_cast<const char*>(source) + first, (size_t)(numBytes - first));
+}
+
+void AlacRecorder::copyFromRing(int position, void* dest, int numBytes) const
+{
+    const int first = juce::jmin(numBytes, fifo.getTotalSize() - position);
+    std::memcpy(dest, ring + position, (size_t)first);
+    std::memcpy(static_cast<char*>(dest) + first, ring, (size_t)(numBytes - first));
+}
+
+void AlacRecorder::setError(const juce::String& error)
+{
+    const juce::ScopedLock sl(errorLock);
+    lastError = error;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <JuceHeader.h>
+#include "AlacFileWriter.h"
+#include <atomic>
+
+// Records an ALAC stream to a file for a thread that mustn't wait on the
+// disk. addPacket() copies the packet into a ring buffer and returns; a
+// background thread drains the ring into an AlacFileWriter, whose writes go
+// out in large blocks. Memory is the ring and the writer's buffers, however
+// long the recording.
+//
+// Should the disk fall so far behind that the ring fills, packets are
+// dropped and counted rather than holding up the stream; the file then
+// skips the audio they held.
+class AlacRecorder : private juce::Thread
+{
+public:
+    // About 20 seconds of stereo ALAC at 44.1 kHz
+    static constexpr int defaultBufferBytes = 4 * 1024 * 1024;
+
+    AlacRecorder();
+    ~AlacRecorder() override;
+
+    // As AlacFileWriter::open(), with the stream encoder's cookie. Ends any
+    // recording under way.
+    bool start(const juce::File& file, double sampleRate, int numChannels, int framesPerPacket,
+               const juce::MemoryBlock& magicCookie, int bufferBytes = defaultBufferBytes);
+
+    // Lock-free and allocation-free, from one thread at a time, which
+    // mustn't still be adding once stop() is called. False when the packet
+    // was dropped or nothing is recording.
+    bool addPacket(const void* data, int size, int numFrames);
+
+    // Writes out what's buffered and finishes the file: false if nothing
+    // was recording, or if any packet was dropped or couldn't be written
+    bool stop();
+
+    bool isRecording() const { return recording.load(); }
+
+    struct Stats
+    {
+        juce::int64 packetsWritten = 0;
+        juce::int64 packetsDropped = 0;
+        juce::int64 framesWritten = 0;
+        juce::int64 bytesWritten = 0;
+    };
+
+    Stats getStats() const;
+    juce::String getLastError() const;
+
+private:
+    // Each packet in the ring: its size and frames, then its bytes
+    struct PacketHeader
+    {
+        juce::int32 size;
+        juce::int32 numFrames;
+    };
+
+    void run() override;
+    void writeBufferedPackets();
+    void copyToRing(int position, const void* source, int numBytes);
+    void copyFromRing(int position, void* dest, int numBytes) const;
+    void setError(const juce::String& error);
+
+    AlacFileWriter writer;
+    juce::HeapBlock<char> ring;
+    juce::AbstractFifo fifo { 1 };
+    juce::HeapBlock<char> packet;
+    int packetCapacity = 0;
+    bool writeFailed = false;
+
+    std::atomic<bool> recording { false };
+    std::atomic<juce::int64> packetsWritten { 0 };
+    std::atomic<juce::int64> packetsDropped { 0 };
+    std::atomic<juce::int64> framesWritten { 0 };
+    std::atomic<juce::int64> bytesWritten { 0 };
+
+    juce::CriticalSection errorLock;
+    juce::String lastError;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AlacRecorder)
+};
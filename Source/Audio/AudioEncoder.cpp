@@ -1,4 +1,5 @@
 #include "AudioEncoder.h"
+#include "PcmConversion.h"
 
 AudioEncoder::AudioEncoder()
 {
@@ -7,16 +8,35 @@ AudioEncoder::AudioEncoder()
 
 AudioEncoder::~AudioEncoder() {}
 
-void AudioEncoder::prepare(double sampleRate, int samplesPerBlock)
+void AudioEncoder::prepare(double sampleRate, int samplesPerBlock, const juce::AudioChannelSet& layout)
 {
     currentSampleRate = sampleRate;
     currentSamplesPerBlock = samplesPerBlock;
+    currentLayout = layout;
     
     // Initialize ALAC encoder if it will be used
     if (currentFormat == Format::ALAC && alacEncoder)
     {
-        // Assuming stereo for now - this could be made configurable
-        alacInitialized = alacEncoder->initialize(sampleRate, 2, samplesPerBlock);
+        alacInitialized = alacEncoder->initialize(sampleRate, currentLayout, samplesPerBlock);
+    }
+}
+
+bool AudioEncoder::isLayoutSupported(const juce::AudioChannelSet& layout)
+{
+    int order[kALACMaxChannels];
+    return ALACEncoderWrapper::getChannelOrder(layout, order);
+}
+
+juce::AudioChannelSet AudioEncoder::getLayoutForChannelCount(int numChannels)
+{
+    switch (numChannels)
+    {
+        case 4:
+            return juce::AudioChannelSet::createLCRS();
+        case 7:
+            return juce::AudioChannelSet::create6point1();
+        default:
+            return juce::AudioChannelSet::canonicalChannelSet(numChannels);
     }
 }
 
@@ -42,27 +62,48 @@ void AudioEncoder::setFormat(Format format)
     // Re-initialize ALAC encoder if switching to ALAC format
     if (currentFormat == Format::ALAC && alacEncoder)
     {
-        alacInitialized = alacEncoder->initialize(currentSampleRate, 2, currentSamplesPerBlock);
+        alacInitialized = alacEncoder->initialize(currentSampleRate, currentLayout, currentSamplesPerBlock);
+    }
+}
+
+AudioEncoder::Format AudioEncoder::getEncodedFormat() const
+{
+    if (currentFormat == Format::ALAC && !alacInitialized)
+        return Format::PCM_16;
+    
+    return currentFormat;
+}
+
+juce::MemoryBlock AudioEncoder::getMagicCookie()
+{
+    if (currentFormat != Format::ALAC || !alacInitialized)
+        return {};
+    
+    return alacEncoder->getMagicCookie();
+}
+
+void AudioEncoder::setElementThreads(int numThreads)
+{
+    alacEncoder->setElementThreads(numThreads);
+    
+    if (currentFormat == Format::ALAC)
+    {
+        alacInitialized = alacEncoder->initialize(currentSampleRate, currentLayout, currentSamplesPerBlock);
     }
 }
 
+int AudioEncoder::getElementThreads() const
+{
+    return alacEncoder->getElementThreads();
+}
+
 juce::MemoryBlock AudioEncoder::encodePCM16(const juce::AudioBuffer<float>& buffer, int numSamples)
 {
     juce::MemoryBlock data;
     int numChannels = buffer.getNumChannels();
     data.setSize(numSamples * numChannels * sizeof(int16_t), true);
     
-    int16_t* dest = static_cast<int16_t*>(data.getData());
-    
-    for (int i = 0; i < numSamples; ++i)
-    {
-        for (int ch = 0; ch < numChannels; ++ch)
-        {
-            float sample = buffer.getSample(ch, i);
-            sample = juce::jlimit(-1.0f, 1.0f, sample);
-            *dest++ = static_cast<int16_t>(sample * 32767.0f);
-        }
-    }
+    PcmConversion::floatToInt16(buffer, 0, numSamples, numChannels, static_cast<int16_t*>(data.getData()));
     
     return data;
 }
@@ -73,21 +114,7 @@ juce::MemoryBlock AudioEncoder::encodePCM24(const juce::AudioBuffer<float>& buff
     int numChannels = buffer.getNumChannels();
     data.setSize(numSamples * numChannels * 3, true);
     
-    uint8_t* dest = static_cast<uint8_t*>(data.getData());
-    
-    for (int i = 0; i < numSamples; ++i)
-    {
-        for (int ch = 0; ch < numChannels; ++ch)
-        {
-            float sample = buffer.getSample(ch, i);
-            sample = juce::jlimit(-1.0f, 1.0f, sample);
-            int32_t value = static_cast<int32_t>(sample * 8388607.0f);
-            
-            *dest++ = static_cast<uint8_t>(value & 0xFF);
-            *dest++ = static_cast<uint8_t>((value >> 8) & 0xFF);
-            *dest++ = static_cast<uint8_t>((value >> 16) & 0xFF);
-        }
-    }
+    PcmConversion::floatToInt24(buffer, 0, numSamples, numChannels, static_cast<uint8_t*>(data.getData()));
     
     return data;
 }
@@ -109,3 +136,64 @@ juce::MemoryBlock AudioEncoder::encodeALAC(const juce::AudioBuffer<float>& buffe
     // Fall back to PCM16 if ALAC encoding fails or is not initialized
     return encodePCM16(buffer, numSamples);
 }
+
+juce::MemoryBlock AudioEncoder::encodeInterleaved(const void* frames, int numSamples, int numChannels, int bitsPerSample)
+{
+    jassert(bitsPerSample == 16 || bitsPerSample == 24);
+    
+    if (currentFormat == Format::ALAC && alacEncoder && alacInitialized)
+    {
+        juce::MemoryBlock encoded;
+        
+        if (bitsPerSample == 16)
+        {
+            encoded = alacEncoder->encodeInterleaved(static_cast<const int16_t*>(frames), numSamples);
+        }
+        else
+        {
+            auto narrowed = convertInterleaved(frames, numSamples, numChannels, bitsPerSample, 16);
+            encoded = alacEncoder->encodeInterleaved(static_cast<const int16_t*>(narrowed.getData()), numSamples);
+        }
+        
+        if (encoded.getSize() > 0)
+            return encoded;
+    }
+    
+    // PCM, or the PCM16 fallback when ALAC is unavailable
+    return convertInterleaved(frames, numSamples, numChannels, bitsPerSample,
+                              currentFormat == Format::PCM_24 ? 24 : 16);
+}
+
+juce::MemoryBlock AudioEncoder::convertInterleaved(const void* frames, int numSamples, int numChannels,
+                                                   int bitsPerSample, int targetBits)
+{
+    const int numValues = numSamples * numChannels;
+    
+    if (bitsPerSample == targetBits)
+        return juce::MemoryBlock(frames, (size_t)(numValues * bitsPerSample / 8));
+    
+    juce::MemoryBlock data((size_t)(numValues * targetBits / 8));
+    
+    if (targetBits == 16)
+    {
+        // Keep the top 16 of 24 bits
+        auto* source = static_cast<const uint8_t*>(frames);
+        auto* dest = static_cast<int16_t*>(data.getData());
+        for (int i = 0; i < numValues; ++i)
+            dest[i] = static_cast<int16_t>(source[3 * i + 1] | (source[3 * i + 2] << 8));
+    }
+    else
+    {
+        auto* source = static_cast<const int16_t*>(frames);
+        auto* dest = static_cast<uint8_t*>(data.getData());
+        for (int i = 0; i < numValues; ++i)
+        {
+            auto value = static_cast<uint16_t>(source[i]);
+            *dest++ = 0;
+            *dest++ = static_cast<uint8_t>(value & 0xFF);
+            *dest++ = static_cast<uint8_t>(value >> 8);
+        }
+    }
+    
+    return data;
+}
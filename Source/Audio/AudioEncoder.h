@@ -9,9 +9,24 @@ public:
     AudioEncoder();
     ~AudioEncoder();
     
-    void prepare(double sampleRate, int samplesPerBlock);
+    // The layout gives the order of the channels passed in. PCM keeps that
+    // order; ALAC reorders into its own channel layout.
+    void prepare(double sampleRate, int samplesPerBlock,
+                 const juce::AudioChannelSet& layout = juce::AudioChannelSet::stereo());
+    
+    // Layouts ALAC can carry: mono, stereo, LCR, LCRS, 5.0, 5.1, 6.1 and 7.1
+    static bool isLayoutSupported(const juce::AudioChannelSet& layout);
+    
+    // The layout to assume for a bare channel count: ALAC's own for 4 (LCRS)
+    // and 7 (6.1), where JUCE's default has other speakers, else JUCE's
+    static juce::AudioChannelSet getLayoutForChannelCount(int numChannels);
     juce::MemoryBlock encode(const juce::AudioBuffer<float>& buffer, int numSamples);
     
+    // Encodes interleaved integer PCM, 16-bit native-endian or packed 24-bit,
+    // as StreamBuffer's integer storage holds it. When the bit depth matches
+    // the format, PCM is copied as is and ALAC reads the frames in place.
+    juce::MemoryBlock encodeInterleaved(const void* frames, int numSamples, int numChannels, int bitsPerSample);
+    
     enum class Format
     {
         PCM_16,
@@ -22,10 +37,22 @@ public:
     void setFormat(Format format);
     Format getFormat() const { return currentFormat; }
     
+    // What encode() actually produces: PCM_16 when ALAC was asked for but
+    // couldn't be set up for the layout
+    Format getEncodedFormat() const;
+    
+    // What a decoder or a file needs to read the ALAC packets; empty for PCM
+    juce::MemoryBlock getMagicCookie();
+    
+    // As ALACEncoderWrapper::setElementThreads(); re-prepares an ALAC encoder
+    void setElementThreads(int numThreads);
+    int getElementThreads() const;
+    
 private:
     Format currentFormat = Format::PCM_16;
     double currentSampleRate = 44100.0;
     int currentSamplesPerBlock = 512;
+    juce::AudioChannelSet currentLayout = juce::AudioChannelSet::stereo();
     
     std::unique_ptr<ALACEncoderWrapper> alacEncoder;
     bool alacInitialized = false;
@@ -33,4 +60,6 @@ private:
     juce::MemoryBlock encodePCM16(const juce::AudioBuffer<float>& buffer, int numSamples);
     juce::MemoryBlock encodePCM24(const juce::AudioBuffer<float>& buffer, int numSamples);
     juce::MemoryBlock encodeALAC(const juce::AudioBuffer<float>& buffer, int numSamples);
+    juce::MemoryBlock convertInterleaved(const void* frames, int numSamples, int numChannels,
+                                         int bitsPerSample, int targetBits);
 };
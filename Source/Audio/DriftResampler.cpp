@@ -0,0 +1,248 @@
+#include "DriftResampler.h"
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+ #include <xmmintrin.h>
+ #define FREECASTER_RESAMPLER_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define FREECASTER_RESAMPLER_NEON 1
+#endif
+
+namespace
+{
+    constexpr int numTaps = DriftResampler::numTaps;
+    constexpr int numPhases = DriftResampler::numPhases;
+
+    // Controller tuning: proportional gain in 1/s on the fill error in
+    // seconds, integral gain for critical damping, and a 0.5 s smoothing of
+    // the fill measurement, which jumps by a whole host block at a time
+    constexpr double proportionalGain = 0.05;
+    constexpr double integralGain = proportionalGain * proportionalGain / 4.0;
+    constexpr double errorSmoothingSeconds = 0.5;
+
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 30; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Phase p holds the taps for a fractional delay of p / numPhases; one
+    // extra phase lets the blend read p + 1 without wrapping
+    struct KernelTable
+    {
+        KernelTable()
+        {
+            const double cutoff = 0.45;
+            const double beta = 8.0;
+            const double halfWidth = numTaps / 2;
+
+            for (int p = 0; p <= numPhases; ++p)
+            {
+                float* taps = coefficients + p * numTaps;
+                double frac = (double)p / numPhases;
+                double sum = 0.0;
+
+                for (int k = 0; k < numTaps; ++k)
+                {
+                    double x = k - (halfWidth - 1.0) - frac;
+                    double sinc = x == 0.0 ? 1.0 : std::sin(juce::MathConstants<double>::pi * 2.0 * cutoff * x)
+                                                   / (juce::MathConstants<double>::pi * 2.0 * cutoff * x);
+                    double r = x / halfWidth;
+                    double window = std::abs(r) >= 1.0 ? 0.0 : besselI0(beta * std::sqrt(1.0 - r * r)) / besselI0(beta);
+                    double value = 2.0 * cutoff * sinc * window;
+                    taps[k] = (float)value;
+                    sum += value;
+                }
+
+                // Unity gain at DC for every phase
+                for (int k = 0; k < numTaps; ++k)
+                    taps[k] = (float)(taps[k] / sum);
+            }
+        }
+
+        alignas(16) float coefficients[(numPhases + 1) * numTaps];
+    };
+
+    const KernelTable& getKernel()
+    {
+        static const KernelTable table;
+        return table;
+    }
+
+    void blendTaps(const float* a, const float* b, float t, float* out)
+    {
+       #if FREECASTER_RESAMPLER_SSE
+        const __m128 weight = _mm_set1_ps(t);
+        for (int k = 0; k < numTaps; k += 4)
+        {
+            __m128 va = _mm_load_ps(a + k);
+            __m128 vb = _mm_load_ps(b + k);
+            _mm_store_ps(out + k, _mm_add_ps(va, _mm_mul_ps(weight, _mm_sub_ps(vb, va))));
+        }
+       #elif FREECASTER_RESAMPLER_NEON
+        const float32x4_t weight = vdupq_n_f32(t);
+        for (int k = 0; k < numTaps; k += 4)
+        {
+            float32x4_t va = vld1q_f32(a + k);
+            float32x4_t vb = vld1q_f32(b + k);
+            vst1q_f32(out + k, vmlaq_f32(va, weight, vsubq_f32(vb, va)));
+        }
+       #else
+        for (int k = 0; k < numTaps; ++k)
+            out[k] = a[k] + t * (b[k] - a[k]);
+       #endif
+    }
+
+    float dotProduct(const float* taps, const float* samples)
+    {
+       #if FREECASTER_RESAMPLER_SSE
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        for (int k = 0; k < numTaps; k += 8)
+        {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(taps + k), _mm_loadu_ps(samples + k)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(taps + k + 4), _mm_loadu_ps(samples + k + 4)));
+        }
+        __m128 acc = _mm_add_ps(acc0, acc1);
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        return _mm_cvtss_f32(acc);
+       #elif FREECASTER_RESAMPLER_NEON
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (int k = 0; k < numTaps; k += 4)
+            acc = vmlaq_f32(acc, vld1q_f32(taps + k), vld1q_f32(samples + k));
+        float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+        return vget_lane_f32(vpadd_f32(sum, sum), 0);
+       #else
+        float sum = 0.0f;
+        for (int k = 0; k < numTaps; ++k)
+            sum += taps[k] * samples[k];
+        return sum;
+       #endif
+    }
+}
+
+DriftResampler::DriftResampler()
+{
+    prepare(2, 4096, 44100.0);
+}
+
+void DriftResampler::prepare(int newNumChannels, int maxInputFrames, double newSampleRate)
+{
+    numChannels = newNumChannels;
+    sampleRate = newSampleRate;
+
+    // Room for a full push on top of the kernel's look-ahead
+    history.setSize(numChannels, maxInputFrames + 2 * numTaps);
+    getKernel();
+    reset();
+}
+
+void DriftResampler::reset()
+{
+    history.clear();
+    historyFill = 0;
+    position = 0.0;
+    step = 1.0;
+    smoothedError = 0.0;
+    integral = 0.0;
+}
+
+void DriftResampler::setTargetFill(int frames)
+{
+    targetFill = frames;
+}
+
+void DriftResampler::setRatio(double inputFramesPerOutputFrame)
+{
+    step = inputFramesPerOutputFrame;
+}
+
+void DriftResampler::updateController(int fillFrames, int framesElapsed)
+{
+    double dt = framesElapsed / sampleRate;
+    double error = (fillFrames - targetFill) / sampleRate;
+
+    smoothedError += (error - smoothedError) * dt / (errorSmoothingSeconds + dt);
+
+    // Anti-windup: the integral alone may not exceed the correction limit
+    integral = juce::jlimit(-maxCorrection / integralGain, maxCorrection / integralGain,
+                            integral + smoothedError * dt);
+
+    double correction = proportionalGain * smoothedError + integralGain * integral;
+    step = 1.0 + juce::jlimit(-maxCorrection, maxCorrection, correction);
+}
+
+int DriftResampler::getInputFramesNeeded(int numOutputFrames) const
+{
+    if (numOutputFrames <= 0)
+        return 0;
+
+    int lastStart = (int)(position + (numOutputFrames - 1) * step);
+    return juce::jmax(0, lastStart + numTaps - historyFill);
+}
+
+int DriftResampler::pushInput(const juce::AudioBuffer<float>& source, int startFrame, int numFrames)
+{
+    int accepted = juce::jmin(numFrames, history.getNumSamples() - historyFill);
+    if (accepted <= 0)
+        return 0;
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        int sourceChannel = juce::jmin(ch, source.getNumChannels() - 1);
+        history.copyFrom(ch, historyFill, source, sourceChannel, startFrame, accepted);
+    }
+
+    historyFill += accepted;
+    return accepted;
+}
+
+int DriftResampler::pullOutput(juce::AudioBuffer<float>& dest, int startFrame, int numFrames)
+{
+    const float* kernel = getKernel().coefficients;
+    int outputChannels = juce::jmin(numChannels, dest.getNumChannels());
+    int produced = 0;
+
+    while (produced < numFrames)
+    {
+        int index = (int)position;
+        if (index + numTaps > historyFill)
+            break;
+
+        double phase = (position - index) * numPhases;
+        int phaseIndex = juce::jmin((int)phase, numPhases - 1);
+        auto weight = (float)(phase - phaseIndex);
+
+        // The blended taps are shared by every channel
+        blendTaps(kernel + phaseIndex * numTaps, kernel + (phaseIndex + 1) * numTaps, weight, blended);
+
+        for (int ch = 0; ch < outputChannels; ++ch)
+            dest.setSample(ch, startFrame + produced, dotProduct(blended, history.getReadPointer(ch, index)));
+
+        position += step;
+        ++produced;
+    }
+
+    // Drop input that no future output can reach
+    int consumed = juce::jmin((int)position, historyFill);
+    if (consumed > 0)
+    {
+        int remaining = historyFill - consumed;
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            float* data = history.getWritePointer(ch);
+            std::memmove(data, data + consumed, (size_t)remaining * sizeof(float));
+        }
+
+        historyFill = remaining;
+        position -= consumed;
+    }
+
+    return produced;
+}
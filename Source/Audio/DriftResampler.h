@@ -0,0 +1,64 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Fractional resampler that absorbs the drift between the host's audio clock
+// and the receiver clock. Input arrives at the host rate and output is pulled
+// at the receiver's pace; a PI controller on the fill level of the buffer
+// feeding it trims the conversion ratio (a few hundred ppm at most) so the
+// fill stays at its target instead of creeping towards overflow/underflow.
+//
+// Interpolation uses a 32-tap Kaiser-windowed sinc with 256 phases, linearly
+// interpolated between phases. The tap blend and dot products are vectorised
+// (SSE on x86, NEON on ARM). Nothing allocates after prepare().
+class DriftResampler
+{
+public:
+    static constexpr int numTaps = 32;
+    static constexpr int numPhases = 256;
+
+    DriftResampler();
+
+    void prepare(int numChannels, int maxInputFrames, double sampleRate);
+    void reset();
+
+    // Fill level (in frames) the controller steers the input buffer towards
+    void setTargetFill(int frames);
+    int getTargetFill() const { return targetFill; }
+
+    // Feeds the controller with the input buffer's current fill level;
+    // framesElapsed is the number of output frames since the last update
+    void updateController(int fillFrames, int framesElapsed);
+
+    // Input frames consumed per output frame (1.0 = no correction)
+    double getRatio() const { return step; }
+    double getCorrectionPpm() const { return (step - 1.0) * 1.0e6; }
+    void setRatio(double inputFramesPerOutputFrame);
+
+    // How many more input frames pullOutput() needs to produce numOutputFrames
+    int getInputFramesNeeded(int numOutputFrames) const;
+
+    // Appends input; returns the number of frames accepted
+    int pushInput(const juce::AudioBuffer<float>& source, int startFrame, int numFrames);
+
+    // Produces up to numFrames of output; returns the number produced
+    int pullOutput(juce::AudioBuffer<float>& dest, int startFrame, int numFrames);
+
+    int getLatencyFrames() const { return numTaps / 2; }
+
+private:
+    int numChannels = 2;
+    double sampleRate = 44100.0;
+
+    juce::AudioBuffer<float> history;
+    int historyFill = 0;
+    double position = 0.0;
+    double step = 1.0;
+
+    // PI controller state
+    int targetFill = 1024;
+    double smoothedError = 0.0;
+    double integral = 0.0;
+    double maxCorrection = 1.0e-3;
+
+    alignas(16) float blended[numTaps];
+};
@@ -0,0 +1,127 @@
+#include "ElementEncoderPool.h"
+
+class ElementEncoderPool::Worker : public juce::Thread
+{
+public:
+    Worker(ElementEncoderPool& ownerToUse, int index)
+        : Thread("ALACElementWorker " + juce::String(index)), owner(ownerToUse)
+    {
+    }
+
+    void run() override
+    {
+        owner.runWorker(*this);
+    }
+
+private:
+    ElementEncoderPool& owner;
+};
+
+//==============================================================================
+ElementEncoderPool::ElementEncoderPool(int numWorkers)
+{
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        auto* worker = workers.add(new Worker(*this, i + 1));
+        worker->startThread(juce::Thread::Priority::high);
+    }
+}
+
+ElementEncoderPool::~ElementEncoderPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        shuttingDown = true;
+    }
+
+    frameStarted.notify_all();
+
+    for (auto* worker : workers)
+        worker->stopThread(2000);
+}
+
+int ElementEncoderPool::getDefaultNumWorkers(int numElements)
+{
+    // The caller takes an element itself; there is no gain in more workers
+    // than spare cores
+    return juce::jlimit(0, juce::jmax(0, numElements - 1), juce::SystemStats::getNumCpus() - 1);
+}
+
+int32_t ElementEncoderPool::encodeElements(ALACEncoder& encoderToUse, const AudioFormatDescription& inputFormat,
+                                           unsigned char* framesToEncode, uint32_t numFramesToEncode)
+{
+    const int elementCount = (int)encoderToUse.GetNumElements();
+
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        encoder = &encoderToUse;
+        format = inputFormat;
+        frames = framesToEncode;
+        numFrames = numFramesToEncode;
+        numElements = elementCount;
+        elementsDone = 0;
+        firstError = 0;
+        nextElement = 0;
+        ++frameNumber;
+    }
+
+    if (elementCount > 1)
+        frameStarted.notify_all();
+
+    encodeAvailableElements();
+
+    // Wait for elements still running on workers
+    std::unique_lock<std::mutex> lock(frameMutex);
+    frameFinished.wait(lock, [this, elementCount] { return elementsDone.load() == elementCount; });
+
+    return firstError.load();
+}
+
+void ElementEncoderPool::encodeAvailableElements()
+{
+    for (;;)
+    {
+        const int element = nextElement.fetch_add(1);
+
+        if (element >= numElements)
+            return;
+
+        auto status = encoder->EncodeElement((uint32_t)element, format, frames, numFrames);
+
+        if (status != 0)
+        {
+            int32_t none = 0;
+            firstError.compare_exchange_strong(none, status);
+        }
+
+        if (elementsDone.fetch_add(1) + 1 == numElements)
+        {
+            // Taking the lock orders this with the caller's check of the count
+            { std::lock_guard<std::mutex> lock(frameMutex); }
+            frameFinished.notify_all();
+        }
+    }
+}
+
+void ElementEncoderPool::runWorker(Worker& worker)
+{
+    juce::uint64 framesSeen = 0;
+
+    while (!worker.threadShouldExit())
+    {
+        {
+            std::unique_lock<std::mutex> lock(frameMutex);
+            frameStarted.wait(lock, [this, &worker, framesSeen]
+            {
+                return shuttingDown || worker.threadShouldExit() || frameNumber != framesSeen;
+            });
+
+            if (shuttingDown)
+                break;
+
+            framesSeen = frameNumber;
+        }
+
+        encodeAvailableElements();
+    }
+}
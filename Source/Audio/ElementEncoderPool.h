@@ -0,0 +1,56 @@
+#pragma once
+#include <JuceHeader.h>
+#include "ALAC/ALACEncoder.h"
+#include <condition_variable>
+#include <mutex>
+
+// Encodes the elements of a multichannel ALAC frame (5.1 is a mono, two
+// channel-pair and an LFE element) at the same time. Each element goes into
+// its own bitstream through ALACEncoder::EncodeElement(), and the caller
+// joins them with FinishElements(), which gives the same bytes as encoding
+// the frame serially.
+//
+// The calling thread encodes elements too, so a frame of N elements keeps
+// at most N - 1 workers busy. Workers sleep between frames.
+class ElementEncoderPool
+{
+public:
+    explicit ElementEncoderPool(int numWorkers);
+    ~ElementEncoderPool();
+
+    // Encodes every element of one frame and returns once all are done: the
+    // first element error, or 0
+    int32_t encodeElements(ALACEncoder& encoder, const AudioFormatDescription& inputFormat,
+                           unsigned char* frames, uint32_t numFrames);
+
+    int getNumWorkers() const { return workers.size(); }
+
+    // Workers worth starting for a frame of numElements on this machine
+    static int getDefaultNumWorkers(int numElements);
+
+private:
+    class Worker;
+
+    void runWorker(Worker& worker);
+    void encodeAvailableElements();
+
+    juce::OwnedArray<Worker> workers;
+
+    std::mutex frameMutex;
+    std::condition_variable frameStarted;
+    std::condition_variable frameFinished;
+    juce::uint64 frameNumber = 0;
+    bool shuttingDown = false;
+
+    // The frame in progress; set under frameMutex before nextElement is reset
+    ALACEncoder* encoder = nullptr;
+    AudioFormatDescription format {};
+    unsigned char* frames = nullptr;
+    uint32_t numFrames = 0;
+    std::atomic<int> numElements{0};
+    std::atomic<int> nextElement{0};
+    std::atomic<int> elementsDone{0};
+    std::atomic<int32_t> firstError{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ElementEncoderPool)
+};
@@ -0,0 +1,201 @@
+#include "LossConcealer.h"
+
+namespace
+{
+    // Period search: the newest window is compared with earlier audio at
+    // every lag in range; below the correlation threshold the audio is
+    // treated as unpitched and a long segment is repeated instead
+    constexpr int searchWindow = 256;
+    constexpr int minimumLag = 20;
+    constexpr int maximumLag = 512;
+    constexpr float periodicThreshold = 0.3f;
+
+    static_assert(searchWindow + maximumLag <= LossConcealer::historyFrames, "Search must fit the history");
+    static_assert(maximumLag <= LossConcealer::fadeOutFrames, "A period must fit the cycle buffer");
+}
+
+LossConcealer::LossConcealer()
+{
+    prepare(2);
+}
+
+void LossConcealer::prepare(int newNumChannels)
+{
+    numChannels = newNumChannels;
+    history.setSize(numChannels, historyFrames);
+    cycle.setSize(numChannels, fadeOutFrames);
+    reset();
+}
+
+void LossConcealer::reset()
+{
+    history.clear();
+    cycle.clear();
+    historyWritePos = 0;
+    concealing = false;
+    recovering = false;
+    concealPosition = 0;
+    fadeInPosition = 0;
+    period = fadeOutFrames;
+}
+
+float LossConcealer::fadeOutGain(int position)
+{
+    if (position >= fadeOutFrames)
+        return 0.0f;
+
+    return 0.5f + 0.5f * std::cos(juce::MathConstants<float>::pi * (float)position / (float)fadeOutFrames);
+}
+
+float LossConcealer::framesAgo(int channel, int frames) const
+{
+    return history.getSample(channel, (historyWritePos - frames + historyFrames) % historyFrames);
+}
+
+float LossConcealer::extrapolate(int channel, int position) const
+{
+    return cycle.getSample(channel, position % period) * fadeOutGain(position);
+}
+
+int LossConcealer::findPeriod() const
+{
+    // Unwrap the first channel, oldest frame first, so the inner loops are
+    // plain dot products
+    float recent[historyFrames];
+    for (int i = 0; i < historyFrames; ++i)
+        recent[i] = framesAgo(0, historyFrames - i);
+
+    const float* newest = recent + historyFrames - searchWindow;
+    float newestEnergy = 0.0f;
+    for (int i = 0; i < searchWindow; ++i)
+        newestEnergy += newest[i] * newest[i];
+
+    if (newestEnergy <= 0.0f)
+        return fadeOutFrames;
+
+    float correlations[maximumLag + 2] = {};
+    float bestCorrelation = 0.0f;
+    int bestLag = 0;
+
+    for (int lag = minimumLag; lag <= maximumLag; ++lag)
+    {
+        const float* lagged = newest - lag;
+        float product = 0.0f, laggedEnergy = 0.0f;
+        for (int i = 0; i < searchWindow; ++i)
+        {
+            product += newest[i] * lagged[i];
+            laggedEnergy += lagged[i] * lagged[i];
+        }
+
+        correlations[lag] = laggedEnergy > 0.0f ? product / std::sqrt(newestEnergy * laggedEnergy) : 0.0f;
+        if (correlations[lag] > bestCorrelation)
+        {
+            bestCorrelation = correlations[lag];
+            bestLag = lag;
+        }
+    }
+
+    if (bestCorrelation < periodicThreshold)
+        return fadeOutFrames;
+
+    // Take the shortest lag nearly as good as the best, so a multiple of the
+    // true period is not picked by a hair
+    for (int lag = minimumLag + 1; lag < bestLag; ++lag)
+        if (correlations[lag] >= 0.95f * bestCorrelation
+            && correlations[lag] >= correlations[lag - 1] && correlations[lag] >= correlations[lag + 1])
+            return lag;
+
+    return bestLag;
+}
+
+int LossConcealer::getFadeInFramesRemaining() const
+{
+    if (concealing)
+        return fadeInFrames;
+
+    return recovering ? fadeInFrames - fadeInPosition : 0;
+}
+
+void LossConcealer::fadeIn(juce::AudioBuffer<float>& audio, int startFrame, int numFrames)
+{
+    if (numFrames <= 0)
+        return;
+
+    if (concealing)
+    {
+        concealing = false;
+        recovering = true;
+        fadeInPosition = 0;
+    }
+
+    if (!recovering)
+        return;
+
+    int channels = juce::jmin(numChannels, audio.getNumChannels());
+    int fadeFrames = juce::jmin(numFrames, fadeInFrames - fadeInPosition);
+
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        float* data = audio.getWritePointer(ch, startFrame);
+        for (int i = 0; i < fadeFrames; ++i)
+        {
+            float gain = (float)(fadeInPosition + i + 1) / (float)(fadeInFrames + 1);
+            float extrapolated = extrapolate(ch, concealPosition + i);
+            data[i] = extrapolated + gain * (data[i] - extrapolated);
+        }
+    }
+
+    concealPosition += fadeFrames;
+    fadeInPosition += fadeFrames;
+    recovering = fadeInPosition < fadeInFrames;
+}
+
+void LossConcealer::remember(const juce::AudioBuffer<float>& audio, int startFrame, int numFrames)
+{
+    int channels = juce::jmin(numChannels, audio.getNumChannels());
+    int keep = juce::jmin(numFrames, historyFrames);
+    int from = startFrame + numFrames - keep;
+
+    if (keep <= 0)
+        return;
+
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        int firstPart = juce::jmin(keep, historyFrames - historyWritePos);
+        history.copyFrom(ch, historyWritePos, audio, ch, from, firstPart);
+        if (keep > firstPart)
+            history.copyFrom(ch, 0, audio, ch, from + firstPart, keep - firstPart);
+    }
+
+    historyWritePos = (historyWritePos + keep) % historyFrames;
+}
+
+void LossConcealer::conceal(juce::AudioBuffer<float>& audio, int startFrame, int numFrames)
+{
+    if (!concealing)
+    {
+        concealing = true;
+        recovering = false;
+        concealPosition = 0;
+        period = findPeriod();
+
+        // The last period, oldest frame first
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < period; ++i)
+                cycle.setSample(ch, i, framesAgo(ch, period - i));
+    }
+
+    int channels = juce::jmin(numChannels, audio.getNumChannels());
+
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        float* data = audio.getWritePointer(ch, startFrame);
+        for (int i = 0; i < numFrames; ++i)
+            data[i] = extrapolate(ch, concealPosition + i);
+    }
+
+    for (int ch = channels; ch < audio.getNumChannels(); ++ch)
+        audio.clear(ch, startFrame, numFrames);
+
+    concealPosition = juce::jmin(concealPosition + numFrames, fadeOutFrames);
+}
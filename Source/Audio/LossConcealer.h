@@ -0,0 +1,61 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Conceals gaps in the stream (buffer underflows) instead of cutting to
+// silence. The missing audio is extrapolated by repeating the last pitch
+// period of real audio under a raised-cosine fade-out, and real audio fades
+// back in over the tail of the extrapolation when it returns.
+//
+// The period is copied out when a gap starts, so the history can keep taking
+// new audio during the gap. Storage is allocated in prepare(); the period
+// search is bounded (a fixed window over a fixed lag range) and runs once
+// per gap, not per sample.
+class LossConcealer
+{
+public:
+    static constexpr int historyFrames = 1024;
+    static constexpr int fadeOutFrames = 512;
+    static constexpr int fadeInFrames = 128;
+
+    LossConcealer();
+
+    void prepare(int numChannels);
+    void reset();
+
+    // Remembers audio as the source for the next gap. Call it with audio in
+    // playback order; when the stream runs dry, the last audio remembered
+    // must be the last audio played.
+    void remember(const juce::AudioBuffer<float>& audio, int startFrame, int numFrames);
+
+    // Crossfades returning audio in from the extrapolation after a gap
+    void fadeIn(juce::AudioBuffer<float>& audio, int startFrame, int numFrames);
+
+    // Frames of returning audio fadeIn() still has to blend
+    int getFadeInFramesRemaining() const;
+
+    // Fills numFrames of missing audio
+    void conceal(juce::AudioBuffer<float>& audio, int startFrame, int numFrames);
+
+    // True from the first concealed frame until real audio returns
+    bool isConcealing() const { return concealing; }
+    int getPeriodFrames() const { return period; }
+
+private:
+    int findPeriod() const;
+    float framesAgo(int channel, int frames) const;
+    float extrapolate(int channel, int position) const;
+    static float fadeOutGain(int position);
+
+    int numChannels = 2;
+    juce::AudioBuffer<float> history;
+    juce::AudioBuffer<float> cycle;
+    int historyWritePos = 0;
+
+    bool concealing = false;
+    bool recovering = false;
+    int concealPosition = 0;
+    int fadeInPosition = 0;
+    int period = fadeOutFrames;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LossConcealer)
+};
@@ -0,0 +1,234 @@
+#include "OfflineEncoder.h"
+
+class OfflineEncoder::Worker : public juce::Thread
+{
+public:
+    Worker(OfflineEncoder& ownerToUse, int index)
+        : Thread("OfflineEncoder " + juce::String(index)), owner(ownerToUse)
+    {
+        // The workers already fill every core; element threads would only
+        // oversubscribe them and hand each frame across threads
+        encoder.setElementThreads(0);
+        encoder.prepare(owner.currentSampleRate, owner.framesPerPacket, owner.currentLayout);
+        encoder.setFormat(AudioEncoder::Format::ALAC);
+    }
+
+    void run() override
+    {
+        owner.runWorker(*this);
+    }
+
+    AudioEncoder encoder;
+
+private:
+    OfflineEncoder& owner;
+};
+
+//==============================================================================
+OfflineEncoder::OfflineEncoder()
+{
+}
+
+OfflineEncoder::~OfflineEncoder()
+{
+    stopWorkers();
+}
+
+bool OfflineEncoder::encode(const ReadFunction& read, double sampleRate, const juce::AudioChannelSet& layout,
+                            const juce::File& file)
+{
+    return encode(read, sampleRate, layout, file, Options());
+}
+
+bool OfflineEncoder::encode(const ReadFunction& read, double sampleRate, const juce::AudioChannelSet& layout,
+                            const juce::File& file, const Options& options)
+{
+    stats = {};
+    lastError = {};
+
+    if (!AudioEncoder::isLayoutSupported(layout))
+        return fail(juce::String(layout.size()) + " channels can't be carried in ALAC");
+
+    currentSampleRate = sampleRate;
+    currentLayout = layout;
+    framesPerPacket = juce::jmax(1, options.framesPerPacket);
+
+    const int numThreads = options.numThreads > 0 ? options.numThreads
+                                                  : juce::jmax(1, juce::SystemStats::getNumCpus());
+    const int framesPerRun = framesPerPacket * juce::jmax(1, options.packetsPerRun);
+
+    // Every encoder's cookie is the same until packets are written, and the
+    // writer fills in the parts that depend on them
+    AudioEncoder cookieSource;
+    cookieSource.setElementThreads(0);
+    cookieSource.prepare(sampleRate, framesPerPacket, layout);
+    cookieSource.setFormat(AudioEncoder::Format::ALAC);
+
+    AlacFileWriter writer;
+
+    if (!writer.open(file, sampleRate, layout.size(), framesPerPacket, cookieSource.getMagicCookie()))
+        return fail(writer.getLastError());
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+
+    shuttingDown = false;
+
+    for (int i = 0; i < numThreads; ++i)
+    {
+        auto* worker = workers.add(new Worker(*this, i + 1));
+        worker->startThread();
+    }
+
+    // Two runs a worker in flight keeps them all busy while the oldest is
+    // written, and bounds the memory held to that many runs
+    std::deque<std::unique_ptr<Run>> inFlight;
+    const size_t maxInFlight = (size_t)numThreads * 2;
+    bool inputEnded = false;
+    bool ok = true;
+
+    while (ok && (!inputEnded || !inFlight.empty()))
+    {
+        while (!inputEnded && inFlight.size() < maxInFlight)
+        {
+            auto run = std::make_unique<Run>();
+            run->audio.setSize(layout.size(), framesPerRun);
+            run->numFrames = read(run->audio, framesPerRun);
+
+            if (run->numFrames < framesPerRun)
+                inputEnded = true;
+
+            if (run->numFrames == 0)
+                break;
+
+            {
+                std::lock_guard<std::mutex> lock(runMutex);
+                queue.push_back(run.get());
+            }
+
+            runQueued.notify_one();
+            inFlight.push_back(std::move(run));
+        }
+
+        if (inFlight.empty())
+            break;
+
+        auto& oldest = *inFlight.front();
+
+        {
+            std::unique_lock<std::mutex> lock(runMutex);
+            runEncoded.wait(lock, [&oldest] { return oldest.encoded; });
+        }
+
+        auto* data = static_cast<const char*>(oldest.packets.getData());
+        int framesLeft = oldest.numFrames;
+
+        for (auto size : oldest.packetSizes)
+        {
+            const int numFrames = juce::jmin(framesPerPacket, framesLeft);
+
+            if (!writer.writePacket(data, (size_t)size, numFrames))
+            {
+                ok = false;
+                break;
+            }
+
+            data += size;
+            framesLeft -= numFrames;
+        }
+
+        inFlight.pop_front();
+    }
+
+    stopWorkers();
+
+    // Runs still queued after a failure are dropped with the workers gone
+    queue.clear();
+
+    ok = writer.finish() && ok;
+
+    stats.numFrames = writer.getNumFrames();
+    stats.numPackets = writer.getNumPackets();
+    stats.numAudioBytes = writer.getNumAudioBytes();
+    stats.audioSeconds = (double)stats.numFrames / sampleRate;
+    stats.wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    stats.numThreads = numThreads;
+
+    if (!ok)
+        return fail(writer.getLastError());
+
+    return true;
+}
+
+void OfflineEncoder::encodeRun(Run& run, AudioEncoder& encoder)
+{
+    juce::AudioBuffer<float> packet(run.audio.getNumChannels(), framesPerPacket);
+
+    for (int start = 0; start < run.numFrames; start += framesPerPacket)
+    {
+        const int numFrames = juce::jmin(framesPerPacket, run.numFrames - start);
+        for (int ch = 0; ch < packet.getNumChannels(); ++ch)
+            packet.copyFrom(ch, 0, run.audio, ch, start, numFrames);
+
+        auto encoded = encoder.encode(packet, numFrames);
+        run.packets.write(encoded.getData(), encoded.getSize());
+        run.packetSizes.add((int)encoded.getSize());
+    }
+
+    // The audio isn't needed once it's encoded
+    run.audio.setSize(0, 0);
+}
+
+void OfflineEncoder::runWorker(Worker& worker)
+{
+    while (!worker.threadShouldExit())
+    {
+        Run* run = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(runMutex);
+            runQueued.wait(lock, [this, &worker]
+            {
+                return shuttingDown || worker.threadShouldExit() || !queue.empty();
+            });
+
+            if (shuttingDown)
+                break;
+
+            if (queue.empty())
+                continue;
+
+            run = queue.front();
+            queue.pop_front();
+        }
+
+        encodeRun(*run, worker.encoder);
+
+        {
+            std::lock_guard<std::mutex> lock(runMutex);
+            run->encoded = true;
+        }
+
+        runEncoded.notify_all();
+    }
+}
+
+void OfflineEncoder::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(runMutex);
+        shuttingDown = true;
+    }
+
+    runQueued.notify_all();
+
+    for (auto* worker : workers)
+        worker->stopThread(2000);
+
+    workers.clear();
+}
+
+bool OfflineEncoder::fail(const juce::String& error)
+{
+    lastError = error;
+    return false;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <JuceHeader.h>
+#include "AudioEncoder.h"
+#include "AlacFileWriter.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+// Encodes a recording to an ALAC file as fast as the machine allows, for
+// bouncing rather than streaming. ALAC packets decode independently of each
+// other, so the audio is cut into runs of whole packets that workers encode
+// at the same time, each with its own encoder, and the calling thread reads
+// the input and writes the runs out in order.
+//
+// Encoders adapt to the audio they've seen, so the bytes differ from a
+// serial encode; every packet still decodes to the same samples.
+class OfflineEncoder
+{
+public:
+    // Fills the start of the buffer with up to numFrames; fewer only at the
+    // end of the input, and 0 once it's over
+    using ReadFunction = std::function<int(juce::AudioBuffer<float>& buffer, int numFrames)>;
+
+    struct Options
+    {
+        int numThreads = 0;             // 0 for one per core
+        int framesPerPacket = 4096;
+        int packetsPerRun = 32;
+    };
+
+    struct Stats
+    {
+        juce::int64 numFrames = 0;
+        juce::int64 numPackets = 0;
+        juce::int64 numAudioBytes = 0;
+        double audioSeconds = 0.0;
+        double wallSeconds = 0.0;
+        int numThreads = 0;
+
+        // Seconds of audio encoded per second taken
+        double getRealtimeFactor() const { return wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0; }
+    };
+
+    OfflineEncoder();
+    ~OfflineEncoder();
+
+    // Reads the input to its end and writes it to the file, CAF or MPEG-4 by
+    // its extension. The layout gives the order of the channels read.
+    bool encode(const ReadFunction& read, double sampleRate, const juce::AudioChannelSet& layout,
+                const juce::File& file, const Options& options);
+    bool encode(const ReadFunction& read, double sampleRate, const juce::AudioChannelSet& layout,
+                const juce::File& file);
+
+    Stats getStats() const { return stats; }
+    juce::String getLastError() const { return lastError; }
+
+private:
+    class Worker;
+
+    // A run of packets' audio, then their encoded bytes once a worker is done
+    struct Run
+    {
+        juce::AudioBuffer<float> audio;
+        int numFrames = 0;
+        juce::MemoryOutputStream packets;
+        juce::Array<int> packetSizes;
+        bool encoded = false;
+    };
+
+    void runWorker(Worker& worker);
+    void encodeRun(Run& run, AudioEncoder& encoder);
+    void stopWorkers();
+    bool fail(const juce::String& error);
+
+    juce::OwnedArray<Worker> workers;
+
+    std::mutex runMutex;
+    std::condition_variable runQueued;
+    std::condition_variable runEncoded;
+    std::deque<Run*> queue;
+    bool shuttingDown = false;
+
+    double currentSampleRate = 44100.0;
+    juce::AudioChannelSet currentLayout;
+    int framesPerPacket = 4096;
+
+    Stats stats;
+    juce::String lastError;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OfflineEncoder)
+};
@@ -0,0 +1,186 @@
+#include "PcmConversion.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+ #include <emmintrin.h>
+ #define FREECASTER_PCM_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define FREECASTER_PCM_NEON 1
+#endif
+
+namespace
+{
+    constexpr float int16Scale = 32767.0f;
+    constexpr float int24Scale = 8388607.0f;
+
+    inline juce::int32 scaleSample(float sample, float scale)
+    {
+        return (juce::int32)(juce::jlimit(-1.0f, 1.0f, sample) * scale);
+    }
+
+    inline void writeInt24(juce::uint8* dest, juce::int32 value)
+    {
+        dest[0] = (juce::uint8)(value & 0xff);
+        dest[1] = (juce::uint8)((value >> 8) & 0xff);
+        dest[2] = (juce::uint8)((value >> 16) & 0xff);
+    }
+
+    inline juce::int32 readInt24(const juce::uint8* source)
+    {
+        // Assemble in the top three bytes so the shift back sign-extends
+        auto bits = (juce::uint32)source[0] << 8 | (juce::uint32)source[1] << 16 | (juce::uint32)source[2] << 24;
+        return (juce::int32)bits >> 8;
+    }
+
+    // Clamps, scales and interleaves four frames of a stereo pair into
+    // L0 R0 L1 R1 and L2 R2 L3 R3; returns the number of frames handled
+    template <typename Store>
+    int convertStereo(const float* left, const float* right, int numFrames, float scale, Store&& store)
+    {
+        int i = 0;
+
+       #if FREECASTER_PCM_SSE
+        const __m128 lower = _mm_set1_ps(-1.0f), upper = _mm_set1_ps(1.0f), gain = _mm_set1_ps(scale);
+        for (; i + 4 <= numFrames; i += 4)
+        {
+            __m128i l = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(left + i), lower), upper), gain));
+            __m128i r = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(right + i), lower), upper), gain));
+            store(i, _mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r));
+        }
+       #elif FREECASTER_PCM_NEON
+        const float32x4_t lower = vdupq_n_f32(-1.0f), upper = vdupq_n_f32(1.0f);
+        for (; i + 4 <= numFrames; i += 4)
+        {
+            int32x4_t l = vcvtq_s32_f32(vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(left + i), lower), upper), scale));
+            int32x4_t r = vcvtq_s32_f32(vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(right + i), lower), upper), scale));
+            int32x4x2_t pairs = vzipq_s32(l, r);
+            store(i, pairs.val[0], pairs.val[1]);
+        }
+       #else
+        juce::ignoreUnused(left, right, numFrames, scale, store);
+       #endif
+
+        return i;
+    }
+}
+
+void PcmConversion::floatToInt16(const juce::AudioBuffer<float>& source, int startFrame, int numFrames,
+                                 int numChannels, juce::int16* dest)
+{
+    if (numFrames <= 0)
+        return;
+
+    const int sourceChannels = source.getNumChannels();
+
+    if (numChannels == 2 && sourceChannels >= 2)
+    {
+        const float* left = source.getReadPointer(0, startFrame);
+        const float* right = source.getReadPointer(1, startFrame);
+
+        int done = convertStereo(left, right, numFrames, int16Scale, [dest](int i, auto low, auto high)
+        {
+           #if FREECASTER_PCM_SSE
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 2 * i), _mm_packs_epi32(low, high));
+           #elif FREECASTER_PCM_NEON
+            vst1q_s16(dest + 2 * i, vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+           #else
+            juce::ignoreUnused(i, low, high);
+           #endif
+        });
+
+        for (int i = done; i < numFrames; ++i)
+        {
+            dest[2 * i] = (juce::int16)scaleSample(left[i], int16Scale);
+            dest[2 * i + 1] = (juce::int16)scaleSample(right[i], int16Scale);
+        }
+
+        return;
+    }
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        const float* samples = ch < sourceChannels ? source.getReadPointer(ch, startFrame) : nullptr;
+
+        for (int i = 0; i < numFrames; ++i)
+            dest[i * numChannels + ch] = samples != nullptr ? (juce::int16)scaleSample(samples[i], int16Scale) : 0;
+    }
+}
+
+void PcmConversion::floatToInt24(const juce::AudioBuffer<float>& source, int startFrame, int numFrames,
+                                 int numChannels, juce::uint8* dest)
+{
+    if (numFrames <= 0)
+        return;
+
+    const int sourceChannels = source.getNumChannels();
+
+    if (numChannels == 2 && sourceChannels >= 2)
+    {
+        const float* left = source.getReadPointer(0, startFrame);
+        const float* right = source.getReadPointer(1, startFrame);
+
+        // Scaling is vectorised; packing to three bytes is not worth a shuffle
+        int done = convertStereo(left, right, numFrames, int24Scale, [dest](int i, auto low, auto high)
+        {
+            alignas(16) juce::int32 values[8];
+           #if FREECASTER_PCM_SSE
+            _mm_store_si128(reinterpret_cast<__m128i*>(values), low);
+            _mm_store_si128(reinterpret_cast<__m128i*>(values + 4), high);
+           #elif FREECASTER_PCM_NEON
+            vst1q_s32(values, low);
+            vst1q_s32(values + 4, high);
+           #else
+            juce::ignoreUnused(low, high);
+           #endif
+
+            for (int k = 0; k < 8; ++k)
+                writeInt24(dest + 3 * (2 * i + k), values[k]);
+        });
+
+        for (int i = done; i < numFrames; ++i)
+        {
+            writeInt24(dest + 6 * i, scaleSample(left[i], int24Scale));
+            writeInt24(dest + 6 * i + 3, scaleSample(right[i], int24Scale));
+        }
+
+        return;
+    }
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        const float* samples = ch < sourceChannels ? source.getReadPointer(ch, startFrame) : nullptr;
+
+        for (int i = 0; i < numFrames; ++i)
+            writeInt24(dest + 3 * (i * numChannels + ch), samples != nullptr ? scaleSample(samples[i], int24Scale) : 0);
+    }
+}
+
+void PcmConversion::int16ToFloat(const juce::int16* source, int numFrames, int numChannels,
+                                 juce::AudioBuffer<float>& dest, int destStart)
+{
+    if (numFrames <= 0)
+        return;
+
+    for (int ch = 0; ch < juce::jmin(numChannels, dest.getNumChannels()); ++ch)
+    {
+        float* samples = dest.getWritePointer(ch, destStart);
+
+        for (int i = 0; i < numFrames; ++i)
+            samples[i] = (float)source[i * numChannels + ch] * (1.0f / int16Scale);
+    }
+}
+
+void PcmConversion::int24ToFloat(const juce::uint8* source, int numFrames, int numChannels,
+                                 juce::AudioBuffer<float>& dest, int destStart)
+{
+    if (numFrames <= 0)
+        return;
+
+    for (int ch = 0; ch < juce::jmin(numChannels, dest.getNumChannels()); ++ch)
+    {
+        float* samples = dest.getWritePointer(ch, destStart);
+
+        for (int i = 0; i < numFrames; ++i)
+            samples[i] = (float)readInt24(source + 3 * (i * numChannels + ch)) * (1.0f / int24Scale);
+    }
+}
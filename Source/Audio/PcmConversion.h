@@ -0,0 +1,26 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Conversion between planar float and interleaved integer PCM: native-endian
+// int16, or packed little-endian 24-bit (3 bytes per sample). Float input is
+// clamped to [-1, 1] and scaled by 32767 / 8388607 with truncation, which is
+// what the encoders have always done, so output is bit-identical to theirs.
+//
+// The stereo case (every RAOP stream) is vectorised with SSE2 on x86 and NEON
+// on ARM; other channel counts take the scalar loop.
+class PcmConversion
+{
+public:
+    // Writes numFrames * numChannels samples. Channels the source lacks are
+    // written as silence.
+    static void floatToInt16(const juce::AudioBuffer<float>& source, int startFrame, int numFrames,
+                             int numChannels, juce::int16* dest);
+    static void floatToInt24(const juce::AudioBuffer<float>& source, int startFrame, int numFrames,
+                             int numChannels, juce::uint8* dest);
+
+    // Inverse conversions into dest, starting at destStart
+    static void int16ToFloat(const juce::int16* source, int numFrames, int numChannels,
+                             juce::AudioBuffer<float>& dest, int destStart);
+    static void int24ToFloat(const juce::uint8* source, int numFrames, int numChannels,
+                             juce::AudioBuffer<float>& dest, int destStart);
+};
@@ -0,0 +1,408 @@
+#include "RealtimeAudit.h"
+
+#if FREECASTER_RT_AUDIT && !JUCE_WINDOWS
+ #include <dlfcn.h>
+ #include <new>
+ #if JUCE_LINUX
+  #include <poll.h>
+  #include <pthread.h>
+  #include <sys/socket.h>
+  #include <time.h>
+  #include <unistd.h>
+ #endif
+#endif
+
+#if defined(__GNUC__)
+ #define FREECASTER_AUDIT_CALLER __builtin_return_address(0)
+#else
+ #define FREECASTER_AUDIT_CALLER nullptr
+#endif
+
+namespace
+{
+    // Constant-initialised and, in a plugin, in static TLS, so reading it
+    // from inside malloc never calls malloc
+   #if defined(__GNUC__) && JUCE_LINUX
+    __attribute__((tls_model("initial-exec")))
+   #endif
+    thread_local int realtimeDepth = 0;
+
+    std::atomic<int> numViolations{0};
+    RealtimeAudit::Violation recordedViolations[RealtimeAudit::maxRecordedViolations];
+
+    const char* getKindName(RealtimeAudit::Kind kind)
+    {
+        switch (kind)
+        {
+            case RealtimeAudit::Kind::Allocation: return "Allocation";
+            case RealtimeAudit::Kind::Lock:       return "Lock";
+            case RealtimeAudit::Kind::SystemCall: return "System call";
+        }
+
+        return "";
+    }
+}
+
+//==============================================================================
+void RealtimeAudit::enterRealtimeContext()
+{
+    ++realtimeDepth;
+}
+
+void RealtimeAudit::leaveRealtimeContext()
+{
+    --realtimeDepth;
+}
+
+bool RealtimeAudit::isRealtimeContext()
+{
+    return realtimeDepth > 0;
+}
+
+void RealtimeAudit::check(Kind kind, const char* function, void* caller)
+{
+    if (realtimeDepth == 0)
+        return;
+
+    const int index = numViolations.fetch_add(1);
+
+    if (index < maxRecordedViolations)
+    {
+        auto& violation = recordedViolations[index];
+        violation.kind = kind;
+        violation.function = function;
+        violation.caller = caller;
+    }
+}
+
+int RealtimeAudit::getNumViolations()
+{
+    return numViolations.load();
+}
+
+juce::StringArray RealtimeAudit::describeViolations()
+{
+    juce::StringArray lines;
+    const int recorded = juce::jmin(getNumViolations(), maxRecordedViolations);
+
+    for (int i = 0; i < recorded; ++i)
+    {
+        const auto& violation = recordedViolations[i];
+        juce::String line = juce::String(getKindName(violation.kind)) + " on the audio thread: "
+                            + violation.function + " called from 0x" + juce::String::toHexString((juce::pointer_sized_int)violation.caller);
+
+       #if FREECASTER_RT_AUDIT && !JUCE_WINDOWS
+        Dl_info info;
+        if (violation.caller != nullptr && dladdr(violation.caller, &info) != 0 && info.dli_sname != nullptr)
+            line << " (" << info.dli_sname << ")";
+       #endif
+
+        lines.add(line);
+    }
+
+    if (getNumViolations() > recorded)
+        lines.add("... and " + juce::String(getNumViolations() - recorded) + " more");
+
+    return lines;
+}
+
+void RealtimeAudit::reset()
+{
+    numViolations = 0;
+}
+
+//==============================================================================
+#if FREECASTER_RT_AUDIT && !JUCE_WINDOWS
+
+namespace
+{
+   #if defined(__GLIBC__)
+    extern "C" void* __libc_malloc(size_t size);
+    extern "C" void* __libc_calloc(size_t count, size_t size);
+    extern "C" void* __libc_realloc(void* block, size_t size);
+    extern "C" void* __libc_memalign(size_t alignment, size_t size);
+    extern "C" void __libc_free(void* block);
+
+    void* rawAlloc(size_t size) { return __libc_malloc(size); }
+    void* rawAlignedAlloc(size_t size, size_t alignment) { return __libc_memalign(alignment, size); }
+    void rawFree(void* block) { __libc_free(block); }
+   #else
+    void* rawAlloc(size_t size) { return std::malloc(size); }
+    void rawFree(void* block) { std::free(block); }
+
+    void* rawAlignedAlloc(size_t size, size_t alignment)
+    {
+        void* block = nullptr;
+        return posix_memalign(&block, juce::jmax(alignment, sizeof(void*)), size) == 0 ? block : nullptr;
+    }
+   #endif
+
+    void* auditedNew(size_t size, void* caller)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "operator new", caller);
+        return rawAlloc(size > 0 ? size : 1);
+    }
+
+    void* auditedAlignedNew(size_t size, std::align_val_t alignment, void* caller)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "operator new", caller);
+        return rawAlignedAlloc(size > 0 ? size : 1, (size_t)alignment);
+    }
+
+    void auditedDelete(void* block, void* caller)
+    {
+        if (block == nullptr)
+            return;
+
+        RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "operator delete", caller);
+        rawFree(block);
+    }
+}
+
+// Every form of the global operators, so no allocation goes around them
+void* operator new(size_t size)
+{
+    if (auto* block = auditedNew(size, FREECASTER_AUDIT_CALLER))
+        return block;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    if (auto* block = auditedNew(size, FREECASTER_AUDIT_CALLER))
+        return block;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    if (auto* block = auditedAlignedNew(size, alignment, FREECASTER_AUDIT_CALLER))
+        return block;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    if (auto* block = auditedAlignedNew(size, alignment, FREECASTER_AUDIT_CALLER))
+        return block;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return auditedNew(size, FREECASTER_AUDIT_CALLER); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return auditedNew(size, FREECASTER_AUDIT_CALLER); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return auditedAlignedNew(size, alignment, FREECASTER_AUDIT_CALLER); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return auditedAlignedNew(size, alignment, FREECASTER_AUDIT_CALLER); }
+
+void operator delete(void* block) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+void operator delete[](void* block) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+void operator delete(void* block, size_t) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+void operator delete[](void* block, size_t) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+void operator delete(void* block, std::align_val_t) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+void operator delete[](void* block, std::align_val_t) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+void operator delete(void* block, size_t, std::align_val_t) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+void operator delete[](void* block, size_t, std::align_val_t) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { auditedDelete(block, FREECASTER_AUDIT_CALLER); }
+
+#if defined(__GLIBC__)
+// The C allocator, for code that doesn't go through operator new (JUCE's
+// HeapBlock, the ALAC codec). glibc's own entry points do the work.
+extern "C"
+{
+    void* malloc(size_t size) noexcept
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "malloc", FREECASTER_AUDIT_CALLER);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) noexcept
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "calloc", FREECASTER_AUDIT_CALLER);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* block, size_t size) noexcept
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "realloc", FREECASTER_AUDIT_CALLER);
+        return __libc_realloc(block, size);
+    }
+
+    void* memalign(size_t alignment, size_t size) noexcept
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "memalign", FREECASTER_AUDIT_CALLER);
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) noexcept
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "aligned_alloc", FREECASTER_AUDIT_CALLER);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** result, size_t alignment, size_t size) noexcept
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "posix_memalign", FREECASTER_AUDIT_CALLER);
+
+        if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        auto* block = __libc_memalign(alignment, size);
+        if (block == nullptr)
+            return ENOMEM;
+
+        *result = block;
+        return 0;
+    }
+
+    void free(void* block) noexcept
+    {
+        if (block != nullptr)
+            RealtimeAudit::check(RealtimeAudit::Kind::Allocation, "free", FREECASTER_AUDIT_CALLER);
+
+        __libc_free(block);
+    }
+}
+#endif
+
+#if JUCE_LINUX
+// Locks and blocking calls are checked and then passed on to the next
+// definition, libc's. Symbols are looked up before main() so dlsym() never
+// runs on the audio thread.
+namespace
+{
+    template <typename Function>
+    Function findNext(Function& cached, const char* name)
+    {
+        if (cached == nullptr)
+            cached = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+
+        return cached;
+    }
+
+    int (*nextMutexLock)(pthread_mutex_t*) = nullptr;
+    int (*nextRwlockRdlock)(pthread_rwlock_t*) = nullptr;
+    int (*nextRwlockWrlock)(pthread_rwlock_t*) = nullptr;
+    int (*nextCondWait)(pthread_cond_t*, pthread_mutex_t*) = nullptr;
+    int (*nextCondTimedwait)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*) = nullptr;
+    ssize_t (*nextRead)(int, void*, size_t) = nullptr;
+    ssize_t (*nextWrite)(int, const void*, size_t) = nullptr;
+    ssize_t (*nextSend)(int, const void*, size_t, int) = nullptr;
+    ssize_t (*nextSendto)(int, const void*, size_t, int, const struct sockaddr*, socklen_t) = nullptr;
+    ssize_t (*nextRecv)(int, void*, size_t, int) = nullptr;
+    ssize_t (*nextRecvfrom)(int, void*, size_t, int, struct sockaddr*, socklen_t*) = nullptr;
+    int (*nextPoll)(struct pollfd*, nfds_t, int) = nullptr;
+    int (*nextNanosleep)(const struct timespec*, struct timespec*) = nullptr;
+    int (*nextUsleep)(useconds_t) = nullptr;
+
+    __attribute__((constructor)) void findNextDefinitions()
+    {
+        findNext(nextMutexLock, "pthread_mutex_lock");
+        findNext(nextRwlockRdlock, "pthread_rwlock_rdlock");
+        findNext(nextRwlockWrlock, "pthread_rwlock_wrlock");
+        findNext(nextCondWait, "pthread_cond_wait");
+        findNext(nextCondTimedwait, "pthread_cond_timedwait");
+        findNext(nextRead, "read");
+        findNext(nextWrite, "write");
+        findNext(nextSend, "send");
+        findNext(nextSendto, "sendto");
+        findNext(nextRecv, "recv");
+        findNext(nextRecvfrom, "recvfrom");
+        findNext(nextPoll, "poll");
+        findNext(nextNanosleep, "nanosleep");
+        findNext(nextUsleep, "usleep");
+    }
+}
+
+extern "C"
+{
+    int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Lock, "pthread_mutex_lock", FREECASTER_AUDIT_CALLER);
+        return findNext(nextMutexLock, "pthread_mutex_lock")(mutex);
+    }
+
+    int pthread_rwlock_rdlock(pthread_rwlock_t* lock) noexcept
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Lock, "pthread_rwlock_rdlock", FREECASTER_AUDIT_CALLER);
+        return findNext(nextRwlockRdlock, "pthread_rwlock_rdlock")(lock);
+    }
+
+    int pthread_rwlock_wrlock(pthread_rwlock_t* lock) noexcept
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Lock, "pthread_rwlock_wrlock", FREECASTER_AUDIT_CALLER);
+        return findNext(nextRwlockWrlock, "pthread_rwlock_wrlock")(lock);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Lock, "pthread_cond_wait", FREECASTER_AUDIT_CALLER);
+        return findNext(nextCondWait, "pthread_cond_wait")(condition, mutex);
+    }
+
+    int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex, const struct timespec* deadline)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::Lock, "pthread_cond_timedwait", FREECASTER_AUDIT_CALLER);
+        return findNext(nextCondTimedwait, "pthread_cond_timedwait")(condition, mutex, deadline);
+    }
+
+    ssize_t read(int fd, void* data, size_t size)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::SystemCall, "read", FREECASTER_AUDIT_CALLER);
+        return findNext(nextRead, "read")(fd, data, size);
+    }
+
+    ssize_t write(int fd, const void* data, size_t size)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::SystemCall, "write", FREECASTER_AUDIT_CALLER);
+        return findNext(nextWrite, "write")(fd, data, size);
+    }
+
+    ssize_t send(int fd, const void* data, size_t size, int flags)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::SystemCall, "send", FREECASTER_AUDIT_CALLER);
+        return findNext(nextSend, "send")(fd, data, size, flags);
+    }
+
+    ssize_t sendto(int fd, const void* data, size_t size, int flags, const struct sockaddr* address, socklen_t addressSize)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::SystemCall, "sendto", FREECASTER_AUDIT_CALLER);
+        return findNext(nextSendto, "sendto")(fd, data, size, flags, address, addressSize);
+    }
+
+    ssize_t recv(int fd, void* data, size_t size, int flags)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::SystemCall, "recv", FREECASTER_AUDIT_CALLER);
+        return findNext(nextRecv, "recv")(fd, data, size, flags);
+    }
+
+    ssize_t recvfrom(int fd, void* data, size_t size, int flags, struct sockaddr* address, socklen_t* addressSize)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::SystemCall, "recvfrom", FREECASTER_AUDIT_CALLER);
+        return findNext(nextRecvfrom, "recvfrom")(fd, data, size, flags, address, addressSize);
+    }
+
+    int poll(struct pollfd* fds, nfds_t numFds, int timeoutMs)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::SystemCall, "poll", FREECASTER_AUDIT_CALLER);
+        return findNext(nextPoll, "poll")(fds, numFds, timeoutMs);
+    }
+
+    int nanosleep(const struct timespec* duration, struct timespec* remaining)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::SystemCall, "nanosleep", FREECASTER_AUDIT_CALLER);
+        return findNext(nextNanosleep, "nanosleep")(duration, remaining);
+    }
+
+    int usleep(useconds_t micros)
+    {
+        RealtimeAudit::check(RealtimeAudit::Kind::SystemCall, "usleep", FREECASTER_AUDIT_CALLER);
+        return findNext(nextUsleep, "usleep")(micros);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+#pragma once
+#include <JuceHeader.h>
+
+#ifndef FREECASTER_RT_AUDIT
+ #define FREECASTER_RT_AUDIT 0
+#endif
+
+// Debug aid for keeping the audio callback real-time safe. Code that must
+// never wait (processBlock and everything it calls) runs inside a
+// ScopedRealtimeContext. In builds configured with FREECASTER_RT_AUDIT, any
+// of the following on a thread inside such a context is recorded as a
+// violation:
+//  - allocating or freeing memory: global operator new and delete on Linux
+//    and macOS, plus malloc and friends on glibc
+//  - blocking lock acquisitions: pthread mutex and rwlock locks and
+//    condition variable waits (Linux). Try-locks are allowed.
+//  - blocking system calls: read, write, send, recv, poll and sleeps (Linux)
+//
+// The test runner fails if any violation was recorded. Without
+// FREECASTER_RT_AUDIT the context is empty and nothing is hooked.
+class RealtimeAudit
+{
+public:
+    enum class Kind
+    {
+        Allocation,
+        Lock,
+        SystemCall
+    };
+
+    struct Violation
+    {
+        Kind kind = Kind::Allocation;
+        const char* function = "";
+        void* caller = nullptr;
+    };
+
+    // Violations past this many are counted but not kept
+    static constexpr int maxRecordedViolations = 64;
+
+    class ScopedRealtimeContext
+    {
+    public:
+       #if FREECASTER_RT_AUDIT
+        ScopedRealtimeContext() { enterRealtimeContext(); }
+        ~ScopedRealtimeContext() { leaveRealtimeContext(); }
+       #else
+        ScopedRealtimeContext() {}
+       #endif
+
+    private:
+        JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeContext)
+    };
+
+    static constexpr bool isEnabled() { return FREECASTER_RT_AUDIT != 0; }
+
+    // True while the calling thread is inside a ScopedRealtimeContext
+    static bool isRealtimeContext();
+
+    // Records a violation if the calling thread is in a real-time context.
+    // Used by the hooks, and by code doing something the hooks can't see.
+    // Never allocates or locks.
+    static void check(Kind kind, const char* function, void* caller = nullptr);
+
+    static int getNumViolations();
+
+    // One line per recorded violation; call once the audited threads are idle
+    static juce::StringArray describeViolations();
+    static void reset();
+
+private:
+    static void enterRealtimeContext();
+    static void leaveRealtimeContext();
+};
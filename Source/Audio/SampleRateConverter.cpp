@@ -0,0 +1,293 @@
+#include "SampleRateConverter.h"
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+ #include <xmmintrin.h>
+ #define FREECASTER_SRC_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define FREECASTER_SRC_NEON 1
+#endif
+
+namespace
+{
+    // Passband to 20 kHz, stopband from the 22.05 kHz output Nyquist, about
+    // 96 dB down (Kaiser beta 9.6). Tap counts per phase below follow from
+    // that transition width at each input rate.
+    constexpr double cutoffOfOutputNyquist = 21025.0 / 22050.0;
+    constexpr double kaiserBeta = 9.6;
+
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 40; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    template <int Taps>
+    float dotProduct(const float* taps, const float* samples)
+    {
+       #if FREECASTER_SRC_SSE
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        for (int k = 0; k < Taps; k += 8)
+        {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(taps + k), _mm_loadu_ps(samples + k)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(taps + k + 4), _mm_loadu_ps(samples + k + 4)));
+        }
+        __m128 acc = _mm_add_ps(acc0, acc1);
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        return _mm_cvtss_f32(acc);
+       #elif FREECASTER_SRC_NEON
+        float32x4_t acc0 = vdupq_n_f32(0.0f);
+        float32x4_t acc1 = vdupq_n_f32(0.0f);
+        for (int k = 0; k < Taps; k += 8)
+        {
+            acc0 = vmlaq_f32(acc0, vld1q_f32(taps + k), vld1q_f32(samples + k));
+            acc1 = vmlaq_f32(acc1, vld1q_f32(taps + k + 4), vld1q_f32(samples + k + 4));
+        }
+        float32x4_t acc = vaddq_f32(acc0, acc1);
+        float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+        return vget_lane_f32(vpadd_f32(sum, sum), 0);
+       #else
+        float sum = 0.0f;
+        for (int k = 0; k < Taps; ++k)
+            sum += taps[k] * samples[k];
+        return sum;
+       #endif
+    }
+}
+
+struct SampleRateConverter::Engine
+{
+    virtual ~Engine() = default;
+    virtual void reset() = 0;
+    virtual int getInputFramesNeeded(int numOutputFrames) const = 0;
+    virtual int pushInput(const juce::AudioBuffer<float>& source, int startFrame, int numFrames) = 0;
+    virtual int pullOutput(juce::AudioBuffer<float>& dest, int startFrame, int numFrames) = 0;
+    virtual int getLatencyFrames() const = 0;
+};
+
+namespace
+{
+    // Upsample by Up, lowpass, decimate by Down. Output frame k sits at
+    // k * Down on the upsampled grid: phase (k * Down) % Up of the filter
+    // applied to the Taps input frames ending at (k * Down) / Up.
+    template <int Up, int Down, int Taps>
+    class PolyphaseConverter : public SampleRateConverter::Engine
+    {
+    public:
+        static_assert(Taps % 8 == 0, "Tap count must suit the vector dot product");
+
+        PolyphaseConverter(int channels, int maxInputFrames)
+            : numChannels(channels),
+              history(channels, maxInputFrames + 2 * Taps)
+        {
+            getTable();
+            reset();
+        }
+
+        void reset() override
+        {
+            history.clear();
+
+            // Start with a full filter's worth of silence behind the first frame
+            historyFill = Taps - 1;
+            position = Taps - 1;
+            phase = 0;
+        }
+
+        int getInputFramesNeeded(int numOutputFrames) const override
+        {
+            if (numOutputFrames <= 0)
+                return 0;
+
+            int lastPosition = position + (int)(((juce::int64)phase + (juce::int64)(numOutputFrames - 1) * Down) / Up);
+            return juce::jmax(0, lastPosition + 1 - historyFill);
+        }
+
+        int pushInput(const juce::AudioBuffer<float>& source, int startFrame, int numFrames) override
+        {
+            int accepted = juce::jmin(numFrames, history.getNumSamples() - historyFill);
+            if (accepted <= 0)
+                return 0;
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                int sourceChannel = juce::jmin(ch, source.getNumChannels() - 1);
+                history.copyFrom(ch, historyFill, source, sourceChannel, startFrame, accepted);
+            }
+
+            historyFill += accepted;
+            return accepted;
+        }
+
+        int pullOutput(juce::AudioBuffer<float>& dest, int startFrame, int numFrames) override
+        {
+            const auto& table = getTable();
+            int outputChannels = juce::jmin(numChannels, dest.getNumChannels());
+            int produced = 0;
+
+            while (produced < numFrames && position < historyFill)
+            {
+                const float* taps = table.coefficients + phase * Taps;
+                int first = position - (Taps - 1);
+
+                for (int ch = 0; ch < outputChannels; ++ch)
+                    dest.setSample(ch, startFrame + produced, dotProduct<Taps>(taps, history.getReadPointer(ch, first)));
+
+                phase += Down;
+                position += phase / Up;
+                phase %= Up;
+                ++produced;
+            }
+
+            // Keep only the frames the next output's filter still reaches
+            int consumed = juce::jmin(position, historyFill) - (Taps - 1);
+            if (consumed > 0)
+            {
+                int remaining = historyFill - consumed;
+                for (int ch = 0; ch < numChannels; ++ch)
+                {
+                    float* data = history.getWritePointer(ch);
+                    std::memmove(data, data + consumed, (size_t)remaining * sizeof(float));
+                }
+
+                historyFill = remaining;
+                position -= consumed;
+            }
+
+            return produced;
+        }
+
+        int getLatencyFrames() const override
+        {
+            // Prototype centre, in upsampled samples, over the decimation factor
+            return juce::roundToInt((Up * Taps - 1) / (2.0 * Down));
+        }
+
+    private:
+        // Phase p holds prototype taps p, p + Up, p + 2 Up ... in reverse, so
+        // each output is a forward dot product over consecutive input frames
+        struct Table
+        {
+            Table()
+            {
+                const int length = Up * Taps;
+                const double centre = (length - 1) / 2.0;
+                const double cutoff = 0.5 * cutoffOfOutputNyquist / Down;
+                const double pi = juce::MathConstants<double>::pi;
+
+                for (int n = 0; n < length; ++n)
+                {
+                    double x = n - centre;
+                    double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * pi * cutoff * x) / (2.0 * pi * cutoff * x);
+                    double r = x / centre;
+                    double window = besselI0(kaiserBeta * std::sqrt(juce::jmax(0.0, 1.0 - r * r))) / besselI0(kaiserBeta);
+
+                    // Gain of Up makes up for the zeros the upsampler inserts
+                    double value = Up * 2.0 * cutoff * sinc * window;
+                    coefficients[(n % Up) * Taps + (Taps - 1 - n / Up)] = (float)value;
+                }
+            }
+
+            alignas(16) float coefficients[Up * Taps];
+        };
+
+        static const Table& getTable()
+        {
+            static const Table table;
+            return table;
+        }
+
+        int numChannels;
+        juce::AudioBuffer<float> history;
+        int historyFill = 0;
+        int position = 0;
+        int phase = 0;
+    };
+
+    struct SupportedRatio
+    {
+        double inputRate;
+        double outputRate;
+        std::unique_ptr<SampleRateConverter::Engine> (*create)(int numChannels, int maxInputFrames);
+    };
+
+    template <int Up, int Down, int Taps>
+    std::unique_ptr<SampleRateConverter::Engine> createConverter(int numChannels, int maxInputFrames)
+    {
+        return std::make_unique<PolyphaseConverter<Up, Down, Taps>>(numChannels, maxInputFrames);
+    }
+
+    const SupportedRatio supportedRatios[] =
+    {
+        { 48000.0, 44100.0, &createConverter<147, 160, 144> },
+        { 96000.0, 44100.0, &createConverter<147, 320, 288> },
+        { 88200.0, 44100.0, &createConverter<1, 2, 264> }
+    };
+
+    const SupportedRatio* findRatio(double inputRate, double outputRate)
+    {
+        for (auto& ratio : supportedRatios)
+            if (std::abs(ratio.inputRate - inputRate) < 0.5 && std::abs(ratio.outputRate - outputRate) < 0.5)
+                return &ratio;
+
+        return nullptr;
+    }
+}
+
+SampleRateConverter::SampleRateConverter()
+{
+}
+
+SampleRateConverter::~SampleRateConverter()
+{
+}
+
+bool SampleRateConverter::isSupported(double inputRate, double outputRate)
+{
+    return findRatio(inputRate, outputRate) != nullptr;
+}
+
+bool SampleRateConverter::prepare(int numChannels, int maxInputFrames, double inputRate, double outputRate)
+{
+    engine.reset();
+    inputSampleRate = inputRate;
+    outputSampleRate = outputRate;
+
+    if (auto* ratio = findRatio(inputRate, outputRate))
+        engine = ratio->create(numChannels, maxInputFrames);
+
+    return isActive();
+}
+
+void SampleRateConverter::reset()
+{
+    if (engine)
+        engine->reset();
+}
+
+int SampleRateConverter::getInputFramesNeeded(int numOutputFrames) const
+{
+    return engine ? engine->getInputFramesNeeded(numOutputFrames) : numOutputFrames;
+}
+
+int SampleRateConverter::pushInput(const juce::AudioBuffer<float>& source, int startFrame, int numFrames)
+{
+    return engine ? engine->pushInput(source, startFrame, numFrames) : 0;
+}
+
+int SampleRateConverter::pullOutput(juce::AudioBuffer<float>& dest, int startFrame, int numFrames)
+{
+    return engine ? engine->pullOutput(dest, startFrame, numFrames) : 0;
+}
+
+int SampleRateConverter::getLatencyFrames() const
+{
+    return engine ? engine->getLatencyFrames() : 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <JuceHeader.h>
+#include <memory>
+
+// Streaming sample-rate converter from the host rate to the 44.1 kHz RAOP
+// receivers expect. Each supported ratio (48, 96 and 88.2 kHz to 44.1 kHz)
+// is a polyphase FIR specialised at compile time for its interpolation and
+// decimation factors and tap count, with a Kaiser-windowed sinc table built
+// once per ratio and shared by every instance.
+//
+// The interface mirrors DriftResampler so the two chain naturally: ask how
+// much input a number of output frames needs, push it, pull the output.
+// Nothing allocates after prepare(). At other host rates the converter is
+// inactive and the stream keeps the host rate.
+class SampleRateConverter
+{
+public:
+    SampleRateConverter();
+    ~SampleRateConverter();
+
+    static constexpr double streamSampleRate = 44100.0;
+
+    static bool isSupported(double inputRate, double outputRate = streamSampleRate);
+
+    // Returns false (and leaves the converter inactive) for unsupported rates
+    bool prepare(int numChannels, int maxInputFrames, double inputRate, double outputRate = streamSampleRate);
+    void reset();
+
+    bool isActive() const { return engine != nullptr; }
+    double getInputSampleRate() const { return inputSampleRate; }
+    double getOutputSampleRate() const { return isActive() ? outputSampleRate : inputSampleRate; }
+
+    // How many more input frames pullOutput() needs to produce numOutputFrames
+    int getInputFramesNeeded(int numOutputFrames) const;
+
+    // Appends input; returns the number of frames accepted
+    int pushInput(const juce::AudioBuffer<float>& source, int startFrame, int numFrames);
+
+    // Produces up to numFrames of output; returns the number produced
+    int pullOutput(juce::AudioBuffer<float>& dest, int startFrame, int numFrames);
+
+    // Group delay of the filter, in output frames
+    int getLatencyFrames() const;
+
+    struct Engine;
+
+private:
+    std::unique_ptr<Engine> engine;
+    double inputSampleRate = streamSampleRate;
+    double outputSampleRate = streamSampleRate;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleRateConverter)
+};
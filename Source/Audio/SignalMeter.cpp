@@ -0,0 +1,324 @@
+#include "SignalMeter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+ #include <emmintrin.h>
+ #define FREECASTER_METER_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define FREECASTER_METER_NEON 1
+#endif
+
+namespace
+{
+    // ITU-R BS.1770-4 Annex 2 interpolation filter, 48 taps as four phases
+    // of 12, transposed so each tap holds the coefficient of every phase and
+    // one multiply-add advances all four interpolated points
+    alignas(16) const float truePeakCoefs[SignalMeter::truePeakTaps][4] =
+    {
+        {  0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f },
+        {  0.0109863281250f,  0.0292968750000f,  0.0330810546875f,  0.0148925781250f },
+        { -0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f },
+        {  0.0332031250000f,  0.0891113281250f,  0.1015625000000f,  0.0476074218750f },
+        { -0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f },
+        {  0.1373291015625f,  0.4650878906250f,  0.7797851562500f,  0.9721679687500f },
+        {  0.9721679687500f,  0.7797851562500f,  0.4650878906250f,  0.1373291015625f },
+        { -0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f },
+        {  0.0476074218750f,  0.1015625000000f,  0.0891113281250f,  0.0332031250000f },
+        { -0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f },
+        {  0.0148925781250f,  0.0330810546875f,  0.0292968750000f,  0.0109863281250f },
+        { -0.0083007812500f, -0.0189208984375f, -0.0291748046875f,  0.0017089843750f }
+    };
+
+    // Frames interpolated per pass; the window lives on the stack
+    constexpr int truePeakChunk = 256;
+}
+
+//==============================================================================
+float SignalMeter::Snapshot::getRms(int channel) const
+{
+    if (numFrames <= 0 || channel < 0 || channel >= numChannels)
+        return 0.0f;
+
+    return (float)std::sqrt(sumSquares[channel] / (double)numFrames);
+}
+
+float SignalMeter::Snapshot::getMaxRms() const
+{
+    float rms = 0.0f;
+    for (int ch = 0; ch < numChannels; ++ch)
+        rms = juce::jmax(rms, getRms(ch));
+    return rms;
+}
+
+float SignalMeter::Snapshot::getMaxTruePeak() const
+{
+    float level = 0.0f;
+    for (int ch = 0; ch < numChannels; ++ch)
+        level = juce::jmax(level, truePeak[ch]);
+    return level;
+}
+
+int SignalMeter::Snapshot::getTotalClippedSamples() const
+{
+    int total = 0;
+    for (int ch = 0; ch < numChannels; ++ch)
+        total += clippedSamples[ch];
+    return total;
+}
+
+//==============================================================================
+SignalMeter::SignalMeter()
+{
+}
+
+void SignalMeter::prepare(int channels)
+{
+    numChannels = juce::jlimit(1, maxChannels, channels);
+    reset();
+}
+
+void SignalMeter::reset()
+{
+    for (auto& history : truePeakHistory)
+        std::fill(std::begin(history), std::end(history), 0.0f);
+
+    measured = {};
+    published = {};
+    for (auto& slot : slots)
+        slot = {};
+
+    writeSlot = 0;
+    readSlot = 2;
+    latest = 1;
+}
+
+void SignalMeter::process(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    if (numSamples <= 0)
+        return;
+
+    const int channels = juce::jmin(numChannels, buffer.getNumChannels());
+
+    measured.numChannels = channels;
+    measured.numFrames = numSamples;
+
+    for (int ch = 0; ch < channels; ++ch)
+    {
+        const float* samples = buffer.getReadPointer(ch);
+        auto levels = measureBlock(samples, numSamples);
+
+        measured.peak[ch] = levels.peak;
+        measured.sumSquares[ch] = levels.sumSquares;
+        measured.clippedSamples[ch] = levels.clippedSamples;
+
+        // The interpolated points can land a hair under the samples themselves
+        measured.truePeak[ch] = juce::jmax(levels.peak, measureTruePeak(samples, numSamples, truePeakHistory[ch]));
+    }
+
+    publish();
+}
+
+void SignalMeter::publish()
+{
+    for (;;)
+    {
+        int current = latest.load();
+
+        // While the GUI hasn't taken the last snapshot, the next one must
+        // include it, or the audio it covered would never be seen
+        auto& slot = slots[writeSlot];
+        slot = measured;
+        if ((current & freshFlag) != 0)
+            accumulate(slot, published);
+
+        // The reader only ever clears the flag, so this retries at most once
+        if (latest.compare_exchange_strong(current, writeSlot | freshFlag))
+        {
+            published = slot;
+            writeSlot = current & ~freshFlag;
+            return;
+        }
+    }
+}
+
+bool SignalMeter::getSnapshot(Snapshot& snapshot)
+{
+    if ((latest.load() & freshFlag) == 0)
+        return false;
+
+    readSlot = latest.exchange(readSlot) & ~freshFlag;
+    snapshot = slots[readSlot];
+    return true;
+}
+
+void SignalMeter::accumulate(Snapshot& into, const Snapshot& from)
+{
+    into.numFrames += from.numFrames;
+
+    for (int ch = 0; ch < from.numChannels; ++ch)
+    {
+        into.peak[ch] = juce::jmax(into.peak[ch], from.peak[ch]);
+        into.truePeak[ch] = juce::jmax(into.truePeak[ch], from.truePeak[ch]);
+        into.sumSquares[ch] += from.sumSquares[ch];
+        into.clippedSamples[ch] += from.clippedSamples[ch];
+    }
+
+    into.numChannels = juce::jmax(into.numChannels, from.numChannels);
+}
+
+//==============================================================================
+SignalMeter::BlockLevels SignalMeter::measureBlock(const float* samples, int numSamples)
+{
+    BlockLevels levels;
+    float peak = 0.0f, sum = 0.0f;
+    int clipped = 0;
+    int i = 0;
+
+   #if FREECASTER_METER_SSE
+    const __m128 magnitudeMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 fullScale = _mm_set1_ps(1.0f);
+    __m128 peaks = _mm_setzero_ps(), sums = _mm_setzero_ps();
+    __m128i clips = _mm_setzero_si128();
+
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(samples + i);
+        __m128 magnitude = _mm_and_ps(x, magnitudeMask);
+        peaks = _mm_max_ps(peaks, magnitude);
+        sums = _mm_add_ps(sums, _mm_mul_ps(x, x));
+
+        // A true comparison is all ones, -1 as an integer
+        clips = _mm_sub_epi32(clips, _mm_castps_si128(_mm_cmpge_ps(magnitude, fullScale)));
+    }
+
+    alignas(16) float peakLanes[4], sumLanes[4];
+    alignas(16) juce::int32 clipLanes[4];
+    _mm_store_ps(peakLanes, peaks);
+    _mm_store_ps(sumLanes, sums);
+    _mm_store_si128(reinterpret_cast<__m128i*>(clipLanes), clips);
+
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        peak = juce::jmax(peak, peakLanes[lane]);
+        sum += sumLanes[lane];
+        clipped += clipLanes[lane];
+    }
+   #elif FREECASTER_METER_NEON
+    const float32x4_t fullScale = vdupq_n_f32(1.0f);
+    float32x4_t peaks = vdupq_n_f32(0.0f), sums = vdupq_n_f32(0.0f);
+    uint32x4_t clips = vdupq_n_u32(0);
+
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        float32x4_t x = vld1q_f32(samples + i);
+        float32x4_t magnitude = vabsq_f32(x);
+        peaks = vmaxq_f32(peaks, magnitude);
+        sums = vmlaq_f32(sums, x, x);
+        clips = vsubq_u32(clips, vcgeq_f32(magnitude, fullScale));
+    }
+
+    float peakLanes[4], sumLanes[4];
+    juce::uint32 clipLanes[4];
+    vst1q_f32(peakLanes, peaks);
+    vst1q_f32(sumLanes, sums);
+    vst1q_u32(clipLanes, clips);
+
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        peak = juce::jmax(peak, peakLanes[lane]);
+        sum += sumLanes[lane];
+        clipped += (int)clipLanes[lane];
+    }
+   #endif
+
+    for (; i < numSamples; ++i)
+    {
+        float magnitude = std::abs(samples[i]);
+        peak = juce::jmax(peak, magnitude);
+        sum += samples[i] * samples[i];
+        clipped += magnitude >= 1.0f ? 1 : 0;
+    }
+
+    levels.peak = peak;
+    levels.sumSquares = sum;
+    levels.clippedSamples = clipped;
+    return levels;
+}
+
+float SignalMeter::measureTruePeak(const float* samples, int numSamples, float* history)
+{
+    constexpr int historySize = truePeakTaps - 1;
+    float window[historySize + truePeakChunk];
+    float peak = 0.0f;
+
+    std::copy(history, history + historySize, window);
+
+    for (int start = 0; start < numSamples; start += truePeakChunk)
+    {
+        const int count = juce::jmin(truePeakChunk, numSamples - start);
+        std::copy(samples + start, samples + start + count, window + historySize);
+
+        // Point n of the chunk sits at window[historySize + n]; each tap
+        // reaches one sample further back
+        int n = 0;
+
+       #if FREECASTER_METER_SSE
+        const __m128 magnitudeMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        __m128 peaks = _mm_setzero_ps();
+
+        for (; n < count; ++n)
+        {
+            const float* newest = window + historySize + n;
+            __m128 points = _mm_setzero_ps();
+
+            for (int tap = 0; tap < truePeakTaps; ++tap)
+                points = _mm_add_ps(points, _mm_mul_ps(_mm_load_ps(truePeakCoefs[tap]), _mm_set1_ps(newest[-tap])));
+
+            peaks = _mm_max_ps(peaks, _mm_and_ps(points, magnitudeMask));
+        }
+
+        alignas(16) float peakLanes[4];
+        _mm_store_ps(peakLanes, peaks);
+        for (float lane : peakLanes)
+            peak = juce::jmax(peak, lane);
+       #elif FREECASTER_METER_NEON
+        float32x4_t peaks = vdupq_n_f32(0.0f);
+
+        for (; n < count; ++n)
+        {
+            const float* newest = window + historySize + n;
+            float32x4_t points = vdupq_n_f32(0.0f);
+
+            for (int tap = 0; tap < truePeakTaps; ++tap)
+                points = vmlaq_n_f32(points, vld1q_f32(truePeakCoefs[tap]), newest[-tap]);
+
+            peaks = vmaxq_f32(peaks, vabsq_f32(points));
+        }
+
+        float peakLanes[4];
+        vst1q_f32(peakLanes, peaks);
+        for (float lane : peakLanes)
+            peak = juce::jmax(peak, lane);
+       #endif
+
+        for (; n < count; ++n)
+        {
+            const float* newest = window + historySize + n;
+
+            for (int phase = 0; phase < 4; ++phase)
+            {
+                float point = 0.0f;
+                for (int tap = 0; tap < truePeakTaps; ++tap)
+                    point += truePeakCoefs[tap][phase] * newest[-tap];
+
+                peak = juce::jmax(peak, std::abs(point));
+            }
+        }
+
+        // Carry the newest samples over as the next chunk's history
+        std::copy(window + count, window + count + historySize, window);
+    }
+
+    std::copy(window, window + historySize, history);
+    return peak;
+}
@@ -1,87 +1,407 @@
 #include "StreamBuffer.h"
+#include "PcmConversion.h"
 
-StreamBuffer::StreamBuffer(int numChannels, int bufferSize)
-    : buffer(numChannels, bufferSize)
+namespace
+{
+    // A window of this much written audio without an underflow counts as
+    // stable; each stable window moves the target a quarter of the way back
+    // towards the latency target and halves the remembered cadence peaks
+    constexpr double stableWindowSeconds = 10.0;
+    constexpr int shrinkDivisor = 4;
+    
+    // Length of the crossfade from the stale read position into the newest
+    // data when a resync jumps the read head (about 3 ms at 44.1 kHz)
+    constexpr int resyncFadeFrames = 128;
+}
+
+StreamBuffer::StreamBuffer(int channels, int bufferSize)
+    : numChannels(channels),
+      capacity(bufferSize),
+      buffer(channels, bufferSize),
+      fadeBuffer(channels, resyncFadeFrames),
+      scratch(channels, LossConcealer::fadeOutFrames),
+      stagedAudio(channels, stagingFrames)
 {
     buffer.clear();
+    concealer.prepare(numChannels);
+    resetAdaptiveState();
 }
 
-void StreamBuffer::write(const juce::AudioBuffer<float>& source, int numSamples)
+void StreamBuffer::prepare(double newSampleRate, double maxLatencyMs, Storage newStorage)
+{
+    const juce::ScopedLock sl(bufferLock);
+    
+    sampleRate = newSampleRate;
+    storage = newStorage;
+    capacity = (int)std::ceil(maxLatencyMs * sampleRate / 1000.0);
+    allocate();
+    resetAdaptiveState();
+}
+
+void StreamBuffer::setNumChannels(int newNumChannels)
 {
     const juce::ScopedLock sl(bufferLock);
     
-    // Check for overflow
-    if (numStored + numSamples > buffer.getNumSamples())
+    if (newNumChannels == numChannels)
+        return;
+    
+    numChannels = newNumChannels;
+    fadeBuffer.setSize(numChannels, resyncFadeFrames);
+    scratch.setSize(numChannels, LossConcealer::fadeOutFrames);
+    stagedAudio.setSize(numChannels, stagingFrames);
+    concealer.prepare(numChannels);
+    allocate();
+    resetAdaptiveState();
+}
+
+int StreamBuffer::getNumChannels() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return numChannels;
+}
+
+void StreamBuffer::allocate()
+{
+    if (storage == Storage::Float)
+    {
+        bytesPerFrame = 0;
+        pcm.free();
+        buffer.setSize(numChannels, capacity);
+        buffer.clear();
+    }
+    else
+    {
+        bytesPerFrame = numChannels * (storage == Storage::Int16 ? 2 : 3);
+        pcm.calloc((size_t)capacity * (size_t)bytesPerFrame);
+        buffer.setSize(numChannels, 0);
+    }
+    
+    writePos = readPos = numStored = 0;
+    staging.reset();
+    stagedBlockFrames = 0;
+    concealer.reset();
+}
+
+void StreamBuffer::write(const juce::AudioBuffer<float>& source, int numSamples)
+{
+    // The audio thread never waits for the reader: if it holds the lock, the
+    // block goes to the staging FIFO instead
+    const juce::ScopedTryLock sl(bufferLock);
+    
+    if (!sl.isLocked())
+    {
+        stage(source, numSamples);
+        return;
+    }
+    
+    takeStaged();
+    noteProducerBlock(numSamples, juce::Time::getHighResolutionTicks());
+    writeFrames(source, 0, numSamples);
+}
+
+void StreamBuffer::stage(const juce::AudioBuffer<float>& source, int numSamples)
+{
+    int start1, size1, start2, size2;
+    staging.prepareToWrite(numSamples, start1, size1, start2, size2);
+    
+    // A block that doesn't fit whole is dropped whole
+    if (size1 + size2 < numSamples)
     {
         overflowCount++;
-        DBG("StreamBuffer: Overflow detected, dropping " + 
-            juce::String(numStored + numSamples - buffer.getNumSamples()) + " samples");
+        droppedFrames += numSamples;
+        return;
+    }
+    
+    for (int channel = 0; channel < juce::jmin(source.getNumChannels(), stagedAudio.getNumChannels()); ++channel)
+    {
+        stagedAudio.copyFrom(channel, start1, source, channel, 0, size1);
+        if (size2 > 0)
+            stagedAudio.copyFrom(channel, start2, source, channel, size1, size2);
+    }
+    
+    // The cadence is the host's block size, so it is noted per staged block
+    // rather than per run of frames takeStaged() moves in
+    auto largest = stagedBlockFrames.load();
+    while (largest < numSamples && !stagedBlockFrames.compare_exchange_weak(largest, numSamples))
+    {
     }
     
-    for (int channel = 0; channel < juce::jmin(source.getNumChannels(), buffer.getNumChannels()); ++channel)
+    stagedTicks = juce::Time::getHighResolutionTicks();
+    staging.finishedWrite(numSamples);
+}
+
+void StreamBuffer::takeStaged()
+{
+    // Called with bufferLock held
+    int start1, size1, start2, size2;
+    staging.prepareToRead(staging.getNumReady(), start1, size1, start2, size2);
+    
+    if (size1 + size2 > 0)
+        noteProducerBlock(stagedBlockFrames.exchange(0), stagedTicks.load());
+    
+    if (size1 > 0)
+        writeFrames(stagedAudio, start1, size1);
+    if (size2 > 0)
+        writeFrames(stagedAudio, start2, size2);
+    
+    staging.finishedRead(size1 + size2);
+}
+
+void StreamBuffer::writeFrames(const juce::AudioBuffer<float>& source, int start, int numSamples)
+{
+    const int overflow = numStored + numSamples - capacity;
+    int sourceStart = start;
+    int framesToWrite = numSamples;
+    int fadeFrames = 0;
+    
+    if (overflow > 0)
     {
-        const float* src = source.getReadPointer(channel);
-        float* dest = buffer.getWritePointer(channel);
-        int size = buffer.getNumSamples();
+        // Counted rather than logged: this runs on the audio thread
+        overflowCount++;
+        droppedFrames += overflow;
         
-        for (int i = 0; i < numSamples; ++i)
+        if (overflowPolicy == OverflowPolicy::DropNewest)
         {
-            dest[(writePos + i) % size] = src[i];
+            framesToWrite -= overflow;
+        }
+        else
+        {
+            // Keep the audio the resync fades out of before it can be overwritten
+            if (overflowPolicy == OverflowPolicy::Resync)
+            {
+                fadeFrames = juce::jmin(numStored, resyncFadeFrames);
+                loadFrames(fadeBuffer, 0, readPos, fadeFrames);
+            }
+            
+            // Input older than a whole buffer would be overwritten anyway
+            if (framesToWrite > capacity)
+            {
+                sourceStart = start + framesToWrite - capacity;
+                framesToWrite = capacity;
+            }
+            
+            // Move the read head past everything the write replaces
+            int discard = juce::jmax(0, numStored + framesToWrite - capacity);
+            readPos = (readPos + discard) % capacity;
+            numStored -= discard;
         }
     }
     
-    writePos = (writePos + numSamples) % buffer.getNumSamples();
-    numStored = juce::jmin(numStored + numSamples, buffer.getNumSamples());
+    storeFrames(source, sourceStart, writePos, framesToWrite);
+    
+    // By the time the buffer runs dry, the newest audio stored is the last
+    // audio played; remembering it here spares the reader a float copy
+    concealer.remember(source, sourceStart, framesToWrite);
+    
+    writePos = (writePos + framesToWrite) % capacity;
+    numStored += framesToWrite;
+    
+    if (overflow > 0 && overflowPolicy == OverflowPolicy::Resync)
+        resyncToNewest(fadeFrames);
+    
+    adaptAfterWrite(numSamples);
 }
 
 int StreamBuffer::read(juce::AudioBuffer<float>& dest, int numSamples)
 {
     const juce::ScopedLock sl(bufferLock);
+    takeStaged();
     
     int samplesToRead = juce::jmin(numSamples, numStored);
     
-    // Check for underflow
+    // Counted rather than logged, as in write()
     if (samplesToRead < numSamples && numStored > 0)
-    {
         underflowCount++;
-        DBG("StreamBuffer: Underflow detected, requested " + juce::String(numSamples) + 
-            " but only " + juce::String(samplesToRead) + " available");
+    
+    loadFrames(dest, 0, readPos, samplesToRead);
+    
+    // Real audio fades back in over a concealed gap, and the missing tail is
+    // extrapolated from the last audio played rather than cut to silence
+    concealer.fadeIn(dest, 0, samplesToRead);
+    if (samplesToRead < numSamples)
+        concealer.conceal(dest, samplesToRead, numSamples - samplesToRead);
+    
+    readPos = (readPos + samplesToRead) % capacity;
+    numStored -= samplesToRead;
+    
+    adaptAfterRead(numSamples, samplesToRead);
+    
+    return samplesToRead;
+}
+
+int StreamBuffer::readInterleaved(void* dest, int numSamples)
+{
+    const juce::ScopedLock sl(bufferLock);
+    takeStaged();
+    
+    jassert(storage != Storage::Float);
+    if (storage == Storage::Float)
+        return 0;
+    
+    int samplesToRead = juce::jmin(numSamples, numStored);
+    
+    if (samplesToRead < numSamples && numStored > 0)
+        underflowCount++;
+    
+    auto* out = static_cast<char*>(dest);
+    int firstPart = juce::jmin(samplesToRead, capacity - readPos);
+    std::memcpy(out, pcm + (size_t)readPos * (size_t)bytesPerFrame, (size_t)(firstPart * bytesPerFrame));
+    std::memcpy(out + firstPart * bytesPerFrame, pcm.get(), (size_t)((samplesToRead - firstPart) * bytesPerFrame));
+    
+    // Only audio blending in after a gap, and the concealment itself, take
+    // the trip through float
+    int fadeFrames = juce::jmin(samplesToRead, concealer.getFadeInFramesRemaining());
+    if (fadeFrames > 0)
+    {
+        fromPcm(out, fadeFrames, scratch, 0);
+        concealer.fadeIn(scratch, 0, fadeFrames);
+        toPcm(scratch, 0, fadeFrames, out);
     }
     
-    for (int channel = 0; channel < juce::jmin(dest.getNumChannels(), buffer.getNumChannels()); ++channel)
+    for (int done = samplesToRead; done < numSamples;)
     {
-        float* destPtr = dest.getWritePointer(channel);
-        const float* src = buffer.getReadPointer(channel);
-        int size = buffer.getNumSamples();
-        
-        for (int i = 0; i < samplesToRead; ++i)
-        {
-            destPtr[i] = src[(readPos + i) % size];
-        }
-        
-        // Fill remaining with silence if underflow
-        for (int i = samplesToRead; i < numSamples; ++i)
-        {
-            destPtr[i] = 0.0f;
-        }
+        int chunk = juce::jmin(numSamples - done, scratch.getNumSamples());
+        concealer.conceal(scratch, 0, chunk);
+        toPcm(scratch, 0, chunk, out + done * bytesPerFrame);
+        done += chunk;
     }
     
-    readPos = (readPos + samplesToRead) % buffer.getNumSamples();
+    readPos = (readPos + samplesToRead) % capacity;
     numStored -= samplesToRead;
     
+    adaptAfterRead(numSamples, samplesToRead);
+    
     return samplesToRead;
 }
 
+int StreamBuffer::conceal(juce::AudioBuffer<float>& dest, int numSamples)
+{
+    const juce::ScopedLock sl(bufferLock);
+    concealer.conceal(dest, 0, numSamples);
+    return numSamples;
+}
+
 int StreamBuffer::getAvailableSpace() const
 {
     const juce::ScopedLock sl(bufferLock);
-    return buffer.getNumSamples() - numStored;
+    return capacity - numStored;
 }
 
 int StreamBuffer::getAvailableData() const
 {
     const juce::ScopedLock sl(bufferLock);
-    return numStored;
+    return numStored + staging.getNumReady();
+}
+
+void StreamBuffer::resyncToNewest(int fadeFrames)
+{
+    // Jump to the newest target's worth of audio and fade into it from where
+    // the reader would have continued
+    int keep = juce::jmin(numStored, juce::jmax(targetFill, fadeFrames));
+    readPos = (writePos - keep + capacity) % capacity;
+    numStored = keep;
+    fadeFrames = juce::jmin(fadeFrames, keep);
+    
+    loadFrames(scratch, 0, readPos, fadeFrames);
+    
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        float* data = scratch.getWritePointer(channel);
+        const float* faded = fadeBuffer.getReadPointer(channel);
+        
+        for (int i = 0; i < fadeFrames; ++i)
+        {
+            float gain = (float)(i + 1) / (float)(fadeFrames + 1);
+            data[i] = faded[i] + gain * (data[i] - faded[i]);
+        }
+    }
+    
+    storeFrames(scratch, 0, readPos, fadeFrames);
+    resyncCount++;
+}
+
+void StreamBuffer::storeFrames(const juce::AudioBuffer<float>& source, int sourceStart, int at, int numFrames)
+{
+    int firstPart = juce::jmin(numFrames, capacity - at);
+    
+    if (storage != Storage::Float)
+    {
+        toPcm(source, sourceStart, firstPart, pcm + (size_t)at * (size_t)bytesPerFrame);
+        toPcm(source, sourceStart + firstPart, numFrames - firstPart, pcm.get());
+        return;
+    }
+    
+    for (int channel = 0; channel < juce::jmin(source.getNumChannels(), numChannels); ++channel)
+    {
+        buffer.copyFrom(channel, at, source, channel, sourceStart, firstPart);
+        if (numFrames > firstPart)
+            buffer.copyFrom(channel, 0, source, channel, sourceStart + firstPart, numFrames - firstPart);
+    }
+}
+
+void StreamBuffer::loadFrames(juce::AudioBuffer<float>& dest, int destStart, int from, int numFrames) const
+{
+    int firstPart = juce::jmin(numFrames, capacity - from);
+    
+    if (storage != Storage::Float)
+    {
+        fromPcm(pcm + (size_t)from * (size_t)bytesPerFrame, firstPart, dest, destStart);
+        fromPcm(pcm.get(), numFrames - firstPart, dest, destStart + firstPart);
+        return;
+    }
+    
+    for (int channel = 0; channel < juce::jmin(dest.getNumChannels(), numChannels); ++channel)
+    {
+        dest.copyFrom(channel, destStart, buffer, channel, from, firstPart);
+        if (numFrames > firstPart)
+            dest.copyFrom(channel, destStart + firstPart, buffer, channel, 0, numFrames - firstPart);
+    }
+}
+
+void StreamBuffer::toPcm(const juce::AudioBuffer<float>& source, int sourceStart, int numFrames, char* dest) const
+{
+    if (storage == Storage::Int16)
+        PcmConversion::floatToInt16(source, sourceStart, numFrames, numChannels, reinterpret_cast<juce::int16*>(dest));
+    else
+        PcmConversion::floatToInt24(source, sourceStart, numFrames, numChannels, reinterpret_cast<juce::uint8*>(dest));
+}
+
+void StreamBuffer::fromPcm(const char* source, int numFrames, juce::AudioBuffer<float>& dest, int destStart) const
+{
+    if (storage == Storage::Int16)
+        PcmConversion::int16ToFloat(reinterpret_cast<const juce::int16*>(source), numFrames, numChannels, dest, destStart);
+    else
+        PcmConversion::int24ToFloat(reinterpret_cast<const juce::uint8*>(source), numFrames, numChannels, dest, destStart);
+}
+
+void StreamBuffer::setOverflowPolicy(OverflowPolicy policy)
+{
+    const juce::ScopedLock sl(bufferLock);
+    overflowPolicy = policy;
+}
+
+StreamBuffer::OverflowPolicy StreamBuffer::getOverflowPolicy() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return overflowPolicy;
+}
+
+int StreamBuffer::getCapacity() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return capacity;
+}
+
+StreamBuffer::Storage StreamBuffer::getStorage() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return storage;
+}
+
+int StreamBuffer::getBytesPerFrame() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return bytesPerFrame;
 }
 
 void StreamBuffer::clear()
@@ -89,24 +409,165 @@ void StreamBuffer::clear()
     const juce::ScopedLock sl(bufferLock);
     buffer.clear();
     writePos = readPos = numStored = 0;
+    staging.reset();
+    stagedBlockFrames = 0;
+    concealer.reset();
     overflowCount = 0;
     underflowCount = 0;
+    droppedFrames = 0;
+    resyncCount = 0;
+    resetAdaptiveState();
+}
+
+void StreamBuffer::setLatencyTargetMs(double ms)
+{
+    const juce::ScopedLock sl(bufferLock);
+    latencyTargetMs = juce::jmax(0.0, ms);
+    targetFill = juce::jlimit(getCadenceFloor(), getMaximumTarget(),
+                              juce::roundToInt(latencyTargetMs * sampleRate / 1000.0));
+}
+
+double StreamBuffer::getLatencyTargetMs() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return latencyTargetMs;
+}
+
+int StreamBuffer::getTargetFill() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return targetFill;
+}
+
+double StreamBuffer::getTargetLatencyMs() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return targetFill * 1000.0 / sampleRate;
+}
+
+double StreamBuffer::getLatencyMs() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return numStored * 1000.0 / sampleRate;
+}
+
+int StreamBuffer::getProducerCadenceFrames() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return producerCadence;
+}
+
+int StreamBuffer::getConsumerCadenceFrames() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return consumerCadence;
+}
+
+void StreamBuffer::resetAdaptiveState()
+{
+    producerCadence = 0;
+    consumerCadence = 0;
+    lastWriteTicks = 0;
+    lastBlockFrames = 0;
+    framesSinceAdjust = 0;
+    underflowSinceAdjust = false;
+    primed = false;
+    growCount = 0;
+    shrinkCount = 0;
+    targetFill = juce::jlimit(1, getMaximumTarget(), juce::roundToInt(latencyTargetMs * sampleRate / 1000.0));
+}
+
+int StreamBuffer::getCadenceFloor() const
+{
+    // Between two writes the consumer drains up to a producer period, and
+    // it still needs a full read's worth when the next one is due
+    return juce::jmin(getMaximumTarget(), producerCadence + consumerCadence);
+}
+
+int StreamBuffer::getMaximumTarget() const
+{
+    // Keep half the storage as headroom for bursts above the target
+    return juce::jmax(1, capacity / 2);
+}
+
+void StreamBuffer::noteProducerBlock(int numSamples, juce::int64 ticks)
+{
+    if (lastWriteTicks != 0)
+    {
+        auto gapFrames = (int)(juce::Time::highResolutionTicksToSeconds(ticks - lastWriteTicks) * sampleRate);
+        
+        // A gap longer than the whole buffer is a pause, not cadence
+        if (gapFrames < capacity)
+            producerCadence = juce::jmax(producerCadence, gapFrames);
+    }
+    
+    lastWriteTicks = ticks;
+    lastBlockFrames = numSamples;
+    producerCadence = juce::jmax(producerCadence, numSamples);
+}
+
+void StreamBuffer::adaptAfterWrite(int numSamples)
+{
+    targetFill = juce::jmax(targetFill, getCadenceFloor());
+    
+    if (numStored >= targetFill)
+        primed = true;
+    
+    framesSinceAdjust += numSamples;
+    if (framesSinceAdjust < (juce::int64)(stableWindowSeconds * sampleRate))
+        return;
+    
+    if (!underflowSinceAdjust)
+    {
+        auto goal = juce::jmax(getCadenceFloor(), juce::roundToInt(latencyTargetMs * sampleRate / 1000.0));
+        if (targetFill > goal)
+        {
+            targetFill -= juce::jmax(1, (targetFill - goal) / shrinkDivisor);
+            shrinkCount++;
+        }
+    }
+    
+    framesSinceAdjust = 0;
+    underflowSinceAdjust = false;
+    producerCadence = juce::jmax(lastBlockFrames, producerCadence / 2);
+    consumerCadence /= 2;
+}
+
+void StreamBuffer::adaptAfterRead(int numSamples, int samplesRead)
+{
+    consumerCadence = juce::jmax(consumerCadence, numSamples);
+    
+    // Only a short read after the buffer reached its target is an underflow
+    // worth growing for; the initial fill is not
+    if (samplesRead < numSamples && primed)
+    {
+        targetFill = juce::jmin(getMaximumTarget(), targetFill + juce::jmax(consumerCadence, targetFill / 4));
+        primed = false;
+        underflowSinceAdjust = true;
+        growCount++;
+    }
 }
 
 bool StreamBuffer::isOverflowing() const
 {
     const juce::ScopedLock sl(bufferLock);
-    return numStored > (buffer.getNumSamples() * 0.9);  // > 90% full
+    return numStored > (capacity * 0.9);  // > 90% full
+}
+
+bool StreamBuffer::isConcealing() const
+{
+    const juce::ScopedLock sl(bufferLock);
+    return concealer.isConcealing();
 }
 
 bool StreamBuffer::isUnderflowing() const
 {
     const juce::ScopedLock sl(bufferLock);
-    return numStored < (buffer.getNumSamples() * 0.1);  // < 10% full
+    return numStored < (capacity * 0.1);  // < 10% full
 }
 
 float StreamBuffer::getUsagePercentage() const
 {
     const juce::ScopedLock sl(bufferLock);
-    return (float)numStored / (float)buffer.getNumSamples() * 100.0f;
+    return (float)numStored / (float)capacity * 100.0f;
 }
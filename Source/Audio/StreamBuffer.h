@@ -1,33 +1,159 @@
 #pragma once
 #include <JuceHeader.h>
+#include "LossConcealer.h"
 
 class StreamBuffer
 {
 public:
     StreamBuffer(int numChannels = 2, int bufferSize = 8192);
     
+    // How the ring holds audio. Float is planar float. Int16 and Int24 hold
+    // interleaved PCM in the encoders' layout, converted as write() stores it
+    // (on the audio thread, while the block is still in cache), so a packet
+    // read with readInterleaved() goes to the encoder as is. Int16 halves
+    // the ring's memory traffic.
+    enum class Storage
+    {
+        Float,
+        Int16,
+        Int24
+    };
+    
+    // Sizes the storage for up to maxLatencyMs of audio at sampleRate and
+    // restarts the adaptive sizing. Allocates, so call it from prepare.
+    void prepare(double sampleRate, double maxLatencyMs = 1000.0, Storage storage = Storage::Float);
+    Storage getStorage() const;
+    
+    // Changes the channel count, e.g. when the host switches to a surround
+    // layout. Discards buffered audio and allocates, like prepare().
+    void setNumChannels(int numChannels);
+    int getNumChannels() const;
+    
+    // Bytes per interleaved frame, or 0 for float storage
+    int getBytesPerFrame() const;
+    
+    // What write() does when the new audio does not fit:
+    //  DropOldest - discard the oldest unread audio to make room
+    //  DropNewest - keep the unread audio and discard what does not fit
+    //  Resync     - jump the read head to the newest target's worth of audio,
+    //               crossfading from the old read position to hide the jump
+    enum class OverflowPolicy
+    {
+        DropOldest,
+        DropNewest,
+        Resync
+    };
+    
+    void setOverflowPolicy(OverflowPolicy policy);
+    OverflowPolicy getOverflowPolicy() const;
+    
+    // Never waits for the reader, so it is safe on the audio thread. While a
+    // read holds the buffer, the block is staged (up to 4096 frames) and
+    // stored, in order, by the next write or read.
     void write(const juce::AudioBuffer<float>& source, int numSamples);
     int read(juce::AudioBuffer<float>& dest, int numSamples);
     
+    // Integer storage only: copies up to numSamples interleaved frames into
+    // dest and conceals the rest, as read() does. Returns the frames that
+    // came from the buffer.
+    int readInterleaved(void* dest, int numSamples);
+    
+    // Fills dest with concealment without consuming buffered audio, for
+    // holding off while the buffer refills after an underflow
+    int conceal(juce::AudioBuffer<float>& dest, int numSamples);
+    
     int getAvailableSpace() const;
     int getAvailableData() const;
+    int getCapacity() const;
     void clear();
     
+    // Adaptive sizing: the fill level the consumer should hold. It starts at
+    // the latency target, never drops below what the measured producer and
+    // consumer cadence need, grows on underflow and shrinks back towards the
+    // latency target once the stream has been stable for a while.
+    void setLatencyTargetMs(double ms);
+    double getLatencyTargetMs() const;
+    int getTargetFill() const;
+    double getTargetLatencyMs() const;
+    
+    // Audio currently buffered, in milliseconds
+    double getLatencyMs() const;
+    
+    // Largest write (or gap between writes, in frames) and largest read seen
+    // in the current measurement window
+    int getProducerCadenceFrames() const;
+    int getConsumerCadenceFrames() const;
+    
     // Buffer health monitoring
     bool isOverflowing() const;
     bool isUnderflowing() const;
+    
+    // True while read() is extrapolating over an underflow
+    bool isConcealing() const;
     float getUsagePercentage() const;
     int getOverflowCount() const { return overflowCount; }
     int getUnderflowCount() const { return underflowCount; }
+    int getDroppedFrameCount() const { return droppedFrames; }
+    int getResyncCount() const { return resyncCount; }
+    int getGrowCount() const { return growCount; }
+    int getShrinkCount() const { return shrinkCount; }
     
 private:
+    void allocate();
+    void writeFrames(const juce::AudioBuffer<float>& source, int start, int numSamples);
+    void stage(const juce::AudioBuffer<float>& source, int numSamples);
+    void takeStaged();
+    void resyncToNewest(int fadeFrames);
+    void storeFrames(const juce::AudioBuffer<float>& source, int sourceStart, int at, int numFrames);
+    void loadFrames(juce::AudioBuffer<float>& dest, int destStart, int from, int numFrames) const;
+    void toPcm(const juce::AudioBuffer<float>& source, int sourceStart, int numFrames, char* dest) const;
+    void fromPcm(const char* source, int numFrames, juce::AudioBuffer<float>& dest, int destStart) const;
+    void resetAdaptiveState();
+    int getCadenceFloor() const;
+    int getMaximumTarget() const;
+    void noteProducerBlock(int numSamples, juce::int64 ticks);
+    void adaptAfterWrite(int numSamples);
+    void adaptAfterRead(int numSamples, int samplesRead);
+    
+    int numChannels;
+    int capacity;
+    Storage storage = Storage::Float;
     juce::AudioBuffer<float> buffer;
+    juce::HeapBlock<char> pcm;
+    int bytesPerFrame = 0;
     int writePos = 0;
     int readPos = 0;
     int numStored = 0;
     juce::CriticalSection bufferLock;
+    OverflowPolicy overflowPolicy = OverflowPolicy::DropOldest;
+    juce::AudioBuffer<float> fadeBuffer;
+    juce::AudioBuffer<float> scratch;
+    LossConcealer concealer;
+    
+    // Blocks written while the lock was held elsewhere
+    static constexpr int stagingFrames = 4096;
+    juce::AbstractFifo staging { stagingFrames };
+    juce::AudioBuffer<float> stagedAudio;
+    std::atomic<int> stagedBlockFrames{0};
+    std::atomic<juce::int64> stagedTicks{0};
+    
+    // Adaptive sizing
+    double sampleRate = 44100.0;
+    double latencyTargetMs = 20.0;
+    int targetFill = 882;
+    bool primed = false;
+    int producerCadence = 0;
+    int consumerCadence = 0;
+    juce::int64 lastWriteTicks = 0;
+    int lastBlockFrames = 0;
+    juce::int64 framesSinceAdjust = 0;
+    bool underflowSinceAdjust = false;
     
     // Monitoring
     std::atomic<int> overflowCount{0};
     std::atomic<int> underflowCount{0};
+    std::atomic<int> droppedFrames{0};
+    std::atomic<int> resyncCount{0};
+    std::atomic<int> growCount{0};
+    std::atomic<int> shrinkCount{0};
 };
@@ -1,14 +1,35 @@
 // Compatibility header for JUCE 8+
 #pragma once
 
-#include <juce_audio_basics/juce_audio_basics.h>
-#include <juce_audio_devices/juce_audio_devices.h>
-#include <juce_audio_formats/juce_audio_formats.h>
-#include <juce_audio_processors/juce_audio_processors.h>
-#include <juce_audio_utils/juce_audio_utils.h>
 #include <juce_core/juce_core.h>
-#include <juce_data_structures/juce_data_structures.h>
-#include <juce_events/juce_events.h>
-#include <juce_graphics/juce_graphics.h>
-#include <juce_gui_basics/juce_gui_basics.h>
-#include <juce_gui_extra/juce_gui_extra.h>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+// The rest only where the target links them: freecaster_core and the tools
+// built on it have no GUI or audio device modules
+#if JUCE_MODULE_AVAILABLE_juce_audio_devices
+ #include <juce_audio_devices/juce_audio_devices.h>
+#endif
+#if JUCE_MODULE_AVAILABLE_juce_audio_formats
+ #include <juce_audio_formats/juce_audio_formats.h>
+#endif
+#if JUCE_MODULE_AVAILABLE_juce_audio_processors
+ #include <juce_audio_processors/juce_audio_processors.h>
+#endif
+#if JUCE_MODULE_AVAILABLE_juce_audio_utils
+ #include <juce_audio_utils/juce_audio_utils.h>
+#endif
+#if JUCE_MODULE_AVAILABLE_juce_data_structures
+ #include <juce_data_structures/juce_data_structures.h>
+#endif
+#if JUCE_MODULE_AVAILABLE_juce_events
+ #include <juce_events/juce_events.h>
+#endif
+#if JUCE_MODULE_AVAILABLE_juce_graphics
+ #include <juce_graphics/juce_graphics.h>
+#endif
+#if JUCE_MODULE_AVAILABLE_juce_gui_basics
+ #include <juce_gui_basics/juce_gui_basics.h>
+#endif
+#if JUCE_MODULE_AVAILABLE_juce_gui_extra
+ #include <juce_gui_extra/juce_gui_extra.h>
+#endif
@@ -157,28 +157,61 @@ void AirPlayPluginEditor::timerCallback()
     updateStatusDisplay();
     updateBufferHealth();
 
-    // Update level meters
-    float inputLevel = (testLevel > 0.0f) ? testLevel : audioProcessor.getInputLevel();
-    float outputLevel = (testLevel > 0.0f) ? testLevel : audioProcessor.getOutputLevel();
+    // Update level meters from everything measured since the last tick
+    float level = testLevel;
+    float peak = testLevel;
+    SignalMeter::Snapshot snapshot;
+    const double nowMs = juce::Time::getMillisecondCounterHiRes();
+    const double tickMs = lastMeterTickMs > 0.0 ? nowMs - lastMeterTickMs : 0.0;
+    lastMeterTickMs = nowMs;
+
+    if (testLevel <= 0.0f)
+    {
+        if (audioProcessor.getMeterSnapshot(snapshot))
+        {
+            // RMS of 0.7 (~-3dB) maps to full scale
+            meterLevel = snapshot.getMaxRms() / 0.7f;
+            peak = snapshot.getMaxTruePeak();
+            lastSnapshotMs = nowMs;
+        }
+        else
+        {
+            // No block has finished since the last tick, which is usual when
+            // host blocks are longer than a tick: fall from the last level.
+            // The peak indicator holds and decays by itself.
+            const double blockMs = audioProcessor.getSampleRate() > 0.0
+                                 ? 1000.0 * audioProcessor.getBlockSize() / audioProcessor.getSampleRate()
+                                 : 0.0;
+
+            if (nowMs - lastSnapshotMs > juce::jmax(minimumSilenceMs, silentAfterBlocks * blockMs))
+                meterLevel = 0.0f;
+            else
+                meterLevel *= juce::Decibels::decibelsToGain(-meterFallDbPerSecond * (float)(tickMs / 1000.0));
+
+            peak = 0.0f;
+        }
+
+        level = meterLevel;
+    }
 
     // Debug logging (remove in production)
     // static int meterDebugCounter = 0;
     // if (++meterDebugCounter % 60 == 0) // Log every 60 calls (~1 second at 60Hz)
     // {
-    //     DBG("Meter levels - Input: " << inputLevel << ", Output: " << outputLevel);
+    //     DBG("Meter levels - RMS: " << level << ", True peak: " << peak);
     // }
 
     // Only show input meters when not connected (to show input signal)
     // Only show output meters when connected (to show what's being sent to AirPlay)
     if (audioProcessor.getAirPlayManager().isConnected())
     {
-        inputMeter.setLevel(0.0f);  // Hide input meter when connected
-        outputMeter.setLevel(outputLevel);  // Show output meter when connected
+        inputMeter.setLevel(0.0f, 0.0f);  // Hide input meter when connected
+        outputMeter.setLevel(level, peak);  // Show output meter when connected
     }
     else
     {
-        inputMeter.setLevel(inputLevel);  // Show input meter when not connected
-        outputMeter.setLevel(0.0f);  // Hide output meter when not connected
+        inputMeter.setLevel(level, peak);  // Show input meter when not connected
+        outputMeter.setLevel(0.0f, 0.0f);  // Hide output meter when not connected
     }
 }
 
@@ -67,15 +67,17 @@ public:
         g.drawRoundedRectangle(bounds, 4.0f, 1.0f);
     }
 
-    void setLevel(float newLevel)
+    // Level drives the bar and peak (true peak, linear) the hold indicator
+    void setLevel(float newLevel, float newPeak)
     {
         // Convert to normalized 0-1 range (assuming input is in 0-1 linear amplitude)
         currentLevel = juce::jlimit(0.0f, 1.0f, newLevel);
+        float peak = juce::jlimit(0.0f, 1.0f, newPeak);
 
         // Update peak hold
-        if (currentLevel > peakLevel)
+        if (peak > peakLevel)
         {
-            peakLevel = currentLevel;
+            peakLevel = peak;
             peakHoldCounter = 60; // Hold for 60 frames (~1 second at 60Hz)
         }
         else if (peakHoldCounter > 0)
@@ -161,6 +163,15 @@ private:
     juce::Label outputMeterLabel;
     juce::TextButton testAudioButton;
     float testLevel = 0.0f;
+
+    // Between snapshots the meter falls from the last level; the input
+    // reads as silent after several host blocks without one
+    static constexpr float meterFallDbPerSecond = 20.0f;
+    static constexpr int silentAfterBlocks = 4;
+    static constexpr double minimumSilenceMs = 100.0;
+    float meterLevel = 0.0f;
+    double lastSnapshotMs = 0.0;
+    double lastMeterTickMs = 0.0;
     class DeviceListModel : public juce::ListBoxModel
     {
     public:
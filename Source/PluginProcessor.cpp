@@ -4,7 +4,9 @@
 AirPlayPluginProcessor::AirPlayPluginProcessor()
     : AudioProcessor(BusesProperties()
                     .withInput("Input", juce::AudioChannelSet::stereo(), true)
-                    .withOutput("Output", juce::AudioChannelSet::stereo(), true))
+                    .withOutput("Output", juce::AudioChannelSet::stereo(), true)),
+      // Instances share one pool of streaming workers rather than a thread each
+      airPlayManager(true)
 {
     deviceDiscovery.startDiscovery();
 }
@@ -32,7 +34,8 @@ void AirPlayPluginProcessor::changeProgramName(int, const juce::String&) {}
 
 void AirPlayPluginProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    airPlayManager.prepare(sampleRate, samplesPerBlock);
+    airPlayManager.prepare(sampleRate, samplesPerBlock, getChannelLayoutOfBus(false, 0));
+    signalMeter.prepare(getChannelLayoutOfBus(false, 0).size());
 }
 
 void AirPlayPluginProcessor::releaseResources()
@@ -41,19 +44,23 @@ void AirPlayPluginProcessor::releaseResources()
 
 bool AirPlayPluginProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
 {
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
-        return false;
+    // Pass-through: input and output match, in any layout the encoder can
+    // stream (mono up to 7.1)
+    const auto& output = layouts.getMainOutputChannelSet();
     
-    if (layouts.getMainInputChannelSet() != juce::AudioChannelSet::stereo())
+    if (layouts.getMainInputChannelSet() != output)
         return false;
     
-    return true;
+    return AudioEncoder::isLayoutSupported(output);
 }
 
 void AirPlayPluginProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
 {
     juce::ScopedNoDenormals noDenormals;
     
+    // Audit builds record anything in here that could wait
+    RealtimeAudit::ScopedRealtimeContext realtimeContext;
+    
     // Debug logging to see if processBlock is called (remove in production)
     // static int processCounter = 0;
     // if (++processCounter % 1000 == 0) // Log every 1000 calls
@@ -61,12 +68,15 @@ void AirPlayPluginProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce
     //     DBG("processBlock called - channels: " << buffer.getNumChannels() << ", samples: " << buffer.getNumSamples());
     // }
     
+    // One lock-free read of the connection state serves the whole block
+    const bool connected = airPlayManager.isConnected();
+    
     // Generate test tone if connected to AirPlay (for testing)
     static double phase = 0.0;
     static double frequency = 440.0; // A4 note
     double sampleRate = getSampleRate();
     
-    if (airPlayManager.isConnected())
+    if (connected)
     {
         for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
         {
@@ -81,48 +91,13 @@ void AirPlayPluginProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce
         }
     }
     
-    // Calculate input level (RMS)
-    float inputRMS = 0.0f;
-    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
-    {
-        const float* channelData = buffer.getReadPointer(channel);
-        float channelRMS = 0.0f;
-        
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
-        {
-            channelRMS += channelData[sample] * channelData[sample];
-        }
-        
-        channelRMS = std::sqrt(channelRMS / buffer.getNumSamples());
-        inputRMS = juce::jmax(inputRMS, channelRMS);
-    }
-    
-    // Convert RMS to normalized level (0-1) with some headroom
-    // RMS of 0.7 (~-3dB) maps to full scale
-    float normalizedInput = juce::jlimit(0.0f, 1.0f, inputRMS / 0.7f);
-    inputLevel.store(normalizedInput);
-    
-    // Debug logging (remove in production)
-    // static int debugCounter = 0;
-    // if (++debugCounter % 1000 == 0) // Log every 1000 calls
-    // {
-    //     DBG("Input RMS: " << inputRMS << ", Normalized: " << normalizedInput);
-    // }
+    // Peak, RMS, clips and true peak for the meters, published to the GUI
+    // without locking
+    signalMeter.process(buffer, buffer.getNumSamples());
     
     // Send to AirPlay if connected
-    if (airPlayManager.isConnected())
-    {
+    if (connected)
         airPlayManager.pushAudioData(buffer, buffer.getNumSamples());
-        
-        // Output level is the same as input for a pass-through plugin
-        // (In a real scenario with processing, this might differ)
-        outputLevel.store(normalizedInput);
-    }
-    else
-    {
-        // Reset output level when not connected
-        outputLevel.store(0.0f);
-    }
 }
 
 bool AirPlayPluginProcessor::hasEditor() const
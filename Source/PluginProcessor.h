@@ -2,6 +2,8 @@
 
 #include <JuceHeader.h>
 #include "AirPlay/AirPlayManager.h"
+#include "Audio/RealtimeAudit.h"
+#include "Audio/SignalMeter.h"
 #include "Discovery/DeviceDiscovery.h"
 
 class AirPlayPluginProcessor : public juce::AudioProcessor
@@ -39,17 +41,16 @@ public:
     AirPlayManager& getAirPlayManager() { return airPlayManager; }
     DeviceDiscovery& getDeviceDiscovery() { return deviceDiscovery; }
 
-    // Level meter accessors
-    float getInputLevel() const { return inputLevel.load(); }
-    float getOutputLevel() const { return outputLevel.load(); }
+    // Levels measured since the previous call (GUI thread); false when no
+    // audio was processed in between
+    bool getMeterSnapshot(SignalMeter::Snapshot& snapshot) { return signalMeter.getSnapshot(snapshot); }
 
 private:
     AirPlayManager airPlayManager;
     DeviceDiscovery deviceDiscovery;
 
-    // Level tracking for meters (thread-safe)
-    std::atomic<float> inputLevel{ 0.0f };
-    std::atomic<float> outputLevel{ 0.0f };
+    // Level tracking for meters (lock-free snapshots for the GUI)
+    SignalMeter signalMeter;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AirPlayPluginProcessor)
 };
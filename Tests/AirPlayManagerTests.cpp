@@ -0,0 +1,276 @@
+#include <JuceHeader.h>
+#include "../Source/AirPlay/AirPlayManager.h"
+#include "LoopbackReceiver.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+class AirPlayManagerTests : public juce::UnitTest
+{
+public:
+    AirPlayManagerTests() : juce::UnitTest("AirPlayManager") {}
+
+    void runTest() override
+    {
+        testConnectionStateFollowsOutputs();
+        testAudioThreadNeverWaits();
+        testQueriesNeverWaitForEncoding();
+        testSharedSchedulerPacesPackets();
+    }
+
+private:
+    static AirPlayDevice makeDevice(int index)
+    {
+        return AirPlayDevice("Zone " + juce::String(index), "127.0.0.1", 7000 + index);
+    }
+
+    static juce::AudioBuffer<float> makeBlock(int numChannels, int numSamples)
+    {
+        juce::AudioBuffer<float> block(numChannels, numSamples);
+        juce::Random random(9);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                block.setSample(ch, i, (random.nextFloat() - 0.5f) * 0.5f);
+        return block;
+    }
+
+    static double percentile(std::vector<double> values, double fraction)
+    {
+        if (values.empty())
+            return 0.0;
+
+        std::sort(values.begin(), values.end());
+        return values[(size_t)((double)(values.size() - 1) * fraction)];
+    }
+
+    void testConnectionStateFollowsOutputs()
+    {
+        beginTest("Connection state follows the outputs");
+        {
+            AirPlayManager manager;
+            manager.prepare(44100.0, 512);
+            expect(!manager.isConnected());
+
+            LoopbackReceiver receiver;
+            expect(manager.addReceiver(makeDevice(1), receiver.getEndpoint()));
+            expect(manager.isConnected(), "A group receiver counts as connected");
+
+            manager.removeReceiver(makeDevice(1));
+            expect(!manager.isConnected(), "Removing the last receiver disconnects");
+
+            expect(manager.addReceiver(makeDevice(2), receiver.getEndpoint()));
+            manager.disconnectFromDevice();
+            expect(!manager.isConnected());
+        }
+    }
+
+    void testAudioThreadNeverWaits()
+    {
+        beginTest("The audio thread never waits for the stream");
+        {
+            // 7.1 makes each packet's encode as long as it gets
+            const int blockSize = 256;
+            AirPlayManager manager;
+            manager.prepare(44100.0, blockSize, juce::AudioChannelSet::create7point1());
+
+            LoopbackReceiver receiver;
+            expect(manager.addReceiver(makeDevice(1), receiver.getEndpoint()));
+
+            auto block = makeBlock(8, blockSize);
+
+            // Host-paced blocks for two seconds; each block asks for the
+            // connection state the way processBlock does and pushes its audio
+            const double blockMs = 1000.0 * blockSize / 44100.0;
+            const int blocks = (int)(2000.0 / blockMs);
+            std::vector<double> stateMicros, pushMicros;
+            auto toMicros = [](juce::int64 ticks) { return juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e6; };
+            double due = juce::Time::getMillisecondCounterHiRes();
+
+            for (int i = 0; i < blocks; ++i)
+            {
+                auto start = juce::Time::getHighResolutionTicks();
+                bool connected = manager.isConnected();
+                auto asked = juce::Time::getHighResolutionTicks();
+
+                if (connected)
+                    manager.pushAudioData(block, blockSize);
+
+                auto pushed = juce::Time::getHighResolutionTicks();
+
+                stateMicros.push_back(toMicros(asked - start));
+                pushMicros.push_back(toMicros(pushed - asked));
+
+                due += blockMs;
+                double wait = due - juce::Time::getMillisecondCounterHiRes();
+                if (wait > 1.0)
+                    juce::Thread::sleep((int)wait);
+            }
+
+            expect(receiver.waitForAudioPackets(100, 2000), "The stream should have been running throughout");
+
+            // A lock-free read costs nanoseconds; anything near the length of
+            // an encode means the audio thread waited for the stream
+            expectLessThan(percentile(stateMicros, 0.99), 20.0, "Asking for the connection state must not wait");
+            expectLessThan(percentile(pushMicros, 0.99), 500.0, "Pushing a block must not wait for an encode");
+
+            logMessage(juce::String(blocks) + " blocks: isConnected p99 " + juce::String(percentile(stateMicros, 0.99), 2)
+                       + " us, max " + juce::String(percentile(stateMicros, 1.0), 1) + " us; pushAudioData p99 "
+                       + juce::String(percentile(pushMicros, 0.99), 1) + " us, max " + juce::String(percentile(pushMicros, 1.0), 1)
+                       + " us");
+
+            manager.disconnectFromDevice();
+        }
+    }
+
+    void testQueriesNeverWaitForEncoding()
+    {
+        beginTest("Queries and receiver changes never wait for an encode");
+        {
+            const int blockSize = 256;
+            AirPlayManager manager;
+            manager.prepare(44100.0, blockSize, juce::AudioChannelSet::create7point1());
+
+            LoopbackReceiver first, second;
+            expect(manager.addReceiver(makeDevice(1), first.getEndpoint()));
+
+            // The host feeds 7.1 blocks on its own thread while the GUI side
+            // polls the status and a second receiver joins and leaves
+            std::atomic<bool> done{false};
+            std::thread host([&]
+            {
+                auto block = makeBlock(8, blockSize);
+                const double blockMs = 1000.0 * blockSize / 44100.0;
+                double due = juce::Time::getMillisecondCounterHiRes();
+
+                while (!done.load())
+                {
+                    if (manager.isConnected())
+                        manager.pushAudioData(block, blockSize);
+
+                    due += blockMs;
+                    double wait = due - juce::Time::getMillisecondCounterHiRes();
+                    if (wait > 1.0)
+                        juce::Thread::sleep((int)wait);
+                }
+            });
+
+            std::vector<double> queryMicros, changeMicros;
+            auto toMicros = [](juce::int64 ticks) { return juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e6; };
+            const double endMs = juce::Time::getMillisecondCounterHiRes() + 2000.0;
+            int changes = 0, wrongCounts = 0;
+
+            while (juce::Time::getMillisecondCounterHiRes() < endMs)
+            {
+                for (int i = 0; i < 50; ++i)
+                {
+                    auto start = juce::Time::getHighResolutionTicks();
+                    auto status = manager.getConnectionStatus();
+                    manager.getConnectedDeviceName();
+                    int receivers = manager.getNumReceivers();
+                    queryMicros.push_back(toMicros(juce::Time::getHighResolutionTicks() - start));
+
+                    if (receivers != 1 || !status.startsWith("Streaming to"))
+                        ++wrongCounts;
+                }
+
+                auto start = juce::Time::getHighResolutionTicks();
+                expect(manager.addReceiver(makeDevice(2), second.getEndpoint()));
+                manager.removeReceiver(makeDevice(2));
+                changeMicros.push_back(toMicros(juce::Time::getHighResolutionTicks() - start));
+                ++changes;
+
+                juce::Thread::sleep(5);
+            }
+
+            const int packetsBefore = first.getNumAudioPackets();
+            expect(first.waitForAudioPackets(packetsBefore + 20, 2000), "The stream carries on through receiver changes");
+
+            done = true;
+            host.join();
+
+            auto stats = manager.getSessionGroup().getStats();
+            expectGreaterThan((int)stats.packetsEncoded, 100);
+            expectEquals(wrongCounts, 0, "Queries see the session published last");
+
+            // A query reads one pointer; an encode of a 7.1 packet takes far longer
+            expectLessThan(percentile(queryMicros, 0.99), 50.0, "Queries must not wait for a streaming pass");
+            const auto slowQueries = std::count_if(queryMicros.begin(), queryMicros.end(),
+                                                   [&](double micros) { return micros > stats.meanEncodeMicros * 0.5; });
+
+            // Queries that waited on the encode lock would be a few percent of
+            // them; a thread preempted now and then is far fewer than 0.1%
+            const int allowedSlowQueries = (int)queryMicros.size() / 1000;
+            expectLessOrEqual((int)slowQueries, allowedSlowQueries,
+                              "No query should take more than half an encode, beyond scheduler noise");
+
+            logMessage(juce::String(queryMicros.size()) + " status queries: p99 " + juce::String(percentile(queryMicros, 0.99), 2)
+                       + " us, max " + juce::String(percentile(queryMicros, 1.0), 1) + " us, " + juce::String((int)slowQueries)
+                       + " over half an encode; " + juce::String(changes)
+                       + " receiver add/remove pairs: p99 " + juce::String(percentile(changeMicros, 0.99), 1)
+                       + " us; mean packet encode " + juce::String(stats.meanEncodeMicros, 1) + " us");
+
+            manager.disconnectFromDevice();
+            expectEquals(manager.getConnectionStatus(), juce::String("Disconnected"));
+        }
+    }
+
+    void testSharedSchedulerPacesPackets()
+    {
+        beginTest("Packets are paced on the shared scheduler, and keep going without pushes");
+        {
+            // A large host block: were passes only run per push, each would
+            // send about six packets at once
+            const int blockSize = 2048;
+            AirPlayManager manager(true);
+            manager.prepare(44100.0, blockSize);
+
+            LoopbackReceiver receiver;
+            expect(manager.addReceiver(makeDevice(1), receiver.getEndpoint()));
+
+            auto block = makeBlock(2, blockSize);
+            const double blockMs = 1000.0 * blockSize / 44100.0;
+            double due = juce::Time::getMillisecondCounterHiRes();
+
+            for (int i = 0; i < (int)(1500.0 / blockMs); ++i)
+            {
+                manager.pushAudioData(block, blockSize);
+
+                due += blockMs;
+                double wait = due - juce::Time::getMillisecondCounterHiRes();
+                if (wait > 1.0)
+                    juce::Thread::sleep((int)wait);
+            }
+
+            const int packetsAtLastPush = receiver.getNumAudioPackets();
+
+            // The host has stopped calling; the stream carries on, concealing
+            expect(receiver.waitForAudioPackets(packetsAtLastPush + 10, 1000),
+                   "Packets should keep going out after the last push");
+
+            auto packets = receiver.getAudioPackets();
+            std::vector<double> gapsMs;
+
+            // Past the first half second, once the clock is running
+            for (size_t i = 1; i < packets.size(); ++i)
+            {
+                const double sinceFirst = juce::Time::highResolutionTicksToSeconds(packets[i].arrivalTicks - packets[0].arrivalTicks);
+
+                if (sinceFirst > 0.5)
+                    gapsMs.push_back(juce::Time::highResolutionTicksToSeconds(packets[i].arrivalTicks - packets[i - 1].arrivalTicks) * 1000.0);
+            }
+
+            // Packets are due every 8 ms; bursts would put most gaps near zero
+            const double packetMs = 1000.0 * RaopTransport::framesPerPacket / 44100.0;
+            expectGreaterThan(percentile(gapsMs, 0.5), packetMs * 0.5, "Packets should be spread out, not sent in bursts");
+            expectLessThan(percentile(gapsMs, 0.95), packetMs * 2.5, "No long silences between bursts");
+
+            logMessage(juce::String(gapsMs.size()) + " packet gaps at a " + juce::String(blockSize) + "-frame host block: p5 "
+                       + juce::String(percentile(gapsMs, 0.05), 2) + " ms, median " + juce::String(percentile(gapsMs, 0.5), 2)
+                       + " ms, p95 " + juce::String(percentile(gapsMs, 0.95), 2) + " ms");
+
+            manager.disconnectFromDevice();
+        }
+    }
+};
+
+static AirPlayManagerTests airPlayManagerTests;
@@ -0,0 +1,186 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../Source/Audio/ALAC/ALACDecoder.h"
+#include "../Source/Audio/ALAC/ALACBitUtilities.h"
+#include <vector>
+
+// Reads the ALAC packets back out of a CAF or MPEG-4 file the way a player
+// finds them: the cookie, then each packet by the file's packet table. For
+// checking what AlacFileWriter and OfflineEncoder write.
+class AlacFileReader
+{
+public:
+    bool valid = false;
+    juce::MemoryBlock cookie;
+    std::vector<juce::MemoryBlock> packets;
+
+    explicit AlacFileReader(const juce::File& file)
+    {
+        if (!file.loadFileAsData(data) || data.getSize() < 8)
+            return;
+
+        valid = std::memcmp(bytes(), "caff", 4) == 0 ? readCaf() : readMpeg4();
+    }
+
+    // Decodes every packet, interleaved in ALAC's channel order
+    std::vector<juce::int16> decode(int numChannels, int framesPerPacket) const
+    {
+        std::vector<juce::int16> decoded;
+        ALACDecoder decoder;
+
+        if (decoder.Init(const_cast<void*>(cookie.getData()), (uint32_t)cookie.getSize()) != 0)
+            return decoded;
+
+        std::vector<juce::int16> packet((size_t)(framesPerPacket * numChannels));
+
+        for (auto& encoded : packets)
+        {
+            BitBuffer bits;
+            BitBufferInit(&bits, static_cast<uint8_t*>(const_cast<void*>(encoded.getData())), (uint32_t)encoded.getSize());
+
+            uint32_t numDecoded = 0;
+            decoder.Decode(&bits, reinterpret_cast<uint8_t*>(packet.data()), (uint32_t)framesPerPacket,
+                           (uint32_t)numChannels, &numDecoded);
+            decoded.insert(decoded.end(), packet.begin(), packet.begin() + numDecoded * (uint32_t)numChannels);
+        }
+
+        return decoded;
+    }
+
+private:
+    juce::MemoryBlock data;
+
+    const juce::uint8* bytes() const { return static_cast<const juce::uint8*>(data.getData()); }
+    juce::uint32 readInt(size_t offset) const { return juce::ByteOrder::bigEndianInt(bytes() + offset); }
+    juce::uint64 readInt64(size_t offset) const { return ((juce::uint64)readInt(offset) << 32) | readInt(offset + 4); }
+
+    bool readCaf()
+    {
+        size_t offset = 8, audio = 0, table = 0, tableEnd = 0;
+
+        while (offset + 12 <= data.getSize())
+        {
+            const auto type = juce::String(reinterpret_cast<const char*>(bytes() + offset), 4);
+            const auto size = (size_t)readInt64(offset + 4);
+            offset += 12;
+
+            if (offset + size > data.getSize())
+                return false;
+
+            if (type == "kuki")
+                cookie = juce::MemoryBlock(bytes() + offset, size);
+            else if (type == "data")
+                audio = offset + 4;
+            else if (type == "pakt")
+            {
+                table = offset + 24;
+                tableEnd = offset + size;
+            }
+
+            offset += size;
+        }
+
+        while (table < tableEnd)
+        {
+            size_t size = 0;
+
+            while (table < tableEnd)
+            {
+                const auto byte = bytes()[table++];
+                size = (size << 7) | (byte & 0x7f);
+
+                if ((byte & 0x80) == 0)
+                    break;
+            }
+
+            if (audio + size > data.getSize())
+                return false;
+
+            packets.emplace_back(bytes() + audio, size);
+            audio += size;
+        }
+
+        return audio > 0 && cookie.getSize() > 0;
+    }
+
+    // Finds a box by path, such as "moov/trak/mdia"; returns its contents' offset
+    bool findBox(const juce::String& path, size_t start, size_t end, size_t& contents, size_t& contentsEnd) const
+    {
+        const auto name = path.upToFirstOccurrenceOf("/", false, false);
+        const auto rest = path.fromFirstOccurrenceOf("/", false, false);
+
+        for (size_t offset = start; offset + 8 <= end;)
+        {
+            size_t size = readInt(offset), header = 8;
+
+            // A size of 1 means the 64-bit size follows the type
+            if (size == 1)
+            {
+                size = (size_t)readInt64(offset + 8);
+                header = 16;
+            }
+
+            if (size < header || offset + size > end)
+                return false;
+
+            if (juce::String(reinterpret_cast<const char*>(bytes() + offset + 4), 4) == name)
+            {
+                if (rest.isEmpty())
+                {
+                    contents = offset + header;
+                    contentsEnd = offset + size;
+                    return true;
+                }
+
+                return findBox(rest, offset + header, offset + size, contents, contentsEnd);
+            }
+
+            offset += size;
+        }
+
+        return false;
+    }
+
+    bool readMpeg4()
+    {
+        size_t stbl = 0, stblEnd = 0, box = 0, boxEnd = 0;
+
+        if (!findBox("moov/trak/mdia/minf/stbl", 0, data.getSize(), stbl, stblEnd))
+            return false;
+
+        // The sample entry's header is 8 bytes of the stsd box and 28 of its own
+        if (!findBox("stsd", stbl, stblEnd, box, boxEnd) || box + 8 + 8 + 28 > boxEnd)
+            return false;
+
+        size_t config = 0, configEnd = 0;
+        const size_t entry = box + 8 + 8 + 28;
+
+        if (!findBox("alac", entry, boxEnd, config, configEnd))
+            return false;
+
+        // The config, after the box's version and flags, then any 'chan' box whole
+        cookie = juce::MemoryBlock(bytes() + config + 4, configEnd - config - 4);
+        cookie.append(bytes() + configEnd, boxEnd - configEnd);
+
+        size_t stsz = 0, stszEnd = 0, stco = 0, stcoEnd = 0;
+
+        if (!findBox("stsz", stbl, stblEnd, stsz, stszEnd) || !findBox("stco", stbl, stblEnd, stco, stcoEnd))
+            return false;
+
+        const auto numPackets = readInt(stsz + 8);
+        size_t audio = readInt(stco + 8);
+
+        for (juce::uint32 i = 0; i < numPackets; ++i)
+        {
+            const size_t size = readInt(stsz + 12 + i * 4);
+
+            if (audio + size > data.getSize())
+                return false;
+
+            packets.emplace_back(bytes() + audio, size);
+            audio += size;
+        }
+
+        return true;
+    }
+};
@@ -0,0 +1,477 @@
+#include <JuceHeader.h>
+#include "../Source/Audio/AlacFileWriter.h"
+#include "../Source/Audio/AudioEncoder.h"
+#include "../Source/Audio/PcmConversion.h"
+#include "../Source/Audio/ALAC/ALACDecoder.h"
+#include "../Source/Audio/ALAC/ALACBitUtilities.h"
+#include "AlacFileReader.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+class AlacFileWriterTests : public juce::UnitTest
+{
+public:
+    AlacFileWriterTests() : juce::UnitTest("AlacFileWriter") {}
+
+    void runTest() override
+    {
+        testCafLayout();
+        testDecodesLosslessly();
+        testShortPacketOnlyAtEnd();
+        testMpeg4Layout();
+        testMpeg4DecodesLosslessly();
+        testPacketTableOnDisk();
+        testUnwritableFile();
+    }
+
+private:
+    static constexpr int framesPerPacket = 4096;
+
+    // The chunks of a CAF file by type, and whether the file parsed
+    struct CafFile
+    {
+        bool valid = false;
+        std::map<juce::String, juce::MemoryBlock> chunks;
+        juce::StringArray order;
+    };
+
+    static CafFile readCaf(const juce::File& file)
+    {
+        CafFile caf;
+        juce::MemoryBlock data;
+
+        if (!file.loadFileAsData(data) || data.getSize() < 8 || std::memcmp(data.getData(), "caff", 4) != 0)
+            return caf;
+
+        auto* bytes = static_cast<const juce::uint8*>(data.getData());
+        size_t offset = 8;
+
+        while (offset + 12 <= data.getSize())
+        {
+            juce::String type(reinterpret_cast<const char*>(bytes + offset), 4);
+            auto size = (juce::int64)(((juce::uint64)juce::ByteOrder::bigEndianInt(bytes + offset + 4) << 32)
+                                      | juce::ByteOrder::bigEndianInt(bytes + offset + 8));
+            offset += 12;
+
+            if (size < 0 || offset + (size_t)size > data.getSize())
+                return caf;
+
+            caf.chunks[type] = juce::MemoryBlock(bytes + offset, (size_t)size);
+            caf.order.add(type);
+            offset += (size_t)size;
+        }
+
+        caf.valid = offset == data.getSize();
+        return caf;
+    }
+
+    // The packet table's sizes, each seven bits to a byte
+    static std::vector<juce::uint32> readPacketSizes(const juce::MemoryBlock& pakt, juce::int64 numPackets)
+    {
+        std::vector<juce::uint32> sizes;
+        auto* bytes = static_cast<const juce::uint8*>(pakt.getData());
+        size_t offset = 24;
+
+        for (juce::int64 i = 0; i < numPackets && offset < pakt.getSize(); ++i)
+        {
+            juce::uint32 value = 0;
+
+            while (offset < pakt.getSize())
+            {
+                auto byte = bytes[offset++];
+                value = (value << 7) | (byte & 0x7f);
+
+                if ((byte & 0x80) == 0)
+                    break;
+            }
+
+            sizes.push_back(value);
+        }
+
+        return sizes;
+    }
+
+    static juce::int64 readInt64(const juce::MemoryBlock& block, size_t offset)
+    {
+        auto* bytes = static_cast<const juce::uint8*>(block.getData()) + offset;
+        return (juce::int64)(((juce::uint64)juce::ByteOrder::bigEndianInt(bytes) << 32)
+                             | juce::ByteOrder::bigEndianInt(bytes + 4));
+    }
+
+    static juce::AudioBuffer<float> makeSignal(int numChannels, int numFrames)
+    {
+        juce::AudioBuffer<float> signal(numChannels, numFrames);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < numFrames; ++i)
+                signal.setSample(ch, i, 0.3f * std::sin(0.013f * (float)(i * (ch + 1))) + 0.05f * std::sin(0.21f * (float)i));
+        return signal;
+    }
+
+    // Encodes the signal a packet at a time into a new file
+    bool writeFile(const juce::File& file, const juce::AudioBuffer<float>& signal, AudioEncoder& encoder,
+                   AlacFileWriter& writer)
+    {
+        const int numChannels = signal.getNumChannels();
+        encoder.prepare(44100.0, framesPerPacket, juce::AudioChannelSet::canonicalChannelSet(numChannels));
+        encoder.setFormat(AudioEncoder::Format::ALAC);
+
+        if (!writer.open(file, 44100.0, numChannels, framesPerPacket, encoder.getMagicCookie()))
+            return false;
+
+        juce::AudioBuffer<float> packet(numChannels, framesPerPacket);
+
+        for (int start = 0; start < signal.getNumSamples(); start += framesPerPacket)
+        {
+            const int numFrames = juce::jmin(framesPerPacket, signal.getNumSamples() - start);
+            for (int ch = 0; ch < numChannels; ++ch)
+                packet.copyFrom(ch, 0, signal, ch, start, numFrames);
+
+            auto encoded = encoder.encode(packet, numFrames);
+            if (!writer.writePacket(encoded.getData(), encoded.getSize(), numFrames))
+                return false;
+        }
+
+        return writer.finish();
+    }
+
+    void testCafLayout()
+    {
+        beginTest("CAF chunks describe the ALAC stream");
+        {
+            juce::TemporaryFile file(".caf");
+            const int numFrames = 10 * framesPerPacket + 1000;
+
+            AudioEncoder encoder;
+            AlacFileWriter writer;
+            expect(writeFile(file.getFile(), makeSignal(2, numFrames), encoder, writer), writer.getLastError());
+            expect(!writer.isOpen());
+            expectEquals((int)writer.getNumPackets(), 11);
+            expectEquals((int)writer.getNumFrames(), numFrames);
+
+            auto caf = readCaf(file.getFile());
+            expect(caf.valid, "Chunk sizes should add up to the file");
+            expect(caf.order == juce::StringArray({ "desc", "kuki", "data", "pakt" }), caf.order.joinIntoString(" "));
+
+            auto& desc = caf.chunks["desc"];
+            auto* d = static_cast<const juce::uint8*>(desc.getData());
+            expectEquals((int)desc.getSize(), 32);
+            expect(juce::String(reinterpret_cast<const char*>(d + 8), 4) == "alac");
+            expectEquals((int)juce::ByteOrder::bigEndianInt(d + 12), 1, "16-bit source data");
+            expectEquals((int)juce::ByteOrder::bigEndianInt(d + 16), 0, "Variable packet sizes");
+            expectEquals((int)juce::ByteOrder::bigEndianInt(d + 20), framesPerPacket);
+            expectEquals((int)juce::ByteOrder::bigEndianInt(d + 24), 2);
+
+            auto& pakt = caf.chunks["pakt"];
+            auto sizes = readPacketSizes(pakt, 11);
+
+            // The encoder's cookie, with the largest packet filled in
+            auto cookie = encoder.getMagicCookie();
+            auto& kuki = caf.chunks["kuki"];
+            auto* k = static_cast<const juce::uint8*>(kuki.getData());
+            expectEquals((int)kuki.getSize(), (int)cookie.getSize());
+            expect(std::memcmp(k, cookie.getData(), 12) == 0 && std::memcmp(k + 20, static_cast<const char*>(cookie.getData()) + 20, 4) == 0);
+            expectEquals((int)juce::ByteOrder::bigEndianInt(k + 12), (int)*std::max_element(sizes.begin(), sizes.end()));
+            expect(juce::ByteOrder::bigEndianInt(k + 16) > 0, "Average bit rate");
+
+            expectEquals((int)readInt64(pakt, 0), 11);
+            expectEquals((int)readInt64(pakt, 8), numFrames);
+            expectEquals((int)juce::ByteOrder::bigEndianInt(static_cast<const juce::uint8*>(pakt.getData()) + 20),
+                         11 * framesPerPacket - numFrames, "Remainder frames");
+
+            juce::int64 tableBytes = 0;
+            for (auto size : sizes)
+                tableBytes += size;
+
+            expectEquals((int)caf.chunks["data"].getSize(), 4 + (int)tableBytes, "Edit count plus the packets");
+            expectEquals((int)writer.getNumAudioBytes(), (int)tableBytes);
+        }
+    }
+
+    void testDecodesLosslessly()
+    {
+        beginTest("Packets read back from the file decode to the input");
+        {
+            for (int numChannels : { 1, 2, 6 })
+            {
+                juce::TemporaryFile file(".caf");
+                const int numFrames = 5 * framesPerPacket + 123;
+                auto signal = makeSignal(numChannels, numFrames);
+
+                AudioEncoder encoder;
+                AlacFileWriter writer;
+                expect(writeFile(file.getFile(), signal, encoder, writer), writer.getLastError());
+
+                auto caf = readCaf(file.getFile());
+                auto& kuki = caf.chunks["kuki"];
+                auto& data = caf.chunks["data"];
+                auto& pakt = caf.chunks["pakt"];
+                auto sizes = readPacketSizes(pakt, readInt64(pakt, 0));
+
+                ALACDecoder decoder;
+                expectEquals((int)decoder.Init(kuki.getData(), (uint32_t)kuki.getSize()), 0);
+
+                // ALAC's own channel order, as the file holds it
+                std::vector<juce::int16> host((size_t)(numFrames * numChannels));
+                PcmConversion::floatToInt16(signal, 0, numFrames, numChannels, host.data());
+
+                int order[kALACMaxChannels];
+                expect(ALACEncoderWrapper::getChannelOrder(juce::AudioChannelSet::canonicalChannelSet(numChannels), order));
+
+                std::vector<juce::int16> expected(host.size());
+                for (int i = 0; i < numFrames; ++i)
+                    for (int position = 0; position < numChannels; ++position)
+                        expected[(size_t)(i * numChannels + position)] = host[(size_t)(i * numChannels + order[position])];
+
+                std::vector<juce::int16> decoded;
+                std::vector<juce::int16> packet((size_t)(framesPerPacket * numChannels));
+                size_t offset = 4;
+
+                for (auto size : sizes)
+                {
+                    BitBuffer bits;
+                    BitBufferInit(&bits, static_cast<uint8_t*>(data.getData()) + offset, size);
+                    offset += size;
+
+                    uint32_t numDecoded = 0;
+                    decoder.Decode(&bits, reinterpret_cast<uint8_t*>(packet.data()), framesPerPacket,
+                                   (uint32_t)numChannels, &numDecoded);
+                    decoded.insert(decoded.end(), packet.begin(), packet.begin() + numDecoded * (uint32_t)numChannels);
+                }
+
+                expect(decoded == expected, juce::String(numChannels) + " channels should decode losslessly");
+            }
+        }
+    }
+
+    void testShortPacketOnlyAtEnd()
+    {
+        beginTest("Only the last packet may be short");
+        {
+            juce::TemporaryFile file(".caf");
+            AudioEncoder encoder;
+            encoder.prepare(44100.0, framesPerPacket);
+            encoder.setFormat(AudioEncoder::Format::ALAC);
+
+            AlacFileWriter writer;
+            expect(writer.open(file.getFile(), 44100.0, 2, framesPerPacket, encoder.getMagicCookie()));
+
+            const char packet[16] = {};
+            expect(writer.writePacket(packet, sizeof(packet), 100));
+            expect(!writer.writePacket(packet, sizeof(packet), framesPerPacket));
+            expect(writer.getLastError().isNotEmpty());
+            expect(!writer.writePacket(packet, sizeof(packet), framesPerPacket + 1));
+            expect(writer.finish());
+            expectEquals((int)writer.getNumPackets(), 1);
+            expectEquals((int)writer.getNumFrames(), 100);
+
+            expect(!writer.open(file.getFile(), 44100.0, 2, framesPerPacket, juce::MemoryBlock(8, true)),
+                   "A cookie too short for ALAC's config is refused");
+        }
+    }
+
+    // Top-level MPEG-4 boxes in order, and the offset of each one's contents
+    static juce::StringArray readTopLevelBoxes(const juce::MemoryBlock& data, std::map<juce::String, size_t>& contents)
+    {
+        juce::StringArray types;
+        auto* bytes = static_cast<const juce::uint8*>(data.getData());
+        size_t offset = 0;
+
+        while (offset + 8 <= data.getSize())
+        {
+            size_t size = juce::ByteOrder::bigEndianInt(bytes + offset), header = 8;
+            juce::String type(reinterpret_cast<const char*>(bytes + offset + 4), 4);
+
+            if (size == 1)
+            {
+                size = (size_t)readInt64(data, offset + 8);
+                header = 16;
+            }
+
+            if (size < header)
+                break;
+
+            types.add(type);
+            contents[type] = offset + header;
+            offset += size;
+        }
+
+        if (offset != data.getSize())
+            types.add("(bad sizes)");
+
+        return types;
+    }
+
+    void testMpeg4Layout()
+    {
+        beginTest("An .m4a file is MPEG-4 with the audio before its description");
+        {
+            expect(AlacFileWriter::getContainerFor(juce::File("/tmp/a.m4a")) == AlacFileWriter::Container::MPEG4);
+            expect(AlacFileWriter::getContainerFor(juce::File("/tmp/a.MP4")) == AlacFileWriter::Container::MPEG4);
+            expect(AlacFileWriter::getContainerFor(juce::File("/tmp/a.caf")) == AlacFileWriter::Container::CAF);
+
+            juce::TemporaryFile file(".m4a");
+            const int numFrames = 7 * framesPerPacket + 500;
+
+            AudioEncoder encoder;
+            AlacFileWriter writer;
+            expect(writeFile(file.getFile(), makeSignal(2, numFrames), encoder, writer), writer.getLastError());
+
+            juce::MemoryBlock data;
+            expect(file.getFile().loadFileAsData(data));
+
+            std::map<juce::String, size_t> contents;
+            auto types = readTopLevelBoxes(data, contents);
+            expect(types == juce::StringArray({ "ftyp", "mdat", "moov" }), types.joinIntoString(" "));
+            expect(std::memcmp(static_cast<const char*>(data.getData()) + contents["ftyp"], "M4A ", 4) == 0);
+
+            auto mdatSize = readInt64(data, contents["mdat"] - 8);
+            expectEquals((int)mdatSize, 16 + (int)writer.getNumAudioBytes(), "64-bit size covers the packets");
+
+            AlacFileReader reader(file.getFile());
+            expect(reader.valid);
+            expectEquals((int)reader.packets.size(), 8);
+            expectEquals((int)reader.cookie.getSize(), 24);
+
+            // The cookie in the 'alac' box, with the largest packet filled in
+            size_t largest = 0;
+            for (auto& packet : reader.packets)
+                largest = juce::jmax(largest, packet.getSize());
+
+            auto* k = static_cast<const juce::uint8*>(reader.cookie.getData());
+            expect(std::memcmp(k, encoder.getMagicCookie().getData(), 12) == 0);
+            expectEquals((int)juce::ByteOrder::bigEndianInt(k + 12), (int)largest);
+
+            // Durations are in frames, with the short packet last in the time table
+            auto find = [&data, moov = contents["moov"]](const char* fourcc)
+            {
+                auto* bytes = static_cast<const char*>(data.getData());
+                for (size_t i = moov; i + 4 <= data.getSize(); ++i)
+                    if (std::memcmp(bytes + i, fourcc, 4) == 0)
+                        return i + 4;
+                return (size_t)0;
+            };
+
+            auto* bytes = static_cast<const juce::uint8*>(data.getData());
+            auto mdhd = find("mdhd");
+            expectEquals((int)juce::ByteOrder::bigEndianInt(bytes + mdhd + 12), 44100, "Timescale");
+            expectEquals((int)juce::ByteOrder::bigEndianInt(bytes + mdhd + 16), numFrames, "Duration");
+
+            auto stts = find("stts");
+            expectEquals((int)juce::ByteOrder::bigEndianInt(bytes + stts + 4), 2);
+            expectEquals((int)juce::ByteOrder::bigEndianInt(bytes + stts + 8), 7);
+            expectEquals((int)juce::ByteOrder::bigEndianInt(bytes + stts + 12), framesPerPacket);
+            expectEquals((int)juce::ByteOrder::bigEndianInt(bytes + stts + 16), 1);
+            expectEquals((int)juce::ByteOrder::bigEndianInt(bytes + stts + 20), 500);
+        }
+    }
+
+    void testMpeg4DecodesLosslessly()
+    {
+        beginTest("Packets read back from an .m4a file decode to the input");
+        {
+            for (int numChannels : { 2, 6 })
+            {
+                juce::TemporaryFile file(".m4a");
+                const int numFrames = 3 * framesPerPacket + 77;
+                auto signal = makeSignal(numChannels, numFrames);
+
+                AudioEncoder encoder;
+                AlacFileWriter writer;
+                expect(writeFile(file.getFile(), signal, encoder, writer), writer.getLastError());
+                expect(writer.getContainer() == AlacFileWriter::Container::MPEG4);
+
+                AlacFileReader reader(file.getFile());
+                expect(reader.valid);
+
+                // More than two channels carry the encoder's 'chan' box after the config
+                expectEquals((int)reader.cookie.getSize(), (int)encoder.getMagicCookie().getSize());
+
+                std::vector<juce::int16> host((size_t)(numFrames * numChannels));
+                PcmConversion::floatToInt16(signal, 0, numFrames, numChannels, host.data());
+
+                int order[kALACMaxChannels];
+                expect(ALACEncoderWrapper::getChannelOrder(juce::AudioChannelSet::canonicalChannelSet(numChannels), order));
+
+                std::vector<juce::int16> expected(host.size());
+                for (int i = 0; i < numFrames; ++i)
+                    for (int position = 0; position < numChannels; ++position)
+                        expected[(size_t)(i * numChannels + position)] = host[(size_t)(i * numChannels + order[position])];
+
+                expect(reader.decode(numChannels, framesPerPacket) == expected,
+                       juce::String(numChannels) + " channels should decode losslessly");
+            }
+        }
+    }
+
+    void testPacketTableOnDisk()
+    {
+        beginTest("The packet table waits on disk, not in memory, and is copied in whole");
+        {
+            auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                 .getChildFile("AlacFileWriterTests-" + juce::String(juce::Random::getSystemRandom().nextInt(1000000)));
+            expect(directory.createDirectory().wasOk());
+
+            AudioEncoder encoder;
+            encoder.prepare(44100.0, framesPerPacket);
+            encoder.setFormat(AudioEncoder::Format::ALAC);
+
+            for (const char* name : { "long.caf", "long.m4a" })
+            {
+                // More sizes than the table's write buffer holds, some of them
+                // taking several bytes in CAF's variable-length form
+                const int numPackets = 40000;
+                std::vector<juce::MemoryBlock> written;
+                bool allWritten = true;
+
+                AlacFileWriter writer;
+                expect(writer.open(directory.getChildFile(name), 44100.0, 2, framesPerPacket, encoder.getMagicCookie()));
+                expectEquals(directory.getNumberOfChildFiles(juce::File::findFiles), 2, "The file and its packet table");
+
+                for (int p = 0; p < numPackets; ++p)
+                {
+                    juce::MemoryBlock packet((size_t)(1 + (p * 37) % 300), true);
+                    packet[0] = (char)p;
+                    allWritten = writer.writePacket(packet.getData(), packet.getSize(), framesPerPacket) && allWritten;
+                    written.push_back(packet);
+                }
+
+                expect(allWritten);
+
+                expect(writer.finish(), writer.getLastError());
+                expectEquals(directory.getNumberOfChildFiles(juce::File::findFiles), 1, "The table is gone once copied in");
+
+                AlacFileReader reader(directory.getChildFile(name));
+                expect(reader.valid, name);
+                expect(reader.packets == written, juce::String(name) + " should list every packet");
+
+                directory.getChildFile(name).deleteFile();
+            }
+
+            directory.deleteRecursively();
+        }
+    }
+
+    void testUnwritableFile()
+    {
+        beginTest("A file that can't be written is reported");
+        {
+            AudioEncoder encoder;
+            encoder.prepare(44100.0, framesPerPacket);
+            encoder.setFormat(AudioEncoder::Format::ALAC);
+
+            auto unwritable = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                  .getChildFile("no-such-directory/out.caf");
+
+            AlacFileWriter writer;
+            expect(!writer.open(unwritable, 44100.0, 2, framesPerPacket, encoder.getMagicCookie()));
+            expect(!writer.isOpen());
+            expect(writer.getLastError().contains("no-such-directory"));
+
+            const char packet[16] = {};
+            expect(!writer.writePacket(packet, sizeof(packet), framesPerPacket), "Nothing is written unopened");
+        }
+    }
+};
+
+static AlacFileWriterTests alacFileWriterTests;
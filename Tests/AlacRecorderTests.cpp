@@ -0,0 +1,185 @@
+#include <JuceHeader.h>
+#include "../Source/Audio/AlacRecorder.h"
+#include "../Source/Audio/AudioEncoder.h"
+#include "../Source/Audio/PcmConversion.h"
+#include "AlacFileReader.h"
+#include <vector>
+
+class AlacRecorderTests : public juce::UnitTest
+{
+public:
+    AlacRecorderTests() : juce::UnitTest("AlacRecorder") {}
+
+    void runTest() override
+    {
+        testRecordsLosslessly();
+        testRingWrapsAround();
+        testDropsWhenFull();
+        testUnwritableFile();
+    }
+
+private:
+    static constexpr int framesPerPacket = 352;
+
+    static juce::MemoryBlock makeCookie(AudioEncoder& encoder)
+    {
+        encoder.prepare(44100.0, framesPerPacket);
+        encoder.setFormat(AudioEncoder::Format::ALAC);
+        return encoder.getMagicCookie();
+    }
+
+    // Waits for the writer thread to catch up with what's been added
+    static bool waitForWritten(const AlacRecorder& recorder, juce::int64 numPackets)
+    {
+        for (int i = 0; i < 500; ++i)
+        {
+            auto stats = recorder.getStats();
+            if (stats.packetsWritten + stats.packetsDropped >= numPackets)
+                return true;
+
+            juce::Thread::sleep(5);
+        }
+
+        return false;
+    }
+
+    void testRecordsLosslessly()
+    {
+        beginTest("Packets added from a streaming thread decode from the file");
+        {
+            for (const char* extension : { ".caf", ".m4a" })
+            {
+                juce::TemporaryFile file(extension);
+                const int numPackets = 400;
+
+                AudioEncoder encoder;
+                AlacRecorder recorder;
+                expect(recorder.start(file.getFile(), 44100.0, 2, framesPerPacket, makeCookie(encoder)),
+                       recorder.getLastError());
+                expect(recorder.isRecording());
+
+                juce::AudioBuffer<float> packet(2, framesPerPacket);
+                std::vector<juce::int16> expected;
+                std::vector<juce::int16> frames((size_t)(framesPerPacket * 2));
+                bool allAdded = true;
+
+                for (int p = 0; p < numPackets; ++p)
+                {
+                    for (int ch = 0; ch < 2; ++ch)
+                        for (int i = 0; i < framesPerPacket; ++i)
+                            packet.setSample(ch, i, 0.4f * std::sin(0.01f * (float)((p * framesPerPacket + i) * (ch + 1))));
+
+                    PcmConversion::floatToInt16(packet, 0, framesPerPacket, 2, frames.data());
+                    expected.insert(expected.end(), frames.begin(), frames.end());
+
+                    auto encoded = encoder.encode(packet, framesPerPacket);
+                    allAdded = recorder.addPacket(encoded.getData(), (int)encoded.getSize(), framesPerPacket) && allAdded;
+                }
+
+                expect(allAdded, "The ring holds the whole recording");
+                expect(recorder.stop(), recorder.getLastError());
+                expect(!recorder.isRecording());
+                expect(!recorder.addPacket("x", 1, framesPerPacket), "Nothing is added once stopped");
+
+                auto stats = recorder.getStats();
+                expectEquals((int)stats.packetsWritten, numPackets);
+                expectEquals((int)stats.packetsDropped, 0);
+                expectEquals((int)stats.framesWritten, numPackets * framesPerPacket);
+
+                AlacFileReader reader(file.getFile());
+                expect(reader.valid, extension);
+                expect(reader.decode(2, framesPerPacket) == expected, juce::String(extension) + " should decode losslessly");
+            }
+        }
+    }
+
+    void testRingWrapsAround()
+    {
+        beginTest("Packets split across the end of the ring come out whole");
+        {
+            juce::TemporaryFile file(".caf");
+            AudioEncoder encoder;
+            AlacRecorder recorder;
+
+            // An odd size, so headers and packets land across the end
+            expect(recorder.start(file.getFile(), 44100.0, 2, framesPerPacket, makeCookie(encoder), 1001));
+
+            juce::Random random(42);
+            std::vector<juce::MemoryBlock> added;
+            bool allAdded = true;
+
+            for (int p = 0; p < 200; ++p)
+            {
+                juce::MemoryBlock packet((size_t)(1 + random.nextInt(300)));
+                for (size_t i = 0; i < packet.getSize(); ++i)
+                    packet[i] = (char)random.nextInt(256);
+
+                allAdded = recorder.addPacket(packet.getData(), (int)packet.getSize(), framesPerPacket) && allAdded;
+                added.push_back(packet);
+
+                // Room for the next packet, whatever its size
+                allAdded = waitForWritten(recorder, p + 1) && allAdded;
+            }
+
+            expect(allAdded);
+            expect(recorder.stop());
+
+            AlacFileReader reader(file.getFile());
+            expect(reader.valid);
+            expect(reader.packets == added, "Every packet's bytes should reach the file unchanged");
+        }
+    }
+
+    void testDropsWhenFull()
+    {
+        beginTest("A full ring drops packets instead of waiting");
+        {
+            juce::TemporaryFile file(".caf");
+            AudioEncoder encoder;
+            AlacRecorder recorder;
+            expect(recorder.start(file.getFile(), 44100.0, 2, framesPerPacket, makeCookie(encoder), 4096));
+
+            // Far more than the ring holds, faster than the writer looks
+            const char packet[1000] = {};
+            int numAdded = 0;
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+
+            for (int p = 0; p < 100; ++p)
+                if (recorder.addPacket(packet, (int)sizeof(packet), framesPerPacket))
+                    numAdded++;
+
+            const double addMs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks) * 1000.0;
+
+            expect(numAdded < 100);
+            expect(addMs < 50.0, "Adding never waits for the disk: " + juce::String(addMs, 2) + " ms");
+            expect(!recorder.stop(), "Dropped packets make the recording incomplete");
+
+            auto stats = recorder.getStats();
+            expectEquals((int)stats.packetsWritten, numAdded);
+            expectEquals((int)(stats.packetsWritten + stats.packetsDropped), 100);
+
+            AlacFileReader reader(file.getFile());
+            expect(reader.valid, "What was written is still a finished file");
+            expectEquals((int)reader.packets.size(), numAdded);
+        }
+    }
+
+    void testUnwritableFile()
+    {
+        beginTest("A file that can't be written is reported at the start");
+        {
+            AudioEncoder encoder;
+            AlacRecorder recorder;
+            auto unwritable = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                  .getChildFile("no-such-directory/out.caf");
+
+            expect(!recorder.start(unwritable, 44100.0, 2, framesPerPacket, makeCookie(encoder)));
+            expect(!recorder.isRecording());
+            expect(recorder.getLastError().contains("no-such-directory"));
+            expect(!recorder.addPacket("x", 1, framesPerPacket));
+            expect(!recorder.stop());
+        }
+    }
+};
+
+static AlacRecorderTests alacRecorderTests;
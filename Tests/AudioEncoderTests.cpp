@@ -1,5 +1,8 @@
 #include <JuceHeader.h>
 #include "../Source/Audio/AudioEncoder.h"
+#include "../Source/Audio/PcmConversion.h"
+#include "../Source/Audio/ALAC/ALACDecoder.h"
+#include "../Source/Audio/ALAC/ALACBitUtilities.h"
 
 class AudioEncoderTests : public juce::UnitTest
 {
@@ -15,6 +18,14 @@ public:
         testBufferSizeVariations();
         testFloatToIntConversion();
         testFormatSwitching();
+        testVectorConversionMatchesScalar();
+        testInterleavedInput();
+        testSurroundLayouts();
+        testSurroundChannelOrder();
+        testSurroundEncodeCost();
+        testParallelElements();
+        testEncoderFootprint();
+        testFastMode();
     }
     
 private:
@@ -224,6 +235,460 @@ private:
             expect(encodedALAC.getSize() > 0, "ALAC should produce output (even if fallback)");
         }
     }
+    
+    // Random audio with some of it clipping, so the clamp is exercised too
+    static void fillRandom(juce::AudioBuffer<float>& buffer, int seed)
+    {
+        juce::Random random(seed);
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample(ch, i, (random.nextFloat() * 2.0f - 1.0f) * 1.2f);
+    }
+    
+    void testVectorConversionMatchesScalar()
+    {
+        beginTest("Vectorised conversion matches the scalar formula");
+        {
+            // Odd frame counts leave a scalar tail after the vector loop
+            for (int numChannels : { 1, 2, 3 })
+            {
+                for (int numSamples : { 1, 7, 352, 4099 })
+                {
+                    juce::AudioBuffer<float> buffer(numChannels, numSamples);
+                    fillRandom(buffer, numSamples * numChannels);
+                    
+                    std::vector<int16_t> pcm16((size_t)(numSamples * numChannels));
+                    std::vector<uint8_t> pcm24((size_t)(numSamples * numChannels * 3));
+                    PcmConversion::floatToInt16(buffer, 0, numSamples, numChannels, pcm16.data());
+                    PcmConversion::floatToInt24(buffer, 0, numSamples, numChannels, pcm24.data());
+                    
+                    bool matches16 = true, matches24 = true;
+                    for (int i = 0; i < numSamples; ++i)
+                    {
+                        for (int ch = 0; ch < numChannels; ++ch)
+                        {
+                            float sample = juce::jlimit(-1.0f, 1.0f, buffer.getSample(ch, i));
+                            int index = i * numChannels + ch;
+                            int32_t value = static_cast<int32_t>(sample * 8388607.0f);
+                            
+                            matches16 = matches16 && pcm16[(size_t)index] == static_cast<int16_t>(sample * 32767.0f);
+                            matches24 = matches24 && pcm24[(size_t)index * 3] == static_cast<uint8_t>(value & 0xFF)
+                                                  && pcm24[(size_t)index * 3 + 1] == static_cast<uint8_t>((value >> 8) & 0xFF)
+                                                  && pcm24[(size_t)index * 3 + 2] == static_cast<uint8_t>((value >> 16) & 0xFF);
+                        }
+                    }
+                    
+                    juce::String shape = juce::String(numChannels) + " channels, " + juce::String(numSamples) + " frames";
+                    expect(matches16, "16-bit output should be bit-identical, " + shape);
+                    expect(matches24, "24-bit output should be bit-identical, " + shape);
+                    
+                    // And back again, within one step
+                    juce::AudioBuffer<float> restored(numChannels, numSamples);
+                    PcmConversion::int24ToFloat(pcm24.data(), numSamples, numChannels, restored, 0);
+                    float worst = 0.0f;
+                    for (int ch = 0; ch < numChannels; ++ch)
+                        for (int i = 0; i < numSamples; ++i)
+                            worst = juce::jmax(worst, std::abs(restored.getSample(ch, i)
+                                                               - juce::jlimit(-1.0f, 1.0f, buffer.getSample(ch, i))));
+                    expectLessThan(worst, 2.0f / 8388607.0f, "24-bit round trip, " + shape);
+                }
+            }
+        }
+    }
+    
+    void testInterleavedInput()
+    {
+        beginTest("Interleaved input encodes the same as float input");
+        {
+            const int numSamples = 352;
+            juce::AudioBuffer<float> buffer(2, numSamples);
+            fillRandom(buffer, 11);
+            
+            std::vector<int16_t> pcm16((size_t)numSamples * 2);
+            std::vector<uint8_t> pcm24((size_t)numSamples * 6);
+            PcmConversion::floatToInt16(buffer, 0, numSamples, 2, pcm16.data());
+            PcmConversion::floatToInt24(buffer, 0, numSamples, 2, pcm24.data());
+            
+            const std::pair<AudioEncoder::Format, const char*> formats[] =
+            {
+                { AudioEncoder::Format::PCM_16, "PCM16" },
+                { AudioEncoder::Format::PCM_24, "PCM24" },
+                { AudioEncoder::Format::ALAC, "ALAC" }
+            };
+            
+            for (auto& format : formats)
+            {
+                AudioEncoder encoder;
+                encoder.setFormat(format.first);
+                encoder.prepare(44100.0, numSamples);
+                
+                auto fromFloat = encoder.encode(buffer, numSamples);
+                const void* frames = format.first == AudioEncoder::Format::PCM_24 ? (const void*)pcm24.data()
+                                                                                   : (const void*)pcm16.data();
+                auto fromInterleaved = encoder.encodeInterleaved(frames, numSamples, 2,
+                                                                 format.first == AudioEncoder::Format::PCM_24 ? 24 : 16);
+                
+                expect(fromFloat.getSize() > 0);
+                expect(fromInterleaved == fromFloat, juce::String(format.second) + " payloads should be byte-identical");
+            }
+            
+            // A bit depth the format does not use is converted, not rejected
+            AudioEncoder encoder;
+            encoder.setFormat(AudioEncoder::Format::PCM_16);
+            auto narrowed = encoder.encodeInterleaved(pcm24.data(), numSamples, 2, 24);
+            expectEquals((int)narrowed.getSize(), numSamples * 2 * 2);
+            expectWithinAbsoluteError((int)static_cast<const int16_t*>(narrowed.getData())[5], (int)pcm16[5], 1);
+        }
+    }
+    
+    // Every channel gets its own level and pitch, so a decoded channel
+    // identifies the host channel it came from
+    static juce::AudioBuffer<float> makeSurround(int numChannels, int numSamples)
+    {
+        juce::AudioBuffer<float> buffer(numChannels, numSamples);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                buffer.setSample(ch, i, 0.1f * (float)(ch + 1) + 0.02f * std::sin(0.05f * (float)(i * (ch + 1))));
+        return buffer;
+    }
+    
+    // Decodes one ALAC packet back to interleaved 16-bit frames
+    static std::vector<int16_t> decodeAlac(juce::MemoryBlock cookie, juce::MemoryBlock packet, int numChannels, int numSamples)
+    {
+        ALACDecoder decoder;
+        if (decoder.Init(cookie.getData(), (uint32_t)cookie.getSize()) != 0)
+            return {};
+        
+        BitBuffer bits;
+        BitBufferInit(&bits, static_cast<uint8_t*>(packet.getData()), (uint32_t)packet.getSize());
+        
+        std::vector<int16_t> frames((size_t)(numSamples * numChannels));
+        uint32_t decoded = 0;
+        if (decoder.Decode(&bits, reinterpret_cast<uint8_t*>(frames.data()), (uint32_t)numSamples,
+                           (uint32_t)numChannels, &decoded) != 0)
+            return {};
+        
+        frames.resize((size_t)decoded * (size_t)numChannels);
+        return frames;
+    }
+    
+    void testSurroundLayouts()
+    {
+        beginTest("Layouts ALAC can carry");
+        {
+            for (auto layout : { juce::AudioChannelSet::mono(), juce::AudioChannelSet::stereo(),
+                                 juce::AudioChannelSet::createLCR(), juce::AudioChannelSet::createLCRS(),
+                                 juce::AudioChannelSet::create5point0(), juce::AudioChannelSet::create5point1(),
+                                 juce::AudioChannelSet::create6point1(), juce::AudioChannelSet::create7point1(),
+                                 juce::AudioChannelSet::create7point1SDDS() })
+                expect(AudioEncoder::isLayoutSupported(layout), layout.getDescription() + " should be supported");
+            
+            // No centre for ALAC's four-channel layout, and more than ALAC's eight channels
+            expect(!AudioEncoder::isLayoutSupported(juce::AudioChannelSet::quadraphonic()));
+            expect(!AudioEncoder::isLayoutSupported(juce::AudioChannelSet::discreteChannels(10)));
+            expect(!AudioEncoder::isLayoutSupported(juce::AudioChannelSet::disabled()));
+            
+            // A bare channel count maps to a layout ALAC carries, up to eight
+            for (int numChannels = 1; numChannels <= 8; ++numChannels)
+                expect(AudioEncoder::isLayoutSupported(AudioEncoder::getLayoutForChannelCount(numChannels)),
+                       juce::String(numChannels) + " channels should be supported");
+        }
+    }
+    
+    void testSurroundChannelOrder()
+    {
+        beginTest("Surround channels reach ALAC's positions");
+        {
+            const int numSamples = 352;
+            
+            // Host channel expected in each ALAC position
+            const std::pair<juce::AudioChannelSet, std::vector<int>> cases[] =
+            {
+                // L R C LFE Ls Rs -> C L R Ls Rs LFE
+                { juce::AudioChannelSet::create5point1(), { 2, 0, 1, 4, 5, 3 } },
+                // L R C LFE Ls Rs Cs -> C L R Ls Rs Cs LFE
+                { juce::AudioChannelSet::create6point1(), { 2, 0, 1, 4, 5, 6, 3 } },
+                // L R C LFE Lss Rss Lrs Rrs -> C Lc Rc L R Ls Rs LFE, rears in the Lc/Rc positions
+                { juce::AudioChannelSet::create7point1(), { 2, 6, 7, 0, 1, 4, 5, 3 } }
+            };
+            
+            for (auto& test : cases)
+            {
+                const auto& layout = test.first;
+                const int numChannels = layout.size();
+                auto buffer = makeSurround(numChannels, numSamples);
+                
+                std::vector<int16_t> host((size_t)(numSamples * numChannels));
+                PcmConversion::floatToInt16(buffer, 0, numSamples, numChannels, host.data());
+                
+                ALACEncoderWrapper encoder;
+                expect(encoder.initialize(44100.0, layout, numSamples), layout.getDescription());
+                
+                auto packet = encoder.encode(buffer, numSamples);
+                expect(packet.getSize() > 0 && packet.getSize() < host.size() * sizeof(int16_t),
+                       "The packet should be compressed");
+                
+                auto decoded = decodeAlac(encoder.getMagicCookie(), packet, numChannels, numSamples);
+                expectEquals((int)decoded.size(), numSamples * numChannels);
+                
+                int misplaced = 0;
+                for (int i = 0; i < numSamples && !decoded.empty(); ++i)
+                    for (int position = 0; position < numChannels; ++position)
+                        if (decoded[(size_t)(i * numChannels + position)] != host[(size_t)(i * numChannels + test.second[(size_t)position])])
+                            ++misplaced;
+                
+                expectEquals(misplaced, 0, layout.getDescription() + " should decode losslessly in ALAC order");
+                
+                // Host-order interleaved frames are reordered the same way. The
+                // encoder adapts its stereo mixing from packet to packet, so
+                // compare against a fresh one.
+                ALACEncoderWrapper interleaved;
+                interleaved.initialize(44100.0, layout, numSamples);
+                expect(interleaved.encodeInterleaved(host.data(), numSamples) == packet,
+                       "Interleaved input should give the same packet");
+            }
+        }
+    }
+    
+    void testSurroundEncodeCost()
+    {
+        beginTest("7.1 ALAC encoding keeps up with the packet rate");
+        {
+            const int numSamples = 352;
+            AudioEncoder encoder;
+            encoder.setFormat(AudioEncoder::Format::ALAC);
+            encoder.prepare(44100.0, numSamples, juce::AudioChannelSet::create7point1());
+            
+            juce::AudioBuffer<float> buffer(8, numSamples);
+            fillRandom(buffer, 17);
+            buffer.applyGain(0.5f);
+            
+            const int packets = 500;
+            size_t bytes = 0;
+            auto start = juce::Time::getHighResolutionTicks();
+            for (int i = 0; i < packets; ++i)
+                bytes += encoder.encode(buffer, numSamples).getSize();
+            double micros = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start)
+                            * 1.0e6 / packets;
+            
+            // A 352-frame packet lasts 8 ms; one encode must take a fraction of that
+            const double packetMicros = 1.0e6 * numSamples / 44100.0;
+            expect(bytes > 0);
+            expectLessThan(micros, packetMicros / 4.0, "Encoding should leave the stream thread most of each packet");
+            
+            logMessage("7.1 ALAC: " + juce::String(micros, 1) + " us per packet ("
+                       + juce::String(100.0 * micros / packetMicros, 1) + "% of real time)");
+        }
+    }
+    
+    void testParallelElements()
+    {
+        beginTest("Parallel element encoding matches serial encoding");
+        {
+            const std::pair<juce::AudioChannelSet, const char*> layouts[] =
+            {
+                { juce::AudioChannelSet::create5point1(), "5.1" },
+                { juce::AudioChannelSet::create7point1(), "7.1" }
+            };
+            
+            for (auto& layout : layouts)
+            {
+                for (int frameSize : { 352, 4096 })
+                {
+                    const int numChannels = layout.first.size();
+                    ALACEncoderWrapper serial, parallel;
+                    serial.setElementThreads(0);
+                    parallel.setElementThreads(numChannels);
+                    expect(serial.initialize(44100.0, layout.first, frameSize));
+                    expect(parallel.initialize(44100.0, layout.first, frameSize));
+                    expectEquals(serial.getElementThreads(), 0);
+                    expectEquals(parallel.getElementThreads(), numChannels == 6 ? 3 : 4, "One worker per extra element");
+                    
+                    // Tonal packets with an occasional burst of noise, which
+                    // takes the uncompressed escape path
+                    auto tonal = makeSurround(numChannels, frameSize);
+                    juce::AudioBuffer<float> noise(numChannels, frameSize);
+                    fillRandom(noise, 23);
+                    
+                    const int packets = frameSize == 352 ? 400 : 40;
+                    double serialSeconds = 0.0, parallelSeconds = 0.0;
+                    int mismatches = 0;
+                    
+                    for (int i = 0; i < packets; ++i)
+                    {
+                        const auto& audio = i % 10 == 7 ? noise : tonal;
+                        
+                        auto start = juce::Time::getHighResolutionTicks();
+                        auto expected = serial.encode(audio, frameSize);
+                        auto middle = juce::Time::getHighResolutionTicks();
+                        auto actual = parallel.encode(audio, frameSize);
+                        auto end = juce::Time::getHighResolutionTicks();
+                        
+                        serialSeconds += juce::Time::highResolutionTicksToSeconds(middle - start);
+                        parallelSeconds += juce::Time::highResolutionTicksToSeconds(end - middle);
+                        
+                        if (expected.getSize() == 0 || !(actual == expected))
+                            ++mismatches;
+                    }
+                    
+                    expectEquals(mismatches, 0, juce::String(layout.second) + " packets should be byte-identical");
+                    
+                    logMessage(juce::String(layout.second) + ", " + juce::String(frameSize) + "-frame packets: "
+                               + juce::String(serialSeconds * 1.0e6 / packets, 1) + " us serial, "
+                               + juce::String(parallelSeconds * 1.0e6 / packets, 1) + " us on "
+                               + juce::String(parallel.getElementThreads() + 1) + " threads ("
+                               + juce::String(serialSeconds / parallelSeconds, 2) + "x, "
+                               + juce::String(juce::SystemStats::getNumCpus()) + " cores)");
+                }
+            }
+            
+            // Every stream has an encoder, so threads are only started on request
+            AudioEncoder encoder;
+            encoder.prepare(44100.0, 352, juce::AudioChannelSet::create7point1());
+            encoder.setFormat(AudioEncoder::Format::ALAC);
+            expectEquals(encoder.getElementThreads(), 0, "Surround encodes serially by default");
+            
+            encoder.setElementThreads(8);
+            expectEquals(encoder.getElementThreads(), 4, "Threads requested take effect at once");
+            expect(encoder.getMagicCookie().getSize() > 0);
+            
+            encoder.setElementThreads(0);
+            expectEquals(encoder.getElementThreads(), 0);
+        }
+    }
+    
+    static AudioFormatDescription alacFormat(int numChannels, int frameSize)
+    {
+        AudioFormatDescription format {};
+        format.mSampleRate = 44100.0;
+        format.mFormatID = kALACFormatAppleLossless;
+        format.mFormatFlags = 1;
+        format.mChannelsPerFrame = (uint32_t)numChannels;
+        format.mFramesPerPacket = (uint32_t)frameSize;
+        return format;
+    }
+    
+    static juce::uint32 arenaSize(int numChannels, int frameSize, bool concurrent)
+    {
+        ALACEncoder encoder;
+        encoder.SetFrameSize((uint32_t)frameSize);
+        encoder.SetConcurrentElements(concurrent);
+        encoder.InitializeEncoder(alacFormat(numChannels, frameSize));
+        return encoder.GetArenaSize();
+    }
+    
+    void testEncoderFootprint()
+    {
+        beginTest("ALAC encoder allocates for its configuration only");
+        {
+            // Nothing sized for the worst case is embedded in the object
+            expectLessThan((int)sizeof(ALACEncoder), 256);
+            
+            const auto stereo = arenaSize(2, 352, false);
+            const auto stereoLarge = arenaSize(2, 4096, false);
+            const auto surround = arenaSize(8, 4096, false);
+            const auto surroundConcurrent = arenaSize(8, 4096, true);
+            
+            expectLessThan((int)stereo, 16 * 1024, "A RAOP-sized stereo encoder should stay small");
+            expectGreaterThan((int)stereoLarge, (int)stereo * 8, "Buffers scale with the frame size");
+            
+            // Encoding serially, extra channels add only their coefs
+            expectLessThan((int)(surround - stereoLarge), 4 * 1024);
+            expectGreaterThan((int)surroundConcurrent, (int)surround * 4, "Each element needs its own buffers");
+            
+            logMessage("Encoder arena: " + juce::String(stereo) + " bytes stereo/352, "
+                       + juce::String(stereoLarge) + " stereo/4096, " + juce::String(surround) + " 7.1/4096, "
+                       + juce::String(surroundConcurrent) + " 7.1/4096 with concurrent elements");
+        }
+        
+        beginTest("Reinitialising the ALAC encoder replaces its buffers");
+        {
+            ALACEncoder reused, fresh;
+            reused.SetFrameSize(4096);
+            reused.SetConcurrentElements(true);
+            expectEquals(reused.InitializeEncoder(alacFormat(8, 4096)), 0);
+            
+            reused.SetFrameSize(352);
+            reused.SetConcurrentElements(false);
+            expectEquals(reused.InitializeEncoder(alacFormat(2, 352)), 0);
+            fresh.SetFrameSize(352);
+            expectEquals(fresh.InitializeEncoder(alacFormat(2, 352)), 0);
+            expectEquals(reused.GetArenaSize(), fresh.GetArenaSize());
+            
+            AudioFormatDescription input {};
+            input.mSampleRate = 44100.0;
+            input.mFormatID = kALACFormatLinearPCM;
+            input.mFormatFlags = kALACFormatFlagIsSignedInteger | kALACFormatFlagsNativeEndian;
+            input.mBytesPerPacket = input.mBytesPerFrame = 4;
+            input.mFramesPerPacket = 1;
+            input.mChannelsPerFrame = 2;
+            input.mBitsPerChannel = 16;
+            
+            std::vector<int16_t> frames(352 * 2);
+            juce::Random random(5);
+            for (auto& sample : frames)
+                sample = (int16_t)(random.nextInt(6000) - 3000);
+            
+            std::vector<uint8_t> reusedOut(reused.GetMaxOutputBytes()), freshOut(fresh.GetMaxOutputBytes());
+            int32_t reusedBytes = 352 * 4, freshBytes = 352 * 4;
+            expectEquals(reused.Encode(input, alacFormat(2, 352), reinterpret_cast<unsigned char*>(frames.data()),
+                                       reusedOut.data(), &reusedBytes), 0);
+            expectEquals(fresh.Encode(input, alacFormat(2, 352), reinterpret_cast<unsigned char*>(frames.data()),
+                                      freshOut.data(), &freshBytes), 0);
+            expect(reusedBytes == freshBytes && std::memcmp(reusedOut.data(), freshOut.data(), (size_t)freshBytes) == 0,
+                   "A reconfigured encoder should encode like a new one");
+            
+            // Without buffers per element, elements can't be encoded apart
+            expectEquals(reused.EncodeElement(0, input, reinterpret_cast<unsigned char*>(frames.data()), 352),
+                         (int32_t)kALAC_ParamError);
+        }
+    }
+    
+    void testFastMode()
+    {
+        beginTest("ALAC fast mode is lossless");
+        {
+            const int numSamples = 352;
+            const int numPackets = 16;
+            
+            ALACEncoderWrapper fast, searching;
+            expect(fast.initialize(44100.0, 2, numSamples));
+            expect(searching.initialize(44100.0, 2, numSamples));
+            fast.setFastMode(true);
+            expect(fast.isFastMode());
+            expect(!searching.isFastMode());
+            
+            size_t fastBytes = 0, searchingBytes = 0;
+            int mismatched = 0;
+            
+            for (int p = 0; p < numPackets; ++p)
+            {
+                juce::AudioBuffer<float> buffer(2, numSamples);
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    const float t = (float)(p * numSamples + i);
+                    buffer.setSample(0, i, 0.4f * std::sin(0.031f * t) + 0.1f * std::sin(0.37f * t));
+                    buffer.setSample(1, i, 0.3f * std::sin(0.029f * t + 0.5f));
+                }
+                
+                std::vector<int16_t> expected((size_t)(numSamples * 2));
+                PcmConversion::floatToInt16(buffer, 0, numSamples, 2, expected.data());
+                
+                auto packet = fast.encode(buffer, numSamples);
+                fastBytes += packet.getSize();
+                searchingBytes += searching.encode(buffer, numSamples).getSize();
+                
+                if (decodeAlac(fast.getMagicCookie(), packet, 2, numSamples) != expected)
+                    ++mismatched;
+            }
+            
+            expectEquals(mismatched, 0, "Fast packets should decode to the input");
+            expect(fastBytes < (size_t)(numPackets * numSamples * 2) * sizeof(int16_t), "Fast packets should still compress");
+            
+            logMessage("Fast mode: " + juce::String((int)fastBytes) + " bytes, searching: "
+                       + juce::String((int)searchingBytes) + " bytes");
+        }
+    }
 };
 
 static AudioEncoderTests audioEncoderTests;
@@ -0,0 +1,168 @@
+#include <JuceHeader.h>
+#include "../Source/Audio/DriftResampler.h"
+
+class DriftResamplerTests : public juce::UnitTest
+{
+public:
+    DriftResamplerTests() : juce::UnitTest("DriftResampler") {}
+
+    void runTest() override
+    {
+        testUnityRatioIsTransparent();
+        testFractionalRatioAccuracy();
+        testControllerHoldsFill();
+    }
+
+private:
+    // Resamples a 1 kHz sine at a fixed ratio and returns the error against
+    // the ideal output in dB relative to the signal
+    double measureErrorDb(double ratio)
+    {
+        const double w = 2.0 * juce::MathConstants<double>::pi * 1000.0 / 44100.0;
+        const int blockSize = 512;
+        const int delay = DriftResampler::numTaps / 2 - 1;
+
+        DriftResampler resampler;
+        resampler.prepare(1, blockSize, 44100.0);
+        resampler.setRatio(ratio);
+
+        juce::AudioBuffer<float> input(1, blockSize), output(1, 352);
+        juce::int64 inputPosition = 0, outputPosition = 0;
+        double errorPower = 0.0, signalPower = 0.0;
+
+        while (outputPosition < 44100)
+        {
+            int needed = resampler.getInputFramesNeeded(352);
+            while (needed > 0)
+            {
+                int chunk = juce::jmin(needed, blockSize);
+                for (int i = 0; i < chunk; ++i)
+                    input.setSample(0, i, (float)(0.5 * std::sin(w * (double)(inputPosition + i))));
+
+                resampler.pushInput(input, 0, chunk);
+                inputPosition += chunk;
+                needed -= chunk;
+            }
+
+            int produced = resampler.pullOutput(output, 0, 352);
+            expectEquals(produced, 352);
+
+            for (int i = 0; i < produced; ++i)
+            {
+                double ideal = 0.5 * std::sin(w * ((double)(outputPosition + i) * ratio + delay));
+                double error = output.getSample(0, i) - ideal;
+                errorPower += error * error;
+                signalPower += ideal * ideal;
+            }
+
+            outputPosition += produced;
+        }
+
+        return 10.0 * std::log10(errorPower / signalPower);
+    }
+
+    void testUnityRatioIsTransparent()
+    {
+        beginTest("Unity ratio is transparent");
+        {
+            double errorDb = measureErrorDb(1.0);
+            expectLessThan(errorDb, -70.0, "1 kHz sine should pass through unchanged");
+            logMessage("Error at ratio 1.0: " + juce::String(errorDb, 1) + " dB");
+        }
+    }
+
+    void testFractionalRatioAccuracy()
+    {
+        beginTest("Fractional ratio accuracy");
+        {
+            for (double ppm : { -1000.0, -150.0, 80.0, 1000.0 })
+            {
+                double errorDb = measureErrorDb(1.0 + ppm * 1.0e-6);
+                expectLessThan(errorDb, -70.0, "Interpolation error at " + juce::String(ppm) + " ppm");
+                logMessage("Error at " + juce::String(ppm, 0) + " ppm: " + juce::String(errorDb, 1) + " dB");
+            }
+        }
+    }
+
+    void testControllerHoldsFill()
+    {
+        beginTest("PI controller holds fill within one packet over an hour");
+        {
+            // Simulated clocks: the host delivers 512-frame blocks at
+            // 44.1 kHz * (1 + drift); the receiver pulls 352-frame packets at
+            // exactly 44.1 kHz. The input FIFO is modelled by its fill level.
+            const int hostBlock = 512;
+            const int packet = 352;
+            const int target = hostBlock + packet;
+            const double simulatedSeconds = 3600.0;
+            const double settleSeconds = 120.0;
+
+            for (double driftPpm : { 100.0, -300.0 })
+            {
+                DriftResampler resampler;
+                resampler.prepare(1, 2048, 44100.0);
+                resampler.setTargetFill(target);
+
+                juce::AudioBuffer<float> input(1, 2048), output(1, packet);
+                input.clear();
+
+                double hostRate = 44100.0 * (1.0 + driftPpm * 1.0e-6);
+                double nextHostBlock = 0.0, nextPacket = (double)target / 44100.0;
+                int fifoFill = 0;
+                int underflows = 0;
+
+                // Fill averaged per second, compared with the target after settling
+                double secondSum = 0.0;
+                int secondSamples = 0, secondIndex = 0;
+                double worstDeviation = 0.0;
+
+                while (nextPacket < simulatedSeconds)
+                {
+                    if (nextHostBlock <= nextPacket)
+                    {
+                        fifoFill += hostBlock;
+                        nextHostBlock += hostBlock / hostRate;
+                        continue;
+                    }
+
+                    int needed = resampler.getInputFramesNeeded(packet);
+                    int taken = juce::jmin(needed, fifoFill);
+                    if (taken < needed)
+                        underflows++;
+
+                    resampler.pushInput(input, 0, taken);
+                    fifoFill -= taken;
+                    resampler.pullOutput(output, 0, packet);
+                    resampler.updateController(fifoFill, packet);
+
+                    secondSum += fifoFill;
+                    secondSamples++;
+
+                    if ((int)nextPacket != secondIndex)
+                    {
+                        if (nextPacket > settleSeconds)
+                            worstDeviation = juce::jmax(worstDeviation, std::abs(secondSum / secondSamples - target));
+
+                        secondIndex = (int)nextPacket;
+                        secondSum = 0.0;
+                        secondSamples = 0;
+                    }
+
+                    nextPacket += packet / 44100.0;
+                }
+
+                expectLessThan(worstDeviation, (double)packet, "Average fill should stay within one packet");
+                expectEquals(underflows, 0, "Drift should never starve the receiver side");
+                expectWithinAbsoluteError(resampler.getCorrectionPpm(), driftPpm, 20.0,
+                                          "Correction should settle on the clock drift");
+
+                logMessage(juce::String(driftPpm, 0) + " ppm drift: correction "
+                           + juce::String(resampler.getCorrectionPpm(), 1) + " ppm, worst 1 s fill deviation "
+                           + juce::String(worstDeviation, 1) + " frames over " + juce::String(simulatedSeconds / 60.0, 0)
+                           + " min");
+            }
+        }
+    }
+};
+
+static DriftResamplerTests driftResamplerTests;
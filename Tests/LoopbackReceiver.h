@@ -0,0 +1,222 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../Source/AirPlay/RaopTransport.h"
+#include "../Source/AirPlay/RtpPacket.h"
+
+// Minimal RAOP receiver bound to localhost for transport tests. Records every
+// audio and sync packet it receives together with its arrival time, and can
+// issue timing requests the way a real receiver does.
+class LoopbackReceiver : public juce::Thread
+{
+public:
+    struct AudioPacket
+    {
+        juce::uint16 sequence = 0;
+        juce::uint32 timestamp = 0;
+        bool marker = false;
+        juce::MemoryBlock payload;
+        juce::int64 arrivalTicks = 0;
+    };
+
+    struct SyncPacket
+    {
+        bool extension = false;
+        juce::uint32 playingTimestamp = 0;
+        NtpTime ntpTime;
+        juce::uint32 nextTimestamp = 0;
+        juce::int64 arrivalTicks = 0;
+    };
+
+    LoopbackReceiver() : Thread("LoopbackReceiver")
+    {
+        RtpPacket::bindExclusive(audioSocket, 0, "127.0.0.1");
+        RtpPacket::bindExclusive(controlSocket, 0, "127.0.0.1");
+        RtpPacket::bindExclusive(timingSocket, 0, "127.0.0.1");
+        startThread();
+    }
+
+    ~LoopbackReceiver() override
+    {
+        stopThread(1000);
+    }
+
+    RaopTransport::Endpoint getEndpoint() const
+    {
+        RaopTransport::Endpoint endpoint;
+        endpoint.host = "127.0.0.1";
+        endpoint.audioPort = audioSocket.getBoundPort();
+        endpoint.controlPort = controlSocket.getBoundPort();
+        endpoint.timingPort = timingSocket.getBoundPort();
+        return endpoint;
+    }
+
+    bool waitForAudioPackets(int count, int timeoutMs)
+    {
+        auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32)timeoutMs;
+        while (getNumAudioPackets() < count)
+        {
+            if (juce::Time::getMillisecondCounter() > deadline)
+                return false;
+            juce::Thread::sleep(1);
+        }
+        return true;
+    }
+
+    int getNumAudioPackets() const
+    {
+        const juce::ScopedLock sl(lock);
+        return (int)audioPackets.size();
+    }
+
+    // Long runs (benchmarks) can stop keeping audio packets; every packet is
+    // still counted
+    void setKeepAudioPackets(bool shouldKeep) { keepAudioPackets = shouldKeep; }
+    juce::int64 getNumAudioPacketsReceived() const { return audioPacketsReceived.load(); }
+
+    std::vector<AudioPacket> getAudioPackets() const
+    {
+        const juce::ScopedLock sl(lock);
+        return audioPackets;
+    }
+
+    std::vector<SyncPacket> getSyncPackets() const
+    {
+        const juce::ScopedLock sl(lock);
+        return syncPackets;
+    }
+
+    std::vector<AudioPacket> getRetransmittedPackets() const
+    {
+        const juce::ScopedLock sl(lock);
+        return retransmittedPackets;
+    }
+
+    // When the given timestamp will be audible, in NTP microseconds, according
+    // to the latest sync packet: the sync maps its playing timestamp to its
+    // NTP time, and the device adds outputLatencyFrames on top. Returns 0
+    // before the first sync packet.
+    double getPlayoutMicros(juce::uint32 timestamp, juce::uint32 outputLatencyFrames,
+                            double sampleRate = 44100.0) const
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (syncPackets.empty())
+            return 0.0;
+
+        const auto& sync = syncPackets.back();
+        auto framesAhead = (double)(juce::int32)(timestamp - sync.playingTimestamp) + (double)outputLatencyFrames;
+        return (double)sync.ntpTime.toMicroseconds() + framesAhead * 1.0e6 / sampleRate;
+    }
+
+    // Asks the sender to resend count packets starting at firstSequence
+    void requestRetransmit(int senderControlPort, juce::uint16 firstSequence, juce::uint16 count)
+    {
+        juce::uint8 request[8];
+        request[0] = 0x80;
+        request[1] = RtpPacket::retransmitRequest | RtpPacket::markerBit;
+        RtpPacket::writeUInt16(request + 2, 1);
+        RtpPacket::writeUInt16(request + 4, firstSequence);
+        RtpPacket::writeUInt16(request + 6, count);
+        controlSocket.write("127.0.0.1", senderControlPort, request, (int)sizeof(request));
+    }
+
+    // Sends a timing request to the sender and waits for the reply.
+    // Returns the round trip in microseconds, or -1 on timeout/bad reply.
+    double requestTiming(int senderTimingPort, int timeoutMs = 500)
+    {
+        juce::uint8 request[RtpPacket::timingPacketSize] = {};
+        request[0] = 0x80;
+        request[1] = RtpPacket::timingRequest | RtpPacket::markerBit;
+        RtpPacket::writeUInt16(request + 2, 7);
+
+        auto sentAt = NtpTime::now();
+        sentAt.write(request + 24);
+
+        auto startTicks = juce::Time::getHighResolutionTicks();
+        timingSocket.write("127.0.0.1", senderTimingPort, request, (int)sizeof(request));
+
+        if (timingSocket.waitUntilReady(true, timeoutMs) <= 0)
+            return -1.0;
+
+        juce::uint8 response[64];
+        int size = timingSocket.read(response, (int)sizeof(response), false);
+        auto elapsed = juce::Time::getHighResolutionTicks() - startTicks;
+
+        if (size != RtpPacket::timingPacketSize
+            || RtpPacket::getPayloadType(response) != RtpPacket::timingResponse
+            || std::memcmp(response + 8, request + 24, 8) != 0)
+            return -1.0;
+
+        return (double)elapsed * 1.0e6 / (double)juce::Time::getHighResolutionTicksPerSecond();
+    }
+
+    void run() override
+    {
+        juce::uint8 packet[8192];
+
+        while (!threadShouldExit())
+        {
+            if (audioSocket.waitUntilReady(true, 1) > 0)
+            {
+                int size = audioSocket.read(packet, (int)sizeof(packet), false);
+                if (size >= RtpPacket::headerSize)
+                {
+                    audioPacketsReceived++;
+
+                    if (keepAudioPackets)
+                        recordAudio(packet, size, audioPackets);
+                }
+            }
+
+            if (controlSocket.waitUntilReady(true, 0) > 0)
+            {
+                int size = controlSocket.read(packet, (int)sizeof(packet), false);
+                if (size >= RtpPacket::syncPacketSize && RtpPacket::getPayloadType(packet) == RtpPacket::sync)
+                    recordSync(packet);
+                else if (size >= 4 + RtpPacket::headerSize
+                         && RtpPacket::getPayloadType(packet) == RtpPacket::retransmitResponse)
+                    recordAudio(packet + 4, size - 4, retransmittedPackets);
+            }
+        }
+    }
+
+private:
+    void recordAudio(const juce::uint8* packet, int size, std::vector<AudioPacket>& destination)
+    {
+        AudioPacket p;
+        p.arrivalTicks = juce::Time::getHighResolutionTicks();
+        p.marker = (packet[1] & RtpPacket::markerBit) != 0;
+        p.sequence = RtpPacket::readUInt16(packet + 2);
+        p.timestamp = RtpPacket::readUInt32(packet + 4);
+        p.payload.append(packet + RtpPacket::headerSize, (size_t)(size - RtpPacket::headerSize));
+
+        const juce::ScopedLock sl(lock);
+        destination.push_back(std::move(p));
+    }
+
+    void recordSync(const juce::uint8* packet)
+    {
+        SyncPacket s;
+        s.arrivalTicks = juce::Time::getHighResolutionTicks();
+        s.extension = (packet[0] & 0x10) != 0;
+        s.playingTimestamp = RtpPacket::readUInt32(packet + 4);
+        s.ntpTime = NtpTime::read(packet + 8);
+        s.nextTimestamp = RtpPacket::readUInt32(packet + 16);
+
+        const juce::ScopedLock sl(lock);
+        syncPackets.push_back(s);
+    }
+
+    juce::DatagramSocket audioSocket;
+    juce::DatagramSocket controlSocket;
+    juce::DatagramSocket timingSocket;
+
+    juce::CriticalSection lock;
+    std::vector<AudioPacket> audioPackets;
+    std::vector<SyncPacket> syncPackets;
+    std::vector<AudioPacket> retransmittedPackets;
+    std::atomic<bool> keepAudioPackets{true};
+    std::atomic<juce::int64> audioPacketsReceived{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopbackReceiver)
+};
@@ -0,0 +1,207 @@
+#include <JuceHeader.h>
+#include "../Source/Audio/StreamBuffer.h"
+#include <vector>
+
+class LossConcealerTests : public juce::UnitTest
+{
+public:
+    LossConcealerTests() : juce::UnitTest("LossConcealer") {}
+
+    void runTest() override
+    {
+        testFindsPitchPeriod();
+        testSilenceStaysSilent();
+        testDiscontinuityEnergy();
+        testConcealmentCost();
+    }
+
+private:
+    static constexpr int blockSize = 352;
+    static constexpr double sampleRate = 44100.0;
+
+    // A 220 Hz tone with a third harmonic, the same on both channels
+    static float toneAt(int frame)
+    {
+        const double w = 2.0 * juce::MathConstants<double>::pi * 220.0 / sampleRate;
+        return (float)(0.4 * std::sin(w * frame) + 0.1 * std::sin(3.0 * w * frame + 0.5));
+    }
+
+    // Frames the producer delivers on each tick: mostly whole packets, with
+    // short, single-packet and multi-packet stalls mixed in
+    static int framesWrittenOnTick(int tick)
+    {
+        switch (tick % 40)
+        {
+            case 10: return 100;
+            case 20: return 0;
+            case 29: return 200;
+            case 30: case 31: case 32: case 33: return 0;
+            default: return blockSize;
+        }
+    }
+
+    struct Run
+    {
+        std::vector<float> concealed;   // What StreamBuffer::read produces
+        std::vector<float> zeroFilled;  // The same reads with gaps cut to silence
+        std::vector<float> clean;       // The tone without gaps, same length
+        int gaps = 0;
+    };
+
+    Run stream(int ticks)
+    {
+        StreamBuffer buffer(2, 8192);
+        juce::AudioBuffer<float> in(2, blockSize), out(2, blockSize);
+        Run run;
+        int produced = 0;
+        bool wasShort = false;
+
+        for (int tick = 0; tick < ticks; ++tick)
+        {
+            int frames = framesWrittenOnTick(tick);
+            for (int ch = 0; ch < 2; ++ch)
+                for (int i = 0; i < frames; ++i)
+                    in.setSample(ch, i, toneAt(produced + i));
+
+            buffer.write(in, frames);
+
+            int read = buffer.read(out, blockSize);
+            for (int i = 0; i < blockSize; ++i)
+            {
+                run.concealed.push_back(out.getSample(0, i));
+                run.zeroFilled.push_back(i < read ? toneAt(produced + i) : 0.0f);
+            }
+
+            if (read < blockSize && !wasShort)
+                ++run.gaps;
+
+            wasShort = read < blockSize;
+            produced += read;
+        }
+
+        for (size_t i = 0; i < run.concealed.size(); ++i)
+            run.clean.push_back(toneAt((int)i));
+
+        return run;
+    }
+
+    // Energy of the third difference: steps and kinks stand out, while a
+    // smooth tone contributes next to nothing
+    static double discontinuityEnergy(const std::vector<float>& signal, double& peak)
+    {
+        double energy = 0.0;
+        peak = 0.0;
+
+        for (size_t i = 3; i < signal.size(); ++i)
+        {
+            double d3 = (double)signal[i] - 3.0 * signal[i - 1] + 3.0 * signal[i - 2] - signal[i - 3];
+            energy += d3 * d3;
+            peak = juce::jmax(peak, std::abs(d3));
+        }
+
+        return energy;
+    }
+
+    void testFindsPitchPeriod()
+    {
+        beginTest("Finds the pitch period");
+        {
+            LossConcealer concealer;
+            juce::AudioBuffer<float> audio(2, LossConcealer::historyFrames);
+
+            for (int ch = 0; ch < 2; ++ch)
+                for (int i = 0; i < audio.getNumSamples(); ++i)
+                    audio.setSample(ch, i, toneAt(i));
+
+            concealer.remember(audio, 0, audio.getNumSamples());
+            concealer.conceal(audio, 0, blockSize);
+
+            expect(concealer.isConcealing());
+            expectWithinAbsoluteError(concealer.getPeriodFrames(), juce::roundToInt(sampleRate / 220.0), 1,
+                                      "Period should match the fundamental");
+
+            // The extrapolation picks up where the real audio stopped
+            expectWithinAbsoluteError(audio.getSample(0, 0), toneAt(audio.getNumSamples()), 0.02f);
+        }
+    }
+
+    void testSilenceStaysSilent()
+    {
+        beginTest("Nothing to extrapolate gives silence");
+        {
+            StreamBuffer buffer(2, 1024);
+            juce::AudioBuffer<float> out(2, blockSize);
+            for (int ch = 0; ch < 2; ++ch)
+                juce::FloatVectorOperations::fill(out.getWritePointer(ch), 1.0f, blockSize);
+
+            expectEquals(buffer.read(out, blockSize), 0);
+            expect(buffer.isConcealing());
+            expectEquals(out.getMagnitude(0, blockSize), 0.0f, "An empty history should conceal as silence");
+        }
+    }
+
+    void testDiscontinuityEnergy()
+    {
+        beginTest("Discontinuity energy versus zero fill");
+        {
+            auto run = stream(2000);
+            expect(run.gaps >= 150, "The schedule should produce plenty of underflows");
+
+            double cleanPeak = 0.0, zeroPeak = 0.0, concealedPeak = 0.0;
+            double clean = discontinuityEnergy(run.clean, cleanPeak);
+            double zeroFilled = discontinuityEnergy(run.zeroFilled, zeroPeak);
+            double concealed = discontinuityEnergy(run.concealed, concealedPeak);
+            double improvementDb = 10.0 * std::log10(zeroFilled / concealed);
+
+            expectGreaterThan(improvementDb, 20.0, "Concealment should remove most of the click energy");
+            expectLessThan(concealedPeak, zeroPeak / 10.0, "The worst click should be far smaller");
+
+            logMessage(juce::String(run.gaps) + " gaps: discontinuity energy " + juce::String(zeroFilled, 3)
+                       + " zero fill, " + juce::String(concealed, 5) + " concealed (" + juce::String(improvementDb, 1)
+                       + " dB less, tone alone " + juce::String(clean, 5) + "); worst step "
+                       + juce::String(zeroPeak, 3) + " -> " + juce::String(concealedPeak, 4));
+        }
+    }
+
+    void testConcealmentCost()
+    {
+        beginTest("Concealment cost is bounded");
+        {
+            StreamBuffer buffer(2, 8192);
+            juce::AudioBuffer<float> in(2, blockSize), out(2, blockSize);
+            juce::Random random(3);
+            for (int ch = 0; ch < 2; ++ch)
+                for (int i = 0; i < blockSize; ++i)
+                    in.setSample(ch, i, random.nextFloat() - 0.5f);
+
+            double normalSeconds = 0.0, concealingSeconds = 0.0;
+            const int ticks = 4000;
+
+            for (int tick = 0; tick < ticks; ++tick)
+            {
+                // Alternate a real packet with a lost one, so every other read
+                // starts a new gap and runs the period search
+                bool lost = (tick & 1) != 0;
+                if (!lost)
+                    buffer.write(in, blockSize);
+
+                auto start = juce::Time::getHighResolutionTicks();
+                buffer.read(out, blockSize);
+                double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+                (lost ? concealingSeconds : normalSeconds) += seconds;
+            }
+
+            double normalMicros = normalSeconds * 1.0e6 / (ticks / 2);
+            double concealingMicros = concealingSeconds * 1.0e6 / (ticks / 2);
+
+            // A packet lasts 8 ms; starting a gap must cost a small fraction of it
+            expectLessThan(concealingMicros, 400.0, "Starting a gap should stay well inside a packet period");
+
+            logMessage("Mean read: " + juce::String(normalMicros, 1) + " us with data, "
+                       + juce::String(concealingMicros, 1) + " us starting a concealed gap");
+        }
+    }
+};
+
+static LossConcealerTests lossConcealerTests;
@@ -0,0 +1,177 @@
+#include <JuceHeader.h>
+#include "../Source/Audio/OfflineEncoder.h"
+#include "../Source/Audio/PcmConversion.h"
+#include "AlacFileReader.h"
+#include <vector>
+
+class OfflineEncoderTests : public juce::UnitTest
+{
+public:
+    OfflineEncoderTests() : juce::UnitTest("OfflineEncoder") {}
+
+    void runTest() override
+    {
+        testParallelDecodesLosslessly();
+        testMatchesSerialPacketCount();
+        testStats();
+        testErrors();
+    }
+
+private:
+    static constexpr int framesPerPacket = 4096;
+
+    static juce::AudioBuffer<float> makeSignal(int numChannels, int numFrames)
+    {
+        juce::AudioBuffer<float> signal(numChannels, numFrames);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < numFrames; ++i)
+                signal.setSample(ch, i, 0.3f * std::sin(0.011f * (float)(i * (ch + 1))) + 0.05f * std::sin(0.17f * (float)i));
+        return signal;
+    }
+
+    // Reads the signal in blocks, as an input file would be
+    static OfflineEncoder::ReadFunction readFrom(const juce::AudioBuffer<float>& signal)
+    {
+        auto position = std::make_shared<int>(0);
+
+        return [&signal, position](juce::AudioBuffer<float>& buffer, int numFrames)
+        {
+            const int numToCopy = juce::jmin(numFrames, signal.getNumSamples() - *position);
+            for (int ch = 0; ch < signal.getNumChannels(); ++ch)
+                buffer.copyFrom(ch, 0, signal, ch, *position, numToCopy);
+
+            *position += numToCopy;
+            return numToCopy;
+        };
+    }
+
+    // The signal as 16-bit samples in ALAC's channel order, as the file holds it
+    static std::vector<juce::int16> toAlacOrder(const juce::AudioBuffer<float>& signal)
+    {
+        const int numChannels = signal.getNumChannels();
+        const int numFrames = signal.getNumSamples();
+        std::vector<juce::int16> host((size_t)(numFrames * numChannels));
+        PcmConversion::floatToInt16(signal, 0, numFrames, numChannels, host.data());
+
+        int order[kALACMaxChannels];
+        ALACEncoderWrapper::getChannelOrder(juce::AudioChannelSet::canonicalChannelSet(numChannels), order);
+
+        std::vector<juce::int16> reordered(host.size());
+        for (int i = 0; i < numFrames; ++i)
+            for (int position = 0; position < numChannels; ++position)
+                reordered[(size_t)(i * numChannels + position)] = host[(size_t)(i * numChannels + order[position])];
+
+        return reordered;
+    }
+
+    void testParallelDecodesLosslessly()
+    {
+        beginTest("Runs encoded on several threads decode to the input, in order");
+        {
+            OfflineEncoder::Options options;
+            options.numThreads = 4;
+            options.packetsPerRun = 3;
+
+            for (int numChannels : { 2, 6 })
+            {
+                for (const char* extension : { ".caf", ".m4a" })
+                {
+                    juce::TemporaryFile file(extension);
+                    const int numFrames = 20 * framesPerPacket + 999;
+                    auto signal = makeSignal(numChannels, numFrames);
+                    const auto layout = juce::AudioChannelSet::canonicalChannelSet(numChannels);
+
+                    OfflineEncoder encoder;
+                    expect(encoder.encode(readFrom(signal), 44100.0, layout, file.getFile(), options),
+                           encoder.getLastError());
+
+                    AlacFileReader reader(file.getFile());
+                    expect(reader.valid, extension);
+                    expectEquals((int)reader.packets.size(), 21);
+                    expect(reader.decode(numChannels, framesPerPacket) == toAlacOrder(signal),
+                           juce::String(numChannels) + " channels in " + extension + " should decode losslessly");
+                }
+            }
+        }
+    }
+
+    void testMatchesSerialPacketCount()
+    {
+        beginTest("One thread and many give the same packets and frames");
+        {
+            auto signal = makeSignal(2, 12 * framesPerPacket);
+            const auto layout = juce::AudioChannelSet::stereo();
+
+            juce::TemporaryFile serialFile(".caf"), parallelFile(".caf");
+
+            OfflineEncoder::Options serial;
+            serial.numThreads = 1;
+
+            OfflineEncoder::Options parallel;
+            parallel.numThreads = 3;
+            parallel.packetsPerRun = 2;
+
+            OfflineEncoder first, second;
+            expect(first.encode(readFrom(signal), 44100.0, layout, serialFile.getFile(), serial));
+            expect(second.encode(readFrom(signal), 44100.0, layout, parallelFile.getFile(), parallel));
+
+            expectEquals((int)first.getStats().numPackets, 12);
+            expectEquals((int)second.getStats().numPackets, 12);
+            expectEquals((int)second.getStats().numFrames, 12 * framesPerPacket);
+
+            AlacFileReader a(serialFile.getFile()), b(parallelFile.getFile());
+            expect(a.decode(2, framesPerPacket) == b.decode(2, framesPerPacket));
+        }
+    }
+
+    void testStats()
+    {
+        beginTest("Stats report the audio, the time taken and the real-time factor");
+        {
+            juce::TemporaryFile file(".m4a");
+            auto signal = makeSignal(2, 5 * 44100);
+
+            OfflineEncoder::Options options;
+            options.numThreads = 2;
+
+            OfflineEncoder encoder;
+            expect(encoder.encode(readFrom(signal), 44100.0, juce::AudioChannelSet::stereo(), file.getFile(), options));
+
+            auto stats = encoder.getStats();
+            expectWithinAbsoluteError(stats.audioSeconds, 5.0, 1.0e-9);
+            expectEquals(stats.numThreads, 2);
+            expect(stats.wallSeconds > 0.0);
+            expect(stats.numAudioBytes > 0 && stats.numAudioBytes < 5 * 44100 * 4, "Compressed below PCM");
+
+            // ALAC runs far faster than real time on any machine the tests run on
+            expect(stats.getRealtimeFactor() > 1.0, juce::String(stats.getRealtimeFactor(), 1) + "x real time");
+            expectWithinAbsoluteError(stats.getRealtimeFactor(), stats.audioSeconds / stats.wallSeconds, 1.0e-9);
+        }
+    }
+
+    void testErrors()
+    {
+        beginTest("Unsupported layouts and unwritable files are reported");
+        {
+            auto signal = makeSignal(2, framesPerPacket);
+
+            OfflineEncoder encoder;
+            expect(!encoder.encode(readFrom(signal), 44100.0, juce::AudioChannelSet::discreteChannels(9),
+                                   juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("nine.caf")));
+            expect(encoder.getLastError().isNotEmpty());
+
+            auto unwritable = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                  .getChildFile("no-such-directory/out.m4a");
+            expect(!encoder.encode(readFrom(signal), 44100.0, juce::AudioChannelSet::stereo(), unwritable));
+            expect(encoder.getLastError().contains("no-such-directory"));
+
+            // An empty input is a file with no packets
+            juce::TemporaryFile file(".caf");
+            juce::AudioBuffer<float> empty(2, 0);
+            expect(encoder.encode(readFrom(empty), 44100.0, juce::AudioChannelSet::stereo(), file.getFile()));
+            expectEquals((int)encoder.getStats().numPackets, 0);
+        }
+    }
+};
+
+static OfflineEncoderTests offlineEncoderTests;
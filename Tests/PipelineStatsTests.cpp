@@ -0,0 +1,236 @@
+#include <JuceHeader.h>
+#include "../Source/AirPlay/PipelineStats.h"
+#include "../Source/AirPlay/AirPlayManager.h"
+#include "LoopbackReceiver.h"
+#include <thread>
+#include <vector>
+
+class PipelineStatsTests : public juce::UnitTest
+{
+public:
+    PipelineStatsTests() : juce::UnitTest("PipelineStats") {}
+
+    void runTest() override
+    {
+        testBuckets();
+        testSummary();
+        testConcurrentRecording();
+        testStreamIsMeasured();
+        testStatsLog();
+    }
+
+private:
+    static juce::AudioBuffer<float> makeSineBlock(int numChannels, int numSamples, int blockIndex)
+    {
+        juce::AudioBuffer<float> block(numChannels, numSamples);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                block.setSample(ch, i, 0.25f * std::sin(0.03f * (float)(blockIndex * numSamples + i)));
+        return block;
+    }
+
+    void testBuckets()
+    {
+        beginTest("Histogram buckets cover every value once");
+        {
+            bool contiguous = true;
+            bool indexed = true;
+
+            for (int i = 0; i < LockFreeHistogram::numBuckets; ++i)
+            {
+                auto lower = LockFreeHistogram::getBucketLowerBound(i);
+                auto upper = LockFreeHistogram::getBucketUpperBound(i);
+
+                indexed = indexed && LockFreeHistogram::getBucketIndex(lower) == i
+                                  && LockFreeHistogram::getBucketIndex(upper) == i;
+
+                if (i + 1 < LockFreeHistogram::numBuckets)
+                    contiguous = contiguous && LockFreeHistogram::getBucketLowerBound(i + 1) == upper + 1;
+
+                // Eight buckets to each power of two: no wider than 1/8 of
+                // the values they hold
+                if (lower >= 8)
+                    expect((double)(upper - lower + 1) <= (double)lower / 8.0 + 0.5, "Bucket " + juce::String(i));
+            }
+
+            expect(contiguous, "Each bucket starts where the previous one ends");
+            expect(indexed, "Both bounds of a bucket map back to it");
+            expectEquals(LockFreeHistogram::getBucketLowerBound(0), (juce::uint64)0);
+            expect(LockFreeHistogram::getBucketUpperBound(LockFreeHistogram::numBuckets - 1)
+                       == std::numeric_limits<juce::uint64>::max(), "The last bucket ends at the largest value");
+        }
+    }
+
+    void testSummary()
+    {
+        beginTest("Summaries are exact where they can be and percentiles close");
+        {
+            LockFreeHistogram histogram;
+
+            auto empty = histogram.getSummary();
+            expectEquals((int)empty.count, 0);
+            expectEquals(empty.p99, 0.0);
+
+            for (juce::uint64 value = 1; value <= 100000; ++value)
+                histogram.record(value);
+
+            auto summary = histogram.getSummary();
+            expectEquals((int)summary.count, 100000);
+            expectEquals(summary.min, 1.0);
+            expectEquals(summary.max, 100000.0);
+            expectWithinAbsoluteError(summary.mean, 50000.5, 1.0e-9);
+            expectWithinAbsoluteError(summary.p50, 50000.0, 50000.0 * 0.0625);
+            expectWithinAbsoluteError(summary.p90, 90000.0, 90000.0 * 0.0625);
+            expectWithinAbsoluteError(summary.p99, 99000.0, 99000.0 * 0.0625);
+            expect(summary.p50 <= summary.p90 && summary.p90 <= summary.p99 && summary.p99 <= summary.max);
+
+            auto scaled = histogram.getSummary(0.001);
+            expectWithinAbsoluteError(scaled.max, 100.0, 1.0e-9);
+            expectWithinAbsoluteError(scaled.p50, summary.p50 * 0.001, 1.0e-9);
+
+            // A single value is reported as itself, not as its bucket
+            LockFreeHistogram single;
+            single.record(1000003);
+            expectEquals(single.getSummary().p50, 1000003.0);
+
+            histogram.reset();
+            expectEquals((int)histogram.getSummary().count, 0);
+        }
+    }
+
+    void testConcurrentRecording()
+    {
+        beginTest("Records from several threads are all counted");
+        {
+            LockFreeHistogram histogram;
+            const int numThreads = 4;
+            const int recordsPerThread = 100000;
+
+            auto startTicks = juce::Time::getHighResolutionTicks();
+
+            std::vector<std::thread> threads;
+            for (int t = 0; t < numThreads; ++t)
+                threads.emplace_back([&histogram, t]
+                {
+                    for (int i = 0; i < recordsPerThread; ++i)
+                        histogram.record((juce::uint64)(t * recordsPerThread + i));
+                });
+
+            for (auto& thread : threads)
+                thread.join();
+
+            auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+            auto summary = histogram.getSummary();
+            expectEquals((int)summary.count, numThreads * recordsPerThread);
+            expectEquals(summary.min, 0.0);
+            expectEquals(summary.max, (double)(numThreads * recordsPerThread - 1));
+
+            logMessage("Record cost with " + juce::String(numThreads) + " threads contending: "
+                       + juce::String(seconds * 1.0e9 / (numThreads * recordsPerThread), 1) + " ns");
+        }
+    }
+
+    void testStreamIsMeasured()
+    {
+        beginTest("Every stage of a stream is measured");
+        {
+            // 48 kHz so the rate converter runs too
+            const int blockSize = 512;
+            const int numBlocks = 120;
+
+            AirPlayManager manager;
+            manager.prepare(48000.0, blockSize);
+
+            LoopbackReceiver receiver;
+            expect(manager.addReceiver(AirPlayDevice("Zone", "127.0.0.1", 7000), receiver.getEndpoint()));
+
+            for (int i = 0; i < numBlocks; ++i)
+            {
+                manager.pushAudioData(makeSineBlock(2, blockSize, i), blockSize);
+                juce::Thread::sleep(10);
+            }
+
+            expect(receiver.waitForAudioPackets(20, 2000));
+            manager.disconnectFromDevice();
+
+            auto stats = manager.getStats();
+            auto packetsEncoded = manager.getSessionGroup().getStats().packetsEncoded;
+
+            expectEquals((int)stats.getStage(PipelineStats::Stage::Enqueue).count, numBlocks);
+            expect(stats.getStage(PipelineStats::Stage::Dequeue).count > 0);
+            expect(stats.getStage(PipelineStats::Stage::Convert).count > 0);
+            expect(stats.queueDepthFrames.count > 0);
+
+            expect(packetsEncoded > 0);
+            expectEquals(stats.getStage(PipelineStats::Stage::Encode).count, packetsEncoded);
+            expectEquals(stats.getStage(PipelineStats::Stage::Send).count, packetsEncoded);
+            expectEquals(stats.packetBytes.count, packetsEncoded);
+            expectEquals((int)stats.getStage(PipelineStats::Stage::Encrypt).count, 0, "Not encrypting");
+
+            // ALAC of a sine is well below its PCM size
+            expect(stats.compressionRatio.p50 > 0.0 && stats.compressionRatio.p50 < 0.9,
+                   "Compression ratio " + juce::String(stats.compressionRatio.p50, 3));
+            expect(stats.packetsPerSecond > 0.0 && stats.encodedBytesPerSecond > 0.0);
+
+            for (int i = 0; i < PipelineStats::numStages; ++i)
+            {
+                auto& stage = stats.stageMicros[i];
+                expect(stage.min <= stage.p50 && stage.p50 <= stage.p99 && stage.p99 <= stage.max,
+                       PipelineStats::getStageName((PipelineStats::Stage)i));
+
+                logMessage(juce::String(PipelineStats::getStageName((PipelineStats::Stage)i)).paddedRight(' ', 8)
+                           + " p50 " + juce::String(stage.p50, 1) + " us, p99 " + juce::String(stage.p99, 1) + " us");
+            }
+
+            manager.resetStats();
+            expectEquals((int)manager.getStats().getStage(PipelineStats::Stage::Encode).count, 0);
+        }
+    }
+
+    void testStatsLog()
+    {
+        beginTest("The stats log appends a line of JSON per interval");
+        {
+            juce::TemporaryFile logFile(".jsonl");
+
+            AirPlayManager manager;
+            manager.prepare(44100.0, 512);
+
+            LoopbackReceiver receiver;
+            expect(manager.addReceiver(AirPlayDevice("Zone", "127.0.0.1", 7000), receiver.getEndpoint()));
+            expect(manager.startStatsLog(logFile.getFile(), 50));
+
+            for (int i = 0; i < 40; ++i)
+            {
+                manager.pushAudioData(makeSineBlock(2, 512, i), 512);
+                juce::Thread::sleep(10);
+            }
+
+            manager.stopStatsLog();
+            manager.disconnectFromDevice();
+
+            int numLines = 0;
+            for (auto& line : juce::StringArray::fromLines(logFile.getFile().loadFileAsString()))
+            {
+                if (line.isEmpty())
+                    continue;
+
+                numLines++;
+                expect(line.startsWith("{\"timeMs\":") && line.endsWith("}"), line);
+                expect(line.contains("\"pipeline\":{\"elapsedSeconds\":"));
+                expect(line.contains("\"encode\":{\"count\":"));
+                expect(!line.contains("\r"), "Lines end with a bare line feed");
+            }
+
+            // One on starting, one on stopping and several in between
+            expect(numLines >= 4, juce::String(numLines) + " lines");
+
+            auto unwritable = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                  .getChildFile("no-such-directory/stats.jsonl");
+            expect(!manager.startStatsLog(unwritable), "A log that can't be written is not started");
+        }
+    }
+};
+
+static PipelineStatsTests pipelineStatsTests;
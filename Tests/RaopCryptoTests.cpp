@@ -0,0 +1,210 @@
+#include <JuceHeader.h>
+#include <openssl/evp.h>
+#include "../Source/AirPlay/RaopCrypto.h"
+#include "../Source/AirPlay/RaopSessionGroup.h"
+#include "LoopbackReceiver.h"
+
+class RaopCryptoTests : public juce::UnitTest
+{
+public:
+    RaopCryptoTests() : juce::UnitTest("RaopCrypto") {}
+
+    void runTest() override
+    {
+        for (int i = 0; i < RaopCrypto::keySize; ++i)
+        {
+            key[i] = (juce::uint8)(0x10 + i);
+            iv[i] = (juce::uint8)(0xa0 + i);
+        }
+
+        testMatchesReferenceCipher();
+        testTransportEncryptsPayload();
+        testGroupEncryptsOnce();
+        testThroughput();
+    }
+
+private:
+    // Independent reference: a fresh OpenSSL context per call
+    void referenceEncrypt(juce::uint8* data, int size)
+    {
+        auto* ctx = EVP_CIPHER_CTX_new();
+        EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), nullptr, key, iv);
+        EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+        int outSize = 0;
+        int blocks = size & ~(RaopCrypto::blockSize - 1);
+        if (blocks > 0)
+            EVP_EncryptUpdate(ctx, data, &outSize, data, blocks);
+
+        EVP_CIPHER_CTX_free(ctx);
+    }
+
+    void referenceDecrypt(juce::uint8* data, int size)
+    {
+        auto* ctx = EVP_CIPHER_CTX_new();
+        EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), nullptr, key, iv);
+        EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+        int outSize = 0;
+        int blocks = size & ~(RaopCrypto::blockSize - 1);
+        if (blocks > 0)
+            EVP_DecryptUpdate(ctx, data, &outSize, data, blocks);
+
+        EVP_CIPHER_CTX_free(ctx);
+    }
+
+    static void fillPattern(juce::uint8* data, int size, int seed)
+    {
+        for (int i = 0; i < size; ++i)
+            data[i] = (juce::uint8)((i * 31 + seed * 7) & 0xff);
+    }
+
+    void testMatchesReferenceCipher()
+    {
+        beginTest("Reused context matches a fresh context per packet");
+        {
+            RaopCrypto crypto;
+            expect(!crypto.isEnabled());
+            expect(crypto.setKey(key, iv));
+            expect(crypto.isEnabled());
+
+            // Sizes with and without a trailing partial block
+            for (int size : { 16, 100, 1024, 1411 })
+            {
+                for (int seed = 0; seed < 3; ++seed)
+                {
+                    std::vector<juce::uint8> plain((size_t)size), encrypted((size_t)size), expected((size_t)size);
+                    fillPattern(plain.data(), size, seed);
+                    encrypted = plain;
+                    expected = plain;
+
+                    expect(crypto.encryptInPlace(encrypted.data(), size));
+                    referenceEncrypt(expected.data(), size);
+
+                    expect(encrypted == expected, "Ciphertext should match for size " + juce::String(size));
+
+                    int tail = size % RaopCrypto::blockSize;
+                    expect(std::equal(encrypted.end() - tail, encrypted.end(), plain.end() - tail),
+                           "Partial block should stay in the clear");
+
+                    referenceDecrypt(encrypted.data(), size);
+                    expect(encrypted == plain, "Ciphertext should decrypt to the original");
+                }
+            }
+
+            expectEquals((int)crypto.getPacketsEncrypted(), 12);
+        }
+    }
+
+    void testTransportEncryptsPayload()
+    {
+        beginTest("Transport encrypts payloads in the packet buffer");
+        {
+            LoopbackReceiver receiver;
+            RaopTransport transport;
+            expect(transport.open(receiver.getEndpoint()));
+            expect(transport.setEncryptionKey(key, iv));
+            expect(transport.isEncrypting());
+
+            std::vector<juce::uint8> payload(500);
+            fillPattern(payload.data(), 500, 1);
+
+            for (int i = 0; i < 4; ++i)
+                transport.sendAudioPacket(payload.data(), 500, RaopTransport::framesPerPacket);
+
+            expect(receiver.waitForAudioPackets(4, 1000));
+
+            for (auto& packet : receiver.getAudioPackets())
+            {
+                std::vector<juce::uint8> data(static_cast<const juce::uint8*>(packet.payload.getData()),
+                                              static_cast<const juce::uint8*>(packet.payload.getData()) + 500);
+                expect(data != payload, "Payload should not be sent in the clear");
+
+                referenceDecrypt(data.data(), 500);
+                expect(data == payload, "Receiver should recover the payload");
+            }
+        }
+    }
+
+    void testGroupEncryptsOnce()
+    {
+        beginTest("Group encrypts each packet once for all receivers");
+        {
+            RaopSessionGroup group;
+            group.prepare(44100.0, 2);
+            expect(group.setEncryptionKey(key, iv));
+
+            LoopbackReceiver receivers[3];
+            for (int i = 0; i < 3; ++i)
+                group.addReceiver(AirPlayDevice("Zone " + juce::String(i), "127.0.0.1", 7000 + i),
+                                  receivers[i].getEndpoint());
+
+            juce::AudioBuffer<float> block(2, RaopTransport::framesPerPacket);
+            for (int i = 0; i < 10; ++i)
+            {
+                for (int s = 0; s < block.getNumSamples(); ++s)
+                    block.setSample(0, s, 0.25f * std::sin(0.05f * (float)(s + i * 352)));
+                block.copyFrom(1, 0, block, 0, 0, block.getNumSamples());
+
+                group.streamAudio(block, RaopTransport::framesPerPacket);
+            }
+
+            auto stats = group.getStats();
+            expectEquals((int)stats.packetsEncrypted, 10, "Encryption should not scale with receivers");
+            expectEquals((int)stats.packetsSent, 30);
+
+            for (auto& receiver : receivers)
+                expect(receiver.waitForAudioPackets(10, 1000));
+
+            auto reference = receivers[0].getAudioPackets();
+            for (int r = 1; r < 3; ++r)
+            {
+                auto packets = receivers[r].getAudioPackets();
+                for (size_t i = 0; i < packets.size() && i < reference.size(); ++i)
+                    expect(packets[i].payload == reference[i].payload, "Every receiver gets the same ciphertext");
+            }
+        }
+    }
+
+    void testThroughput()
+    {
+        beginTest("Encryption throughput in packets per second");
+        {
+            // A typical stereo ALAC packet is a little over 1 KB
+            const int payloadSize = 1100;
+            const int numPackets = 20000;
+            std::vector<juce::uint8> packet((size_t)payloadSize);
+            fillPattern(packet.data(), payloadSize, 3);
+
+            RaopCrypto crypto;
+            crypto.setKey(key, iv);
+
+            auto start = juce::Time::getHighResolutionTicks();
+            for (int i = 0; i < numPackets; ++i)
+                crypto.encryptInPlace(packet.data(), payloadSize);
+            auto reusedTicks = juce::Time::getHighResolutionTicks() - start;
+
+            // Baseline: new context and key schedule for every packet
+            start = juce::Time::getHighResolutionTicks();
+            for (int i = 0; i < numPackets; ++i)
+                referenceEncrypt(packet.data(), payloadSize);
+            auto freshTicks = juce::Time::getHighResolutionTicks() - start;
+
+            auto ticksPerSecond = (double)juce::Time::getHighResolutionTicksPerSecond();
+            double reusedRate = numPackets * ticksPerSecond / (double)juce::jmax((juce::int64)1, reusedTicks);
+            double freshRate = numPackets * ticksPerSecond / (double)juce::jmax((juce::int64)1, freshTicks);
+
+            // Real time needs ~125 packets/s per stream
+            expectGreaterThan(reusedRate, 125.0 * 100, "Should encrypt well over 100 streams in real time");
+
+            logMessage("AES-128-CBC " + juce::String(payloadSize) + " byte packets: "
+                       + juce::String(reusedRate, 0) + " packets/s with a reused context, "
+                       + juce::String(freshRate, 0) + " packets/s with per-packet key setup");
+        }
+    }
+
+    juce::uint8 key[RaopCrypto::keySize];
+    juce::uint8 iv[RaopCrypto::blockSize];
+};
+
+static RaopCryptoTests raopCryptoTests;
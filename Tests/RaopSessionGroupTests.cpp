@@ -0,0 +1,348 @@
+#include <JuceHeader.h>
+#include "../Source/AirPlay/RaopSessionGroup.h"
+#include "LoopbackReceiver.h"
+#include "AlacFileReader.h"
+#include "../Source/Audio/PcmConversion.h"
+
+class RaopSessionGroupTests : public juce::UnitTest
+{
+public:
+    RaopSessionGroupTests() : juce::UnitTest("RaopSessionGroup") {}
+
+    void runTest() override
+    {
+        testFanOutDeliversSamePayload();
+        testRetransmitRing();
+        testLatencyAlignment();
+        testFanOutCostScaling();
+        testRecording();
+        testChannelCounts();
+    }
+
+private:
+    static void fillSine(juce::AudioBuffer<float>& buffer, double& phase)
+    {
+        for (int i = 0; i < buffer.getNumSamples(); ++i)
+        {
+            auto value = (float)(0.5 * std::sin(phase));
+            for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                buffer.setSample(ch, i, value);
+            phase += 2.0 * juce::MathConstants<double>::pi * 440.0 / 44100.0;
+        }
+    }
+
+    static AirPlayDevice makeDevice(int index)
+    {
+        return AirPlayDevice("Zone " + juce::String(index), "127.0.0.1", 7000 + index);
+    }
+
+    void testFanOutDeliversSamePayload()
+    {
+        beginTest("Fan-out delivers one encode to every receiver");
+        {
+            RaopSessionGroup group;
+            group.prepare(44100.0, 2);
+
+            LoopbackReceiver receivers[3];
+            for (int i = 0; i < 3; ++i)
+                expect(group.addReceiver(makeDevice(i), receivers[i].getEndpoint()), "Receiver should be added");
+
+            expectEquals(group.getNumReceivers(), 3, "Group should hold three receivers");
+
+            // Host blocks of 512 do not line up with 352-frame packets
+            juce::AudioBuffer<float> block(2, 512);
+            double phase = 0.0;
+            for (int i = 0; i < 11; ++i)
+            {
+                fillSine(block, phase);
+                expect(group.streamAudio(block, 512), "Streaming should succeed");
+            }
+
+            const int expectedPackets = (11 * 512) / RaopTransport::framesPerPacket;
+            auto stats = group.getStats();
+            expectEquals((int)stats.packetsEncoded, expectedPackets, "Each packet should be encoded once");
+            expectEquals((int)stats.packetsSent, expectedPackets * 3, "Each packet should reach every receiver");
+
+            for (auto& receiver : receivers)
+                expect(receiver.waitForAudioPackets(expectedPackets, 1000), "Receiver should get every packet");
+
+            auto reference = receivers[0].getAudioPackets();
+            for (int r = 1; r < 3; ++r)
+            {
+                auto packets = receivers[r].getAudioPackets();
+                bool samePayloads = packets.size() == reference.size();
+                for (size_t i = 0; samePayloads && i < packets.size(); ++i)
+                    samePayloads = packets[i].payload == reference[i].payload;
+
+                expect(samePayloads, "All receivers should get identical payloads");
+            }
+
+            group.removeReceiver(makeDevice(1));
+            expectEquals(group.getNumReceivers(), 2, "Receiver should be removed");
+            expect(!group.hasReceiver(makeDevice(1)), "Removed receiver should be gone");
+        }
+    }
+
+    void testRetransmitRing()
+    {
+        beginTest("Retransmit ring answers requests per receiver");
+        {
+            LoopbackReceiver receiver;
+            RaopTransport transport;
+            expect(transport.open(receiver.getEndpoint()), "Transport should open");
+
+            juce::uint8 payload[32] = {};
+            auto firstSequence = transport.getNextSequenceNumber();
+
+            for (int i = 0; i < 10; ++i)
+            {
+                payload[0] = (juce::uint8)i;
+                transport.sendAudioPacket(payload, 32, RaopTransport::framesPerPacket);
+            }
+
+            expect(receiver.waitForAudioPackets(10, 1000), "Receiver should get the originals");
+
+            // Packets 3..5 plus one that was never sent
+            receiver.requestRetransmit(transport.getLocalControlPort(), (juce::uint16)(firstSequence + 3), 3);
+            receiver.requestRetransmit(transport.getLocalControlPort(), (juce::uint16)(firstSequence + 200), 1);
+            juce::Thread::sleep(20);
+
+            // Requests are answered from the streaming thread before the next send
+            transport.serviceControlChannel();
+            juce::Thread::sleep(20);
+
+            auto retransmitted = receiver.getRetransmittedPackets();
+            expectEquals((int)retransmitted.size(), 3, "Three packets should be resent");
+
+            auto originals = receiver.getAudioPackets();
+            for (size_t i = 0; i < retransmitted.size() && i < 3; ++i)
+            {
+                expectEquals((int)retransmitted[i].sequence, (int)(juce::uint16)(firstSequence + 3 + i),
+                             "Retransmit should carry the original sequence");
+                expect(retransmitted[i].payload == originals[3 + i].payload,
+                       "Retransmit should carry the original payload");
+            }
+
+            auto stats = transport.getStats();
+            expectEquals((int)stats.packetsRetransmitted, 3, "Retransmits should be counted");
+            expectEquals((int)stats.retransmitMisses, 1, "Unknown sequence should count as a miss");
+        }
+    }
+
+    void testLatencyAlignment()
+    {
+        beginTest("Receivers with different output latencies play in phase");
+        {
+            RaopSessionGroup group;
+            group.prepare(44100.0, 2);
+            group.setLatencyFrames(11025);
+
+            const juce::uint32 outputLatencies[] = { 0, 4410, 2205 };
+            LoopbackReceiver receivers[3];
+
+            expect(group.addReceiver(makeDevice(0), receivers[0].getEndpoint(), outputLatencies[0]));
+            expect(group.addReceiver(makeDevice(1), receivers[1].getEndpoint(), outputLatencies[1]));
+            expectEquals((int)group.getGroupLatencyFrames(), 11025 + 4410, "Slowest output sets the group latency");
+
+            juce::AudioBuffer<float> block(2, RaopTransport::framesPerPacket);
+            double phase = 0.0;
+            for (int i = 0; i < 150; ++i)
+            {
+                fillSine(block, phase);
+                group.streamAudio(block, RaopTransport::framesPerPacket);
+            }
+
+            // Third receiver joins mid-stream, after the stream has run ahead of the wall clock
+            juce::Thread::sleep(50);
+            expect(group.addReceiver(makeDevice(2), receivers[2].getEndpoint(), outputLatencies[2]));
+
+            for (int i = 0; i < 150; ++i)
+            {
+                fillSine(block, phase);
+                group.streamAudio(block, RaopTransport::framesPerPacket);
+            }
+
+            expect(receivers[0].waitForAudioPackets(300, 1000));
+            expect(receivers[1].waitForAudioPackets(300, 1000));
+            expect(receivers[2].waitForAudioPackets(150, 1000));
+            juce::Thread::sleep(20);
+
+            // The last packet carries the same audio everywhere; compare when each device plays it
+            auto reference = receivers[0].getAudioPackets().back();
+            double earliest = 0.0, latest = 0.0;
+
+            for (int r = 0; r < 3; ++r)
+            {
+                auto last = receivers[r].getAudioPackets().back();
+                expect(last.payload == reference.payload, "Receivers should end on the same packet");
+
+                double playout = receivers[r].getPlayoutMicros(last.timestamp, outputLatencies[r]);
+                expect(playout > 0.0, "Receiver should have a sync packet");
+
+                earliest = r == 0 ? playout : juce::jmin(earliest, playout);
+                latest = r == 0 ? playout : juce::jmax(latest, playout);
+            }
+
+            double packetMicros = RaopTransport::framesPerPacket * 1.0e6 / 44100.0;
+            expectLessThan(latest - earliest, packetMicros, "Playout skew should stay under one packet");
+            logMessage("Group playout skew: " + juce::String(latest - earliest, 1) + " us");
+        }
+    }
+
+    void testFanOutCostScaling()
+    {
+        beginTest("Fan-out cost with N loopback receivers");
+        {
+            const int numPackets = 400;
+            juce::AudioBuffer<float> block(2, RaopTransport::framesPerPacket);
+            double singleReceiverMicros = 0.0, singleEncodeMicros = 0.0;
+
+            for (int numReceivers : { 1, 2, 4, 8 })
+            {
+                RaopSessionGroup group;
+                group.prepare(44100.0, 2);
+
+                std::vector<std::unique_ptr<LoopbackReceiver>> receivers;
+                for (int i = 0; i < numReceivers; ++i)
+                {
+                    receivers.push_back(std::make_unique<LoopbackReceiver>());
+                    group.addReceiver(makeDevice(i), receivers.back()->getEndpoint());
+                }
+
+                // The best of three rounds, to keep scheduler noise out of the comparison
+                double phase = 0.0, perPacketMicros = 0.0;
+
+                for (int round = 0; round < 3; ++round)
+                {
+                    auto startTicks = juce::Time::getHighResolutionTicks();
+
+                    for (int i = 0; i < numPackets; ++i)
+                    {
+                        fillSine(block, phase);
+                        group.streamAudio(block, RaopTransport::framesPerPacket);
+                    }
+
+                    auto elapsed = juce::Time::getHighResolutionTicks() - startTicks;
+                    double micros = (double)elapsed * 1.0e6
+                                  / (double)juce::Time::getHighResolutionTicksPerSecond() / numPackets;
+                    perPacketMicros = round == 0 ? micros : juce::jmin(perPacketMicros, micros);
+                }
+
+                auto stats = group.getStats();
+                expectEquals((int)stats.packetsEncoded, 3 * numPackets, "Encodes must not scale with receivers");
+
+                if (numReceivers == 1)
+                {
+                    singleReceiverMicros = perPacketMicros;
+                    singleEncodeMicros = stats.meanEncodeMicros;
+                }
+
+                // Each receiver past the first adds only its send, which must
+                // stay well below the encode it shares
+                const double marginalMicros = numReceivers > 1 ? (perPacketMicros - singleReceiverMicros) / (numReceivers - 1)
+                                                               : 0.0;
+
+                if (numReceivers == 8)
+                    expectLessThan(marginalMicros, singleEncodeMicros,
+                                   "Another receiver should cost less than another encode");
+
+                logMessage(juce::String(numReceivers) + " receiver(s): " + juce::String(perPacketMicros, 2)
+                           + " us/packet, " + juce::String(marginalMicros, 2) + " us per added receiver (encode "
+                           + juce::String(stats.meanEncodeMicros, 2) + " us, fan-out "
+                           + juce::String(stats.meanFanOutMicros, 2) + " us)");
+            }
+        }
+    }
+
+    void testRecording()
+    {
+        beginTest("Recording keeps the packets sent, before encryption, in a playable file");
+        {
+            juce::TemporaryFile file(".m4a");
+            RaopSessionGroup group;
+            group.prepare(44100.0, 2);
+
+            LoopbackReceiver receiver;
+            expect(group.addReceiver(makeDevice(0), receiver.getEndpoint()));
+
+            juce::uint8 key[16], iv[16];
+            for (int i = 0; i < 16; ++i)
+            {
+                key[i] = (juce::uint8)(i * 7 + 1);
+                iv[i] = (juce::uint8)(i * 3 + 2);
+            }
+
+            expect(group.setEncryptionKey(key, iv));
+
+            group.setFormat(AudioEncoder::Format::PCM_16);
+            expect(!group.startRecording(file.getFile()), "Only ALAC is recorded");
+            expect(group.getLastError().contains("ALAC"));
+
+            group.setFormat(AudioEncoder::Format::ALAC);
+            expect(group.startRecording(file.getFile()), group.getLastError());
+            expect(group.isRecording());
+
+            juce::AudioBuffer<float> block(2, 512);
+            std::vector<juce::int16> streamed;
+            std::vector<juce::int16> frames(512 * 2);
+            double phase = 0.0;
+
+            for (int i = 0; i < 40; ++i)
+            {
+                fillSine(block, phase);
+                PcmConversion::floatToInt16(block, 0, 512, 2, frames.data());
+                streamed.insert(streamed.end(), frames.begin(), frames.end());
+                group.streamAudio(block, 512);
+            }
+
+            expect(group.stopRecording(), group.getLastError());
+            expect(!group.isRecording());
+
+            const int numPackets = (40 * 512) / RaopTransport::framesPerPacket;
+            auto stats = group.getRecordingStats();
+            expectEquals((int)stats.packetsWritten, numPackets);
+            expectEquals((int)stats.packetsDropped, 0);
+
+            // The receivers got ciphertext; the file has what was encoded
+            AlacFileReader reader(file.getFile());
+            expect(reader.valid);
+            expectEquals((int)reader.packets.size(), numPackets);
+
+            streamed.resize((size_t)(numPackets * RaopTransport::framesPerPacket * 2));
+            expect(reader.decode(2, RaopTransport::framesPerPacket) == streamed, "The recording should decode to what was streamed");
+
+            expect(receiver.waitForAudioPackets(numPackets, 1000));
+            auto received = receiver.getAudioPackets();
+            expect(!received.empty() && !(received[0].payload == reader.packets[0]), "Receivers get the encrypted packet");
+        }
+    }
+
+    void testChannelCounts()
+    {
+        beginTest("Every channel count ALAC carries is streamed as ALAC, and no other layout");
+        {
+            RaopSessionGroup group;
+
+            for (int numChannels = 1; numChannels <= 8; ++numChannels)
+                expect(group.prepare(44100.0, numChannels), group.getLastError());
+
+            // No centre for ALAC's four-channel layout: refused rather than
+            // streamed as PCM to receivers told ALAC
+            expect(!group.prepare(44100.0, juce::AudioChannelSet::quadraphonic()));
+            expect(group.getLastError().contains("ALAC"));
+
+            // Nor is the PCM that comes out instead recorded as ALAC
+            juce::TemporaryFile file(".caf");
+            expect(!group.startRecording(file.getFile()));
+            expect(!group.isRecording());
+
+            expect(group.setFormat(AudioEncoder::Format::PCM_16));
+            expect(!group.setFormat(AudioEncoder::Format::ALAC));
+
+            expect(group.prepare(44100.0, 2));
+            expect(group.setFormat(AudioEncoder::Format::ALAC), group.getLastError());
+        }
+    }
+};
+
+static RaopSessionGroupTests raopSessionGroupTests;
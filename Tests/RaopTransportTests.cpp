@@ -0,0 +1,203 @@
+#include <JuceHeader.h>
+#include "../Source/AirPlay/RaopTiming.h"
+#include "../Source/AirPlay/RaopTransport.h"
+#include "LoopbackReceiver.h"
+
+class RaopTransportTests : public juce::UnitTest
+{
+public:
+    RaopTransportTests() : juce::UnitTest("RaopTransport") {}
+
+    void runTest() override
+    {
+        testNtpTimeConversion();
+        testSyncPacketLayout();
+        testTimingResponder();
+        testAudioPacketsAndSync();
+    }
+
+private:
+    void testNtpTimeConversion()
+    {
+        beginTest("NTP timestamp conversion");
+        {
+            auto t = NtpTime::fromMicroseconds(3900000000ull * 1000000ull + 500000);
+            expectEquals((juce::int64)t.seconds, (juce::int64)3900000000ll, "Seconds should be preserved");
+            expectEquals((juce::int64)t.fraction, (juce::int64)0x80000000ll, "Half a second is fraction 2^31");
+
+            juce::uint8 bytes[8];
+            t.write(bytes);
+            auto back = NtpTime::read(bytes);
+            expect(back.seconds == t.seconds && back.fraction == t.fraction, "Wire round trip should be exact");
+
+            auto later = t.plusSeconds(0.25);
+            expectEquals((juce::int64)(later.toMicroseconds() - t.toMicroseconds()), (juce::int64)250000,
+                         "Offset should be applied in microseconds");
+
+            // now() must be after 2020 in NTP seconds
+            expect(NtpTime::now().seconds > 3786825600u, "Current NTP time should be plausible");
+        }
+    }
+
+    void testSyncPacketLayout()
+    {
+        beginTest("Sync packet layout and scheduling");
+        {
+            RaopSyncScheduler scheduler;
+            scheduler.reset(44100);
+
+            expect(scheduler.isDue(1000), "First packet should always be due");
+
+            juce::uint8 packet[RtpPacket::syncPacketSize];
+            auto ntp = NtpTime::fromMicroseconds(1000000);
+            int size = scheduler.buildPacket(packet, 100000, 11025, ntp);
+
+            expectEquals(size, RtpPacket::syncPacketSize, "Sync packet should be 20 bytes");
+            expectEquals((int)packet[0], 0x90, "First sync should carry the extension bit");
+            expectEquals((int)RtpPacket::getPayloadType(packet), (int)RtpPacket::sync, "Payload type should be sync");
+            expectEquals((juce::int64)RtpPacket::readUInt32(packet + 4), (juce::int64)(100000 - 11025),
+                         "Playing timestamp should be next timestamp minus latency");
+            expectEquals((juce::int64)RtpPacket::readUInt32(packet + 16), (juce::int64)100000,
+                         "Next timestamp should be carried");
+
+            expect(!scheduler.isDue(100000 + 44099), "Sync should not be due within the interval");
+            expect(scheduler.isDue(100000 + 44100), "Sync should be due after the interval");
+
+            scheduler.buildPacket(packet, 144100, 11025, ntp);
+            expectEquals((int)packet[0], 0x80, "Later syncs should not carry the extension bit");
+
+            // Schedule must survive 32-bit timestamp wrap-around
+            scheduler.buildPacket(packet, 0xffffff00u, 11025, ntp);
+            expect(!scheduler.isDue(0x00000010u), "Wrapped timestamp inside the interval is not due");
+            expect(scheduler.isDue(0xffffff00u + 44100u), "Wrapped timestamp past the interval is due");
+        }
+    }
+
+    void testTimingResponder()
+    {
+        beginTest("Timing responder answers requests");
+        {
+            RaopTimingResponder responder;
+            expect(responder.start(), "Responder should bind");
+            expect(responder.getLocalPort() > 0, "Responder should report its port");
+
+            LoopbackReceiver receiver;
+            double worstRoundTrip = 0.0;
+            int answered = 0;
+
+            for (int i = 0; i < 20; ++i)
+            {
+                double roundTrip = receiver.requestTiming(responder.getLocalPort());
+                if (roundTrip >= 0.0)
+                {
+                    answered++;
+                    worstRoundTrip = juce::jmax(worstRoundTrip, roundTrip);
+                }
+            }
+
+            expectEquals(answered, 20, "Every request should be answered");
+
+            // The responder records its stats just after the reply leaves
+            juce::Thread::sleep(10);
+            auto stats = responder.getStats();
+            expectEquals(stats.requestsAnswered, 20, "Responder should count answered requests");
+            expect(stats.maxResponseMicros >= stats.meanResponseMicros, "Max should bound mean");
+
+            logMessage("Timing response: mean " + juce::String(stats.meanResponseMicros, 1) + " us, max "
+                       + juce::String(stats.maxResponseMicros, 1) + " us, worst round trip "
+                       + juce::String(worstRoundTrip, 1) + " us");
+
+            juce::uint8 bogus[RtpPacket::timingPacketSize] = {};
+            juce::uint8 response[RtpPacket::timingPacketSize];
+            expectEquals(RaopTimingResponder::buildResponse(bogus, 8, NtpTime::now(), response), 0,
+                         "Short requests should be rejected");
+        }
+    }
+
+    void testAudioPacketsAndSync()
+    {
+        beginTest("Audio packets and sync over loopback");
+        {
+            LoopbackReceiver receiver;
+            RaopTransport transport;
+
+            expect(transport.open(receiver.getEndpoint()), "Transport should open");
+            expectEquals((int)transport.getLatencyFrames(), (int)RaopTransport::defaultLatencyFrames,
+                         "Default latency should be ~2 s");
+
+            transport.setLatencyFrames(11025);
+            expectWithinAbsoluteError(transport.getLatencyMs(), 250.0, 0.01, "Latency should be settable to 250 ms");
+
+            transport.setLatencyFrames(10);
+            expectEquals((int)transport.getLatencyFrames(), (int)RaopTransport::minimumLatencyFrames,
+                         "Latency should be clamped to the minimum");
+            transport.setLatencyFrames(11025);
+
+            juce::uint8 payload[64];
+            for (int i = 0; i < 64; ++i)
+                payload[i] = (juce::uint8)i;
+
+            const int numPackets = 300;  // > 2 s of audio, so at least 3 syncs
+            auto firstTimestamp = transport.getNextTimestamp();
+
+            // Send in bursts so the loopback socket buffer never overflows
+            for (int i = 0; i < numPackets; ++i)
+            {
+                expect(transport.sendAudioPacket(payload, 64, RaopTransport::framesPerPacket), "Send should succeed");
+
+                if ((i + 1) % 50 == 0)
+                    receiver.waitForAudioPackets(i + 1, 1000);
+            }
+
+            expect(receiver.waitForAudioPackets(numPackets, 2000), "Receiver should get every packet");
+
+            auto packets = receiver.getAudioPackets();
+            bool sequential = true;
+            for (size_t i = 1; i < packets.size(); ++i)
+            {
+                sequential = sequential && (juce::uint16)(packets[i].sequence - packets[i - 1].sequence) == 1;
+                sequential = sequential && packets[i].timestamp - packets[i - 1].timestamp
+                                               == (juce::uint32)RaopTransport::framesPerPacket;
+            }
+
+            expect(sequential, "Sequence numbers and timestamps should advance per packet");
+            expect(packets.front().marker, "First packet should carry the marker bit");
+            expectEquals(packets.front().timestamp, firstTimestamp, "First timestamp should match transport");
+            expect(packets.front().payload == juce::MemoryBlock(payload, 64), "Payload should arrive intact");
+
+            juce::Thread::sleep(20);
+            auto syncs = receiver.getSyncPackets();
+            expectEquals((int)syncs.size(), 3, "One sync per second of audio plus the initial one");
+
+            if (!syncs.empty())
+            {
+                expect(syncs.front().extension, "Initial sync should carry the extension bit");
+                expectEquals(syncs.front().nextTimestamp, firstTimestamp, "Initial sync should reference first packet");
+                expectEquals(syncs.front().nextTimestamp - syncs.front().playingTimestamp, (juce::uint32)11025,
+                             "Sync should encode the latency target");
+            }
+
+            if (syncs.size() >= 2)
+            {
+                // NTP spacing follows the pacer's schedule, not send-time jitter
+                auto ntpDelta = (double)(syncs[1].ntpTime.toMicroseconds() - syncs[0].ntpTime.toMicroseconds());
+                auto rtpDelta = (double)(syncs[1].nextTimestamp - syncs[0].nextTimestamp) * 1.0e6 / 44100.0;
+                expectWithinAbsoluteError(ntpDelta, rtpDelta, 2.0, "Sync NTP times should track RTP time");
+            }
+
+            auto roundTrip = receiver.requestTiming(transport.getLocalTimingPort());
+            expect(roundTrip >= 0.0, "Transport should answer timing requests");
+            juce::Thread::sleep(10);
+
+            auto stats = transport.getStats();
+            expectEquals((int)stats.packetsSent, numPackets, "Packets sent should be counted");
+            expectEquals(stats.sync.packetsSent, 3, "Sync packets should be counted");
+            expectEquals(stats.timing.requestsAnswered, 1, "Timing requests should be counted");
+
+            logMessage("Sync lateness vs pacer: mean " + juce::String(stats.sync.meanLatenessMicros, 1)
+                       + " us, max " + juce::String(stats.sync.maxLatenessMicros, 1) + " us");
+        }
+    }
+};
+
+static RaopTransportTests raopTransportTests;
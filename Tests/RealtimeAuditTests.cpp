@@ -0,0 +1,165 @@
+#include <JuceHeader.h>
+#include "../Source/Audio/RealtimeAudit.h"
+#include "../Source/Audio/SignalMeter.h"
+#include "../Source/AirPlay/AirPlayManager.h"
+#include "LoopbackReceiver.h"
+#include <mutex>
+
+#if JUCE_LINUX
+ #include <unistd.h>
+#endif
+
+class RealtimeAuditTests : public juce::UnitTest
+{
+public:
+    RealtimeAuditTests() : juce::UnitTest("RealtimeAudit") {}
+
+    void runTest() override
+    {
+        if (!RealtimeAudit::isEnabled())
+        {
+            beginTest("Audit mode");
+            logMessage("Built without FREECASTER_RT_AUDIT; configure with -DFREECASTER_RT_AUDIT=ON to audit the audio thread");
+            return;
+        }
+
+        testDetectsViolations();
+        testAudioCallbackIsRealtimeSafe();
+    }
+
+private:
+    // Keeps the compiler from eliding the allocations under test
+    static inline void* volatile sink = nullptr;
+
+    template <typename Function>
+    static int countViolations(Function&& function)
+    {
+        const int before = RealtimeAudit::getNumViolations();
+        {
+            RealtimeAudit::ScopedRealtimeContext context;
+            function();
+        }
+        return RealtimeAudit::getNumViolations() - before;
+    }
+
+    void reportViolations()
+    {
+        for (auto& line : RealtimeAudit::describeViolations())
+            logMessage(line);
+    }
+
+    void testDetectsViolations()
+    {
+        beginTest("Violations in a real-time context are recorded");
+        {
+            expectEquals(RealtimeAudit::getNumViolations(), 0, "Earlier tests ran clean");
+            reportViolations();
+
+            expectGreaterThan(countViolations([] { std::vector<int> values(1000); sink = values.data(); }), 0,
+                              "Allocating and freeing");
+            expectGreaterThan(countViolations([] { juce::HeapBlock<float> block(1000); sink = block.get(); }), 0,
+                              "malloc through HeapBlock");
+
+            std::mutex mutex;
+            juce::CriticalSection criticalSection;
+            expectEquals(countViolations([&] { if (mutex.try_lock()) mutex.unlock(); }), 0, "Try-locks never wait");
+            expectEquals(countViolations([&] { const juce::ScopedTryLock sl(criticalSection); }), 0);
+
+           #if JUCE_LINUX
+            expectGreaterThan(countViolations([&] { std::lock_guard<std::mutex> lock(mutex); }), 0, "Blocking lock");
+            expectGreaterThan(countViolations([&] { const juce::ScopedLock sl(criticalSection); }), 0, "Blocking lock");
+            expectGreaterThan(countViolations([] { ::usleep(10); }), 0, "Sleeping");
+           #endif
+
+            // Outside a context nothing counts
+            const int before = RealtimeAudit::getNumViolations();
+            std::vector<int> values(1000);
+            sink = values.data();
+            { const juce::ScopedLock sl(criticalSection); }
+            expectEquals(RealtimeAudit::getNumViolations(), before);
+            expect(!RealtimeAudit::isRealtimeContext());
+
+            auto descriptions = RealtimeAudit::describeViolations();
+            expect(descriptions.size() > 0 && descriptions[0].startsWith("Allocation on the audio thread"));
+
+            RealtimeAudit::reset();
+        }
+    }
+
+    void testAudioCallbackIsRealtimeSafe()
+    {
+        beginTest("The audio callback never allocates, locks or blocks");
+        {
+            struct Setup
+            {
+                double sampleRate;
+                juce::AudioChannelSet layout;
+                bool driftCompensation;
+                bool sharedScheduler;
+            };
+
+            // Float and 16-bit ring storage, rate conversion, surround, and
+            // both ways of running the stream
+            const Setup setups[] = {
+                { 44100.0, juce::AudioChannelSet::stereo(), true, false },
+                { 44100.0, juce::AudioChannelSet::stereo(), false, true },
+                { 48000.0, juce::AudioChannelSet::stereo(), true, true },
+                { 44100.0, juce::AudioChannelSet::create7point1(), false, false },
+            };
+
+            const int blockSize = 256;
+
+            for (const auto& setup : setups)
+            {
+                const int numChannels = setup.layout.size();
+                AirPlayManager manager(setup.sharedScheduler);
+                manager.setDriftCompensation(setup.driftCompensation);
+                manager.prepare(setup.sampleRate, blockSize, setup.layout);
+
+                LoopbackReceiver receiver;
+                expect(manager.addReceiver(AirPlayDevice("Zone", "127.0.0.1", 7000), receiver.getEndpoint()));
+
+                SignalMeter meter;
+                meter.prepare(numChannels);
+
+                juce::AudioBuffer<float> block(numChannels, blockSize);
+                juce::Random random(3);
+                for (int ch = 0; ch < numChannels; ++ch)
+                    for (int i = 0; i < blockSize; ++i)
+                        block.setSample(ch, i, (random.nextFloat() - 0.5f) * 0.5f);
+
+                // What processBlock does with each block, while the stream
+                // reads the buffer on its own thread
+                const int before = RealtimeAudit::getNumViolations();
+
+                for (int i = 0; i < 300; ++i)
+                {
+                    {
+                        RealtimeAudit::ScopedRealtimeContext context;
+
+                        const bool connected = manager.isConnected();
+                        meter.process(block, blockSize);
+
+                        if (connected)
+                            manager.pushAudioData(block, blockSize);
+                    }
+
+                    juce::Thread::sleep(2);
+                }
+
+                expect(receiver.waitForAudioPackets(20, 2000), "The stream should have been running");
+
+                const int violations = RealtimeAudit::getNumViolations() - before;
+                expectEquals(violations, 0, juce::String(numChannels) + " channels at " + juce::String(setup.sampleRate, 0)
+                                                + " Hz, drift compensation " + (setup.driftCompensation ? "on" : "off")
+                                                + (setup.sharedScheduler ? ", shared scheduler" : ", own thread"));
+                if (violations > 0)
+                    reportViolations();
+
+                manager.disconnectFromDevice();
+            }
+        }
+    }
+};
+
+static RealtimeAuditTests realtimeAuditTests;
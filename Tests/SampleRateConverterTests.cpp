@@ -0,0 +1,250 @@
+#include <JuceHeader.h>
+#include "../Source/Audio/SampleRateConverter.h"
+
+class SampleRateConverterTests : public juce::UnitTest
+{
+public:
+    SampleRateConverterTests() : juce::UnitTest("SampleRateConverter") {}
+
+    void runTest() override
+    {
+        testSupportedRates();
+        testStreamingMatchesSinglePass();
+        testDistortion();
+        testAliasing();
+        testCpuPerChannelSecond();
+    }
+
+private:
+    static constexpr double inputRates[] = { 48000.0, 96000.0, 88200.0 };
+
+    // Converts a mono sine in blocks of blockSize, returning the output
+    std::vector<float> convertSine(double inputRate, double frequency, double seconds, int blockSize = 512)
+    {
+        SampleRateConverter converter;
+        converter.prepare(1, blockSize, inputRate);
+
+        const double w = 2.0 * juce::MathConstants<double>::pi * frequency / inputRate;
+        const int totalInput = (int)(seconds * inputRate);
+
+        juce::AudioBuffer<float> input(1, blockSize), output(1, blockSize);
+        std::vector<float> result;
+
+        for (int position = 0; position < totalInput; position += blockSize)
+        {
+            int chunk = juce::jmin(blockSize, totalInput - position);
+            for (int i = 0; i < chunk; ++i)
+                input.setSample(0, i, (float)(0.5 * std::sin(w * (double)(position + i))));
+
+            converter.pushInput(input, 0, chunk);
+
+            int produced;
+            while ((produced = converter.pullOutput(output, 0, blockSize)) > 0)
+                result.insert(result.end(), output.getReadPointer(0), output.getReadPointer(0) + produced);
+        }
+
+        return result;
+    }
+
+    // Least-squares fit of a sine at the known frequency plus DC; returns the
+    // residual (THD+N) in dB relative to the fitted sine, and its amplitude
+    static double measureThdN(const std::vector<float>& signal, int start, double frequency, double rate,
+                              double& amplitude)
+    {
+        const double w = 2.0 * juce::MathConstants<double>::pi * frequency / rate;
+        double ss = 0, sc = 0, s1 = 0, cc = 0, c1 = 0, n = 0, ys = 0, yc = 0, y1 = 0;
+
+        for (size_t i = (size_t)start; i < signal.size(); ++i)
+        {
+            double s = std::sin(w * (double)i), c = std::cos(w * (double)i), y = signal[i];
+            ss += s * s; sc += s * c; s1 += s; cc += c * c; c1 += c; n += 1.0;
+            ys += y * s; yc += y * c; y1 += y;
+        }
+
+        // Solve the 3x3 normal equations by Cramer's rule
+        auto det3 = [](double a, double b, double c, double d, double e, double f, double g, double h, double k)
+        {
+            return a * (e * k - f * h) - b * (d * k - f * g) + c * (d * h - e * g);
+        };
+
+        double det = det3(ss, sc, s1, sc, cc, c1, s1, c1, n);
+        double a = det3(ys, sc, s1, yc, cc, c1, y1, c1, n) / det;
+        double b = det3(ss, ys, s1, sc, yc, c1, s1, y1, n) / det;
+        double dc = det3(ss, sc, ys, sc, cc, yc, s1, c1, y1) / det;
+
+        double residual = 0.0, power = 0.0;
+        for (size_t i = (size_t)start; i < signal.size(); ++i)
+        {
+            double fit = a * std::sin(w * (double)i) + b * std::cos(w * (double)i) + dc;
+            residual += (signal[i] - fit) * (signal[i] - fit);
+            power += fit * fit;
+        }
+
+        amplitude = std::sqrt(a * a + b * b);
+        return 10.0 * std::log10(residual / power);
+    }
+
+    void testSupportedRates()
+    {
+        beginTest("Supported rates");
+        {
+            for (double rate : inputRates)
+                expect(SampleRateConverter::isSupported(rate), juce::String(rate) + " Hz should convert");
+
+            expect(!SampleRateConverter::isSupported(44100.0));
+            expect(!SampleRateConverter::isSupported(192000.0));
+
+            SampleRateConverter converter;
+            expect(!converter.prepare(2, 512, 44100.0), "44.1 kHz needs no conversion");
+            expect(!converter.isActive());
+            expectEquals(converter.getOutputSampleRate(), 44100.0);
+
+            expect(converter.prepare(2, 512, 48000.0));
+            expect(converter.isActive());
+            expectEquals(converter.getOutputSampleRate(), 44100.0);
+        }
+    }
+
+    void testStreamingMatchesSinglePass()
+    {
+        beginTest("Streaming in uneven blocks matches a single pass");
+        {
+            for (double rate : inputRates)
+            {
+                const int total = (int)rate / 4;
+                juce::AudioBuffer<float> input(2, total);
+                juce::Random random(42);
+                for (int ch = 0; ch < 2; ++ch)
+                    for (int i = 0; i < total; ++i)
+                        input.setSample(ch, i, random.nextFloat() * 2.0f - 1.0f);
+
+                SampleRateConverter whole;
+                whole.prepare(2, total, rate);
+                whole.pushInput(input, 0, total);
+                juce::AudioBuffer<float> expected(2, total);
+                int expectedFrames = whole.pullOutput(expected, 0, total);
+
+                expectWithinAbsoluteError((double)expectedFrames, total * 44100.0 / rate, 1.0 + whole.getLatencyFrames(),
+                                          "Output length should follow the ratio");
+
+                // Pull-driven, the way the packet path uses it
+                SampleRateConverter streamed;
+                streamed.prepare(2, 1024, rate);
+                juce::AudioBuffer<float> actual(2, total);
+                int consumed = 0, produced = 0;
+                bool matches = true;
+
+                while (produced < expectedFrames)
+                {
+                    int want = juce::jmin(1 + random.nextInt(400), expectedFrames - produced);
+                    int needed = streamed.getInputFramesNeeded(want);
+                    expect(consumed + needed <= total);
+                    expectEquals(streamed.pushInput(input, consumed, needed), needed);
+                    consumed += needed;
+
+                    expectEquals(streamed.pullOutput(actual, produced, want), want,
+                                 "getInputFramesNeeded should be exact");
+                    produced += want;
+                }
+
+                for (int ch = 0; ch < 2; ++ch)
+                    for (int i = 0; i < expectedFrames; ++i)
+                        matches = matches && actual.getSample(ch, i) == expected.getSample(ch, i);
+
+                expect(matches, "Block boundaries must not change the output at " + juce::String(rate) + " Hz");
+            }
+        }
+    }
+
+    void testDistortion()
+    {
+        beginTest("THD+N and passband gain");
+        {
+            for (double rate : inputRates)
+            {
+                for (double frequency : { 1000.0, 19000.0 })
+                {
+                    auto output = convertSine(rate, frequency, 1.0);
+                    double amplitude = 0.0;
+                    double thdN = measureThdN(output, 1000, frequency, 44100.0, amplitude);
+                    double gainDb = juce::Decibels::gainToDecibels(amplitude / 0.5);
+
+                    expectLessThan(thdN, -90.0, juce::String(frequency, 0) + " Hz from " + juce::String(rate, 0));
+                    expectWithinAbsoluteError(gainDb, 0.0, 0.01, "Passband should be flat");
+
+                    logMessage(juce::String(rate / 1000.0, 1) + " kHz -> 44.1 kHz, " + juce::String(frequency, 0)
+                               + " Hz: THD+N " + juce::String(thdN, 1) + " dB, gain " + juce::String(gainDb, 4) + " dB");
+                }
+            }
+        }
+    }
+
+    void testAliasing()
+    {
+        beginTest("Aliasing rejection above the output Nyquist");
+        {
+            for (double rate : inputRates)
+            {
+                // Tones that would fold back into the audible band
+                for (double frequency : { 23000.0, juce::jmax(23500.0, 0.45 * rate) })
+                {
+                    auto output = convertSine(rate, frequency, 0.5);
+                    double power = 0.0;
+                    for (size_t i = 1000; i < output.size(); ++i)
+                        power += (double)output[i] * output[i];
+
+                    double rms = std::sqrt(power / (double)(output.size() - 1000));
+                    double rejectionDb = juce::Decibels::gainToDecibels(rms / (0.5 / std::sqrt(2.0)), -200.0);
+
+                    expectLessThan(rejectionDb, -90.0, juce::String(frequency, 0) + " Hz from " + juce::String(rate, 0));
+                    logMessage(juce::String(rate / 1000.0, 1) + " kHz -> 44.1 kHz, " + juce::String(frequency, 0)
+                               + " Hz alias: " + juce::String(rejectionDb, 1) + " dB");
+                }
+            }
+        }
+    }
+
+    void testCpuPerChannelSecond()
+    {
+        beginTest("CPU per channel-second");
+        {
+            const double seconds = 10.0;
+            const int blockSize = 512;
+
+            for (double rate : inputRates)
+            {
+                SampleRateConverter converter;
+                converter.prepare(2, blockSize, rate);
+
+                juce::AudioBuffer<float> input(2, blockSize), output(2, blockSize);
+                juce::Random random(7);
+                for (int ch = 0; ch < 2; ++ch)
+                    for (int i = 0; i < blockSize; ++i)
+                        input.setSample(ch, i, random.nextFloat() - 0.5f);
+
+                const int blocks = (int)(seconds * rate / blockSize);
+                int produced = 0;
+
+                auto start = juce::Time::getHighResolutionTicks();
+                for (int b = 0; b < blocks; ++b)
+                {
+                    converter.pushInput(input, 0, blockSize);
+                    produced += converter.pullOutput(output, 0, blockSize);
+                }
+                auto ticks = juce::Time::getHighResolutionTicks() - start;
+
+                double channelSeconds = 2.0 * blocks * blockSize / rate;
+                double microsPerChannelSecond = juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e6 / channelSeconds;
+
+                expectGreaterThan(produced, 0);
+                // Generous bound: 5% of a core per channel
+                expectLessThan(microsPerChannelSecond, 50000.0, "Conversion should be far faster than real time");
+
+                logMessage(juce::String(rate / 1000.0, 1) + " kHz -> 44.1 kHz: "
+                           + juce::String(microsPerChannelSecond, 0) + " us CPU per channel-second");
+            }
+        }
+    }
+};
+
+static SampleRateConverterTests sampleRateConverterTests;
@@ -0,0 +1,254 @@
+#include <JuceHeader.h>
+#include "../Source/Audio/SignalMeter.h"
+#include <thread>
+
+class SignalMeterTests : public juce::UnitTest
+{
+public:
+    SignalMeterTests() : juce::UnitTest("SignalMeter") {}
+
+    void runTest() override
+    {
+        testKernelMatchesScalar();
+        testTruePeak();
+        testSnapshotsCoverEverything();
+        testConcurrentSnapshots();
+        testMeteringCost();
+    }
+
+private:
+    static constexpr double sampleRate = 44100.0;
+
+    static void fillRandom(juce::AudioBuffer<float>& buffer, int seed, float range)
+    {
+        juce::Random random(seed);
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample(ch, i, (random.nextFloat() * 2.0f - 1.0f) * range);
+    }
+
+    void testKernelMatchesScalar()
+    {
+        beginTest("Vectorised peak, RMS and clip count match the scalar loop");
+        {
+            juce::AudioBuffer<float> audio(1, 1031);
+            fillRandom(audio, 11, 1.3f);
+            const float* samples = audio.getReadPointer(0);
+            int mismatches = 0;
+
+            // Every length up to a few vectors, so each tail size is covered
+            for (int length = 0; length < 1031; length += (length < 40 ? 1 : 97))
+            {
+                float peak = 0.0f;
+                double sum = 0.0;
+                int clipped = 0;
+                for (int i = 0; i < length; ++i)
+                {
+                    peak = juce::jmax(peak, std::abs(samples[i]));
+                    sum += (double)samples[i] * samples[i];
+                    clipped += std::abs(samples[i]) >= 1.0f ? 1 : 0;
+                }
+
+                auto levels = SignalMeter::measureBlock(samples, length);
+
+                if (levels.peak != peak || levels.clippedSamples != clipped
+                    || std::abs(levels.sumSquares - sum) > 1.0e-5 * juce::jmax(1.0, sum))
+                    ++mismatches;
+            }
+
+            expectEquals(mismatches, 0);
+
+            // Exactly full scale counts as clipped
+            const float edges[] = { 1.0f, -1.0f, 0.99999f, -1.5f, 0.0f };
+            expectEquals(SignalMeter::measureBlock(edges, 5).clippedSamples, 3);
+        }
+    }
+
+    void testTruePeak()
+    {
+        beginTest("True peak finds the peaks between samples");
+        {
+            // A quarter of the sample rate with a 45 degree phase offset puts
+            // every sample at 0.707 of the waveform's peak
+            const int length = 4096;
+            std::vector<float> tone((size_t)length);
+            for (int i = 0; i < length; ++i)
+                tone[(size_t)i] = 0.5f * (float)std::sin(juce::MathConstants<double>::halfPi * i
+                                                         + juce::MathConstants<double>::pi / 4.0);
+
+            float history[SignalMeter::truePeakTaps - 1] = {};
+            auto samplePeak = SignalMeter::measureBlock(tone.data(), length).peak;
+            auto truePeak = SignalMeter::measureTruePeak(tone.data(), length, history);
+
+            expectWithinAbsoluteError(samplePeak, 0.3536f, 0.001f);
+            expectWithinAbsoluteError(juce::Decibels::gainToDecibels(truePeak), juce::Decibels::gainToDecibels(0.5f), 0.5f,
+                                      "Within the BS.1770 filter's tolerance of the real peak");
+
+            // Split into uneven blocks, the carried history gives the same answer
+            float splitHistory[SignalMeter::truePeakTaps - 1] = {};
+            float splitPeak = 0.0f;
+            for (int start = 0, block = 1; start < length; start += block, block = block * 3 % 700 + 1)
+            {
+                const int count = juce::jmin(block, length - start);
+                splitPeak = juce::jmax(splitPeak, SignalMeter::measureTruePeak(tone.data() + start, count, splitHistory));
+            }
+
+            expectWithinAbsoluteError(splitPeak, truePeak, 1.0e-6f);
+
+            logMessage("Sample peak " + juce::String(juce::Decibels::gainToDecibels(samplePeak), 2) + " dBFS, true peak "
+                       + juce::String(juce::Decibels::gainToDecibels(truePeak), 2) + " dBFS (waveform peak -6.02)");
+        }
+    }
+
+    void testSnapshotsCoverEverything()
+    {
+        beginTest("A snapshot covers every block since the last one taken");
+        {
+            SignalMeter meter;
+            meter.prepare(2);
+            SignalMeter::Snapshot snapshot;
+            expect(!meter.getSnapshot(snapshot), "Nothing published yet");
+
+            juce::AudioBuffer<float> quiet(2, 256), loud(2, 256);
+            fillRandom(quiet, 1, 0.1f);
+            fillRandom(loud, 2, 0.1f);
+            loud.setSample(1, 100, 1.2f);
+
+            // Three blocks before the GUI polls: the loud one in the middle
+            // must still show
+            meter.process(quiet, 256);
+            meter.process(loud, 256);
+            meter.process(quiet, 256);
+
+            expect(meter.getSnapshot(snapshot));
+            expectEquals((int)snapshot.numFrames, 768);
+            expectEquals(snapshot.numChannels, 2);
+            expectEquals(snapshot.peak[1], 1.2f);
+            expect(snapshot.truePeak[1] >= 1.2f);
+            expectEquals(snapshot.clippedSamples[1], 1);
+            expectEquals(snapshot.clippedSamples[0], 0);
+
+            double expectedSum = 0.0;
+            for (auto* block : { &quiet, &loud, &quiet })
+                for (int i = 0; i < 256; ++i)
+                    expectedSum += (double)block->getSample(0, i) * block->getSample(0, i);
+
+            expectWithinAbsoluteError(snapshot.getRms(0), (float)std::sqrt(expectedSum / 768.0), 1.0e-5f);
+
+            expect(!meter.getSnapshot(snapshot), "Taken snapshots are not repeated");
+
+            meter.process(quiet, 256);
+            expect(meter.getSnapshot(snapshot));
+            expectEquals((int)snapshot.numFrames, 256, "The next snapshot starts after the last one taken");
+            expectLessThan(snapshot.peak[1], 0.11f);
+        }
+    }
+
+    void testConcurrentSnapshots()
+    {
+        beginTest("Snapshots taken while the audio thread publishes lose nothing");
+        {
+            SignalMeter meter;
+            meter.prepare(2);
+
+            juce::AudioBuffer<float> block(2, 64);
+            fillRandom(block, 3, 0.5f);
+            block.setSample(0, 10, 1.0f);
+
+            const int blocks = 200000;
+            std::atomic<bool> done{false};
+            juce::int64 framesSeen = 0;
+            int clipsSeen = 0, snapshotsTaken = 0;
+
+            std::thread audio([&]
+            {
+                for (int i = 0; i < blocks; ++i)
+                    meter.process(block, 64);
+                done = true;
+            });
+
+            SignalMeter::Snapshot snapshot;
+            for (;;)
+            {
+                const bool finished = done.load();
+
+                if (meter.getSnapshot(snapshot))
+                {
+                    framesSeen += snapshot.numFrames;
+                    clipsSeen += snapshot.clippedSamples[0];
+                    ++snapshotsTaken;
+                }
+                else if (finished)
+                {
+                    break;
+                }
+            }
+
+            audio.join();
+
+            expectEquals(framesSeen, (juce::int64)blocks * 64);
+            expectEquals(clipsSeen, blocks);
+            expectGreaterThan(snapshotsTaken, 1);
+
+            logMessage(juce::String(blocks) + " blocks published, " + juce::String(snapshotsTaken) + " snapshots taken");
+        }
+    }
+
+    void testMeteringCost()
+    {
+        beginTest("Metering cost per block");
+        {
+            const int blockSize = 512;
+            const int blocks = 4000;
+            juce::AudioBuffer<float> audio(2, blockSize);
+            fillRandom(audio, 4, 0.8f);
+
+            SignalMeter meter;
+            meter.prepare(2);
+
+            auto start = juce::Time::getHighResolutionTicks();
+            for (int i = 0; i < blocks; ++i)
+                meter.process(audio, blockSize);
+            double meterSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            // The per-sample RMS loop processBlock used to run
+            volatile float sink = 0.0f;
+            start = juce::Time::getHighResolutionTicks();
+            for (int i = 0; i < blocks; ++i)
+            {
+                float rms = 0.0f;
+                for (int ch = 0; ch < 2; ++ch)
+                {
+                    const float* data = audio.getReadPointer(ch);
+                    float sum = 0.0f;
+                    for (int s = 0; s < blockSize; ++s)
+                        sum += data[s] * data[s];
+                    rms = juce::jmax(rms, std::sqrt(sum / blockSize));
+                }
+                sink = sink + rms;
+            }
+            double scalarSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            SignalMeter::Snapshot snapshot;
+            expect(meter.getSnapshot(snapshot));
+            expectEquals((int)snapshot.numFrames, blocks * blockSize);
+
+            // A 512-frame block lasts 11.6 ms
+            const double meterMicros = meterSeconds * 1.0e6 / blocks;
+            expectLessThan(meterMicros, 200.0, "Metering should take a sliver of the block period");
+
+            SignalMeter::BlockLevels levels;
+            start = juce::Time::getHighResolutionTicks();
+            for (int i = 0; i < blocks; ++i)
+                levels = SignalMeter::measureBlock(audio.getReadPointer(i & 1), blockSize);
+            double kernelSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            logMessage("Stereo " + juce::String(blockSize) + "-frame block: " + juce::String(meterMicros, 2)
+                       + " us metered with true peak, peak/RMS/clip kernel " + juce::String(kernelSeconds * 1.0e6 / blocks * 2.0, 2)
+                       + " us, scalar RMS loop " + juce::String(scalarSeconds * 1.0e6 / blocks, 2) + " us (peak "
+                       + juce::String(levels.peak, 2) + ")");
+        }
+    }
+};
+
+static SignalMeterTests signalMeterTests;
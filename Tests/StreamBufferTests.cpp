@@ -1,7 +1,9 @@
 #include <JuceHeader.h>
 #include "../Source/Audio/StreamBuffer.h"
+#include "../Source/Audio/PcmConversion.h"
 #include <thread>
 #include <vector>
+#include <algorithm>
 
 class StreamBufferTests : public juce::UnitTest
 {
@@ -17,6 +19,17 @@ public:
         testClearOperation();
         testConcurrentReadWrite();
         testCircularBufferWrapAround();
+        testPrepareSizesFromSampleRate();
+        testTargetCoversCadence();
+        testGrowsOnUnderflow();
+        testShrinksWhenStable();
+        testOverflowDropOldest();
+        testOverflowDropNewest();
+        testOverflowResync();
+        testOverflowWriteTime();
+        testInterleavedStorage();
+        testInterleavedThroughput();
+        testSurroundChannels();
     }
     
 private:
@@ -226,6 +239,435 @@ private:
             }
         }
     }
+    
+    // Host-sized writes until the target is reached, then packet-sized
+    // reads until the buffer runs dry
+    static void primeAndRunDry(StreamBuffer& buffer, juce::AudioBuffer<float>& block)
+    {
+        while (buffer.getAvailableData() < buffer.getTargetFill())
+            buffer.write(block, 512);
+        
+        while (buffer.read(block, 352) == 352) {}
+    }
+    
+    void testPrepareSizesFromSampleRate()
+    {
+        beginTest("Prepare sizes storage and latency from the sample rate");
+        {
+            StreamBuffer buffer;
+            buffer.prepare(48000.0, 500.0);
+            
+            expectEquals(buffer.getCapacity(), 24000, "500 ms at 48 kHz");
+            expectWithinAbsoluteError(buffer.getTargetLatencyMs(), buffer.getLatencyTargetMs(), 0.1,
+                                      "Target should start at the latency target");
+            
+            juce::AudioBuffer<float> data(2, 4800);
+            data.clear();
+            buffer.write(data, 4800);
+            expectWithinAbsoluteError(buffer.getLatencyMs(), 100.0, 0.001, "4800 frames at 48 kHz is 100 ms");
+        }
+    }
+    
+    void testTargetCoversCadence()
+    {
+        beginTest("Target covers the measured producer and consumer cadence");
+        {
+            StreamBuffer buffer;
+            buffer.prepare(44100.0);
+            buffer.setLatencyTargetMs(1.0);
+            
+            juce::AudioBuffer<float> block(2, 2048);
+            block.clear();
+            
+            for (int i = 0; i < 20; ++i)
+            {
+                buffer.write(block, 2048);
+                buffer.read(block, 1024);
+                buffer.read(block, 1024);
+            }
+            
+            expect(buffer.getProducerCadenceFrames() >= 2048);
+            expectEquals(buffer.getConsumerCadenceFrames(), 1024);
+            expect(buffer.getTargetFill() >= 2048 + 1024, "A 1 ms target cannot hold 2048-frame host blocks");
+        }
+    }
+    
+    void testGrowsOnUnderflow()
+    {
+        beginTest("Target grows on underflow, not during the initial fill");
+        {
+            StreamBuffer buffer;
+            buffer.prepare(44100.0);
+            juce::AudioBuffer<float> block(2, 4096);
+            block.clear();
+            
+            // Reads before the target has ever been reached are not underflows
+            buffer.read(block, 512);
+            expectEquals(buffer.getGrowCount(), 0);
+            
+            int target = buffer.getTargetFill();
+            primeAndRunDry(buffer, block);
+            
+            expectEquals(buffer.getGrowCount(), 1, "Running dry after priming should grow the target");
+            expect(buffer.getTargetFill() > target, "Target should have grown");
+            
+            // Still dry: no further growth until the buffer refills
+            int grown = buffer.getTargetFill();
+            buffer.read(block, 352);
+            expectEquals(buffer.getTargetFill(), grown, "Repeated short reads should grow only once");
+        }
+    }
+    
+    void testShrinksWhenStable()
+    {
+        beginTest("Target shrinks back towards the latency target when stable");
+        {
+            StreamBuffer buffer;
+            buffer.prepare(44100.0);
+            juce::AudioBuffer<float> block(2, 4096);
+            block.clear();
+            
+            // Force a few rounds of growth
+            for (int i = 0; i < 4; ++i)
+                primeAndRunDry(buffer, block);
+            
+            int grown = buffer.getTargetFill();
+            expectEquals(buffer.getGrowCount(), 4);
+            
+            // Then a long, steady stream that never runs dry
+            buffer.write(block, grown);
+            for (int i = 0; i < 300 * 44100 / 512; ++i)
+            {
+                buffer.write(block, 512);
+                buffer.read(block, 512);
+            }
+            
+            int goal = juce::jmax(882, buffer.getProducerCadenceFrames() + buffer.getConsumerCadenceFrames());
+            expect(buffer.getShrinkCount() > 0, "Stable windows should shrink the target");
+            expect(buffer.getTargetFill() < grown, "Target should come down");
+            expectLessOrEqual(buffer.getTargetFill(), goal + 32, "Target should settle near the latency target");
+            
+            logMessage("Target " + juce::String(grown) + " -> " + juce::String(buffer.getTargetFill())
+                       + " frames (" + juce::String(buffer.getTargetLatencyMs(), 1) + " ms) after 300 s stable");
+        }
+    }
+    
+    // Fills both channels with consecutive values starting at first
+    static void fillRamp(juce::AudioBuffer<float>& data, int numSamples, int first)
+    {
+        for (int ch = 0; ch < data.getNumChannels(); ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                data.setSample(ch, i, (float)(first + i));
+    }
+    
+    bool readsRamp(StreamBuffer& buffer, int numSamples, int first)
+    {
+        juce::AudioBuffer<float> data(2, numSamples);
+        if (buffer.read(data, numSamples) != numSamples)
+            return false;
+        
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                if (data.getSample(ch, i) != (float)(first + i))
+                    return false;
+        
+        return true;
+    }
+    
+    void testOverflowDropOldest()
+    {
+        beginTest("Overflow policy: drop oldest");
+        {
+            StreamBuffer buffer(2, 1000);
+            expect(buffer.getOverflowPolicy() == StreamBuffer::OverflowPolicy::DropOldest, "Default policy");
+            
+            juce::AudioBuffer<float> data(2, 2500);
+            
+            // Offset the write head so the overflow wraps
+            fillRamp(data, 300, 0);
+            buffer.write(data, 300);
+            expect(readsRamp(buffer, 300, 0));
+            
+            fillRamp(data, 800, 1000);
+            buffer.write(data, 800);
+            fillRamp(data, 500, 1800);
+            buffer.write(data, 500);
+            
+            expectEquals(buffer.getAvailableData(), 1000);
+            expectEquals(buffer.getDroppedFrameCount(), 300);
+            expect(readsRamp(buffer, 1000, 1300), "Newest 1000 frames should read back in order");
+            
+            // A write larger than the whole buffer keeps its newest part
+            fillRamp(data, 2500, 5000);
+            buffer.write(data, 2500);
+            expect(readsRamp(buffer, 1000, 6500), "Oversized write should keep its last 1000 frames");
+        }
+    }
+    
+    void testOverflowDropNewest()
+    {
+        beginTest("Overflow policy: drop newest");
+        {
+            StreamBuffer buffer(2, 1000);
+            buffer.setOverflowPolicy(StreamBuffer::OverflowPolicy::DropNewest);
+            juce::AudioBuffer<float> data(2, 2500);
+            
+            fillRamp(data, 700, 0);
+            buffer.write(data, 700);
+            buffer.read(data, 200);
+            
+            fillRamp(data, 600, 700);
+            buffer.write(data, 600);
+            
+            expectEquals(buffer.getAvailableData(), 1000);
+            expectEquals(buffer.getDroppedFrameCount(), 100);
+            expect(readsRamp(buffer, 1000, 200), "Unread audio should survive untouched");
+        }
+    }
+    
+    void testOverflowResync()
+    {
+        beginTest("Overflow policy: resync with crossfade");
+        {
+            StreamBuffer buffer(2, 4096);
+            buffer.setOverflowPolicy(StreamBuffer::OverflowPolicy::Resync);
+            buffer.setLatencyTargetMs(10.0);
+            
+            // A constant old level and a constant new level make the fade easy to check
+            juce::AudioBuffer<float> data(2, 1024);
+            data.clear();
+            for (int i = 0; i < 4; ++i)
+                buffer.write(data, 1024);
+            
+            for (int ch = 0; ch < 2; ++ch)
+                juce::FloatVectorOperations::fill(data.getWritePointer(ch), 1.0f, 1024);
+            buffer.write(data, 1024);
+            
+            int target = buffer.getTargetFill();
+            expectEquals(buffer.getResyncCount(), 1);
+            expectEquals(buffer.getAvailableData(), target, "Resync should leave exactly the target");
+            
+            juce::AudioBuffer<float> out(2, target);
+            buffer.read(out, target);
+            
+            bool monotonic = true;
+            for (int i = 1; i < target; ++i)
+                monotonic = monotonic && out.getSample(0, i) >= out.getSample(0, i - 1);
+            
+            expectLessThan(out.getSample(0, 0), 0.01f, "Fade should start from the old audio");
+            expect(monotonic, "Fade should rise smoothly");
+            expectEquals(out.getSample(1, target - 1), 1.0f, "Fade should end on the new audio");
+        }
+    }
+    
+    void testOverflowWriteTime()
+    {
+        beginTest("Worst-case overflowing write time per policy");
+        {
+            const int writes = 20000;
+            const int blockSize = 512;
+            juce::AudioBuffer<float> data(2, blockSize);
+            fillRamp(data, blockSize, 0);
+            
+            const std::pair<StreamBuffer::OverflowPolicy, const char*> policies[] =
+            {
+                { StreamBuffer::OverflowPolicy::DropOldest, "drop oldest" },
+                { StreamBuffer::OverflowPolicy::DropNewest, "drop newest" },
+                { StreamBuffer::OverflowPolicy::Resync, "resync" }
+            };
+            
+            for (auto& policy : policies)
+            {
+                StreamBuffer buffer;
+                buffer.prepare(48000.0, 200.0);
+                buffer.setOverflowPolicy(policy.first);
+                
+                std::vector<double> micros;
+                micros.reserve(writes);
+                
+                // Nothing reads, so writes keep overflowing (resync empties
+                // the buffer down to its target each time)
+                for (int i = 0; i < writes; ++i)
+                {
+                    auto start = juce::Time::getHighResolutionTicks();
+                    buffer.write(data, blockSize);
+                    micros.push_back(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1.0e6);
+                }
+                
+                std::sort(micros.begin(), micros.end());
+                double median = micros[micros.size() / 2];
+                double p999 = micros[micros.size() * 999 / 1000];
+                
+                expect(buffer.getOverflowCount() > writes / 20);
+                expectLessThan(median, 50.0, "A 512-frame write should take microseconds");
+                
+                logMessage(juce::String(policy.second) + ": median " + juce::String(median, 2) + " us, 99.9th "
+                           + juce::String(p999, 2) + " us, worst " + juce::String(micros.back(), 2) + " us");
+            }
+        }
+    }
+    
+    void testInterleavedStorage()
+    {
+        beginTest("Interleaved integer storage");
+        {
+            for (auto storage : { StreamBuffer::Storage::Int16, StreamBuffer::Storage::Int24 })
+            {
+                const bool is16 = storage == StreamBuffer::Storage::Int16;
+                StreamBuffer buffer(2);
+                buffer.prepare(1000.0, 1000.0, storage);
+                expectEquals(buffer.getCapacity(), 1000);
+                expectEquals(buffer.getBytesPerFrame(), is16 ? 4 : 6);
+                
+                juce::AudioBuffer<float> data(2, 700);
+                juce::Random random(5);
+                for (int ch = 0; ch < 2; ++ch)
+                    for (int i = 0; i < 700; ++i)
+                        data.setSample(ch, i, random.nextFloat() * 2.0f - 1.0f);
+                
+                // Offset the heads so both the write and the read wrap
+                buffer.write(data, 600);
+                juce::HeapBlock<char> out(700 * 6, true), expected(700 * 6, true);
+                expectEquals(buffer.readInterleaved(out, 600), 600);
+                buffer.write(data, 700);
+                expectEquals(buffer.readInterleaved(out, 700), 700);
+                
+                if (is16)
+                    PcmConversion::floatToInt16(data, 0, 700, 2, reinterpret_cast<juce::int16*>(expected.get()));
+                else
+                    PcmConversion::floatToInt24(data, 0, 700, 2, reinterpret_cast<juce::uint8*>(expected.get()));
+                
+                expect(std::memcmp(out, expected, (size_t)(700 * buffer.getBytesPerFrame())) == 0,
+                       "Frames should come out exactly as the encoder would have converted them");
+                
+                // The float interface still works on integer storage
+                buffer.write(data, 300);
+                juce::AudioBuffer<float> floats(2, 300);
+                expectEquals(buffer.read(floats, 300), 300);
+                float worst = 0.0f;
+                for (int ch = 0; ch < 2; ++ch)
+                    for (int i = 0; i < 300; ++i)
+                        worst = juce::jmax(worst, std::abs(floats.getSample(ch, i) - data.getSample(ch, i)));
+                expectLessThan(worst, is16 ? 1.0f / 16384.0f : 1.0f / 4194304.0f, "Float reads should match to the bit depth");
+                
+                // Underflows are concealed in PCM too: the missing tail continues the audio
+                buffer.write(data, 100);
+                std::memset(out, 0, 700 * 6);
+                expectEquals(buffer.readInterleaved(out, 200), 100);
+                expect(buffer.isConcealing());
+                expect(!std::all_of(out + 100 * buffer.getBytesPerFrame(), out + 200 * buffer.getBytesPerFrame(),
+                                    [](char c) { return c == 0; }),
+                       "The gap should be filled, not left silent");
+            }
+            
+            // Resync crossfades in the integer domain as well
+            StreamBuffer buffer(2);
+            buffer.prepare(44100.0, 100.0, StreamBuffer::Storage::Int16);
+            buffer.setOverflowPolicy(StreamBuffer::OverflowPolicy::Resync);
+            juce::AudioBuffer<float> data(2, 1024);
+            data.clear();
+            for (int i = 0; i < 4; ++i)
+                buffer.write(data, 1024);
+            for (int ch = 0; ch < 2; ++ch)
+                juce::FloatVectorOperations::fill(data.getWritePointer(ch), 0.5f, 1024);
+            buffer.write(data, 1024);
+            
+            expect(buffer.getResyncCount() > 0);
+            std::vector<juce::int16> pcm((size_t)buffer.getAvailableData() * 2);
+            int frames = buffer.readInterleaved(pcm.data(), buffer.getAvailableData());
+            expect(pcm[0] < 1000 && pcm[(size_t)(frames - 1) * 2] == 16383, "Fade should run from the old audio to the new");
+        }
+    }
+    
+    void testInterleavedThroughput()
+    {
+        beginTest("Interleaved storage throughput");
+        {
+            const int blockSize = 352;
+            const int blocks = 20000;
+            juce::AudioBuffer<float> data(2, blockSize), floats(2, blockSize);
+            fillRamp(data, blockSize, 0);
+            data.applyGain(1.0f / blockSize);
+            std::vector<juce::int16> pcm((size_t)blockSize * 2);
+            
+            // Float storage: the encoder converts and interleaves after the read
+            StreamBuffer floatBuffer(2);
+            floatBuffer.prepare(44100.0, 100.0);
+            auto start = juce::Time::getHighResolutionTicks();
+            for (int b = 0; b < blocks; ++b)
+            {
+                floatBuffer.write(data, blockSize);
+                floatBuffer.read(floats, blockSize);
+                PcmConversion::floatToInt16(floats, 0, blockSize, 2, pcm.data());
+            }
+            double floatSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+            
+            // Int16 storage: converted once on write, read out ready to encode
+            StreamBuffer pcmBuffer(2);
+            pcmBuffer.prepare(44100.0, 100.0, StreamBuffer::Storage::Int16);
+            start = juce::Time::getHighResolutionTicks();
+            for (int b = 0; b < blocks; ++b)
+            {
+                pcmBuffer.write(data, blockSize);
+                pcmBuffer.readInterleaved(pcm.data(), blockSize);
+            }
+            double pcmSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+            
+            expectEquals(pcmBuffer.getUnderflowCount(), 0);
+            logMessage("Per 352-frame packet: float ring + convert " + juce::String(floatSeconds * 1.0e6 / blocks, 2)
+                       + " us, int16 ring " + juce::String(pcmSeconds * 1.0e6 / blocks, 2) + " us; ring bytes per frame "
+                       + juce::String(2 * (int)sizeof(float)) + " -> " + juce::String(pcmBuffer.getBytesPerFrame()));
+        }
+    }
+    
+    void testSurroundChannels()
+    {
+        beginTest("Surround channel counts");
+        {
+            for (auto storage : { StreamBuffer::Storage::Float, StreamBuffer::Storage::Int16 })
+            {
+                StreamBuffer buffer;
+                buffer.setNumChannels(8);
+                buffer.prepare(48000.0, 100.0, storage);
+                expectEquals(buffer.getNumChannels(), 8);
+                
+                // Each channel gets its own level so a swapped channel shows
+                juce::AudioBuffer<float> data(8, 1000);
+                for (int ch = 0; ch < 8; ++ch)
+                    for (int i = 0; i < 1000; ++i)
+                        data.setSample(ch, i, 0.1f * (float)(ch + 1) * ((i & 1) != 0 ? 1.0f : -1.0f));
+                
+                // Wrap the ring (4800 frames) on the way
+                juce::AudioBuffer<float> out(8, 1000);
+                for (int pass = 0; pass < 6; ++pass)
+                {
+                    buffer.write(data, 1000);
+                    expectEquals(buffer.read(out, 1000), 1000);
+                }
+                
+                float worst = 0.0f;
+                for (int ch = 0; ch < 8; ++ch)
+                    for (int i = 0; i < 1000; ++i)
+                        worst = juce::jmax(worst, std::abs(out.getSample(ch, i) - data.getSample(ch, i)));
+                expectLessThan(worst, 1.0f / 16384.0f, "Every channel should come back in place");
+                
+                if (storage == StreamBuffer::Storage::Int16)
+                {
+                    expectEquals(buffer.getBytesPerFrame(), 16);
+                    buffer.write(data, 352);
+                    juce::HeapBlock<juce::int16> frames(352 * 8, true);
+                    expectEquals(buffer.readInterleaved(frames, 352), 352);
+                    expectEquals((int)frames[5 * 8 + 7], (int)(0.8f * 32767.0f), "Interleaved frames keep the host order");
+                }
+                
+                // Going back to stereo discards the surround audio
+                buffer.write(data, 500);
+                buffer.setNumChannels(2);
+                expectEquals(buffer.getAvailableData(), 0);
+                expectEquals(buffer.getBytesPerFrame(), storage == StreamBuffer::Storage::Int16 ? 4 : 0);
+            }
+        }
+    }
 };
 
 static StreamBufferTests streamBufferTests;
@@ -0,0 +1,257 @@
+#include <JuceHeader.h>
+#include "../Source/AirPlay/StreamScheduler.h"
+
+class StreamSchedulerTests : public juce::UnitTest
+{
+public:
+    StreamSchedulerTests() : juce::UnitTest("StreamScheduler") {}
+
+    void runTest() override
+    {
+        testPassesAreSerialisedPerSession();
+        testRemoveWaitsForRunningPass();
+        testIdlePoolDoesNotWake();
+        testTimedPasses();
+        testManySessionsAtBlockRate();
+    }
+
+private:
+    // Counts passes and flags any pass that overlaps another on the same session
+    struct CountingSession : public StreamScheduler::Session
+    {
+        void serviceStream() override
+        {
+            if (inFlight.exchange(true))
+                overlaps++;
+
+            if (workMicros > 0)
+                busyWait(workMicros);
+
+            passes++;
+            inFlight = false;
+        }
+
+        static void busyWait(int micros)
+        {
+            auto end = juce::Time::getHighResolutionTicks()
+                     + juce::Time::getHighResolutionTicksPerSecond() * micros / 1000000;
+            while (juce::Time::getHighResolutionTicks() < end) {}
+        }
+
+        std::atomic<int> passes{0};
+        std::atomic<int> overlaps{0};
+        std::atomic<bool> inFlight{false};
+        int workMicros = 0;
+    };
+
+    // Asks for its next pass itself, as a paced stream does between pushes
+    struct PacingSession : public CountingSession
+    {
+        PacingSession(StreamScheduler& schedulerToUse, int intervalMsToUse)
+            : scheduler(schedulerToUse), intervalMs(intervalMsToUse)
+        {
+        }
+
+        void serviceStream() override
+        {
+            CountingSession::serviceStream();
+            scheduler.scheduleAfter(this, intervalMs);
+        }
+
+        StreamScheduler& scheduler;
+        const int intervalMs;
+    };
+
+    static bool waitFor(const std::function<bool()>& condition, int timeoutMs)
+    {
+        auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32)timeoutMs;
+        while (!condition())
+        {
+            if (juce::Time::getMillisecondCounter() > deadline)
+                return false;
+            juce::Thread::sleep(1);
+        }
+        return true;
+    }
+
+    void testPassesAreSerialisedPerSession()
+    {
+        beginTest("Sessions never run on two workers at once");
+        {
+            StreamScheduler scheduler(4);
+            CountingSession sessions[4];
+
+            for (auto& session : sessions)
+            {
+                session.workMicros = 200;
+                scheduler.addSession(&session);
+            }
+
+            expectEquals(scheduler.getNumSessions(), 4);
+
+            for (int i = 0; i < 200; ++i)
+            {
+                for (auto& session : sessions)
+                    scheduler.schedule(&session);
+
+                if (i % 20 == 0)
+                    juce::Thread::sleep(1);
+            }
+
+            // Each schedule either runs a pass or folds into one already pending
+            expect(waitFor([&]
+            {
+                auto stats = scheduler.getStats();
+                return stats.passesRun + stats.schedulesCollapsed == 800;
+            }, 1000), "Every schedule should be accounted for");
+
+            int overlaps = 0;
+            for (auto& session : sessions)
+            {
+                expectGreaterThan(session.passes.load(), 0, "Every session should be serviced");
+                overlaps += session.overlaps.load();
+            }
+
+            expectEquals(overlaps, 0, "A session should never be serviced concurrently");
+
+            for (auto& session : sessions)
+                scheduler.removeSession(&session);
+        }
+    }
+
+    void testRemoveWaitsForRunningPass()
+    {
+        beginTest("removeSession waits for a running pass");
+        {
+            StreamScheduler scheduler(2);
+            CountingSession session;
+            session.workMicros = 50000;
+
+            scheduler.addSession(&session);
+            scheduler.schedule(&session);
+            expect(waitFor([&] { return session.inFlight.load(); }, 1000), "Pass should start");
+
+            scheduler.removeSession(&session);
+            expect(!session.inFlight, "Pass should be finished when removeSession returns");
+            expectEquals(session.passes.load(), 1);
+
+            scheduler.schedule(&session);
+            juce::Thread::sleep(20);
+            expectEquals(session.passes.load(), 1, "Removed sessions should not be serviced");
+            expectEquals(scheduler.getNumSessions(), 0);
+        }
+    }
+
+    void testIdlePoolDoesNotWake()
+    {
+        beginTest("Idle pool does not poll");
+        {
+            StreamScheduler scheduler(4);
+            CountingSession sessions[16];
+            for (auto& session : sessions)
+                scheduler.addSession(&session);
+
+            juce::Thread::sleep(10);
+            auto before = scheduler.getStats().workerWakeups;
+            juce::Thread::sleep(100);
+            auto after = scheduler.getStats().workerWakeups;
+
+            expectEquals((int)(after - before), 0, "Workers should sleep until work arrives");
+
+            for (auto& session : sessions)
+                scheduler.removeSession(&session);
+        }
+    }
+
+    void testTimedPasses()
+    {
+        beginTest("Timed passes keep a session running between schedules");
+        {
+            StreamScheduler scheduler(2);
+            PacingSession session(scheduler, 5);
+
+            // Only registered sessions take timers
+            scheduler.scheduleAfter(&session, 0);
+            juce::Thread::sleep(20);
+            expectEquals(session.passes.load(), 0);
+
+            scheduler.addSession(&session);
+            scheduler.schedule(&session);
+
+            juce::Thread::sleep(200);
+            const int passes = session.passes.load();
+            auto stats = scheduler.getStats();
+
+            // One pass every 5 ms, give or take the timer's wakeups
+            expect(passes >= 15 && passes <= 42, "Passes every 5 ms for 200 ms: " + juce::String(passes));
+            expectGreaterOrEqual((int)stats.timersFired, passes - 2, "Every pass after the first comes from a timer");
+
+            scheduler.removeSession(&session);
+            const int passesAtRemoval = session.passes.load();
+            juce::Thread::sleep(30);
+            expectEquals(session.passes.load(), passesAtRemoval, "Removing a session cancels its timer");
+
+            logMessage(juce::String(passes) + " passes in 200 ms at a 5 ms interval");
+        }
+    }
+
+    void testManySessionsAtBlockRate()
+    {
+        beginTest("16 sessions at host block rate");
+        {
+            // 16 instances pushing 512-sample blocks at 44.1 kHz, each pass
+            // costing roughly a stereo ALAC packet encode
+            const int numSessions = 16;
+            const int runMs = 500;
+            const int blockIntervalMicros = 11610;
+
+            StreamScheduler scheduler;
+            CountingSession sessions[numSessions];
+            for (auto& session : sessions)
+            {
+                session.workMicros = 60;
+                scheduler.addSession(&session);
+            }
+
+            auto startTicks = juce::Time::getHighResolutionTicks();
+            auto ticksPerMicro = (double)juce::Time::getHighResolutionTicksPerSecond() / 1.0e6;
+            int blocks = 0;
+
+            while (juce::Time::getHighResolutionTicks() - startTicks < (juce::int64)(runMs * 1000 * ticksPerMicro))
+            {
+                for (auto& session : sessions)
+                    scheduler.schedule(&session);
+
+                ++blocks;
+                auto nextBlock = startTicks + (juce::int64)(blocks * blockIntervalMicros * ticksPerMicro);
+                while (juce::Time::getHighResolutionTicks() < nextBlock)
+                    juce::Thread::sleep(1);
+            }
+
+            juce::Thread::sleep(20);
+
+            int overlaps = 0;
+            for (auto& session : sessions)
+                overlaps += session.overlaps.load();
+
+            auto stats = scheduler.getStats();
+            expectEquals(overlaps, 0);
+            expectEquals((int)(stats.passesRun + stats.schedulesCollapsed), blocks * numSessions);
+            expectLessOrEqual((double)stats.workerWakeups, (double)stats.passesRun,
+                              "Workers should only wake for work");
+
+            // A thread per instance polling every 10 ms would wake 100 times a second each
+            double seconds = runMs / 1000.0;
+            logMessage(juce::String(scheduler.getNumWorkers()) + " workers, " + juce::String(numSessions)
+                       + " sessions: " + juce::String(stats.workerWakeups / seconds, 0) + " wakeups/s, "
+                       + juce::String(stats.passesRun / seconds, 0) + " passes/s (per-instance polling: "
+                       + juce::String(numSessions * 100) + " wakeups/s on " + juce::String(numSessions)
+                       + " threads)");
+
+            for (auto& session : sessions)
+                scheduler.removeSession(&session);
+        }
+    }
+};
+
+static StreamSchedulerTests streamSchedulerTests;
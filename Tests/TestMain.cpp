@@ -1,9 +1,25 @@
 #include <JuceHeader.h>
+#include "../Source/Audio/RealtimeAudit.h"
 
 // Include all test files
 #include "StreamBufferTests.cpp"
 #include "AudioEncoderTests.cpp"
 #include "AirPlayDeviceTests.cpp"
+#include "RaopTransportTests.cpp"
+#include "RaopSessionGroupTests.cpp"
+#include "StreamSchedulerTests.cpp"
+#include "TransportEventLoopTests.cpp"
+#include "RaopCryptoTests.cpp"
+#include "DriftResamplerTests.cpp"
+#include "SampleRateConverterTests.cpp"
+#include "LossConcealerTests.cpp"
+#include "SignalMeterTests.cpp"
+#include "AirPlayManagerTests.cpp"
+#include "PipelineStatsTests.cpp"
+#include "AlacFileWriterTests.cpp"
+#include "OfflineEncoderTests.cpp"
+#include "AlacRecorderTests.cpp"
+#include "RealtimeAuditTests.cpp"
 
 int main(int argc, char* argv[])
 {
@@ -23,6 +39,16 @@ int main(int argc, char* argv[])
         numFailures += result->failures;
     }
 
+    // Audit builds: anything a test did in a real-time context that could wait
+    if (RealtimeAudit::getNumViolations() > 0)
+    {
+        std::cout << "\n=== Real-time violations ===" << std::endl;
+        for (auto& line : RealtimeAudit::describeViolations())
+            std::cout << line << std::endl;
+
+        numFailures += RealtimeAudit::getNumViolations();
+    }
+
     std::cout << "\n=== Test Summary ===" << std::endl;
     std::cout << "Total tests: " << numTests << std::endl;
     std::cout << "Passed: " << numPasses << std::endl;
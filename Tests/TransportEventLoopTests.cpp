@@ -0,0 +1,226 @@
+#include <JuceHeader.h>
+#include "../Source/AirPlay/TransportEventLoop.h"
+#include "../Source/AirPlay/RaopSessionGroup.h"
+#include "LoopbackReceiver.h"
+
+class TransportEventLoopTests : public juce::UnitTest
+{
+public:
+    TransportEventLoopTests() : juce::UnitTest("TransportEventLoop") {}
+
+    void runTest() override
+    {
+        testDispatchAndRemove();
+        testManyReadyAtOnce();
+        testTransportServicedByLoop();
+        testCpuPerSession();
+    }
+
+private:
+    static bool waitFor(const std::function<bool()>& condition, int timeoutMs)
+    {
+        auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32)timeoutMs;
+        while (!condition())
+        {
+            if (juce::Time::getMillisecondCounter() > deadline)
+                return false;
+            juce::Thread::sleep(1);
+        }
+        return true;
+    }
+
+    void testDispatchAndRemove()
+    {
+        beginTest("Readable sockets are dispatched until removed");
+        {
+            TransportEventLoop loop;
+            juce::DatagramSocket first, second, sender;
+            first.bindToPort(0, "127.0.0.1");
+            second.bindToPort(0, "127.0.0.1");
+
+            std::atomic<int> firstCount{0}, secondCount{0};
+            auto drain = [](juce::DatagramSocket& socket, std::atomic<int>& count)
+            {
+                juce::uint8 data[64];
+                while (socket.waitUntilReady(true, 0) > 0 && socket.read(data, (int)sizeof(data), false) > 0)
+                    count++;
+            };
+
+            expect(loop.addSocket(first.getRawSocketHandle(), [&] { drain(first, firstCount); }));
+            expect(loop.addSocket(second.getRawSocketHandle(), [&] { drain(second, secondCount); }));
+            expectEquals(loop.getNumSockets(), 2);
+
+            juce::uint8 datagram[8] = {};
+            for (int i = 0; i < 10; ++i)
+            {
+                sender.write("127.0.0.1", first.getBoundPort(), datagram, 8);
+                sender.write("127.0.0.1", second.getBoundPort(), datagram, 8);
+            }
+
+            expect(waitFor([&] { return firstCount == 10 && secondCount == 10; }, 1000),
+                   "Both sockets should be drained by the loop");
+
+            loop.removeSocket(first.getRawSocketHandle());
+            expectEquals(loop.getNumSockets(), 1);
+
+            sender.write("127.0.0.1", first.getBoundPort(), datagram, 8);
+            sender.write("127.0.0.1", second.getBoundPort(), datagram, 8);
+            expect(waitFor([&] { return secondCount == 11; }, 1000));
+            juce::Thread::sleep(10);
+            expectEquals(firstCount.load(), 10, "Removed sockets should not be dispatched");
+
+            loop.removeSocket(second.getRawSocketHandle());
+            logMessage(juce::String("Backend: ") + loop.getBackendName());
+        }
+    }
+
+    void testManyReadyAtOnce()
+    {
+        beginTest("More sockets ready at once than one wait returns");
+        {
+            // The loop takes 64 per wait; the rest must come out of the next
+            // ones, and every socket must keep being dispatched afterwards
+            constexpr int numSockets = 150;
+            TransportEventLoop loop;
+            juce::OwnedArray<juce::DatagramSocket> sockets;
+            std::vector<std::atomic<int>> counts(numSockets);
+            juce::DatagramSocket sender;
+            bool allBound = true;
+
+            // Exclusive, as sockets bound to port 0 can otherwise share a port
+            for (int i = 0; i < numSockets; ++i)
+            {
+                auto* socket = sockets.add(new juce::DatagramSocket());
+                allBound = RtpPacket::bindExclusive(*socket, 0, "127.0.0.1") && allBound;
+                counts[(size_t)i] = 0;
+
+                loop.addSocket(socket->getRawSocketHandle(), [socket, &count = counts[(size_t)i]]
+                {
+                    juce::uint8 data[64];
+                    while (socket->waitUntilReady(true, 0) > 0 && socket->read(data, (int)sizeof(data), false) > 0)
+                        count++;
+                });
+            }
+
+            expect(allBound);
+            expectEquals(loop.getNumSockets(), numSockets);
+
+            auto allReached = [&](int expected)
+            {
+                for (auto& count : counts)
+                    if (count.load() < expected)
+                        return false;
+                return true;
+            };
+
+            juce::uint8 datagram[8] = {};
+            for (int round = 1; round <= 3; ++round)
+            {
+                for (auto* socket : sockets)
+                    sender.write("127.0.0.1", socket->getBoundPort(), datagram, 8);
+
+                expect(waitFor([&] { return allReached(round); }, 2000),
+                       "Every socket should be dispatched in round " + juce::String(round));
+            }
+
+            for (auto* socket : sockets)
+                loop.removeSocket(socket->getRawSocketHandle());
+        }
+    }
+
+    void testTransportServicedByLoop()
+    {
+        beginTest("Transport timing and retransmits answered on the loop");
+        {
+            TransportEventLoop loop;
+            LoopbackReceiver receiver;
+            RaopTransport transport;
+            expect(transport.open(receiver.getEndpoint(), 44100.0, &loop));
+            expectEquals(loop.getNumSockets(), 2, "Control and timing sockets should be registered");
+
+            juce::uint8 payload[32] = {};
+            auto firstSequence = transport.getNextSequenceNumber();
+            for (int i = 0; i < 5; ++i)
+                transport.sendAudioPacket(payload, 32, RaopTransport::framesPerPacket);
+
+            expect(receiver.waitForAudioPackets(5, 1000));
+
+            // No further packets are sent: the loop alone has to answer
+            expectGreaterOrEqual(receiver.requestTiming(transport.getLocalTimingPort()), 0.0,
+                                 "Timing request should be answered");
+
+            receiver.requestRetransmit(transport.getLocalControlPort(), (juce::uint16)(firstSequence + 1), 2);
+            expect(waitFor([&] { return receiver.getRetransmittedPackets().size() == 2; }, 1000),
+                   "Retransmits should be answered without waiting for the next packet");
+
+            transport.close();
+            expectEquals(loop.getNumSockets(), 0, "Closing should unregister both sockets");
+        }
+    }
+
+    void testCpuPerSession()
+    {
+        beginTest("Loop CPU per session up to 32 sessions");
+        {
+            // Each round sends one audio packet to every session and has every
+            // receiver make a timing request, far more often than a real
+            // receiver (every ~3 s) to make the loop cost measurable
+            const int rounds = 50;
+            juce::SharedResourcePointer<TransportEventLoopPool> pool;
+
+            for (int numSessions : { 1, 4, 8, 16, 32 })
+            {
+                RaopSessionGroup group;
+                group.prepare(44100.0, 2);
+
+                std::vector<std::unique_ptr<LoopbackReceiver>> receivers;
+                std::vector<int> timingPorts;
+
+                for (int i = 0; i < numSessions; ++i)
+                {
+                    receivers.push_back(std::make_unique<LoopbackReceiver>());
+                    AirPlayDevice device("Zone " + juce::String(i), "127.0.0.1", 7000 + i);
+                    group.addReceiver(device, receivers.back()->getEndpoint());
+                    timingPorts.push_back(group.getReceiverTimingPort(device));
+                }
+
+                auto before = pool->getStats();
+                juce::AudioBuffer<float> block(2, RaopTransport::framesPerPacket);
+                block.clear();
+
+                int answered = 0;
+                double totalRoundTrip = 0.0;
+
+                for (int round = 0; round < rounds; ++round)
+                {
+                    group.streamAudio(block, RaopTransport::framesPerPacket);
+
+                    for (int i = 0; i < numSessions; ++i)
+                    {
+                        auto roundTrip = receivers[(size_t)i]->requestTiming(timingPorts[(size_t)i]);
+
+                        if (roundTrip >= 0.0)
+                        {
+                            answered++;
+                            totalRoundTrip += roundTrip;
+                        }
+                    }
+                }
+
+                auto after = pool->getStats();
+                double loopCpu = after.cpuMicros - before.cpuMicros;
+
+                expectEquals(answered, rounds * numSessions, "Every timing request should be answered");
+
+                logMessage(juce::String(numSessions) + " sessions on " + juce::String(pool->getNumLoops())
+                           + " loop thread(s): " + juce::String(loopCpu / (numSessions * rounds), 2)
+                           + " us loop CPU per session-round, timing RTT "
+                           + juce::String(totalRoundTrip / juce::jmax(1, answered), 1) + " us, "
+                           + juce::String((juce::int64)(after.eventsHandled - before.eventsHandled)) + " events in "
+                           + juce::String((juce::int64)(after.wakeups - before.wakeups)) + " wakeups");
+            }
+        }
+    }
+};
+
+static TransportEventLoopTests transportEventLoopTests;